@@ -0,0 +1,51 @@
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+/*
+ * Kernel configuration of host/rtos_harness.c on the FreeRTOS POSIX port. Not used by the board build, whose
+ * FreeRTOSConfig.h belongs to the application.
+ *
+ * The scheduler is cooperative: host/host_transport.c guards its receive queues with pthread mutexes, and a task must
+ * not be switched out by the tick while it holds one. Tasks still give way whenever they block, which is all the
+ * harness needs.
+ */
+
+#include <stdint.h>
+
+uint32_t harnessRunTimeUs(void);
+void harnessAssert(const char *file, int line);
+
+#define configUSE_PREEMPTION                    0
+#define configUSE_IDLE_HOOK                     0
+#define configUSE_TICK_HOOK                     0
+#define configTICK_RATE_HZ                      1000
+#define configMAX_PRIORITIES                    5
+#define configMINIMAL_STACK_SIZE                4096 // Words; every task is a pthread on the POSIX port
+#define configMAX_TASK_NAME_LEN                 16
+#define configUSE_16_BIT_TICKS                  0
+#define configIDLE_SHOULD_YIELD                 1
+#define configUSE_MUTEXES                       1
+#define configUSE_RECURSIVE_MUTEXES             1
+#define configUSE_COUNTING_SEMAPHORES           1
+#define configQUEUE_REGISTRY_SIZE               0
+#define configUSE_TIMERS                        0
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 1    // DY50_RTOS_TLS_INDEX
+#define configSUPPORT_DYNAMIC_ALLOCATION        1
+#define configSUPPORT_STATIC_ALLOCATION         0
+#define configCHECK_FOR_STACK_OVERFLOW          0
+#define configUSE_MALLOC_FAILED_HOOK            0
+#define configTOTAL_HEAP_SIZE                   (1024 * 1024) // Unused with heap_3.c
+
+// Idle time shows whether waiting tasks really block, see the report of host/rtos_harness.c
+#define configGENERATE_RUN_TIME_STATS           1
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()        harnessRunTimeUs()
+
+#define INCLUDE_vTaskDelay                      1
+#define INCLUDE_vTaskDelete                     1
+#define INCLUDE_xTaskGetIdleTaskHandle          1
+#define INCLUDE_xTaskGetSchedulerState          1
+
+#define configASSERT(condition)                 if (!(condition)) harnessAssert(__FILE__, __LINE__)
+
+#endif /* FREERTOS_CONFIG_H */
@@ -0,0 +1,419 @@
+/*
+ * Sweep of the security level and the data packet size of a sensor against a labelled set of character files.
+ *
+ *   cc -O2 -DDY50_HOST -I . -I lib -I host -I utils -o autotune host/autotune.c host/template_archive.c \
+ *      host/rpc_client.c lib/rpc_protocol.c
+ *   autotune (-d device [-b baud] | -u socket) [-n sensor] [options] gallery probes
+ *
+ * gallery is a template archive of the library on the sensor, as written by template_archive backup, whose metadata
+ * labels every page with the user enrolled there; --load stores it on the sensor first. probes is an archive of
+ * character files captured separately, each labelled with the user it was taken from. Probes of users missing from
+ * the gallery are impostors.
+ *
+ * For every configuration each probe is downloaded into CharBuffer 1 and searched. A probe accepted for another user
+ * is a false accept, counted over all probes; a genuine probe not accepted for its own user is a false reject,
+ * counted over the genuine probes. The best configuration is the fastest one within --max-far and --max-frr, or else
+ * the one with the lowest false-accept rate, then false-reject rate. --apply writes it to the sensor; otherwise the
+ * settings found at the start are restored.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "template_archive.h"
+#include "rpc_client.h"
+#include "dy50.h"
+
+#define MAX_CONFIGS                             (5 * 4)
+#define PROBE_BUFFER                            1
+#define NO_LABEL                                0xFFFFFFFFu
+
+typedef struct
+{
+    uint8_t securityLevel;
+    uint8_t packetSizeCode;
+    uint32_t probes;
+    uint32_t genuineProbes;
+    uint32_t falseAccepts;
+    uint32_t falseRejects;
+    uint32_t errors;
+    double downloadMs;          // Totals over the probes
+    double searchMs;
+    double *latencies;          // Download and search of every probe, for the percentile
+} ConfigResult;
+
+static double nowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t recordLabel(const ArchiveRecordHeader *record)
+{
+    return (record->flags & RECORD_HAS_METADATA) ? record->userId : NO_LABEL;
+}
+
+/**
+ * @brief  Parse a comma separated list of numbers within [low, high]
+ * @return Number of values, 0 if the list is malformed
+ */
+static uint8_t parseList(const char *text, uint16_t low, uint16_t high, uint16_t *values, uint8_t capacity)
+{
+    uint8_t count = 0;
+    char *end;
+
+    while (count < capacity)
+    {
+        unsigned long value = strtoul(text, &end, 0);
+        if (end == text || value < low || value > high)
+        {
+            return 0;
+        }
+        values[count++] = (uint16_t)value;
+        if (*end != ',')
+        {
+            break;
+        }
+        text = end + 1;
+    }
+    return *end == '\0' ? count : 0;
+}
+
+static uint8_t packetSizeCode(uint16_t packetLength)
+{
+    uint8_t code = 0;
+    while (code < 3 && (32 << code) < packetLength)
+    {
+        code++;
+    }
+    return code;
+}
+
+static int setParameter(RpcClient *client, uint8_t parameter, uint8_t value)
+{
+    uint8_t request[2] = { parameter, value };
+    RpcFrame response;
+
+    if (rpcClientCall(client, RPC_OP_SET_PARAMETER, request, sizeof(request), &response) != 0 ||
+        response.payload[0] != FINGERPRINT_OK)
+    {
+        fprintf(stderr, "cannot set parameter %u to %u\n", parameter, value);
+        return -1;
+    }
+    return 0;
+}
+
+static int loadGallery(RpcClient *client, const ArchiveMap *gallery, uint16_t packetLength)
+{
+    for (uint32_t i = 0; i < gallery->header->recordCount; i++)
+    {
+        const ArchiveRecordHeader *record = archiveRecordAt(gallery, i);
+        uint8_t request[3] = { PROBE_BUFFER };
+        RpcFrame response;
+
+        rpcPutU16(&request[1], (uint16_t)record->page);
+        if (!archiveRecordIsValid(gallery, record) ||
+            rpcClientDownloadTemplate(client, PROBE_BUFFER, archiveRecordTemplate(record),
+                                      gallery->header->templateSize, packetLength) != 0 ||
+            rpcClientCall(client, RPC_OP_STORE_MODEL, request, sizeof(request), &response) != 0 ||
+            response.payload[0] != FINGERPRINT_OK)
+        {
+            fprintf(stderr, "page %u: cannot store the gallery template\n", record->page);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief  Replay every probe through search with the sensor set to the configuration of result
+ */
+static int runConfig(RpcClient *client, const ArchiveMap *gallery, const ArchiveMap *probes, const bool *isGenuine,
+                     uint32_t repeat, ConfigResult *result)
+{
+    uint16_t packetLength = (uint16_t)(32 << result->packetSizeCode);
+
+    if (setParameter(client, SYSPARAM_SECURITY_LEVEL, result->securityLevel) != 0 ||
+        setParameter(client, SYSPARAM_PACKET_SIZE, result->packetSizeCode) != 0)
+    {
+        return -1;
+    }
+    for (uint32_t round = 0; round < repeat; round++)
+    {
+        for (uint32_t i = 0; i < probes->header->recordCount; i++)
+        {
+            const ArchiveRecordHeader *probe = archiveRecordAt(probes, i);
+            const ArchiveRecordHeader *match;
+            uint8_t bufferId = PROBE_BUFFER;
+            RpcFrame response;
+            double start;
+            double downloaded;
+            double searched;
+            bool isAccepted;
+
+            if (recordLabel(probe) == NO_LABEL)
+            {
+                continue;
+            }
+            start = nowMs();
+            if (rpcClientDownloadTemplate(client, PROBE_BUFFER, archiveRecordTemplate(probe),
+                                          probes->header->templateSize, packetLength) != 0)
+            {
+                result->errors++;
+                continue;
+            }
+            downloaded = nowMs();
+            if (rpcClientCall(client, RPC_OP_SEARCH, &bufferId, 1, &response) != 0)
+            {
+                result->errors++;
+                continue;
+            }
+            searched = nowMs();
+
+            isAccepted = (response.payload[0] == FINGERPRINT_OK);
+            match = isAccepted ? archiveFindPage(gallery, rpcGetU16(&response.payload[1])) : NULL;
+            if (isAccepted && (match == NULL || recordLabel(match) != recordLabel(probe)))
+            {
+                result->falseAccepts++;
+            }
+            if (isGenuine[i])
+            {
+                result->genuineProbes++;
+                if (!isAccepted || match == NULL || recordLabel(match) != recordLabel(probe))
+                {
+                    result->falseRejects++;
+                }
+            }
+            result->downloadMs += downloaded - start;
+            result->searchMs += searched - downloaded;
+            result->latencies[result->probes++] = searched - start;
+        }
+    }
+    return 0;
+}
+
+static double rate(uint32_t count, uint32_t total)
+{
+    return total > 0 ? (double)count / total : 0;
+}
+
+static double meanLatency(const ConfigResult *result)
+{
+    return result->probes > 0 ? (result->downloadMs + result->searchMs) / result->probes : 0;
+}
+
+/**
+ * @brief  Whether a is a better configuration than b, see the selection rule at the top of the file
+ */
+static bool isBetter(const ConfigResult *a, const ConfigResult *b, double maxFar, double maxFrr)
+{
+    double farA = rate(a->falseAccepts, a->probes);
+    double farB = rate(b->falseAccepts, b->probes);
+    double frrA = rate(a->falseRejects, a->genuineProbes);
+    double frrB = rate(b->falseRejects, b->genuineProbes);
+    bool isWithinA = a->errors == 0 && farA <= maxFar && frrA <= maxFrr;
+    bool isWithinB = b->errors == 0 && farB <= maxFar && frrB <= maxFrr;
+
+    if (isWithinA != isWithinB)
+    {
+        return isWithinA;
+    }
+    if (!isWithinA && (farA != farB || frrA != frrB))
+    {
+        return farA < farB || (farA == farB && frrA < frrB);
+    }
+    return meanLatency(a) < meanLatency(b);
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s (-d device [-b baud] | -u socket) [-n sensor] [options] gallery probes\n"
+            "  --levels LIST      security levels to try, default 1,2,3,4,5\n"
+            "  --packets LIST     data packet sizes to try, default 32,64,128,256\n"
+            "  --repeat N         searches per probe and configuration, default 1\n"
+            "  --max-far RATE     highest acceptable false-accept rate, default 0.001\n"
+            "  --max-frr RATE     highest acceptable false-reject rate, default 0.05\n"
+            "  --load             store the gallery on the sensor first\n"
+            "  --apply            keep the best configuration on the sensor\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] =
+    {
+        { "levels", required_argument, NULL, 'l' }, { "packets", required_argument, NULL, 'p' },
+        { "repeat", required_argument, NULL, 'r' }, { "max-far", required_argument, NULL, 'F' },
+        { "max-frr", required_argument, NULL, 'R' }, { "load", no_argument, NULL, 'L' },
+        { "apply", no_argument, NULL, 'A' }, { NULL, 0, NULL, 0 },
+    };
+    const char *device = NULL;
+    const char *socketPath = NULL;
+    int baudRate = UART_SENSOR_BAUD;
+    int sensor = -1;
+    uint16_t levels[5] = { 1, 2, 3, 4, 5 };
+    uint16_t packets[4] = { 32, 64, 128, 256 };
+    uint8_t levelCount = 5;
+    uint8_t packetCount = 4;
+    uint32_t repeat = 1;
+    double maxFar = 0.001;
+    double maxFrr = 0.05;
+    bool isLoadRequested = false;
+    bool isApplyRequested = false;
+    ConfigResult results[MAX_CONFIGS] = {};
+    uint8_t resultCount = 0;
+    ConfigResult *best = NULL;
+    RpcClient client;
+    RpcFrame response;
+    ArchiveMap gallery;
+    ArchiveMap probes;
+    bool *isGenuine;
+    uint16_t originalLevel;
+    uint16_t originalPacketLength;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "d:b:u:n:", options, NULL)) != -1)
+    {
+        switch (option)
+        {
+            case 'd': device = optarg; break;
+            case 'b': baudRate = atoi(optarg); break;
+            case 'u': socketPath = optarg; break;
+            case 'n': sensor = atoi(optarg); break;
+            case 'l': levelCount = parseList(optarg, 1, 5, levels, 5); break;
+            case 'p': packetCount = parseList(optarg, 32, 256, packets, 4); break;
+            case 'r': repeat = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'F': maxFar = strtod(optarg, NULL); break;
+            case 'R': maxFrr = strtod(optarg, NULL); break;
+            case 'L': isLoadRequested = true; break;
+            case 'A': isApplyRequested = true; break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc - 2 || (device == NULL) == (socketPath == NULL) || levelCount == 0 || packetCount == 0 ||
+        repeat == 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    for (uint8_t i = 0; i < packetCount; i++)
+    {
+        if (32 << packetSizeCode(packets[i]) != packets[i])
+        {
+            fprintf(stderr, "packet sizes are 32, 64, 128 or 256\n");
+            return 2;
+        }
+    }
+
+    if (archiveMapOpen(&gallery, argv[optind]) != 0 || archiveMapOpen(&probes, argv[optind + 1]) != 0)
+    {
+        fprintf(stderr, "%s\n", errno == EBADMSG ? "not a complete template archive" : strerror(errno));
+        return 1;
+    }
+    isGenuine = calloc(probes.header->recordCount + 1, sizeof(bool));
+    for (uint32_t i = 0; i < probes.header->recordCount; i++)
+    {
+        uint32_t label = recordLabel(archiveRecordAt(&probes, i));
+        for (uint32_t j = 0; j < gallery.header->recordCount && label != NO_LABEL && !isGenuine[i]; j++)
+        {
+            isGenuine[i] = (recordLabel(archiveRecordAt(&gallery, j)) == label);
+        }
+    }
+    for (uint8_t i = 0; i < levelCount * packetCount; i++)
+    {
+        results[i].securityLevel = (uint8_t)levels[i / packetCount];
+        results[i].packetSizeCode = packetSizeCode(packets[i % packetCount]);
+        results[i].latencies = malloc(((size_t)probes.header->recordCount * repeat + 1) * sizeof(double));
+    }
+
+    if ((socketPath != NULL ? rpcClientConnect(&client, socketPath) : rpcClientOpen(&client, device, baudRate)) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", socketPath != NULL ? socketPath : device, strerror(errno));
+        return 1;
+    }
+    if (sensor >= 0)
+    {
+        uint8_t index = (uint8_t)sensor;
+        if (rpcClientCall(&client, RPC_OP_SELECT_SENSOR, &index, 1, &response) != 0 || response.payload[0] != 0)
+        {
+            fprintf(stderr, "cannot select sensor %d\n", sensor);
+            return 1;
+        }
+    }
+    if (rpcClientCall(&client, RPC_OP_GET_PARAMETERS, NULL, 0, &response) != 0 || response.length < 16)
+    {
+        fprintf(stderr, "cannot read the sensor parameters\n");
+        return 1;
+    }
+    originalLevel = rpcGetU16(&response.payload[6]);
+    originalPacketLength = rpcGetU16(&response.payload[12]);
+    if (isLoadRequested && loadGallery(&client, &gallery, originalPacketLength) != 0)
+    {
+        return 1;
+    }
+
+    printf("%u gallery templates, %u probes\n", gallery.header->recordCount, probes.header->recordCount);
+    printf("level  packet      FAR      FRR  download ms  search ms  p95 ms  errors\n");
+    for (resultCount = 0; resultCount < levelCount * packetCount; resultCount++)
+    {
+        ConfigResult *result = &results[resultCount];
+        double p95 = 0;
+
+        if (runConfig(&client, &gallery, &probes, isGenuine, repeat, result) != 0)
+        {
+            break;
+        }
+        if (result->probes > 0)
+        {
+            qsort(result->latencies, result->probes, sizeof(double), compareDouble);
+            p95 = result->latencies[(result->probes * 95 - 1) / 100];
+        }
+        printf("%5u  %6u  %7.4f  %7.4f  %11.1f  %9.1f  %6.1f  %6u\n", result->securityLevel,
+               32 << result->packetSizeCode, rate(result->falseAccepts, result->probes),
+               rate(result->falseRejects, result->genuineProbes),
+               result->probes > 0 ? result->downloadMs / result->probes : 0,
+               result->probes > 0 ? result->searchMs / result->probes : 0, p95, result->errors);
+        fflush(stdout);
+        if (best == NULL || isBetter(result, best, maxFar, maxFrr))
+        {
+            best = result;
+        }
+    }
+
+    if (best != NULL && isApplyRequested)
+    {
+        printf("applying level %u, packet %u\n", best->securityLevel, 32 << best->packetSizeCode);
+        setParameter(&client, SYSPARAM_SECURITY_LEVEL, best->securityLevel);
+        setParameter(&client, SYSPARAM_PACKET_SIZE, best->packetSizeCode);
+    }
+    else
+    {
+        if (best != NULL)
+        {
+            printf("best: level %u, packet %u (not applied)\n", best->securityLevel, 32 << best->packetSizeCode);
+        }
+        setParameter(&client, SYSPARAM_SECURITY_LEVEL, (uint8_t)originalLevel);
+        setParameter(&client, SYSPARAM_PACKET_SIZE, packetSizeCode(originalPacketLength));
+    }
+
+    rpcClientClose(&client);
+    archiveMapClose(&gallery);
+    archiveMapClose(&probes);
+    for (uint8_t i = 0; i < levelCount * packetCount; i++)
+    {
+        free(results[i].latencies);
+    }
+    free(isGenuine);
+    return resultCount == levelCount * packetCount ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+/*
+ * Time of sumBytes() of lib/checksum.c against a plain byte loop, per call for the packet sizes of the module.
+ *
+ *   cc -O2 -I lib -o checksum_bench host/checksum_bench.c lib/checksum.c
+ *   checksum_bench [-n calls]
+ *
+ * The result is for the host build of sumBytes(), i.e. SSE2 on x86-64 and NEON on AArch64. Cortex-M4 numbers cannot
+ * be measured here; the figures given for USADA8 are estimates from instruction counts, see the note of sumBytes().
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "checksum.h"
+
+#define BENCH_DEFAULT_CALLS                     1000000
+#define BENCH_MAX_LENGTH                        256
+
+static const uint16_t lengths[] = { 32, 64, 128, 256 };
+
+// Reference: the byte loop calculateChecksum() used before sumBytes(). volatile keeps the host compiler from
+// vectorizing it, which the TI compiler does not do either.
+static uint32_t sumByteLoop(const volatile uint8_t *data, uint16_t length)
+{
+    uint32_t sum = 0;
+    for (uint16_t i = 0; i < length; i++)
+    {
+        sum += data[i];
+    }
+    return sum;
+}
+
+static double nowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t data[BENCH_MAX_LENGTH];
+    uint32_t calls = BENCH_DEFAULT_CALLS;
+    volatile uint32_t sink = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:")) != -1)
+    {
+        if (option != 'n' || (calls = (uint32_t)strtoul(optarg, NULL, 0)) == 0)
+        {
+            fprintf(stderr, "usage: %s [-n calls]\n", argv[0]);
+            return 2;
+        }
+    }
+    for (uint16_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(i * 37 + 11);
+    }
+
+    printf("%6s %12s %12s %8s\n", "bytes", "loop ns", "sumBytes ns", "speedup");
+    for (uint8_t k = 0; k < sizeof(lengths) / sizeof(lengths[0]); k++)
+    {
+        uint16_t length = lengths[k];
+        double startNs;
+        double loopNs;
+        double sumNs;
+
+        if (sumBytes(data, length) != sumByteLoop(data, length))
+        {
+            printf("sumBytes differs from the byte loop at %u bytes\n", length);
+            return 1;
+        }
+        startNs = nowNs();
+        for (uint32_t call = 0; call < calls; call++)
+        {
+            sink += sumByteLoop(data, length);
+        }
+        loopNs = (nowNs() - startNs) / calls;
+        startNs = nowNs();
+        for (uint32_t call = 0; call < calls; call++)
+        {
+            data[0] = (uint8_t)call;    // Keeps the compiler from hoisting the call out of the loop
+            sink += sumBytes(data, length);
+        }
+        sumNs = (nowNs() - startNs) / calls;
+        printf("%6u %12.1f %12.1f %7.1fx\n", length, loopNs, sumNs, loopNs / sumNs);
+    }
+    (void)sink;
+    return 0;
+}
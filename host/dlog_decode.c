@@ -0,0 +1,119 @@
+/*
+ * Host-side decoder of the deferred log written by utils/dlog.c.
+ *
+ * Reads the console UART stream from a file or stdin, copies plain console text through unchanged and expands every
+ * binary record into its format string from utils/dlog_formats.h.
+ *
+ *   cc -O2 -I utils -o dlog_decode host/dlog_decode.c
+ *   stty -F /dev/ttyACM0 115200 raw && ./dlog_decode -t /dev/ttyACM0
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "dlog.h"
+
+#define DLOG_FORMAT(id, text) text,
+static const char *formats[] = { DLOG_FORMATS };
+#undef DLOG_FORMAT
+
+static uint32_t readWord(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+/**
+ * @brief  Print a format string, taking the arguments of its conversions from the record in order
+ */
+static void printRecord(FILE *out, const char *format, const uint32_t *arguments, uint8_t argumentCount)
+{
+    uint8_t next = 0;
+
+    for (const char *c = format; *c != '\0'; c++)
+    {
+        if (*c != '%' || c[1] == '\0')
+        {
+            fputc(*c, out);
+            continue;
+        }
+        c++;
+        uint32_t value = (next < argumentCount) ? arguments[next] : 0;
+        switch (*c)
+        {
+            case 'd': fprintf(out, "%d", (int32_t)value); next++; break;
+            case 'u': fprintf(out, "%u", value); next++; break;
+            case 'x': fprintf(out, "%x", value); next++; break;
+            case 'c': fputc((int)(value & 0xFF), out); next++; break;
+            default:  fputc(*c, out); break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    int showTicks = 0;
+    uint8_t record[DLOG_RECORD_HEADER_SIZE + 4 * DLOG_MAX_ARGUMENTS];
+    int c;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0)
+        {
+            showTicks = 1;
+        }
+        else if ((in = fopen(argv[i], "rb")) == NULL)
+        {
+            perror(argv[i]);
+            return 1;
+        }
+    }
+
+    setvbuf(stdout, NULL, _IONBF, 0);
+    while ((c = fgetc(in)) != EOF)
+    {
+        if (c != DLOG_SYNC)
+        {
+            if (c < 0x80)
+            {
+                fputc(c, stdout); // Console text written with UARTprintf()
+            }
+            continue;
+        }
+
+        record[0] = (uint8_t)c;
+        if (fread(&record[1], 1, DLOG_RECORD_HEADER_SIZE - 1, in) != DLOG_RECORD_HEADER_SIZE - 1)
+        {
+            break;
+        }
+        uint8_t id = record[1];
+        uint8_t argumentCount = record[2];
+        if (argumentCount > DLOG_MAX_ARGUMENTS)
+        {
+            fprintf(stderr, "[dlog: corrupt record]\n");
+            continue;
+        }
+        if (fread(&record[DLOG_RECORD_HEADER_SIZE], 4, argumentCount, in) != argumentCount)
+        {
+            break;
+        }
+
+        uint32_t arguments[DLOG_MAX_ARGUMENTS];
+        for (uint8_t i = 0; i < argumentCount; i++)
+        {
+            arguments[i] = readWord(&record[DLOG_RECORD_HEADER_SIZE + 4 * i]);
+        }
+        if (showTicks)
+        {
+            printf("[%10u ms] ", readWord(&record[3]));
+        }
+        if (id < DLOG_FORMAT_COUNT)
+        {
+            printRecord(stdout, formats[id], arguments, argumentCount);
+        }
+        else
+        {
+            printf("[dlog: unknown format %u]\n", id);
+        }
+    }
+    return 0;
+}
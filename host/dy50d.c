@@ -0,0 +1,1128 @@
+/*
+ * Multi-sensor daemon, see dy50d.h.
+ *
+ * lib/dy50.c blocks until each response arrives and so cannot share a thread between ports. The daemon sends the
+ * same instructions (the command table of lib/sensor_command.c, framed by lib/wire_frame.c) and receives with the same
+ * lib/packet_parser.c, but keeps a state machine per port instead of a call stack: a port is idle, waiting for the
+ * acknowledge of a command, receiving the data packets of an upload or sending those of a download. Every byte that
+ * arrives advances its port; deadlines are checked whenever epoll_wait() returns.
+ */
+#define _GNU_SOURCE                             // accept4()
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "dy50d.h"
+#include "dy50.h"
+#include "packet_parser.h"
+#include "rpc_protocol.h"
+#include "sensor_command.h"
+
+/* ***** Defines ***** */
+
+#define SOURCE_LISTENER                         0    // Kinds of epoll event sources, see eventTag()
+#define SOURCE_PORT                             1
+#define SOURCE_CLIENT                           2
+#define MAX_EVENTS                              32
+#define REQUEST_ANY_LENGTH                      -1
+
+/* ***** Structures ***** */
+
+typedef struct Client Client;
+
+typedef enum
+{
+    PORT_IDLE,
+    PORT_AWAIT_ACK,             // Command sent, waiting for its acknowledge packet
+    PORT_AWAIT_DATA,            // Upload acknowledged, receiving data packets
+    PORT_DOWNLOADING            // Download acknowledged, forwarding the client's data frames
+} PortState;
+
+// A request waiting for or being executed by a sensor port
+typedef struct Request
+{
+    Client *client;             // NULL for the port's own requests and after the client disconnected
+    uint16_t requestId;
+    uint8_t opcode;
+    uint8_t flags;
+    bool isStream;              // Data frame of a template download
+    bool isParameterQueried;    // A search whose parameter query was already attempted
+    bool isIdempotent;          // The command may be repeated after a link error
+    uint8_t step;               // Sensor command of a request that takes several, see RPC_OP_VERIFY
+    uint8_t attempts;
+    uint16_t length;
+    uint8_t payload[RPC_MAX_PAYLOAD];
+    int64_t acceptedMs;
+    struct Request *next;
+} Request;
+
+typedef struct
+{
+    int fd;
+    const char *device;
+    bool isOffline;             // The device went away; commands time out
+    bool isOutputWatched;       // EPOLLOUT is enabled
+    PacketParser parser;
+    PortState state;
+    Request *current;           // Request being executed
+    Request *head;              // Requests waiting, in arrival order
+    Request *tail;
+    int64_t deadlineMs;         // End of the current wait, 0 when idle
+    uint8_t lastLinkError;      // Result of the last failed command
+    bool isParameterKnown;
+    uint16_t capacity;          // Library size, valid when isParameterKnown
+    uint16_t packetLength;      // Data packet size in bytes, valid when isParameterKnown
+    uint8_t output[DY50D_PORT_OUTPUT_SIZE];
+    size_t outputLength;
+    PortStats stats;
+} Port;
+
+struct Client
+{
+    int fd;
+    uint8_t slot;
+    bool isClosed;              // Released by reapClients() once no call chain uses it any more
+    bool isOutputWatched;
+    uint8_t sensor;             // Port of the following requests, see RPC_OP_SELECT_SENSOR
+    bool isDownloadPending;     // Data frames with downloadRequestId belong to a template download
+    uint16_t downloadRequestId;
+    uint8_t downloadSensor;     // Port of the download, the selection may change before its data frames
+    RpcParser parser;
+    uint8_t *output;
+    size_t outputLength;
+    size_t outputCapacity;
+};
+
+/* ***** Variables ***** */
+
+static int epollFd = -1;
+static Port ports[DY50D_MAX_PORTS];
+static uint8_t portCount;
+static Client *clients[DY50D_MAX_CLIENTS];
+static volatile sig_atomic_t isStopRequested;
+
+// Request payload length per opcode; REQUEST_ANY_LENGTH for ping and streamed frames
+static const int16_t requestLengths[RPC_OP_COUNT] =
+{
+    [RPC_OP_PING] = REQUEST_ANY_LENGTH,
+    [RPC_OP_GET_IMAGE] = 0,
+    [RPC_OP_IMAGE2TZ] = 1,
+    [RPC_OP_CREATE_MODEL] = 0,
+    [RPC_OP_STORE_MODEL] = 3,
+    [RPC_OP_LOAD_MODEL] = 3,
+    [RPC_OP_DELETE_MODEL] = 3,
+    [RPC_OP_EMPTY_DATABASE] = 0,
+    [RPC_OP_SEARCH] = 1,
+    [RPC_OP_TEMPLATE_COUNT] = 0,
+    [RPC_OP_GET_PARAMETERS] = 0,
+    [RPC_OP_LED] = 1,
+    [RPC_OP_CHECK_PASSWORD] = 4,
+    [RPC_OP_UPLOAD_TEMPLATE] = 1,
+    [RPC_OP_UPLOAD_IMAGE] = 0,
+    [RPC_OP_DOWNLOAD_TEMPLATE] = 1,
+    [RPC_OP_METRICS] = 0,
+    [RPC_OP_SELECT_SENSOR] = 1,
+    [RPC_OP_PORT_METRICS] = 0,
+    [RPC_OP_SET_PARAMETER] = 2,
+    [RPC_OP_VERIFY] = 2,
+    [RPC_OP_READ_JOURNAL] = 4,
+    [RPC_OP_CAPTURE] = 1,
+};
+
+static void startNext(Port *port);
+
+/* ***** Helpers ***** */
+
+static int64_t nowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static speed_t toSpeed(int baudRate)
+{
+    switch (baudRate)
+    {
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        default:     return B57600;
+    }
+}
+
+static uint64_t eventTag(uint32_t kind, uint32_t index)
+{
+    return (uint64_t)kind << 32 | index;
+}
+
+static void watch(int fd, uint32_t events, uint32_t kind, uint32_t index, int operation)
+{
+    struct epoll_event event;
+
+    event.events = events;
+    event.data.u64 = eventTag(kind, index);
+    epoll_ctl(epollFd, operation, fd, &event);
+}
+
+static void setOutputWatch(int fd, bool *isWatched, bool isNeeded, uint32_t kind, uint32_t index)
+{
+    if (*isWatched != isNeeded)
+    {
+        *isWatched = isNeeded;
+        watch(fd, EPOLLIN | (isNeeded ? EPOLLOUT : 0), kind, index, EPOLL_CTL_MOD);
+    }
+}
+
+/* ***** Client output ***** */
+
+static void flushClient(Client *client)
+{
+    while (client->outputLength > 0)
+    {
+        ssize_t written = send(client->fd, client->output, client->outputLength, MSG_NOSIGNAL);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN)
+            {
+                client->isClosed = true;
+                return;
+            }
+            break;
+        }
+        memmove(client->output, client->output + written, client->outputLength - (size_t)written);
+        client->outputLength -= (size_t)written;
+    }
+    setOutputWatch(client->fd, &client->isOutputWatched, client->outputLength > 0, SOURCE_CLIENT, client->slot);
+}
+
+static void sendResponse(Client *client, uint16_t requestId, uint8_t opcode, uint8_t flags,
+                         const uint8_t *payload, uint16_t length)
+{
+    static RpcFrame frame;
+    uint8_t buffer[RPC_MAX_FRAME];
+    uint16_t size;
+
+    if (client == NULL || client->isClosed)
+    {
+        return;
+    }
+    frame.flags = RPC_FLAG_RESPONSE | flags;
+    frame.requestId = requestId;
+    frame.opcode = opcode;
+    frame.length = length;
+    memcpy(frame.payload, payload, length);
+    size = rpcEncodeFrame(&frame, buffer);
+
+    if (client->outputLength + size > DY50D_CLIENT_OUTPUT_LIMIT)
+    {
+        client->isClosed = true;
+        return;
+    }
+    if (client->outputLength + size > client->outputCapacity)
+    {
+        size_t capacity = client->outputCapacity * 2 + size;
+        uint8_t *output = realloc(client->output, capacity);
+        if (output == NULL)
+        {
+            client->isClosed = true;
+            return;
+        }
+        client->output = output;
+        client->outputCapacity = capacity;
+    }
+    memcpy(client->output + client->outputLength, buffer, size);
+    client->outputLength += size;
+    if (client->outputLength == size)
+    {
+        flushClient(client);
+    }
+}
+
+static void sendStatus(Client *client, const Request *request, uint8_t flags, uint8_t status)
+{
+    sendResponse(client, request->requestId, request->opcode, flags, &status, 1);
+}
+
+static void sendError(Client *client, const RpcFrame *request, uint8_t error)
+{
+    sendResponse(client, request->requestId, request->opcode, RPC_FLAG_ERROR, &error, 1);
+}
+
+/* ***** Sensor ports ***** */
+
+static void flushPort(Port *port)
+{
+    while (port->outputLength > 0)
+    {
+        ssize_t written = write(port->fd, port->output, port->outputLength);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        port->stats.bytesSent += (uint32_t)written;
+        memmove(port->output, port->output + written, port->outputLength - (size_t)written);
+        port->outputLength -= (size_t)written;
+    }
+    setOutputWatch(port->fd, &port->isOutputWatched, port->outputLength > 0, SOURCE_PORT, (uint32_t)(port - ports));
+}
+
+static void queueFrame(Port *port, WireFrame *frame, uint16_t size)
+{
+    if (port->isOffline || size == 0 || port->outputLength + size > sizeof(port->output))
+    {
+        return; // Lost like a frame corrupted on the line; the command times out
+    }
+    memcpy(port->output + port->outputLength, wireFrameBytes(frame), size);
+    port->outputLength += size;
+    flushPort(port);
+}
+
+static void writeFrame(Port *port, uint8_t type, const uint8_t *data, uint16_t length)
+{
+    WireFrame frame;
+
+    queueFrame(port, &frame, buildWireFrame(&frame, SENSOR_ADDRESS, type, data, length));
+}
+
+/**
+ * @brief  Check the length of a data frame of a template download: at most PACKET_MAX_DATA, and the packet length of
+ *         the sensor for every frame but the last, once the port knows it
+ */
+static bool isDataFrameLengthValid(const Port *port, uint16_t length, bool isLast)
+{
+    if (length > PACKET_MAX_DATA)
+    {
+        return false;
+    }
+    if (!port->isParameterKnown)
+    {
+        return true;
+    }
+    return isLast ? length <= port->packetLength : length == port->packetLength;
+}
+
+/**
+ * @brief  Select the sensor command of a request and its arguments, as the lib/dy50.c function of the opcode does
+ * @param  arguments                         - Receives one value per parameter of the command
+ * @return Entry of sensorCommands, COMMAND_COUNT for an opcode that sends no command
+ */
+static CommandId selectCommand(const Port *port, const Request *request, uint32_t *arguments)
+{
+    const uint8_t *in = request->payload;
+
+    switch (request->opcode)
+    {
+        case RPC_OP_GET_IMAGE:
+            return COMMAND_GET_IMAGE;
+        case RPC_OP_IMAGE2TZ:
+            arguments[0] = in[0];
+            return COMMAND_IMAGE_TO_CHARACTER;
+        case RPC_OP_CREATE_MODEL:
+            return COMMAND_REGISTER_MODEL;
+        case RPC_OP_STORE_MODEL:
+        case RPC_OP_LOAD_MODEL:
+            arguments[0] = in[0];
+            arguments[1] = rpcGetU16(&in[1]);
+            return (request->opcode == RPC_OP_LOAD_MODEL) ? COMMAND_LOAD : COMMAND_STORE;
+        case RPC_OP_DELETE_MODEL:
+            arguments[0] = rpcGetU16(&in[0]);
+            arguments[1] = in[2];
+            return COMMAND_DELETE;
+        case RPC_OP_EMPTY_DATABASE:
+            return COMMAND_EMPTY;
+        case RPC_OP_SEARCH:
+            arguments[0] = in[0];
+            arguments[1] = 0;
+            arguments[2] = port->capacity;
+            return COMMAND_SEARCH;
+        case RPC_OP_VERIFY:
+            if (request->step == 0)
+            {
+                // Like fingerVerify(): the page into CharBuffer2, then Match
+                arguments[0] = 2;
+                arguments[1] = rpcGetU16(&in[0]);
+                return COMMAND_LOAD;
+            }
+            return COMMAND_MATCH;
+        case RPC_OP_TEMPLATE_COUNT:
+            return COMMAND_TEMPLATE_COUNT;
+        case RPC_OP_GET_PARAMETERS:
+            return COMMAND_READ_SYSTEM_PARAMETERS;
+        case RPC_OP_LED:
+            return in[0] ? COMMAND_LED_ON : COMMAND_LED_OFF;
+        case RPC_OP_SET_PARAMETER:
+            arguments[0] = in[0];
+            arguments[1] = in[1];
+            return COMMAND_SET_SYSTEM_PARAMETER;
+        case RPC_OP_CHECK_PASSWORD:
+            arguments[0] = rpcGetU32(in);
+            return COMMAND_VERIFY_PASSWORD;
+        case RPC_OP_UPLOAD_TEMPLATE:
+            arguments[0] = in[0];
+            return COMMAND_UPLOAD;
+        case RPC_OP_DOWNLOAD_TEMPLATE:
+            arguments[0] = in[0];
+            return COMMAND_DOWNLOAD;
+        case RPC_OP_UPLOAD_IMAGE:
+            return COMMAND_UPLOAD_IMAGE;
+        default:
+            return COMMAND_COUNT;
+    }
+}
+
+static void sendCommand(Port *port)
+{
+    uint32_t arguments[COMMAND_MAX_PARAMETERS];
+    CommandId id = selectCommand(port, port->current, arguments);
+    WireFrame frame;
+
+    port->current->attempts++;
+    port->state = PORT_AWAIT_ACK;
+    port->deadlineMs = nowMs() + DEFAULTTIMEOUT;
+    if (id == COMMAND_COUNT)
+    {
+        return; // Nothing to send; the request times out
+    }
+    port->current->isIdempotent = sensorCommands[id].isIdempotent;
+    queueFrame(port, &frame, encodeCommand(&frame, &sensorCommands[id], arguments));
+}
+
+static void finishRequest(Port *port)
+{
+    Request *request = port->current;
+    uint32_t latencyMs = (uint32_t)(nowMs() - request->acceptedMs);
+
+    if (request->client != NULL && request->opcode == RPC_OP_DOWNLOAD_TEMPLATE &&
+        request->client->downloadRequestId == request->requestId)
+    {
+        request->client->isDownloadPending = false;
+    }
+    port->stats.completed++;
+    port->stats.latencyTotalMs += latencyMs;
+    if (latencyMs > port->stats.latencyMaxMs)
+    {
+        port->stats.latencyMaxMs = latencyMs;
+    }
+    free(request);
+    port->current = NULL;
+    port->state = PORT_IDLE;
+    port->deadlineMs = 0;
+    startNext(port);
+}
+
+/**
+ * @brief  Answer the current request from the acknowledge packet, in the response format of lib/rpc_server.c
+ * @param  data                              - Acknowledge data; data[0] is the confirmation word or a link error
+ */
+static void completeFromAck(Port *port, const uint8_t *data)
+{
+    Request *request = port->current;
+    uint8_t out[16] = {};
+    uint16_t packetLength;
+
+    switch (request->opcode)
+    {
+        case RPC_OP_SEARCH:
+            out[0] = data[0];
+            rpcPutU16(&out[1], data[0] == FINGERPRINT_OK ? (uint16_t)(data[1] << 8 | data[2]) : data[0]);
+            rpcPutU16(&out[3], data[0] == FINGERPRINT_OK ? (uint16_t)(data[3] << 8 | data[4]) : data[0]);
+            sendResponse(request->client, request->requestId, request->opcode, 0, out, 5);
+            break;
+        case RPC_OP_VERIFY:
+            if (request->step == 0 && data[0] == FINGERPRINT_OK)
+            {
+                request->step = 1;
+                request->attempts = 0;
+                sendCommand(port);
+                return;
+            }
+            out[0] = data[0];
+            if (request->step == 1 && (data[0] == FINGERPRINT_OK || data[0] == FINGERPRINT_NOMATCH))
+            {
+                rpcPutU16(&out[1], (uint16_t)(data[1] << 8 | data[2]));
+            }
+            sendResponse(request->client, request->requestId, request->opcode, 0, out, 3);
+            break;
+        case RPC_OP_TEMPLATE_COUNT:
+            rpcPutU16(&out[0], (uint16_t)(data[1] << 8 | data[2]));
+            sendResponse(request->client, request->requestId, request->opcode, 0, out, 2);
+            break;
+        case RPC_OP_GET_PARAMETERS:
+            packetLength = (uint16_t)(data[13] << 8 | data[14]);
+            rpcPutU16(&out[0], (uint16_t)(data[1] << 8 | data[2]));
+            rpcPutU16(&out[2], (uint16_t)(data[3] << 8 | data[4]));
+            rpcPutU16(&out[4], (uint16_t)(data[5] << 8 | data[6]));
+            rpcPutU16(&out[6], (uint16_t)(data[7] << 8 | data[8]));
+            rpcPutU32(&out[8], (uint32_t)data[9] << 24 | (uint32_t)data[10] << 16 | (uint32_t)data[11] << 8 |
+                               data[12]);
+            rpcPutU16(&out[12], packetLength <= 3 ? (uint16_t)(32 << packetLength) : packetLength);
+            rpcPutU16(&out[14], (uint16_t)((data[15] << 8 | data[16]) * 9600));
+            if (data[0] == FINGERPRINT_OK)
+            {
+                port->capacity = (uint16_t)(data[5] << 8 | data[6]);
+                port->packetLength = rpcGetU16(&out[12]);
+                port->isParameterKnown = true;
+            }
+            sendResponse(request->client, request->requestId, request->opcode, 0, out, 16);
+            break;
+        case RPC_OP_UPLOAD_TEMPLATE:
+        case RPC_OP_UPLOAD_IMAGE:
+            if (data[0] == FINGERPRINT_OK)
+            {
+                port->state = PORT_AWAIT_DATA;
+                port->deadlineMs = nowMs() + DEFAULTTIMEOUT;
+                return;
+            }
+            sendStatus(request->client, request, 0, data[0]);
+            break;
+        case RPC_OP_DOWNLOAD_TEMPLATE:
+            if (data[0] == FINGERPRINT_OK)
+            {
+                sendStatus(request->client, request, RPC_FLAG_MORE, data[0]);
+                port->state = PORT_DOWNLOADING;
+                port->deadlineMs = nowMs() + DY50D_DOWNLOAD_IDLE_MS;
+                startNext(port); // Data frames may already be queued
+                return;
+            }
+            sendStatus(request->client, request, 0, data[0]);
+            break;
+        default:
+            sendStatus(request->client, request, 0, data[0]);
+            break;
+    }
+    finishRequest(port);
+}
+
+// Timeout or corrupted response: repeat idempotent commands like executeCommand() in lib/dy50.c, else report it
+static void handleLinkError(Port *port, uint8_t result)
+{
+    uint8_t data[PACKET_MAX_DATA] = {};
+
+    tcflush(port->fd, TCIFLUSH);
+    resetPacketParser(&port->parser);
+    port->isParameterKnown = false;
+    port->lastLinkError = result;
+    if (port->state == PORT_AWAIT_ACK && port->current->isIdempotent &&
+        port->current->attempts <= DEFAULT_MAX_RETRIES)
+    {
+        port->stats.retries++;
+        sendCommand(port);
+        return;
+    }
+    data[0] = result;
+    if (port->state == PORT_AWAIT_ACK)
+    {
+        completeFromAck(port, data);
+        return;
+    }
+    sendStatus(port->current->client, port->current, 0, result);
+    finishRequest(port);
+}
+
+static void handlePacket(Port *port, const Packet *packet, bool isChecksumValid)
+{
+    Request *request = port->current;
+    uint16_t dataLength = packet->length - PACKET_CHECKSUM_SIZE;
+
+    switch (port->state)
+    {
+        case PORT_AWAIT_ACK:
+            if (!isChecksumValid || packet->type != FINGERPRINT_ACKPACKET)
+            {
+                port->stats.badPackets++;
+                handleLinkError(port, FINGERPRINT_BADPACKET);
+                return;
+            }
+            completeFromAck(port, packet->data);
+            break;
+        case PORT_AWAIT_DATA:
+            if (!isChecksumValid ||
+                (packet->type != FINGERPRINT_DATAPACKET && packet->type != FINGERPRINT_ENDDATAPACKET))
+            {
+                port->stats.badPackets++;
+                handleLinkError(port, FINGERPRINT_BADPACKET);
+                return;
+            }
+            sendResponse(request->client, request->requestId, request->opcode, RPC_FLAG_MORE, packet->data,
+                         dataLength);
+            if (packet->type == FINGERPRINT_ENDDATAPACKET)
+            {
+                sendStatus(request->client, request, 0, FINGERPRINT_OK);
+                finishRequest(port);
+                return;
+            }
+            port->deadlineMs = nowMs() + DEFAULTTIMEOUT;
+            break;
+        default:
+            port->stats.unsolicited++;
+            break;
+    }
+}
+
+static void readPort(Port *port)
+{
+    uint8_t buffer[512];
+    ssize_t received = read(port->fd, buffer, sizeof(buffer));
+    Packet packet;
+
+    if (received < 0 && errno != EAGAIN && errno != EINTR)
+    {
+        // Adapter unplugged; stop polling it and let the pending commands time out
+        fprintf(stderr, "%s: %s\n", port->device, strerror(errno));
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, port->fd, NULL);
+        port->isOffline = true;
+        return;
+    }
+    if (received <= 0)
+    {
+        return;
+    }
+    port->stats.bytesReceived += (uint32_t)received;
+    for (ssize_t i = 0; i < received; i++)
+    {
+        ParserResult result = parsePacketByte(&port->parser, buffer[i]);
+        if (result == PARSER_PACKET_OK || result == PARSER_PACKET_BADSUM)
+        {
+            getParsedPacket(&port->parser, &packet);
+            handlePacket(port, &packet, result == PARSER_PACKET_OK);
+        }
+    }
+}
+
+/* ***** Request queues ***** */
+
+static void enqueue(Port *port, Request *request, bool isUrgent)
+{
+    if (port->head == NULL)
+    {
+        port->head = request;
+        port->tail = request;
+    }
+    else if (isUrgent)
+    {
+        request->next = port->head;
+        port->head = request;
+    }
+    else
+    {
+        port->tail->next = request;
+        port->tail = request;
+    }
+    port->stats.queueDepth++;
+    if (port->stats.queueDepth > port->stats.maxQueueDepth)
+    {
+        port->stats.maxQueueDepth = port->stats.queueDepth;
+    }
+}
+
+// Remove the first waiting request accepted by match, or the head if match is NULL
+static Request *dequeue(Port *port, const Request *match)
+{
+    Request *previous = NULL;
+
+    for (Request *request = port->head; request != NULL; previous = request, request = request->next)
+    {
+        if (match != NULL &&
+            !(request->isStream && request->client == match->client && request->requestId == match->requestId))
+        {
+            continue;
+        }
+        if (previous == NULL)
+        {
+            port->head = request->next;
+        }
+        else
+        {
+            previous->next = request->next;
+        }
+        if (port->tail == request)
+        {
+            port->tail = previous;
+        }
+        request->next = NULL;
+        port->stats.queueDepth--;
+        return request;
+    }
+    return NULL;
+}
+
+// Forward the data frames queued for the download in progress; other requests wait until it is complete
+static void forwardDownload(Port *port)
+{
+    Request *frame;
+
+    while (port->state == PORT_DOWNLOADING && (frame = dequeue(port, port->current)) != NULL)
+    {
+        bool isLast = (frame->flags & RPC_FLAG_MORE) == 0;
+
+        if (!isDataFrameLengthValid(port, frame->length, isLast))
+        {
+            // Queued before the packet length was known; the client may send the frame again
+            uint8_t error = RPC_ERROR_BAD_LENGTH;
+            sendResponse(frame->client, frame->requestId, frame->opcode, RPC_FLAG_ERROR, &error, 1);
+            free(frame);
+            continue;
+        }
+        writeFrame(port, isLast ? FINGERPRINT_ENDDATAPACKET : FINGERPRINT_DATAPACKET, frame->payload, frame->length);
+        free(frame);
+        port->deadlineMs = nowMs() + DY50D_DOWNLOAD_IDLE_MS;
+        if (isLast)
+        {
+            sendStatus(port->current->client, port->current, 0, FINGERPRINT_OK);
+            finishRequest(port);
+            return;
+        }
+    }
+}
+
+static void startNext(Port *port)
+{
+    Request *request;
+
+    if (port->state == PORT_DOWNLOADING)
+    {
+        forwardDownload(port);
+        return;
+    }
+    while (port->state == PORT_IDLE && (request = dequeue(port, NULL)) != NULL)
+    {
+        if (request->isStream)
+        {
+            // Data frames of a download that was refused
+            uint8_t error = RPC_ERROR_STREAM;
+            sendResponse(request->client, request->requestId, request->opcode, RPC_FLAG_ERROR, &error, 1);
+            free(request);
+            continue;
+        }
+        if ((request->opcode == RPC_OP_SEARCH || request->opcode == RPC_OP_DOWNLOAD_TEMPLATE) &&
+            !port->isParameterKnown)
+        {
+            if (request->isParameterQueried)
+            {
+                // The module did not answer the parameter query either
+                uint8_t data[PACKET_MAX_DATA] = { port->lastLinkError };
+                port->current = request;
+                completeFromAck(port, data);
+                continue;
+            }
+            Request *query = calloc(1, sizeof(Request));
+            if (query != NULL)
+            {
+                // The search range is the library size and data frames of a download must have the packet length,
+                // both read once per port like getParameters() does
+                request->isParameterQueried = true;
+                query->opcode = RPC_OP_GET_PARAMETERS;
+                query->acceptedMs = nowMs();
+                enqueue(port, request, true);
+                port->stats.requests++;
+                request = query;
+            }
+        }
+        port->current = request;
+        sendCommand(port);
+    }
+}
+
+/* ***** Clients ***** */
+
+static void sendPortMetrics(Client *client, const RpcFrame *frame)
+{
+    const PortStats *stats = &ports[client->sensor].stats;
+    const uint32_t *fields = (const uint32_t *)stats;
+    uint8_t out[sizeof(PortStats)];
+
+    for (size_t i = 0; i < sizeof(PortStats) / sizeof(uint32_t); i++)
+    {
+        rpcPutU32(&out[i * 4], fields[i]);
+    }
+    sendResponse(client, frame->requestId, frame->opcode, 0, out, sizeof(out));
+}
+
+static void handleFrame(Client *client, const RpcFrame *frame)
+{
+    bool isStream = client->isDownloadPending && frame->opcode == RPC_OP_DOWNLOAD_TEMPLATE &&
+                    frame->requestId == client->downloadRequestId;
+    Port *port = &ports[isStream ? client->downloadSensor : client->sensor];
+    Request *request;
+
+    if (frame->opcode >= RPC_OP_COUNT || frame->opcode == RPC_OP_METRICS || frame->opcode == RPC_OP_READ_JOURNAL ||
+        frame->opcode == RPC_OP_CAPTURE)
+    {
+        sendError(client, frame, RPC_ERROR_UNKNOWN_OPCODE);
+        return;
+    }
+    if (isStream ? !isDataFrameLengthValid(port, frame->length, (frame->flags & RPC_FLAG_MORE) == 0) :
+        requestLengths[frame->opcode] != REQUEST_ANY_LENGTH && frame->length != requestLengths[frame->opcode])
+    {
+        sendError(client, frame, RPC_ERROR_BAD_LENGTH);
+        return;
+    }
+    switch (frame->opcode)
+    {
+        case RPC_OP_PING:
+            sendResponse(client, frame->requestId, frame->opcode, 0, frame->payload, frame->length);
+            return;
+        case RPC_OP_SELECT_SENSOR:
+            if (frame->payload[0] >= portCount)
+            {
+                sendError(client, frame, RPC_ERROR_NO_SENSOR);
+                return;
+            }
+            client->sensor = frame->payload[0];
+            sendResponse(client, frame->requestId, frame->opcode, 0, (const uint8_t[]){ FINGERPRINT_OK }, 1);
+            return;
+        case RPC_OP_PORT_METRICS:
+            sendPortMetrics(client, frame);
+            return;
+        default:
+            break;
+    }
+
+    if (port->stats.queueDepth >= DY50D_MAX_QUEUE && !isStream)
+    {
+        port->stats.rejected++;
+        sendError(client, frame, RPC_ERROR_BUSY);
+        return;
+    }
+    request = calloc(1, sizeof(Request));
+    if (request == NULL)
+    {
+        sendError(client, frame, RPC_ERROR_BUSY);
+        return;
+    }
+    request->client = client;
+    request->requestId = frame->requestId;
+    request->opcode = frame->opcode;
+    request->flags = frame->flags;
+    request->isStream = isStream;
+    request->length = frame->length;
+    memcpy(request->payload, frame->payload, frame->length);
+    request->acceptedMs = nowMs();
+    if (frame->opcode == RPC_OP_DOWNLOAD_TEMPLATE && !isStream)
+    {
+        client->isDownloadPending = true;
+        client->downloadRequestId = frame->requestId;
+        client->downloadSensor = client->sensor;
+    }
+    if (!isStream)
+    {
+        port->stats.requests++;
+    }
+    enqueue(port, request, false);
+    startNext(port);
+}
+
+static void readClient(Client *client)
+{
+    uint8_t buffer[4096];
+    ssize_t received = read(client->fd, buffer, sizeof(buffer));
+
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR))
+    {
+        client->isClosed = true;
+        return;
+    }
+    for (ssize_t i = 0; i < received && !client->isClosed; i++)
+    {
+        if (rpcParseByte(&client->parser, buffer[i]) && (client->parser.frame.flags & RPC_FLAG_RESPONSE) == 0)
+        {
+            handleFrame(client, &client->parser.frame);
+        }
+    }
+}
+
+static void acceptClient(int listenFd)
+{
+    int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    Client *client;
+
+    if (fd < 0)
+    {
+        return;
+    }
+    for (uint8_t slot = 0; slot < DY50D_MAX_CLIENTS; slot++)
+    {
+        if (clients[slot] == NULL && (client = calloc(1, sizeof(Client))) != NULL)
+        {
+            client->fd = fd;
+            client->slot = slot;
+            rpcResetParser(&client->parser);
+            clients[slot] = client;
+            watch(fd, EPOLLIN, SOURCE_CLIENT, slot, EPOLL_CTL_ADD);
+            return;
+        }
+    }
+    close(fd);
+}
+
+// Drop the client's waiting requests; a command already on the wire completes without a response
+static void releaseClient(Client *client)
+{
+    for (uint8_t i = 0; i < portCount; i++)
+    {
+        Port *port = &ports[i];
+        Request *kept = NULL;
+        Request *request;
+
+        while ((request = dequeue(port, NULL)) != NULL)
+        {
+            if (request->client == client)
+            {
+                free(request);
+                continue;
+            }
+            request->next = kept;
+            kept = request;
+        }
+        while (kept != NULL)
+        {
+            request = kept;
+            kept = kept->next;
+            request->next = port->head;
+            port->head = request;
+            if (port->tail == NULL)
+            {
+                port->tail = request;
+            }
+            port->stats.queueDepth++;
+        }
+        if (port->current != NULL && port->current->client == client)
+        {
+            port->current->client = NULL;
+            if (port->state == PORT_DOWNLOADING)
+            {
+                finishRequest(port); // The module discards the incomplete template
+            }
+        }
+    }
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    clients[client->slot] = NULL;
+    free(client->output);
+    free(client);
+}
+
+static void reapClients(void)
+{
+    for (uint8_t slot = 0; slot < DY50D_MAX_CLIENTS; slot++)
+    {
+        if (clients[slot] != NULL && clients[slot]->isClosed)
+        {
+            releaseClient(clients[slot]);
+        }
+    }
+}
+
+/* ***** Event loop ***** */
+
+static int openPort(Port *port, const char *device, int baudRate)
+{
+    struct termios tty;
+    int fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (tcgetattr(fd, &tty) == 0)
+    {
+        cfmakeraw(&tty);
+        cfsetispeed(&tty, toSpeed(baudRate));
+        cfsetospeed(&tty, toSpeed(baudRate));
+        tty.c_cc[VMIN] = 0;
+        tty.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tty);
+        tcflush(fd, TCIOFLUSH);
+    }
+    memset(port, 0, sizeof(*port));
+    port->fd = fd;
+    port->device = device;
+    resetPacketParser(&port->parser);
+    watch(fd, EPOLLIN, SOURCE_PORT, (uint32_t)(port - ports), EPOLL_CTL_ADD);
+    return 0;
+}
+
+static int openListener(const char *path)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd < 0 || strlen(path) >= sizeof(address.sun_path))
+    {
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 16) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    watch(fd, EPOLLIN, SOURCE_LISTENER, 0, EPOLL_CTL_ADD);
+    return fd;
+}
+
+// Milliseconds until the earliest port deadline, -1 if no port is waiting
+static int nextTimeout(void)
+{
+    int64_t now = nowMs();
+    int64_t earliest = -1;
+
+    for (uint8_t i = 0; i < portCount; i++)
+    {
+        if (ports[i].deadlineMs != 0 && (earliest < 0 || ports[i].deadlineMs < earliest))
+        {
+            earliest = ports[i].deadlineMs;
+        }
+    }
+    if (earliest < 0)
+    {
+        return -1;
+    }
+    return earliest <= now ? 0 : (int)(earliest - now);
+}
+
+static void checkDeadlines(void)
+{
+    int64_t now = nowMs();
+
+    for (uint8_t i = 0; i < portCount; i++)
+    {
+        Port *port = &ports[i];
+        if (port->deadlineMs == 0 || port->deadlineMs > now)
+        {
+            continue;
+        }
+        if (port->state == PORT_DOWNLOADING)
+        {
+            sendStatus(port->current->client, port->current, 0, FINGERPRINT_TIMEOUT);
+            finishRequest(port);
+            continue;
+        }
+        port->stats.timeouts++;
+        handleLinkError(port, FINGERPRINT_TIMEOUT);
+    }
+}
+
+static void onSignal(int signal)
+{
+    (void)signal;
+    isStopRequested = 1;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s -s socket [-b baud] device...\n", program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *socketPath = NULL;
+    int baudRate = UART_SENSOR_BAUD;
+    int listenFd;
+    int option;
+    struct epoll_event events[MAX_EVENTS];
+
+    while ((option = getopt(argc, argv, "s:b:")) != -1)
+    {
+        switch (option)
+        {
+            case 's':
+                socketPath = optarg;
+                break;
+            case 'b':
+                baudRate = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (socketPath == NULL || optind == argc || argc - optind > DY50D_MAX_PORTS)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    for (int i = optind; i < argc; i++)
+    {
+        if (openPort(&ports[portCount], argv[i], baudRate) != 0)
+        {
+            fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+            return 1;
+        }
+        portCount++;
+    }
+    listenFd = openListener(socketPath);
+    if (listenFd < 0)
+    {
+        fprintf(stderr, "%s: %s\n", socketPath, strerror(errno));
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    while (!isStopRequested)
+    {
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, nextTimeout());
+
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t kind = (uint32_t)(events[i].data.u64 >> 32);
+            uint32_t index = (uint32_t)events[i].data.u64;
+
+            if (kind == SOURCE_LISTENER)
+            {
+                acceptClient(listenFd);
+            }
+            else if (kind == SOURCE_PORT)
+            {
+                if (events[i].events & EPOLLOUT)
+                {
+                    flushPort(&ports[index]);
+                }
+                if (events[i].events & EPOLLIN)
+                {
+                    readPort(&ports[index]);
+                }
+            }
+            else if (clients[index] != NULL && !clients[index]->isClosed)
+            {
+                if (events[i].events & EPOLLOUT)
+                {
+                    flushClient(clients[index]);
+                }
+                if (!clients[index]->isClosed && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                {
+                    readClient(clients[index]);
+                }
+            }
+        }
+        checkDeadlines();
+        reapClients();
+    }
+
+    close(listenFd);
+    unlink(socketPath);
+    return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef DY50D_H
+#define DY50D_H
+
+#include <stdint.h>
+
+/*
+ * Multi-sensor daemon for Linux gateways. One thread drives up to DY50D_MAX_PORTS modules on serial ports from a
+ * single epoll loop and serves the RPC protocol of lib/rpc_protocol.h on a Unix stream socket, so host/rpc_client.c
+ * can be attached to the socket unchanged.
+ *
+ *   cc -O2 -DDY50_HOST -I . -I lib -I host -o dy50d host/dy50d.c lib/sensor_command.c lib/wire_frame.c \
+ *      lib/packet_parser.c lib/checksum.c lib/rpc_protocol.c
+ *   dy50d -s /run/dy50d.sock [-b 57600] /dev/ttyUSB0 /dev/ttyUSB1 ...
+ *
+ * Sensors are numbered in the order of the devices on the command line. A connection starts on sensor 0 and
+ * RPC_OP_SELECT_SENSOR routes its following requests to another one. Requests to the same sensor are executed in
+ * order; requests to different sensors run concurrently and their responses may arrive in any order, matched by
+ * request ID. A client may therefore pipeline requests to several sensors over one connection.
+ */
+
+/* ***** Defines ***** */
+
+#define DY50D_MAX_PORTS                         16
+#define DY50D_MAX_CLIENTS                       64
+#define DY50D_MAX_QUEUE                         64   // Requests waiting per sensor before RPC_ERROR_BUSY
+#define DY50D_PORT_OUTPUT_SIZE                  4096 // Bytes buffered per serial port while the device is busy
+#define DY50D_CLIENT_OUTPUT_LIMIT               (256 * 1024) // Clients falling further behind are disconnected
+#define DY50D_DOWNLOAD_IDLE_MS                  2000 // Abandon a template download after this gap in data frames
+
+/* ***** Structures ***** */
+
+// Statistics of one sensor port, returned by RPC_OP_PORT_METRICS as uint32 fields in declaration order
+typedef struct
+{
+    uint32_t requests;          // Requests accepted for the port
+    uint32_t completed;         // Requests answered, including failures
+    uint32_t rejected;          // Requests refused with RPC_ERROR_BUSY
+    uint32_t retries;           // Repetitions of idempotent commands after a link error
+    uint32_t timeouts;          // Responses not received in time
+    uint32_t badPackets;        // Responses with a wrong checksum or type
+    uint32_t unsolicited;       // Packets received while no response was expected
+    uint32_t queueDepth;        // Requests waiting, not counting the one in progress
+    uint32_t maxQueueDepth;
+    uint32_t latencyTotalMs;    // Sum of the times from acceptance to the final response
+    uint32_t latencyMaxMs;
+    uint32_t bytesReceived;
+    uint32_t bytesSent;
+} PortStats;
+
+#endif /* DY50D_H */
@@ -0,0 +1,326 @@
+/*
+ * Host transport for DY50_HOST builds of lib/dy50.c, see host_transport.h.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include "host_transport.h"
+
+#define RECEIVE_QUEUE_SIZE                      65536 // Holds a complete image upload
+
+// Receive state of one simulated sensor UART
+typedef struct
+{
+    uint8_t receiveQueue[RECEIVE_QUEUE_SIZE];
+    uint32_t queueHead;
+    uint32_t queueTail;
+    PacketParser receiveParser;
+    WireFrame responseFrame;    // Complete response, kept until releaseResponseFrame()
+    bool isReceived;
+    bool isResponseValid;
+    bool isHandshakeReceived;
+    uint32_t handshakeTick;
+    SensorWriter sensorWriter;
+    void *sensorContext;
+} SensorPort;
+
+static SensorPort ports[HOST_MAX_SENSORS];
+static SensorPort *port = &ports[0];
+static uint32_t (*clockSource)(void);
+static struct timespec startTime;
+static bool (*frameWait)(uint32_t timeoutMs);
+static void (*frameSignal)(void);
+
+// Guards the receive state when the sensor side runs in another thread
+static pthread_mutex_t receiveLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t receiveCondition = PTHREAD_COND_INITIALIZER;
+
+static uint32_t monotonicMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((now.tv_sec - startTime.tv_sec) * 1000 + (now.tv_nsec - startTime.tv_nsec) / 1000000);
+}
+
+void init()
+{
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    for (uint8_t i = 0; i < HOST_MAX_SENSORS; i++)
+    {
+        resetPacketParser(&ports[i].receiveParser);
+        ports[i].queueHead = 0;
+        ports[i].queueTail = 0;
+        ports[i].isReceived = false;
+        ports[i].isHandshakeReceived = false;
+    }
+    port = &ports[0];
+}
+
+/**
+ * @brief  Milliseconds since init(), or the time of the clock installed with hostTransportSetClock()
+ */
+uint32_t getTickCount(void)
+{
+    return (clockSource != NULL) ? clockSource() : monotonicMs();
+}
+
+/**
+ * @brief  Microseconds since init(), in steps of a millisecond with a clock installed by hostTransportSetClock()
+ */
+uint32_t getMicroseconds(void)
+{
+    struct timespec now;
+
+    if (clockSource != NULL)
+    {
+        return clockSource() * 1000;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((now.tv_sec - startTime.tv_sec) * 1000000 + (now.tv_nsec - startTime.tv_nsec) / 1000);
+}
+
+/**
+ * @brief  Use a different time base, e.g. the virtual clock of a simulation. NULL restores the monotonic clock.
+ */
+void hostTransportSetClock(uint32_t (*now)(void))
+{
+    clockSource = now;
+}
+
+void setFrameWaitHooks(bool (*wait)(uint32_t timeoutMs), void (*signal)(void))
+{
+    frameWait = wait;
+    frameSignal = signal;
+}
+
+/**
+ * @brief  Accepted for the board API; frames are handed to the SensorWriter in one call, so nothing waits for them
+ */
+void setTransmitWaitHooks(bool (*wait)(uint32_t timeoutMs), void (*signal)(void))
+{
+    (void)wait;
+    (void)signal;
+}
+
+/**
+ * @brief  Route the bytes sent by the driver on a port to a sensor implementation
+ */
+void hostTransportConnect(uint8_t index, SensorWriter writer, void *context)
+{
+    if (index < HOST_MAX_SENSORS)
+    {
+        ports[index].sensorWriter = writer;
+        ports[index].sensorContext = context;
+    }
+}
+
+/**
+ * @brief  Bytes sent by the sensor on a port. Equivalent of the UART interrupt handlers; may be called from any
+ *         thread, including from within the SensorWriter while sendPacket() runs. The bytes are queued and parsed by
+ *         the waiting side one frame at a time, so a sensor that answers instantly cannot overwrite a response
+ *         before the driver has read it.
+ */
+void hostTransportReceive(uint8_t index, const uint8_t *data, uint16_t length)
+{
+    SensorPort *sensor = &ports[index];
+
+    pthread_mutex_lock(&receiveLock);
+    for (uint16_t i = 0; i < length && sensor->queueHead - sensor->queueTail < RECEIVE_QUEUE_SIZE; i++)
+    {
+        sensor->receiveQueue[sensor->queueHead++ % RECEIVE_QUEUE_SIZE] = data[i];
+    }
+    pthread_cond_broadcast(&receiveCondition);
+    pthread_mutex_unlock(&receiveLock);
+
+    if (frameSignal != NULL)
+    {
+        frameSignal();
+    }
+}
+
+/**
+ * @brief  Parse queued bytes of the selected port until a frame completes or the queue is empty. Called with
+ *         receiveLock held.
+ */
+static void parseQueuedBytes(void)
+{
+    while (!port->isReceived && port->queueTail != port->queueHead)
+    {
+        uint8_t byte = port->receiveQueue[port->queueTail++ % RECEIVE_QUEUE_SIZE];
+
+        ParserResult result = parsePacketByte(&port->receiveParser, byte);
+        switch (result)
+        {
+            case PARSER_OUTSIDE_PACKET:
+                if (byte == SENSOR_HANDSHAKE_BYTE && !port->isHandshakeReceived)
+                {
+                    port->handshakeTick = getTickCount();
+                    port->isHandshakeReceived = true;
+                }
+                break;
+            case PARSER_PACKET_OK:
+            case PARSER_PACKET_BADSUM:
+                memcpy(&port->responseFrame, &port->receiveParser.frame, wireFrameSize(&port->receiveParser.frame));
+                port->isResponseValid = (result == PARSER_PACKET_OK);
+                port->isReceived = true;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+bool isSensorHandshakeReceived(uint32_t *readyTick)
+{
+    pthread_mutex_lock(&receiveLock);
+    parseQueuedBytes();
+    pthread_mutex_unlock(&receiveLock);
+    if (port->isHandshakeReceived && readyTick != NULL)
+    {
+        *readyTick = port->handshakeTick;
+    }
+    return port->isHandshakeReceived;
+}
+
+void selectSensorPort(uint8_t index)
+{
+    if (index < HOST_MAX_SENSORS)
+    {
+        port = &ports[index];
+    }
+}
+
+uint8_t getSelectedSensorPort(void)
+{
+    return (uint8_t)(port - ports);
+}
+
+static void writeToPort(SensorPort *sensor, const WireFrame *frame, uint16_t size)
+{
+    if (sensor->sensorWriter != NULL)
+    {
+        sensor->sensorWriter((const uint8_t *)frame, size, sensor->sensorContext);
+    }
+}
+
+/**
+ * @brief  Hand a complete frame to the sensor in one write
+ */
+void sendFrame(const WireFrame *frame, uint16_t size)
+{
+    writeToPort(port, frame, size);
+}
+
+void broadcastFrame(uint8_t portMask, const WireFrame *frame, uint16_t size)
+{
+    for (uint8_t i = 0; i < HOST_MAX_SENSORS; i++)
+    {
+        if (portMask & (1 << i))
+        {
+            writeToPort(&ports[i], frame, size);
+        }
+    }
+}
+
+void sendPacket(Packet *packet)
+{
+    WireFrame frame;
+    uint32_t address = (uint32_t)packet->address[0] << 24 | (uint32_t)packet->address[1] << 16 |
+                       (uint32_t)packet->address[2] << 8 | packet->address[3];
+
+    sendFrame(&frame, buildWireFrame(&frame, address, packet->type, packet->data, packet->length - 2));
+}
+
+Packet awaitReponsePacket()
+{
+    Packet response;
+    while (!awaitReponsePacketTimeout(&response, 0xFFFFFFFF))
+    {
+    }
+    return response;
+}
+
+/**
+ * @brief  Wait for a response frame of the selected port; no further frame is parsed until releaseResponseFrame()
+ * @return The frame, NULL if the timeout was reached
+ */
+const WireFrame *awaitResponseFrame(uint32_t timeoutMs)
+{
+    uint32_t start = getTickCount();
+
+    pthread_mutex_lock(&receiveLock);
+    parseQueuedBytes();
+    while (!port->isReceived)
+    {
+        uint32_t elapsed = getTickCount() - start;
+        if (elapsed >= timeoutMs)
+        {
+            pthread_mutex_unlock(&receiveLock);
+            return NULL;
+        }
+        if (frameWait != NULL)
+        {
+            pthread_mutex_unlock(&receiveLock);
+            frameWait(timeoutMs - elapsed);
+            pthread_mutex_lock(&receiveLock);
+        }
+        else if (clockSource != NULL)
+        {
+            // A virtual clock only moves when the simulation runs, so give it a chance without blocking
+            pthread_mutex_unlock(&receiveLock);
+            sched_yield();
+            pthread_mutex_lock(&receiveLock);
+        }
+        else
+        {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += (timeoutMs - elapsed) / 1000;
+            deadline.tv_nsec += (long)((timeoutMs - elapsed) % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&receiveCondition, &receiveLock, &deadline);
+        }
+        parseQueuedBytes();
+    }
+    pthread_mutex_unlock(&receiveLock);
+    return &port->responseFrame;
+}
+
+void releaseResponseFrame(void)
+{
+    pthread_mutex_lock(&receiveLock);
+    port->isReceived = false;
+    pthread_mutex_unlock(&receiveLock);
+}
+
+bool awaitReponsePacketTimeout(Packet *response, uint32_t timeoutMs)
+{
+    const WireFrame *frame = awaitResponseFrame(timeoutMs);
+
+    if (frame == NULL)
+    {
+        return false;
+    }
+    wireFrameToPacket(frame, response);
+    releaseResponseFrame();
+    return true;
+}
+
+void flushReceiver(void)
+{
+    pthread_mutex_lock(&receiveLock);
+    resetPacketParser(&port->receiveParser);
+    port->queueTail = port->queueHead;
+    port->isReceived = false;
+    pthread_mutex_unlock(&receiveLock);
+}
+
+bool isResponseChecksumValid(void)
+{
+    return port->isResponseValid;
+}
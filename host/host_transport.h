@@ -0,0 +1,51 @@
+#ifndef HOST_TRANSPORT_H
+#define HOST_TRANSPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "types.h"
+#include "packet_parser.h"
+
+/*
+ * Host replacement of the sensor transport in utils/tm4c123gxl_utils.c, selected by DY50_HOST. It provides the same
+ * functions to lib/dy50.c; bytes written by the driver go to a SensorWriter (usually host/sensor_sim.c) and bytes from
+ * the sensor are fed to hostTransportReceive(), which plays the part of the UART1 interrupt handler.
+ *
+ *   cc -O2 -DDY50_HOST -I . -I lib -I host lib/dy50.c lib/sensor_command.c lib/checksum.c lib/packet_parser.c \
+ *      lib/wire_frame.c host/host_transport.c host/sensor_sim.c <program>.c -lpthread
+ */
+
+/* ***** Defines ***** */
+
+#define HOST_MAX_SENSORS                        4 // Simulated sensor ports, see selectSensorPort()
+
+/* ***** Structures ***** */
+
+typedef void (*SensorWriter)(const uint8_t *data, uint16_t length, void *context);
+
+/* ***** Functions ***** */
+
+void init();
+uint32_t getTickCount(void);
+uint32_t getMicroseconds(void);
+void setFrameWaitHooks(bool (*wait)(uint32_t timeoutMs), void (*signal)(void));
+void setTransmitWaitHooks(bool (*wait)(uint32_t timeoutMs), void (*signal)(void));
+bool isSensorHandshakeReceived(uint32_t *readyTick);
+void selectSensorPort(uint8_t index);
+uint8_t getSelectedSensorPort(void);
+void sendFrame(const WireFrame *frame, uint16_t size);
+void broadcastFrame(uint8_t portMask, const WireFrame *frame, uint16_t size);
+void sendPacket(Packet *packet);
+Packet awaitReponsePacket();
+bool awaitReponsePacketTimeout(Packet *response, uint32_t timeoutMs);
+const WireFrame *awaitResponseFrame(uint32_t timeoutMs);
+void releaseResponseFrame(void);
+void flushReceiver(void);
+bool isResponseChecksumValid(void);
+
+void hostTransportConnect(uint8_t index, SensorWriter writer, void *context);
+void hostTransportReceive(uint8_t index, const uint8_t *data, uint16_t length);
+void hostTransportSetClock(uint32_t (*now)(void));
+
+#endif /* HOST_TRANSPORT_H */
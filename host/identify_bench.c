@@ -0,0 +1,599 @@
+/*
+ * End-to-end enrolment and identification benchmark on simulated modules in virtual time, see sensor_timing.h.
+ *
+ *   cc -O2 -DDY50_HOST -DSENSOR_COUNT=4 -I . -I lib -I host -I utils -I src -o identify_bench \
+ *      host/identify_bench.c host/sensor_timing.c host/sensor_sim.c host/host_transport.c src/flows.c lib/dy50.c \
+ *      lib/sensor_command.c lib/dy50_shard.c lib/dy50_enrol.c lib/scheduler.c lib/checksum.c lib/packet_parser.c \
+ *      lib/wire_frame.c utils/event_journal.c utils/page_map.c -lpthread -lm
+ *   identify_bench [--runs 200] [--gallery 500] [--search-per-template normal:0.6:0.05] [--save base.txt]
+ *   identify_bench --baseline base.txt
+ *   identify_bench --scenario identify,verify --gallery 100,500,1000
+ *
+ * Scenarios:
+ *   enrol              enrollFinger() of src/flows.c, as run by the enrolment application, with a new finger
+ *   enrol-duplicate    enrollFinger() with a finger of the gallery under a new ID, refused after the first sample
+ *   identify           identifyFinger() of src/flows.c, as run by the search application
+ *   identify-async     IdentifyJob of lib/scheduler.c driven by schedulerPoll()
+ *   identify-sharded   Capture on sensor 0 and shardedSearch() of lib/dy50_shard.c, the gallery spread over
+ *                      SENSOR_COUNT modules; only built with SENSOR_COUNT > 1
+ *   verify             verifyFinger() of src/flows.c, the page known from a card or PIN presented first
+ *
+ * A user approaches, puts the finger on the window for a while and leaves; the next user approaches after that.
+ * Latency runs from the finger touching the window to the result; throughput counts completed flows per minute of
+ * virtual time. Runs are deterministic for a seed, so a baseline saved with --save can be compared against later
+ * builds with --baseline; a p95 latency or throughput worse than the tolerance is reported and fails the run.
+ * --scenario and --gallery take comma separated lists; with several galleries every result is named after its
+ * scenario and gallery, e.g. verify@1000. --fault injects a fault of host/sensor_sim.h into every module, e.g.
+ * "--fault drop:any:0:0:0:100" loses every hundredth response to measure the cost of the retries of the driver; see
+ * simParseFault() for the format. It can be given up to SIM_MAX_FAULTS times.
+ */
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dy50.h"
+#include "dy50_shard.h"
+#include "dy50_enrol.h"
+#include "scheduler.h"
+#include "flows.h"
+#include "dlog.h"
+#include "sensor_sim.h"
+#include "sensor_timing.h"
+
+/* ***** Defines ***** */
+
+#define MAX_SCENARIOS                           6
+#define MAX_GALLERIES                           8
+#define DEFAULT_RUNS                            200
+#define DEFAULT_GALLERY                         500
+#define DEFAULT_TOLERANCE                       0.05
+#define RETOUCH_DELAY_US                        1000000 // Wait after lifting the finger before a user tries again
+
+/* ***** Structures ***** */
+
+typedef struct
+{
+    uint64_t startUs;
+    uint64_t endUs;
+} Press;
+
+// The person at the gate: one press to identify, one per sample to enrol
+typedef struct
+{
+    uint8_t sensor;
+    uint32_t fingerId;
+    Press presses[ENROL_MAX_SAMPLES];
+    uint8_t pressCount;
+    uint64_t firstTouchUs;      // Start of the latency, presses move when the user tries again
+} User;
+
+typedef struct
+{
+    Distribution approach;      // From the previous user leaving to the finger touching the window
+    Distribution dwell;         // Finger on the window
+    Distribution regrip;        // Enrolment, from lifting the finger to putting it back
+} UserModel;
+
+// Runs one flow for the current user; returns true if it produced the expected result
+typedef bool (*ScenarioRun)(uint32_t run);
+
+typedef struct
+{
+    const char *name;
+    ScenarioRun run;
+    uint8_t pressCount;
+    bool isSharded;             // Gallery spread over all sensors
+    bool isEnrolling;           // Run n stores under ID gallery + n, so gallery + runs must fit into SIM_CAPACITY
+} Scenario;
+
+typedef struct
+{
+    char name[32];
+    uint32_t runs;
+    uint32_t correct;
+    double p50Ms;
+    double p95Ms;
+    double p99Ms;
+    double perMinute;
+} ScenarioResult;
+
+/* ***** Variables ***** */
+
+static SensorSim sims[SENSOR_COUNT];
+static SimFault faults[SIM_MAX_FAULTS];
+static uint8_t faultCount;
+static User user;
+static UserModel userModel;
+static uint32_t gallerySize = DEFAULT_GALLERY;
+
+/* ***** Log stub ***** */
+
+void dlogWrite(DlogFormatId id, uint8_t argumentCount, uint32_t arg0, uint32_t arg1, uint32_t arg2)
+{
+    (void)id;
+    (void)argumentCount;
+    (void)arg0;
+    (void)arg1;
+    (void)arg2;
+}
+
+/* ***** User model ***** */
+
+static void updateFinger(uint8_t port, SensorSim *sim, uint64_t nowUs, void *context)
+{
+    (void)context;
+    if (port == user.sensor)
+    {
+        Press *last = &user.presses[user.pressCount - 1];
+
+        // Still waited for long after the last press, e.g. when injected faults made the flow miss it
+        if (nowUs >= last->endUs + RETOUCH_DELAY_US)
+        {
+            uint64_t dwell = last->endUs - last->startUs;
+
+            last->startUs = nowUs;
+            last->endUs = nowUs + dwell;
+        }
+        for (uint8_t i = 0; i < user.pressCount; i++)
+        {
+            if (nowUs >= user.presses[i].startUs && nowUs < user.presses[i].endUs)
+            {
+                simPlaceFinger(sim, user.fingerId);
+                return;
+            }
+        }
+    }
+    simRemoveFinger(sim);
+}
+
+static uint64_t sampleUs(const Distribution *distribution)
+{
+    return (uint64_t)(sampleDistribution(distribution) * 1000.0);
+}
+
+/**
+ * @brief  Schedule the presses of the next user, who arrives after the previous one has left
+ */
+static void nextUser(uint32_t fingerId, uint8_t pressCount, uint64_t previousLeftUs)
+{
+    uint64_t touch = previousLeftUs + sampleUs(&userModel.approach);
+
+    user.sensor = 0;
+    user.fingerId = fingerId;
+    user.pressCount = pressCount;
+    user.firstTouchUs = touch;
+    for (uint8_t i = 0; i < pressCount; i++)
+    {
+        user.presses[i].startUs = touch;
+        user.presses[i].endUs = touch + sampleUs(&userModel.dwell);
+        touch = user.presses[i].endUs + sampleUs(&userModel.regrip);
+    }
+}
+
+/* ***** Scenarios ***** */
+
+// Enrolled finger presented in a run, scattered over the gallery
+static uint32_t galleryFinger(uint32_t run)
+{
+    return 1 + (uint32_t)((run * 2654435761u) % gallerySize);
+}
+
+// ID of the user enrolled in a run, on a page after the gallery; main() rejects runs that would not fit
+static uint16_t newUserId(uint32_t run)
+{
+    return (uint16_t)(gallerySize + run);
+}
+
+static bool runEnrol(uint32_t run)
+{
+    return enrollFinger(newUserId(run)) == FINGERPRINT_OK;
+}
+
+static bool runEnrolDuplicate(uint32_t run)
+{
+    return enrollFinger(newUserId(run)) == ENROL_DUPLICATE;
+}
+
+static bool runIdentify(uint32_t run)
+{
+    FingerPageAndConfidence match = identifyFinger();
+    (void)run;
+    return match.statusCode == FINGERPRINT_OK && match.fingerprintPage == user.fingerId - 1;
+}
+
+static bool runIdentifyAsync(uint32_t run)
+{
+    IdentifyJob identify;
+
+    (void)run;
+    do
+    {
+        initIdentifyJob(&identify, NULL);
+        schedulerSubmit(&identify.job, PRIORITY_INTERACTIVE);
+        while (!schedulerIsIdle())
+        {
+            schedulerPoll();
+        }
+    } while (identify.job.result == FINGERPRINT_NOFINGER);
+    return identify.job.result == FINGERPRINT_OK && identify.match.fingerprintPage == user.fingerId - 1;
+}
+
+static bool runVerify(uint32_t run)
+{
+    FingerPageAndConfidence match = verifyFinger((uint16_t)(user.fingerId - 1));
+    (void)run;
+    return match.statusCode == FINGERPRINT_OK && match.fingerprintPage == user.fingerId - 1;
+}
+
+#if SENSOR_COUNT > 1
+static bool runIdentifySharded(uint32_t run)
+{
+    uint32_t index = user.fingerId - 1;
+    ShardMatch match;
+
+    (void)run;
+    selectSensor(0);
+    while (getImage() != FINGERPRINT_OK)
+    {
+    }
+    if (image2Tz(1) != FINGERPRINT_OK)
+    {
+        return false;
+    }
+    match = shardedSearch(0, 1);
+    return match.match.statusCode == FINGERPRINT_OK && match.sensor == index % SENSOR_COUNT &&
+           match.match.fingerprintPage == index / SENSOR_COUNT;
+}
+#endif
+
+static const Scenario scenarios[] =
+{
+    { "enrol", runEnrol, ENROL_DEFAULT_SAMPLES, false, true },
+    { "enrol-duplicate", runEnrolDuplicate, 1, false, true },
+    { "identify", runIdentify, 1, false, false },
+    { "identify-async", runIdentifyAsync, 1, false, false },
+#if SENSOR_COUNT > 1
+    { "identify-sharded", runIdentifySharded, 1, true, false },
+#endif
+    { "verify", runVerify, 1, false, false },
+};
+
+/* ***** Measurement ***** */
+
+// Fresh modules with the gallery stored, finger n on page n - 1 or spread over the sensors round robin
+static void prepareSensors(const Scenario *scenario, const TimingModel *timing, uint64_t seed)
+{
+    uint8_t sensorCount = scenario->isSharded ? SENSOR_COUNT : 1;
+
+    init();
+    timingInit(timing, seed);
+    timingSetUserHook(updateFinger, NULL);
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        simInit(&sims[i], NULL, NULL);
+        timingAttach(i, &sims[i]);
+        for (uint8_t k = 0; k < faultCount; k++)
+        {
+            simInjectFault(&sims[i], &faults[k]);
+        }
+    }
+    for (uint32_t finger = 1; finger <= gallerySize; finger++)
+    {
+        SensorSim *sim = &sims[(finger - 1) % sensorCount];
+        uint32_t page = (finger - 1) / sensorCount;
+        simMakeTemplate(sim->library[page], finger);
+        sim->isOccupied[page] = true;
+    }
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        selectSensor(i);
+        sensorBegin(DEFAULT_PASSWORD);
+    }
+    selectSensor(0);
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, uint32_t count, double fraction)
+{
+    uint32_t rank = (uint32_t)ceil(fraction * count);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static ScenarioResult runScenario(const Scenario *scenario, const TimingModel *timing, uint32_t runs,
+                                  uint64_t seed, bool isGalleryNamed)
+{
+    ScenarioResult result = { "", runs, 0, 0, 0, 0, 0 };
+    double *latencies = malloc(sizeof(double) * runs);
+    uint64_t startUs;
+    uint64_t leftUs;
+
+    if (isGalleryNamed)
+    {
+        snprintf(result.name, sizeof(result.name), "%s@%u", scenario->name, gallerySize);
+    }
+    else
+    {
+        snprintf(result.name, sizeof(result.name), "%s", scenario->name);
+    }
+    prepareSensors(scenario, timing, seed);
+    startUs = timingNowUs();
+    leftUs = startUs;
+    for (uint32_t run = 0; run < runs; run++)
+    {
+        uint32_t finger = (scenario->run == runEnrol) ? gallerySize + 1 + run : galleryFinger(run);
+        uint64_t endUs;
+
+        nextUser(finger, scenario->pressCount, leftUs);
+        result.correct += scenario->run(run);
+        endUs = timingNowUs();
+        latencies[run] = (double)(endUs - user.firstTouchUs) / 1000.0;
+        leftUs = user.presses[user.pressCount - 1].endUs > endUs ? user.presses[user.pressCount - 1].endUs : endUs;
+        timingAdvanceTo(leftUs);
+    }
+    qsort(latencies, runs, sizeof(double), compareDoubles);
+    result.p50Ms = percentile(latencies, runs, 0.50);
+    result.p95Ms = percentile(latencies, runs, 0.95);
+    result.p99Ms = percentile(latencies, runs, 0.99);
+    result.perMinute = runs * 60e6 / (double)(timingNowUs() - startUs);
+    free(latencies);
+    return result;
+}
+
+/* ***** Baselines ***** */
+
+static bool saveResults(const char *path, const ScenarioResult *results, uint8_t count)
+{
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL)
+    {
+        return false;
+    }
+    fprintf(file, "# scenario p50_ms p95_ms p99_ms per_minute\n");
+    for (uint8_t i = 0; i < count; i++)
+    {
+        fprintf(file, "%s %.3f %.3f %.3f %.3f\n", results[i].name, results[i].p50Ms, results[i].p95Ms,
+                results[i].p99Ms, results[i].perMinute);
+    }
+    return fclose(file) == 0;
+}
+
+/**
+ * @brief  Compare with a saved baseline
+ * @return Number of regressions, -1 if the baseline cannot be read
+ */
+static int compareWithBaseline(const char *path, const ScenarioResult *results, uint8_t count, double tolerance)
+{
+    FILE *file = fopen(path, "r");
+    char line[256];
+    int regressions = 0;
+
+    if (file == NULL)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char name[64];
+        ScenarioResult base;
+
+        if (line[0] == '#' || sscanf(line, "%63s %lf %lf %lf %lf", name, &base.p50Ms, &base.p95Ms, &base.p99Ms,
+                                     &base.perMinute) != 5)
+        {
+            continue;
+        }
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (strcmp(results[i].name, name) != 0)
+            {
+                continue;
+            }
+            if (results[i].p95Ms > base.p95Ms * (1 + tolerance))
+            {
+                printf("REGRESSION %s: p95 %.1f ms, baseline %.1f ms (%+.1f%%)\n", name, results[i].p95Ms,
+                       base.p95Ms, 100.0 * (results[i].p95Ms / base.p95Ms - 1));
+                regressions++;
+            }
+            if (results[i].perMinute < base.perMinute * (1 - tolerance))
+            {
+                printf("REGRESSION %s: %.2f per minute, baseline %.2f (%+.1f%%)\n", name, results[i].perMinute,
+                       base.perMinute, 100.0 * (results[i].perMinute / base.perMinute - 1));
+                regressions++;
+            }
+        }
+    }
+    fclose(file);
+    return regressions;
+}
+
+/* ***** Command line ***** */
+
+static bool isListed(const char *list, const char *name)
+{
+    size_t length = strlen(name);
+
+    while (list != NULL)
+    {
+        if (strncmp(list, name, length) == 0 && (list[length] == ',' || list[length] == '\0'))
+        {
+            return true;
+        }
+        list = strchr(list, ',');
+        list = (list != NULL) ? list + 1 : NULL;
+    }
+    return false;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --runs N --gallery N[,N...] --seed N --baud N --scenario NAME[,NAME...]\n"
+            "  --capture D --extract D --merge D --flash D --search-base D --search-per-template D --command D\n"
+            "  --approach D --dwell D --regrip D        (D: ms as fixed:A, uniform:A:B, normal:MEAN:SD, exp:A:MEAN)\n"
+            "  --save FILE --baseline FILE --tolerance F --fault KIND[:COMMAND[:SKIP[:COUNT[:VALUE[:PERIOD]]]]]\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] =
+    {
+        { "runs", required_argument, NULL, 'n' }, { "gallery", required_argument, NULL, 'g' },
+        { "seed", required_argument, NULL, 's' }, { "baud", required_argument, NULL, 'b' },
+        { "scenario", required_argument, NULL, 'x' }, { "capture", required_argument, NULL, 'c' },
+        { "extract", required_argument, NULL, 'e' }, { "merge", required_argument, NULL, 'm' },
+        { "flash", required_argument, NULL, 'f' }, { "search-base", required_argument, NULL, 'S' },
+        { "search-per-template", required_argument, NULL, 'T' }, { "command", required_argument, NULL, 'C' },
+        { "approach", required_argument, NULL, 'a' }, { "dwell", required_argument, NULL, 'd' },
+        { "regrip", required_argument, NULL, 'r' }, { "save", required_argument, NULL, 'w' },
+        { "baseline", required_argument, NULL, 'B' }, { "tolerance", required_argument, NULL, 't' },
+        { "fault", required_argument, NULL, 'F' }, { NULL, 0, NULL, 0 },
+    };
+    TimingModel timing =
+    {
+        .baudRate = UART_SENSOR_BAUD,
+        .capture = { DISTRIBUTION_NORMAL, 150, 20 },
+        .extract = { DISTRIBUTION_NORMAL, 300, 30 },
+        .merge = { DISTRIBUTION_NORMAL, 80, 10 },
+        .flashWrite = { DISTRIBUTION_NORMAL, 40, 5 },
+        .searchBase = { DISTRIBUTION_FIXED, 10, 0 },
+        .searchPerTemplate = { DISTRIBUTION_NORMAL, 0.6, 0.05 },
+        .command = { DISTRIBUTION_NORMAL, 15, 3 },
+    };
+    uint32_t runs = DEFAULT_RUNS;
+    uint64_t seed = 1;
+    const char *only = NULL;
+    const char *savePath = NULL;
+    const char *baselinePath = NULL;
+    double tolerance = DEFAULT_TOLERANCE;
+    ScenarioResult results[MAX_SCENARIOS * MAX_GALLERIES];
+    uint8_t resultCount = 0;
+    uint32_t galleries[MAX_GALLERIES] = { DEFAULT_GALLERY };
+    uint8_t galleryCount = 1;
+    int option;
+
+    userModel.approach = (Distribution){ DISTRIBUTION_NORMAL, 2000, 500 };
+    userModel.dwell = (Distribution){ DISTRIBUTION_NORMAL, 1200, 200 };
+    userModel.regrip = (Distribution){ DISTRIBUTION_NORMAL, 1000, 200 };
+
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1)
+    {
+        Distribution *target = NULL;
+        switch (option)
+        {
+            case 'n': runs = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'g':
+            {
+                char *next = optarg;
+                for (galleryCount = 0; galleryCount < MAX_GALLERIES && *next != '\0'; galleryCount++)
+                {
+                    galleries[galleryCount] = (uint32_t)strtoul(next, &next, 0);
+                    next += (*next == ',');
+                }
+                break;
+            }
+            case 's': seed = strtoull(optarg, NULL, 0); break;
+            case 'b': timing.baudRate = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'x': only = optarg; break;
+            case 'c': target = &timing.capture; break;
+            case 'e': target = &timing.extract; break;
+            case 'm': target = &timing.merge; break;
+            case 'f': target = &timing.flashWrite; break;
+            case 'S': target = &timing.searchBase; break;
+            case 'T': target = &timing.searchPerTemplate; break;
+            case 'C': target = &timing.command; break;
+            case 'a': target = &userModel.approach; break;
+            case 'd': target = &userModel.dwell; break;
+            case 'r': target = &userModel.regrip; break;
+            case 'w': savePath = optarg; break;
+            case 'B': baselinePath = optarg; break;
+            case 't': tolerance = strtod(optarg, NULL); break;
+            case 'F':
+                if (faultCount == SIM_MAX_FAULTS || !simParseFault(optarg, &faults[faultCount]))
+                {
+                    fprintf(stderr, "bad fault: %s\n", optarg);
+                    return 2;
+                }
+                faultCount++;
+                break;
+            default: usage(argv[0]); return 2;
+        }
+        if (target != NULL && !parseDistribution(optarg, target))
+        {
+            fprintf(stderr, "bad distribution: %s\n", optarg);
+            return 2;
+        }
+    }
+    for (uint8_t i = 0; i < galleryCount; i++)
+    {
+        if (galleries[i] == 0 || galleries[i] > SIM_CAPACITY)
+        {
+            galleryCount = 0;
+        }
+    }
+    if (runs == 0 || galleryCount == 0 || timing.baudRate == 0)
+    {
+        fprintf(stderr, "need 0 < runs and 0 < gallery <= %d\n", SIM_CAPACITY);
+        return 2;
+    }
+    for (uint8_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    {
+        if (!scenarios[i].isEnrolling || (only != NULL && !isListed(only, scenarios[i].name)))
+        {
+            continue;
+        }
+        for (uint8_t g = 0; g < galleryCount; g++)
+        {
+            if (runs > SIM_CAPACITY - galleries[g])
+            {
+                fprintf(stderr, "%s needs gallery + runs <= %d, not %u + %u\n", scenarios[i].name, SIM_CAPACITY,
+                        galleries[g], runs);
+                return 2;
+            }
+        }
+    }
+
+    printf("%-22s %6s %6s %10s %10s %10s %10s\n", "scenario", "runs", "ok", "p50 ms", "p95 ms", "p99 ms",
+           "per min");
+    for (uint8_t g = 0; g < galleryCount; g++)
+    {
+        gallerySize = galleries[g];
+        for (uint8_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+        {
+            ScenarioResult *result;
+            if (only != NULL && !isListed(only, scenarios[i].name))
+            {
+                continue;
+            }
+            result = &results[resultCount++];
+            *result = runScenario(&scenarios[i], &timing, runs, seed, galleryCount > 1);
+            printf("%-22s %6u %6u %10.1f %10.1f %10.1f %10.2f\n", result->name, result->runs, result->correct,
+                   result->p50Ms, result->p95Ms, result->p99Ms, result->perMinute);
+        }
+    }
+
+    if (savePath != NULL && !saveResults(savePath, results, resultCount))
+    {
+        perror(savePath);
+        return 1;
+    }
+    if (baselinePath != NULL)
+    {
+        int regressions = compareWithBaseline(baselinePath, results, resultCount, tolerance);
+        if (regressions < 0)
+        {
+            perror(baselinePath);
+            return 1;
+        }
+        return regressions > 0 ? 1 : 0;
+    }
+    return 0;
+}
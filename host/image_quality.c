@@ -0,0 +1,376 @@
+/*
+ * Fingerprint image quality, see image_quality.h. The kernels are chosen at compile time: build with -march=native
+ * (or -mavx2) for AVX2, SSE2 is the x86-64 baseline, other hosts use the portable loops.
+ */
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "image_quality.h"
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+typedef struct
+{
+    const uint8_t *const *images;
+    uint32_t count;
+    const QualityThresholds *thresholds;
+    ImageQuality *qualities;
+    atomic_uint_fast32_t next;
+} BatchContext;
+
+void qualityDefaultThresholds(QualityThresholds *thresholds)
+{
+    thresholds->minForeground = 0.25f;
+    thresholds->minBlockDeviation = 24.0f;
+    thresholds->minContrast = 40.0f;
+    thresholds->minCoherence = 0.35f;
+    thresholds->maxWetness = 0.15f;
+}
+
+const char *qualityKernelName(void)
+{
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+const char *qualityVerdictName(uint8_t verdict)
+{
+    static const char *names[] = { "ok", "no-finger", "low-contrast", "smudged", "wet", "dry" };
+    return verdict < sizeof(names) / sizeof(names[0]) ? names[verdict] : "?";
+}
+
+/* ***** Kernels ***** */
+
+/**
+ * @brief  Expand the 4-bit pixels to 8 bits (n * 17) and replicate the border pixels
+ */
+void qualityDecode(const uint8_t *packed, QualityWorkspace *work)
+{
+    for (uint16_t y = 0; y < QUALITY_IMAGE_HEIGHT; y++)
+    {
+        const uint8_t *in = &packed[y * QUALITY_IMAGE_WIDTH / 2];
+        uint8_t *out = &work->pixels[(y + 1) * QUALITY_STRIDE + 1];
+        uint16_t x = 0;
+#if defined(__SSE2__)
+        const __m128i lowMask = _mm_set1_epi8(0x0F);
+        for (; x < QUALITY_IMAGE_WIDTH / 2; x += 16)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i *)&in[x]);
+            __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), lowMask);
+            __m128i low = _mm_and_si128(bytes, lowMask);
+            high = _mm_or_si128(high, _mm_slli_epi16(high, 4));
+            low = _mm_or_si128(low, _mm_slli_epi16(low, 4));
+            _mm_storeu_si128((__m128i *)&out[2 * x], _mm_unpacklo_epi8(high, low));
+            _mm_storeu_si128((__m128i *)&out[2 * x + 16], _mm_unpackhi_epi8(high, low));
+        }
+#endif
+        for (; x < QUALITY_IMAGE_WIDTH / 2; x++)
+        {
+            out[2 * x] = (uint8_t)((in[x] >> 4) * 17);
+            out[2 * x + 1] = (uint8_t)((in[x] & 0x0F) * 17);
+        }
+        out[-1] = out[0];
+        out[QUALITY_IMAGE_WIDTH] = out[QUALITY_IMAGE_WIDTH - 1];
+    }
+    memcpy(work->pixels, &work->pixels[QUALITY_STRIDE], QUALITY_STRIDE);
+    memcpy(&work->pixels[(QUALITY_IMAGE_HEIGHT + 1) * QUALITY_STRIDE],
+           &work->pixels[QUALITY_IMAGE_HEIGHT * QUALITY_STRIDE], QUALITY_STRIDE);
+}
+
+#if defined(__AVX2__)
+static inline __m256i load16(const uint8_t *pixels)
+{
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)pixels));
+}
+
+static inline int64_t sumLanes(__m256i vector)
+{
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(vector), _mm256_extracti128_si256(vector, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+#endif
+
+/**
+ * @brief  Pixel sums, extremes and Sobel gradient moments of one block; a block row is one 16-lane vector
+ */
+static void sumBlock(QualityWorkspace *work, uint8_t bx, uint8_t by, uint8_t *minimum, uint8_t *maximum)
+{
+    const uint8_t *row = &work->pixels[(by * QUALITY_BLOCK_SIZE + 1) * QUALITY_STRIDE + bx * QUALITY_BLOCK_SIZE + 1];
+#if defined(__AVX2__)
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    __m256i squares = _mm256_setzero_si256();
+    __m256i xx = _mm256_setzero_si256();
+    __m256i yy = _mm256_setzero_si256();
+    __m256i xy = _mm256_setzero_si256();
+    __m128i low = _mm_set1_epi8((char)0xFF);
+    __m128i high = _mm_setzero_si128();
+    uint8_t lanes[16];
+
+    for (uint8_t y = 0; y < QUALITY_BLOCK_SIZE; y++, row += QUALITY_STRIDE)
+    {
+        const uint8_t *up = row - QUALITY_STRIDE;
+        const uint8_t *down = row + QUALITY_STRIDE;
+        __m128i bytes = _mm_loadu_si128((const __m128i *)row);
+        __m256i centre = _mm256_cvtepu8_epi16(bytes);
+        __m256i left = _mm256_add_epi16(_mm256_add_epi16(load16(up - 1), load16(down - 1)),
+                                        _mm256_slli_epi16(load16(row - 1), 1));
+        __m256i right = _mm256_add_epi16(_mm256_add_epi16(load16(up + 1), load16(down + 1)),
+                                         _mm256_slli_epi16(load16(row + 1), 1));
+        __m256i top = _mm256_add_epi16(_mm256_add_epi16(load16(up - 1), load16(up + 1)),
+                                       _mm256_slli_epi16(load16(up), 1));
+        __m256i bottom = _mm256_add_epi16(_mm256_add_epi16(load16(down - 1), load16(down + 1)),
+                                          _mm256_slli_epi16(load16(down), 1));
+        __m256i gx = _mm256_sub_epi16(right, left);
+        __m256i gy = _mm256_sub_epi16(bottom, top);
+
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(centre, ones));
+        squares = _mm256_add_epi32(squares, _mm256_madd_epi16(centre, centre));
+        xx = _mm256_add_epi32(xx, _mm256_madd_epi16(gx, gx));
+        yy = _mm256_add_epi32(yy, _mm256_madd_epi16(gy, gy));
+        xy = _mm256_add_epi32(xy, _mm256_madd_epi16(gx, gy));
+        low = _mm_min_epu8(low, bytes);
+        high = _mm_max_epu8(high, bytes);
+    }
+    work->sum[by][bx] = (uint32_t)sumLanes(sum);
+    work->sumSquares[by][bx] = (uint32_t)sumLanes(squares);
+    work->gxx[by][bx] = sumLanes(xx);
+    work->gyy[by][bx] = sumLanes(yy);
+    work->gxy[by][bx] = sumLanes(xy);
+    _mm_storeu_si128((__m128i *)lanes, low);
+    *minimum = 255;
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        *minimum = lanes[i] < *minimum ? lanes[i] : *minimum;
+    }
+    _mm_storeu_si128((__m128i *)lanes, high);
+    *maximum = 0;
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        *maximum = lanes[i] > *maximum ? lanes[i] : *maximum;
+    }
+#else
+    uint32_t sum = 0;
+    uint32_t squares = 0;
+    int64_t xx = 0;
+    int64_t yy = 0;
+    int64_t xy = 0;
+
+    *minimum = 255;
+    *maximum = 0;
+    for (uint8_t y = 0; y < QUALITY_BLOCK_SIZE; y++, row += QUALITY_STRIDE)
+    {
+        const uint8_t *up = row - QUALITY_STRIDE;
+        const uint8_t *down = row + QUALITY_STRIDE;
+        for (uint8_t x = 0; x < QUALITY_BLOCK_SIZE; x++)
+        {
+            int32_t gx = (up[x + 1] + 2 * row[x + 1] + down[x + 1]) - (up[x - 1] + 2 * row[x - 1] + down[x - 1]);
+            int32_t gy = (down[x - 1] + 2 * down[x] + down[x + 1]) - (up[x - 1] + 2 * up[x] + up[x + 1]);
+            sum += row[x];
+            squares += (uint32_t)row[x] * row[x];
+            xx += gx * gx;
+            yy += gy * gy;
+            xy += gx * gy;
+            *minimum = row[x] < *minimum ? row[x] : *minimum;
+            *maximum = row[x] > *maximum ? row[x] : *maximum;
+        }
+    }
+    work->sum[by][bx] = sum;
+    work->sumSquares[by][bx] = squares;
+    work->gxx[by][bx] = xx;
+    work->gyy[by][bx] = yy;
+    work->gxy[by][bx] = xy;
+#endif
+}
+
+/**
+ * @brief  Pixels of a block darker than threshold
+ */
+static uint32_t countDark(const QualityWorkspace *work, uint8_t bx, uint8_t by, uint8_t threshold)
+{
+    const uint8_t *row = &work->pixels[(by * QUALITY_BLOCK_SIZE + 1) * QUALITY_STRIDE + bx * QUALITY_BLOCK_SIZE + 1];
+    uint32_t count = 0;
+
+    if (threshold == 0)
+    {
+        return 0;
+    }
+#if defined(__SSE2__)
+    const __m128i limit = _mm_set1_epi8((char)(threshold - 1));
+    for (uint8_t y = 0; y < QUALITY_BLOCK_SIZE; y++, row += QUALITY_STRIDE)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)row);
+        __m128i isDark = _mm_cmpeq_epi8(_mm_min_epu8(bytes, limit), bytes);
+        count += (uint32_t)__builtin_popcount((unsigned)_mm_movemask_epi8(isDark));
+    }
+#else
+    for (uint8_t y = 0; y < QUALITY_BLOCK_SIZE; y++, row += QUALITY_STRIDE)
+    {
+        for (uint8_t x = 0; x < QUALITY_BLOCK_SIZE; x++)
+        {
+            count += row[x] < threshold;
+        }
+    }
+#endif
+    return count;
+}
+
+/* ***** Metrics ***** */
+
+/**
+ * @brief  Score one packed image
+ * @param  packed                            - QUALITY_IMAGE_SIZE bytes as uploaded by the module
+ */
+void qualityScore(const uint8_t *packed, const QualityThresholds *thresholds, QualityWorkspace *work,
+                  ImageQuality *quality)
+{
+    const float pixelsPerBlock = QUALITY_BLOCK_SIZE * QUALITY_BLOCK_SIZE;
+    uint8_t minimum[QUALITY_BLOCKS_Y][QUALITY_BLOCKS_X];
+    uint8_t maximum[QUALITY_BLOCKS_Y][QUALITY_BLOCKS_X];
+    uint32_t foregroundBlocks = 0;
+    double deviationTotal = 0;
+    double coherenceTotal = 0;
+    uint32_t darkPixels = 0;
+
+    memset(quality, 0, sizeof(*quality));
+    qualityDecode(packed, work);
+    for (uint8_t by = 0; by < QUALITY_BLOCKS_Y; by++)
+    {
+        for (uint8_t bx = 0; bx < QUALITY_BLOCKS_X; bx++)
+        {
+            float mean;
+            float variance;
+            float deviation;
+            double moments;
+
+            sumBlock(work, bx, by, &minimum[by][bx], &maximum[by][bx]);
+            mean = work->sum[by][bx] / pixelsPerBlock;
+            variance = work->sumSquares[by][bx] / pixelsPerBlock - mean * mean;
+            deviation = variance > 0 ? sqrtf(variance) : 0;
+            if (deviation < thresholds->minBlockDeviation)
+            {
+                continue;
+            }
+            quality->mask[by] |= (uint16_t)(1u << bx);
+            foregroundBlocks++;
+            deviationTotal += deviation;
+            moments = (double)(work->gxx[by][bx] + work->gyy[by][bx]);
+            if (moments > 0)
+            {
+                double difference = (double)(work->gxx[by][bx] - work->gyy[by][bx]);
+                coherenceTotal += sqrt(difference * difference + 4.0 * (double)work->gxy[by][bx] *
+                                       (double)work->gxy[by][bx]) / moments;
+            }
+        }
+    }
+
+    quality->foreground = (float)foregroundBlocks / (QUALITY_BLOCKS_X * QUALITY_BLOCKS_Y);
+    if (foregroundBlocks > 0)
+    {
+        // Ridges are the pixels below the middle between the block minimum and maximum, which follows uneven pressure
+        for (uint8_t by = 0; by < QUALITY_BLOCKS_Y; by++)
+        {
+            for (uint8_t bx = 0; bx < QUALITY_BLOCKS_X; bx++)
+            {
+                if (quality->mask[by] & (1u << bx))
+                {
+                    darkPixels += countDark(work, bx, by, (uint8_t)((minimum[by][bx] + maximum[by][bx] + 1) / 2));
+                }
+            }
+        }
+        quality->contrast = (float)(deviationTotal / foregroundBlocks);
+        quality->coherence = (float)(coherenceTotal / foregroundBlocks);
+        quality->wetness = darkPixels / (pixelsPerBlock * foregroundBlocks) - 0.5f;
+    }
+
+    if (quality->foreground < thresholds->minForeground)
+    {
+        quality->verdict = QUALITY_NO_FINGER;
+    }
+    else if (quality->contrast < thresholds->minContrast)
+    {
+        quality->verdict = QUALITY_LOW_CONTRAST;
+    }
+    else if (quality->coherence < thresholds->minCoherence)
+    {
+        quality->verdict = QUALITY_SMUDGED;
+    }
+    else if (quality->wetness > thresholds->maxWetness)
+    {
+        quality->verdict = QUALITY_WET;
+    }
+    else if (quality->wetness < -thresholds->maxWetness)
+    {
+        quality->verdict = QUALITY_DRY;
+    }
+    else
+    {
+        quality->verdict = QUALITY_OK;
+    }
+}
+
+/* ***** Batches ***** */
+
+static void *scoreWorker(void *argument)
+{
+    BatchContext *batch = (BatchContext *)argument;
+    QualityWorkspace *work = malloc(sizeof(QualityWorkspace));
+    uint32_t index;
+
+    if (work == NULL)
+    {
+        return NULL;
+    }
+    while ((index = (uint32_t)atomic_fetch_add(&batch->next, 1)) < batch->count)
+    {
+        qualityScore(batch->images[index], batch->thresholds, work, &batch->qualities[index]);
+    }
+    free(work);
+    return NULL;
+}
+
+/**
+ * @brief  Score many images on several threads; the images are handed out one at a time
+ * @param  threadCount                       - Worker threads, 0 for one per online CPU
+ * @return 0 on success, -1 if no thread could be started
+ */
+int qualityScoreBatch(const uint8_t *const *images, uint32_t count, const QualityThresholds *thresholds,
+                      uint8_t threadCount, ImageQuality *qualities)
+{
+    pthread_t threads[QUALITY_MAX_THREADS];
+    BatchContext batch = { images, count, thresholds, qualities, 0 };
+    uint8_t started = 0;
+
+    if (threadCount == 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = (uint8_t)(online < 1 ? 1 : online > QUALITY_MAX_THREADS ? QUALITY_MAX_THREADS : online);
+    }
+    if (threadCount > QUALITY_MAX_THREADS)
+    {
+        threadCount = QUALITY_MAX_THREADS;
+    }
+    for (uint8_t i = 0; i < threadCount; i++)
+    {
+        if (pthread_create(&threads[started], NULL, scoreWorker, &batch) == 0)
+        {
+            started++;
+        }
+    }
+    for (uint8_t i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    return started > 0 ? 0 : -1;
+}
@@ -0,0 +1,85 @@
+#ifndef IMAGE_QUALITY_H
+#define IMAGE_QUALITY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Quality metrics of fingerprint images uploaded from the module (RPC_OP_UPLOAD_IMAGE), to find out offline why
+ * image2Tz() fails with FINGERPRINT_IMAGEMESS or FINGERPRINT_FEATUREFAIL and to tune capture guidance.
+ *
+ * An image is 256 x 288 pixels of 4 bits, two per byte with the left pixel in the high nibble. It is decoded to 8 bits
+ * and cut into 16 x 16 blocks. For every block the kernels sum the pixels, their squares and the products of the
+ * Sobel gradients in one pass; with AVX2 a block row is exactly one vector of 16 lanes. The metrics follow from the
+ * block sums:
+ *   foreground     blocks whose standard deviation reaches minBlockDeviation hold the finger
+ *   contrast       mean standard deviation of the foreground blocks, in grey levels
+ *   coherence      mean ridge-orientation coherence of the foreground blocks, |(Gxx - Gyy, 2 Gxy)| / (Gxx + Gyy);
+ *                  1 for parallel ridges, 0 for smudges and noise
+ *   wetness        share of dark (ridge) pixels in the foreground minus one half; wet fingers merge ridges into dark
+ *                  areas (positive), dry ones break them up (negative)
+ */
+
+/* ***** Defines ***** */
+
+#define QUALITY_IMAGE_WIDTH                     256
+#define QUALITY_IMAGE_HEIGHT                    288
+#define QUALITY_IMAGE_SIZE                      (QUALITY_IMAGE_WIDTH * QUALITY_IMAGE_HEIGHT / 2)
+#define QUALITY_BLOCK_SIZE                      16
+#define QUALITY_BLOCKS_X                        (QUALITY_IMAGE_WIDTH / QUALITY_BLOCK_SIZE)
+#define QUALITY_BLOCKS_Y                        (QUALITY_IMAGE_HEIGHT / QUALITY_BLOCK_SIZE)
+#define QUALITY_STRIDE                          (QUALITY_IMAGE_WIDTH + 2) // Decoded rows with a border pixel
+#define QUALITY_MAX_THREADS                     64
+
+// Verdicts, in order of precedence
+#define QUALITY_OK                              0
+#define QUALITY_NO_FINGER                       1
+#define QUALITY_LOW_CONTRAST                    2
+#define QUALITY_SMUDGED                         3
+#define QUALITY_WET                             4
+#define QUALITY_DRY                             5
+
+/* ***** Structures ***** */
+
+typedef struct
+{
+    float minForeground;        // Fraction of foreground blocks below which no finger is reported
+    float minBlockDeviation;    // Standard deviation of a foreground block
+    float minContrast;
+    float minCoherence;
+    float maxWetness;           // Wetness above is wet, below -maxWetness dry
+} QualityThresholds;
+
+typedef struct
+{
+    float contrast;
+    float coherence;
+    float foreground;           // Fraction of the blocks in the mask
+    float wetness;
+    uint8_t verdict;            // QUALITY_ code
+    uint16_t mask[QUALITY_BLOCKS_Y]; // Foreground blocks, bit x of row y
+} ImageQuality;
+
+// Scratch memory of one thread
+typedef struct
+{
+    uint8_t pixels[(QUALITY_IMAGE_HEIGHT + 2) * QUALITY_STRIDE]; // Decoded image with replicated border
+    uint32_t sum[QUALITY_BLOCKS_Y][QUALITY_BLOCKS_X];
+    uint32_t sumSquares[QUALITY_BLOCKS_Y][QUALITY_BLOCKS_X];
+    int64_t gxx[QUALITY_BLOCKS_Y][QUALITY_BLOCKS_X];
+    int64_t gyy[QUALITY_BLOCKS_Y][QUALITY_BLOCKS_X];
+    int64_t gxy[QUALITY_BLOCKS_Y][QUALITY_BLOCKS_X];
+} QualityWorkspace;
+
+/* ***** Functions ***** */
+
+void qualityDefaultThresholds(QualityThresholds *thresholds);
+void qualityDecode(const uint8_t *packed, QualityWorkspace *work);
+void qualityScore(const uint8_t *packed, const QualityThresholds *thresholds, QualityWorkspace *work,
+                  ImageQuality *quality);
+int qualityScoreBatch(const uint8_t *const *images, uint32_t count, const QualityThresholds *thresholds,
+                      uint8_t threadCount, ImageQuality *qualities);
+const char *qualityVerdictName(uint8_t verdict);
+const char *qualityKernelName(void);
+
+#endif /* IMAGE_QUALITY_H */
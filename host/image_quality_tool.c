@@ -0,0 +1,308 @@
+/*
+ * Batch scoring and capture of fingerprint images, see image_quality.h.
+ *
+ *   cc -O3 -march=native -pthread -I lib -I host -I utils -o image_quality host/image_quality_tool.c \
+ *      host/image_quality.c host/rpc_client.c lib/rpc_protocol.c -lm
+ *
+ *   image_quality [-j threads] [--csv] [thresholds] file...
+ *   image_quality capture (-d device [-b baud] | -u socket) [-n sensor] [-c count] [thresholds] file
+ *
+ * Files hold raw uploads back to back, QUALITY_IMAGE_SIZE bytes per image, as appended by capture. Scoring prints a
+ * summary per verdict and the throughput, and with --csv one line per image. capture waits for a finger, uploads
+ * the image, converts it with image2Tz() like an enrolment does and prints the verdict next to the conversion result,
+ * so that IMAGEMESS and FEATUREFAIL can be related to the metrics.
+ *
+ * Thresholds: --min-foreground F --min-block-deviation F --min-contrast F --min-coherence F --max-wetness F
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "image_quality.h"
+#include "rpc_client.h"
+#include "config.h"
+
+#define MAX_FILES                               256
+#define VERDICT_COUNT                           (QUALITY_DRY + 1)
+#define CAPTURE_BUFFER                          1
+
+typedef struct
+{
+    const char *path;
+    const uint8_t *data;
+    size_t size;
+} InputFile;
+
+static double nowSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void printQuality(FILE *out, const char *path, uint32_t index, const ImageQuality *quality)
+{
+    fprintf(out, "%s,%u,%s,%.3f,%.1f,%.3f,%+.3f\n", path, index, qualityVerdictName(quality->verdict),
+            quality->foreground, quality->contrast, quality->coherence, quality->wetness);
+}
+
+static int mapFile(InputFile *file, const char *path)
+{
+    struct stat status;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    file->path = path;
+    if (fd < 0 || fstat(fd, &status) != 0)
+    {
+        return -1;
+    }
+    file->size = (size_t)status.st_size - (size_t)status.st_size % QUALITY_IMAGE_SIZE;
+    file->data = file->size > 0 ? mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (file->data == MAP_FAILED)
+    {
+        return -1;
+    }
+    if ((size_t)status.st_size != file->size)
+    {
+        fprintf(stderr, "%s: ignoring %zu trailing bytes\n", path, (size_t)status.st_size - file->size);
+    }
+    return 0;
+}
+
+static int scoreFiles(char **paths, int pathCount, const QualityThresholds *thresholds, uint8_t threadCount,
+                      bool isCsv)
+{
+    InputFile files[MAX_FILES];
+    const uint8_t **images;
+    ImageQuality *qualities;
+    uint32_t verdicts[VERDICT_COUNT] = {0};
+    uint32_t count = 0;
+    uint32_t next = 0;
+    double start;
+    double elapsed;
+
+    if (pathCount > MAX_FILES)
+    {
+        fprintf(stderr, "at most %d files\n", MAX_FILES);
+        return 2;
+    }
+    for (int i = 0; i < pathCount; i++)
+    {
+        if (mapFile(&files[i], paths[i]) != 0)
+        {
+            fprintf(stderr, "%s: %s\n", paths[i], strerror(errno));
+            return 1;
+        }
+        count += (uint32_t)(files[i].size / QUALITY_IMAGE_SIZE);
+    }
+    images = malloc((count + 1) * sizeof(*images));
+    qualities = malloc((count + 1) * sizeof(*qualities));
+    if (images == NULL || qualities == NULL)
+    {
+        perror("malloc");
+        return 1;
+    }
+    for (int i = 0; i < pathCount; i++)
+    {
+        for (size_t offset = 0; offset < files[i].size; offset += QUALITY_IMAGE_SIZE)
+        {
+            images[next++] = files[i].data + offset;
+        }
+    }
+
+    start = nowSeconds();
+    if (qualityScoreBatch(images, count, thresholds, threadCount, qualities) != 0)
+    {
+        perror("pthread_create");
+        return 1;
+    }
+    elapsed = nowSeconds() - start;
+
+    next = 0;
+    if (isCsv)
+    {
+        printf("file,image,verdict,foreground,contrast,coherence,wetness\n");
+    }
+    for (int i = 0; i < pathCount; i++)
+    {
+        for (uint32_t image = 0; image < files[i].size / QUALITY_IMAGE_SIZE; image++, next++)
+        {
+            verdicts[qualities[next].verdict]++;
+            if (isCsv)
+            {
+                printQuality(stdout, files[i].path, image, &qualities[next]);
+            }
+        }
+        if (files[i].data != NULL)
+        {
+            munmap((void *)files[i].data, files[i].size);
+        }
+    }
+    for (uint8_t verdict = 0; verdict < VERDICT_COUNT; verdict++)
+    {
+        fprintf(stderr, "%-13s %8u  %5.1f%%\n", qualityVerdictName(verdict), verdicts[verdict],
+                count > 0 ? 100.0 * verdicts[verdict] / count : 0);
+    }
+    fprintf(stderr, "%u images in %.3f s, %.0f images/s (%s kernels)\n", count, elapsed,
+            elapsed > 0 ? count / elapsed : 0, qualityKernelName());
+    free(images);
+    free(qualities);
+    return 0;
+}
+
+static int waitForFinger(RpcClient *client, bool isPresent)
+{
+    RpcFrame response;
+
+    for (;;)
+    {
+        if (rpcClientCall(client, RPC_OP_GET_IMAGE, NULL, 0, &response) != 0)
+        {
+            return -1;
+        }
+        if ((response.payload[0] == 0) == isPresent)
+        {
+            return 0;
+        }
+        usleep(50000);
+    }
+}
+
+static int capture(RpcClient *client, const char *path, uint32_t count, const QualityThresholds *thresholds)
+{
+    FILE *output = fopen(path, "ab");
+    QualityWorkspace *work = malloc(sizeof(QualityWorkspace));
+    uint8_t image[QUALITY_IMAGE_SIZE];
+    uint8_t slot = CAPTURE_BUFFER;
+
+    if (output == NULL || work == NULL)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    printf("image,verdict,foreground,contrast,coherence,wetness,image2Tz\n");
+    for (uint32_t i = 0; i < count; i++)
+    {
+        ImageQuality quality;
+        RpcFrame response;
+        size_t length;
+
+        fprintf(stderr, "place a finger (%u of %u)\n", i + 1, count);
+        if (waitForFinger(client, true) != 0 ||
+            rpcClientUploadImage(client, image, sizeof(image), &length) != 0 || length != sizeof(image) ||
+            rpcClientCall(client, RPC_OP_IMAGE2TZ, &slot, 1, &response) != 0)
+        {
+            fprintf(stderr, "capture failed: %s\n", strerror(errno));
+            break;
+        }
+        if (fwrite(image, 1, sizeof(image), output) != sizeof(image))
+        {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            break;
+        }
+        qualityScore(image, thresholds, work, &quality);
+        printf("%u,%s,%.3f,%.1f,%.3f,%+.3f,0x%02X\n", i, qualityVerdictName(quality.verdict), quality.foreground,
+               quality.contrast, quality.coherence, quality.wetness, response.payload[0]);
+        fflush(stdout);
+        fprintf(stderr, "lift the finger\n");
+        if (waitForFinger(client, false) != 0)
+        {
+            break;
+        }
+    }
+    free(work);
+    return fclose(output) == 0 ? 0 : 1;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [-j threads] [--csv] [thresholds] file...\n"
+            "       %s capture (-d device [-b baud] | -u socket) [-n sensor] [-c count] [thresholds] file\n"
+            "thresholds: --min-foreground F --min-block-deviation F --min-contrast F --min-coherence F "
+            "--max-wetness F\n", program, program);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] =
+    {
+        { "csv", no_argument, NULL, 'C' }, { "min-foreground", required_argument, NULL, 'F' },
+        { "min-block-deviation", required_argument, NULL, 'D' }, { "min-contrast", required_argument, NULL, 'K' },
+        { "min-coherence", required_argument, NULL, 'H' }, { "max-wetness", required_argument, NULL, 'W' },
+        { NULL, 0, NULL, 0 },
+    };
+    QualityThresholds thresholds;
+    bool isCapture = argc > 1 && strcmp(argv[1], "capture") == 0;
+    bool isCsv = false;
+    const char *device = NULL;
+    const char *socketPath = NULL;
+    int baudRate = UART_SENSOR_BAUD;
+    int sensor = -1;
+    uint32_t count = 1;
+    uint8_t threadCount = 0;
+    RpcClient client;
+    int option;
+
+    qualityDefaultThresholds(&thresholds);
+    optind = isCapture ? 2 : 1;
+    while ((option = getopt_long(argc, argv, "j:d:b:u:n:c:", options, NULL)) != -1)
+    {
+        switch (option)
+        {
+            case 'j': threadCount = (uint8_t)atoi(optarg); break;
+            case 'C': isCsv = true; break;
+            case 'F': thresholds.minForeground = strtof(optarg, NULL); break;
+            case 'D': thresholds.minBlockDeviation = strtof(optarg, NULL); break;
+            case 'K': thresholds.minContrast = strtof(optarg, NULL); break;
+            case 'H': thresholds.minCoherence = strtof(optarg, NULL); break;
+            case 'W': thresholds.maxWetness = strtof(optarg, NULL); break;
+            case 'd': device = optarg; break;
+            case 'b': baudRate = atoi(optarg); break;
+            case 'u': socketPath = optarg; break;
+            case 'n': sensor = atoi(optarg); break;
+            case 'c': count = (uint32_t)strtoul(optarg, NULL, 0); break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (!isCapture)
+    {
+        if (optind == argc)
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        return scoreFiles(&argv[optind], argc - optind, &thresholds, threadCount, isCsv);
+    }
+
+    if (optind != argc - 1 || (device == NULL) == (socketPath == NULL))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if ((socketPath != NULL ? rpcClientConnect(&client, socketPath) : rpcClientOpen(&client, device, baudRate)) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", socketPath != NULL ? socketPath : device, strerror(errno));
+        return 1;
+    }
+    if (sensor >= 0)
+    {
+        uint8_t index = (uint8_t)sensor;
+        RpcFrame response;
+        if (rpcClientCall(&client, RPC_OP_SELECT_SENSOR, &index, 1, &response) != 0 || response.payload[0] != 0)
+        {
+            fprintf(stderr, "cannot select sensor %d\n", sensor);
+            return 1;
+        }
+    }
+    option = capture(&client, argv[optind], count, &thresholds);
+    rpcClientClose(&client);
+    return option;
+}
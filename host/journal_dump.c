@@ -0,0 +1,94 @@
+/*
+ * Bulk read of the access event journal kept by utils/event_journal.c on the board.
+ *
+ *   cc -O2 -I lib -I host -I utils -o journal_dump host/journal_dump.c host/rpc_client.c lib/rpc_protocol.c
+ *   journal_dump -d device [-b baud] [-f first] [-o raw]
+ *
+ * Prints one CSV line per record, oldest first. -f starts at a sequence number, e.g. one past the last record of
+ * the previous dump, so that a collector only fetches what is new. -o also writes the records as read from flash.
+ * Sequence numbers missing between records were dropped on the board (stage full) or overwritten by the ring.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "event_journal.h"
+#include "rpc_client.h"
+#include "config.h"
+
+#define JOURNAL_CAPACITY                        (JOURNAL_SECTOR_COUNT * JOURNAL_RECORDS_PER_SECTOR)
+
+static const char *eventName(uint8_t event)
+{
+    switch (event)
+    {
+        case JOURNAL_EVENT_IDENTIFY: return "identify";
+        case JOURNAL_EVENT_VERIFY:   return "verify";
+        default:                     return "?";
+    }
+}
+
+static void printRecord(const uint8_t *data)
+{
+    printf("%u,%u,%u,%s,0x%02X,%u,%u\n", rpcGetU32(&data[0]), data[14], rpcGetU32(&data[4]), eventName(data[12]),
+           data[13], rpcGetU16(&data[8]), rpcGetU16(&data[10]));
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t records[JOURNAL_CAPACITY * JOURNAL_RECORD_SIZE];
+    const char *device = NULL;
+    const char *rawPath = NULL;
+    int baudRate = UART_PRINT_BAUD;
+    uint32_t first = 0;
+    RpcClient client;
+    size_t length;
+    int option;
+
+    while ((option = getopt(argc, argv, "d:b:f:o:")) != -1)
+    {
+        switch (option)
+        {
+            case 'd': device = optarg; break;
+            case 'b': baudRate = atoi(optarg); break;
+            case 'f': first = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'o': rawPath = optarg; break;
+            default: device = NULL; optind = argc + 1; break;
+        }
+    }
+    if (device == NULL || optind != argc)
+    {
+        fprintf(stderr, "usage: %s -d device [-b baud] [-f first] [-o raw]\n", argv[0]);
+        return 2;
+    }
+    if (rpcClientOpen(&client, device, baudRate) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", device, strerror(errno));
+        return 1;
+    }
+    if (rpcClientReadJournal(&client, first, records, sizeof(records), &length) != 0)
+    {
+        fprintf(stderr, "reading the journal failed: %s\n", strerror(errno));
+        rpcClientClose(&client);
+        return 1;
+    }
+    rpcClientClose(&client);
+
+    printf("sequence,session,tick_ms,event,status,page,confidence\n");
+    for (size_t offset = 0; offset + JOURNAL_RECORD_SIZE <= length; offset += JOURNAL_RECORD_SIZE)
+    {
+        printRecord(&records[offset]);
+    }
+    if (rawPath != NULL)
+    {
+        FILE *raw = fopen(rawPath, "wb");
+        if (raw == NULL || fwrite(records, 1, length, raw) != length || fclose(raw) != 0)
+        {
+            fprintf(stderr, "%s: %s\n", rawPath, strerror(errno));
+            return 1;
+        }
+    }
+    fprintf(stderr, "%zu records\n", length / JOURNAL_RECORD_SIZE);
+    return 0;
+}
@@ -0,0 +1,572 @@
+/*
+ * Stack and RAM budget report of a firmware build, from the outputs of the TI Arm compiler and linker.
+ *
+ *   cc -O2 -o ram_report host/ram_report.c
+ *   ram_report [-m map] [-e caller=callee]... [-u bytes] [listing.asm]...
+ *
+ * The listings are the assembly files kept with --keep_asm (-k, set in the Debug configuration of the CCS project),
+ * i.e. the .asm files in Debug and its lib, utils and src directories. The compiler writes the frame size of every
+ * function in the comment block above it; together with the BL instructions of the function bodies that gives the
+ * worst-case stack depth of every entry point in commands[] and handlers[], printed with its deepest call chain.
+ * The worst case of the whole program is the deepest command, plus the exception frame and the deepest interrupt
+ * handler, as all handlers run at the same priority and do not nest.
+ *
+ * Calls through function pointers cannot be followed; the report names the functions that make them, and -e adds
+ * the possible targets as calls, e.g. -e uploadModel=streamDataPacket. Callees without a listing, such as the
+ * run-time library or driverlib, count -u bytes each (0 by default) and are listed at the end.
+ *
+ * map is the linker map file, Debug/DY50Lib.map. Its module summary gives the static RAM (.data and .bss) of every
+ * object file, which is checked against ramBudgets[], and the stack size. Objects of this project without a budget
+ * fail the check, so that every new buffer is accounted for; library objects only count towards the total.
+ *
+ * Exits with 1 when the worst-case stack depth exceeds the stack or any module exceeds its budget.
+ */
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_FUNCTIONS                           2048
+#define MAX_NAME                                64
+#define SRAM_SIZE                               0x8000 // SRAM length in tm4c123gh6pm.cmd
+#define EXCEPTION_FRAME_SIZE                    108    // Stacked registers with the FPU context, plus alignment
+
+typedef struct
+{
+    char name[MAX_NAME];
+    uint32_t frameSize;         // Bytes, -1 for callees without a listing
+    uint32_t *callees;          // Indices into functions
+    uint16_t calleeCount;
+    uint16_t calleeCapacity;
+    bool hasIndirectCall;
+    bool isVisited;
+    bool isOnPath;              // Being visited, a call back to it is recursion
+    bool isRecursive;
+    uint32_t depth;             // Worst case of this function and its callees
+    int32_t deepestCallee;      // Index of the callee on the deepest path, -1 for none
+} Function;
+
+typedef struct
+{
+    const char *module;
+    uint32_t bytes;             // .data and .bss
+} RamBudget;
+
+// Entry points run from main() or the RPC loop
+static const char *const commands[] = {
+    "main", "rpcServerPoll", "journalPoll", "dlogFlush", "init", "sensorBegin", "getImage", "image2Tz",
+    "createModel", "storeModel", "loadModel", "deleteModel", "emptyDatabase", "fingerSearch", "fingerFastSearch",
+    "fingerVerify", "fingerMatch", "getTemplateCount", "getParameters", "uploadModel", "uploadImage",
+    "beginDownloadModel", "sendDataPacket", "setSystemParameter", "checkPassword", "LEDcontrol", "enrollFinger",
+    "identifyFinger", "verifyFinger",
+};
+
+// Entry points of the vector table in tm4c123gh6pm_startup_ccs.c
+static const char *const handlers[] = {
+    "HostLinkIntHandler", "UARTInterruptHandler", "SensorPort1IntHandler", "SensorPort2IntHandler",
+    "SensorPort3IntHandler", "SysTickIntHandler",
+};
+
+// Static RAM per object file of this project. Raise a budget in the same change that needs it.
+static const RamBudget ramBudgets[] = {
+    { "dy50.obj",               512 },  // Shadow state, recvPacket
+    { "dy50_shard.obj",         640 },  // Per-sensor search state
+    { "dy50_compact.obj",       1152 }, // Index table and group of every page, PAGE_MAP_MAX_PAGES
+    { "tm4c123gxl_utils.obj",   1536 }, // uDMA control table, sensor port receive parsers and frame queues
+    { "host_link.obj",          1152 }, // Host UART receive and transmit rings
+    { "rpc_server.obj",         1024 }, // Response frame and its encoded copy
+    { "dlog.obj",               640 },  // Deferred log ring
+    { "event_journal.obj",      384 },  // Journal record stage
+    { "page_map.obj",           64 },
+    { "dy50_enrol.obj",         0 },
+    { "uart_capture.obj",       4224 }, // Capture ring, CAPTURE_RING_SIZE
+    { "scheduler.obj",          128 },
+    { "stack_monitor.obj",      0 },
+    { "checksum.obj",           0 },
+    { "packet_parser.obj",      0 },
+    { "wire_frame.obj",         0 },
+    { "sensor_command.obj",     0 },
+    { "frame_queue.obj",        0 },
+    { "rpc_protocol.obj",       0 },
+    { "dy50_rtos.obj",          0 },
+    { "flows.obj",              0 },
+    { "main.obj",               0 },
+    { "tm4c123gh6pm_startup_ccs.obj", 0 },
+};
+
+static Function functions[MAX_FUNCTIONS];
+static uint32_t functionCount;
+static uint32_t unresolvedSize;
+
+static uint32_t findFunction(const char *name, bool isCreated)
+{
+    for (uint32_t i = 0; i < functionCount; i++)
+    {
+        if (strcmp(functions[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    if (!isCreated || functionCount == MAX_FUNCTIONS)
+    {
+        return UINT32_MAX;
+    }
+    snprintf(functions[functionCount].name, MAX_NAME, "%s", name);
+    functions[functionCount].frameSize = UINT32_MAX;
+    return functionCount++;
+}
+
+static void addCall(uint32_t caller, uint32_t callee)
+{
+    Function *function = &functions[caller];
+
+    for (uint16_t i = 0; i < function->calleeCount; i++)
+    {
+        if (function->callees[i] == callee)
+        {
+            return;
+        }
+    }
+    if (function->calleeCount == function->calleeCapacity)
+    {
+        function->calleeCapacity = function->calleeCapacity ? function->calleeCapacity * 2 : 8;
+        function->callees = realloc(function->callees, function->calleeCapacity * sizeof(uint32_t));
+        if (function->callees == NULL)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    function->callees[function->calleeCount++] = callee;
+}
+
+// Copies the operand of an instruction line, without the || quotes of symbols with special characters
+static void readOperand(const char *text, char *operand)
+{
+    size_t length = 0;
+
+    while (*text == ' ' || *text == '\t' || *text == '|')
+    {
+        text++;
+    }
+    while (text[length] != '\0' && text[length] != '|' && !isspace((unsigned char)text[length]) &&
+           text[length] != ';' && length < MAX_NAME - 1)
+    {
+        length++;
+    }
+    memcpy(operand, text, length);
+    operand[length] = '\0';
+}
+
+static bool isRegister(const char *operand)
+{
+    static const char *const registers[] = {
+        "A1", "A2", "A3", "A4", "V1", "V2", "V3", "V4", "V5", "V6", "V7", "V8", "V9", "SP", "LR", "PC",
+    };
+
+    for (size_t i = 0; i < sizeof(registers) / sizeof(registers[0]); i++)
+    {
+        if (strcmp(operand, registers[i]) == 0)
+        {
+            return true;
+        }
+    }
+    return operand[0] == 'R' && isdigit((unsigned char)operand[1]);
+}
+
+/**
+ * @brief  Read the functions of one compiler listing: the frame size from the comment block in front of every
+ *         function, and the calls from its body. Branches to other functions are tail calls and count as calls.
+ * @param  path                              - Assembly file written with --keep_asm
+ * @return 0 on success, 1 if the file cannot be read
+ */
+static int readListing(const char *path)
+{
+    FILE *input = fopen(path, "r");
+    char line[512];
+    char pendingName[MAX_NAME] = "";
+    uint32_t current = UINT32_MAX;
+
+    if (input == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), input) != NULL)
+    {
+        const char *field;
+        char mnemonic[16];
+        char operand[MAX_NAME];
+        uint32_t frameSize;
+
+        if ((field = strstr(line, "FUNCTION NAME:")) != NULL)
+        {
+            readOperand(field + strlen("FUNCTION NAME:"), pendingName);
+            continue;
+        }
+        if ((field = strstr(line, "Local Frame Size")) != NULL && pendingName[0] != '\0')
+        {
+            field = strstr(field, "= ");
+            if (field != NULL && sscanf(field + 2, "%u", &frameSize) == 1)
+            {
+                current = findFunction(pendingName, true);
+                if (current != UINT32_MAX)
+                {
+                    functions[current].frameSize = frameSize;
+                }
+            }
+            pendingName[0] = '\0';
+            continue;
+        }
+        if (current == UINT32_MAX || line[0] != ' ' || sscanf(line, "%15s", mnemonic) != 1)
+        {
+            continue;
+        }
+        if (strcmp(mnemonic, "BL") != 0 && strcmp(mnemonic, "BLX") != 0 && strcmp(mnemonic, "B") != 0 &&
+            strcmp(mnemonic, "B.W") != 0)
+        {
+            continue;
+        }
+        readOperand(strstr(line, mnemonic) + strlen(mnemonic), operand);
+        if (operand[0] == '\0' || operand[0] == '$')
+        {
+            continue;               // Local label
+        }
+        if (isRegister(operand))
+        {
+            functions[current].hasIndirectCall |= strcmp(mnemonic, "BLX") == 0;
+            continue;
+        }
+        addCall(current, findFunction(operand, true));
+    }
+    fclose(input);
+    return 0;
+}
+
+static uint32_t visit(uint32_t index)
+{
+    Function *function = &functions[index];
+    uint32_t deepest = 0;
+
+    if (function->isVisited)
+    {
+        return function->depth;
+    }
+    function->isOnPath = true;
+    function->deepestCallee = -1;
+    for (uint16_t i = 0; i < function->calleeCount; i++)
+    {
+        uint32_t depth;
+
+        if (functions[function->callees[i]].isOnPath)
+        {
+            functions[function->callees[i]].isRecursive = true;
+            continue;
+        }
+        depth = visit(function->callees[i]);
+        if (depth > deepest || function->deepestCallee < 0)
+        {
+            deepest = depth;
+            function->deepestCallee = (int32_t)function->callees[i];
+        }
+    }
+    function->isOnPath = false;
+    function->isVisited = true;
+    function->depth = (function->frameSize == UINT32_MAX ? unresolvedSize : function->frameSize) + deepest;
+    return function->depth;
+}
+
+// Whether a function reachable from index calls through a pointer; marks the visited functions in seen
+static void printIndirectCalls(uint32_t index, bool *seen, bool *isFirst)
+{
+    if (seen[index])
+    {
+        return;
+    }
+    seen[index] = true;
+    if (functions[index].hasIndirectCall)
+    {
+        printf("%s%s", *isFirst ? "    indirect calls in: " : ", ", functions[index].name);
+        *isFirst = false;
+    }
+    for (uint16_t i = 0; i < functions[index].calleeCount; i++)
+    {
+        printIndirectCalls(functions[index].callees[i], seen, isFirst);
+    }
+}
+
+/**
+ * @brief  Print the worst-case depth of each entry point with its deepest call chain
+ * @param  names                             - Entry points, those without a listing are skipped
+ * @param  count                             - Number of names
+ * @param  deepestName                       - Receives the entry point with the largest depth, NULL if none
+ * @return Largest depth
+ */
+static uint32_t printEntryPoints(const char *const *names, size_t count, const char **deepestName)
+{
+    static bool seen[MAX_FUNCTIONS];
+    uint32_t worst = 0;
+
+    *deepestName = NULL;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t index = findFunction(names[i], false);
+        bool isFirst = true;
+
+        if (index == UINT32_MAX || functions[index].frameSize == UINT32_MAX)
+        {
+            continue;
+        }
+        printf("  %-24s %5u  %s", names[i], visit(index), functions[index].name);
+        for (int32_t callee = functions[index].deepestCallee; callee >= 0; callee = functions[callee].deepestCallee)
+        {
+            printf(" > %s", functions[callee].name);
+        }
+        printf("\n");
+        memset(seen, 0, sizeof(seen));
+        printIndirectCalls(index, seen, &isFirst);
+        if (!isFirst)
+        {
+            printf("\n");
+        }
+        if (functions[index].depth > worst || *deepestName == NULL)
+        {
+            worst = functions[index].depth;
+            *deepestName = names[i];
+        }
+    }
+    return worst;
+}
+
+static void printUnresolved(void)
+{
+    bool isFirst = true;
+
+    for (uint32_t i = 0; i < functionCount; i++)
+    {
+        if (functions[i].frameSize == UINT32_MAX)
+        {
+            if (isFirst)
+            {
+                printf("no listing, counted as %u bytes each: ", unresolvedSize);
+            }
+            printf("%s%s", isFirst ? "" : ", ", functions[i].name);
+            isFirst = false;
+        }
+    }
+    if (!isFirst)
+    {
+        printf("\n");
+    }
+    for (uint32_t i = 0; i < functionCount; i++)
+    {
+        if (functions[i].isRecursive)
+        {
+            printf("recursive, one level counted: %s\n", functions[i].name);
+        }
+    }
+}
+
+static const RamBudget *findBudget(const char *module)
+{
+    for (size_t i = 0; i < sizeof(ramBudgets) / sizeof(ramBudgets[0]); i++)
+    {
+        if (strcmp(ramBudgets[i].module, module) == 0)
+        {
+            return &ramBudgets[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief  Check the static RAM of every object file in the module summary of a linker map against ramBudgets[]
+ * @param  path                              - Map file written with --map_file
+ * @param  stackSize                         - Receives the size of the .stack section, unchanged if not listed
+ * @return Number of failed checks, -1 if the file cannot be read or has no module summary
+ */
+static int checkRam(const char *path, uint32_t *stackSize)
+{
+    FILE *input = fopen(path, "r");
+    char line[512];
+    bool isInSummary = false;
+    bool isLibrary = false;
+    uint32_t total = 0;
+    int failures = 0;
+
+    if (input == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    printf("static RAM per module, bytes:\n");
+    while (fgets(line, sizeof(line), input) != NULL)
+    {
+        char name[256];
+        uint32_t code;
+        uint32_t readOnly;
+        uint32_t readWrite;
+        char *end = line + strlen(line);
+        char *numbers;
+        const RamBudget *budget;
+
+        while (end > line && isspace((unsigned char)end[-1]))
+        {
+            *--end = '\0';
+        }
+        if (!isInSummary)
+        {
+            isInSummary = strcmp(line, "MODULE SUMMARY") == 0;
+            continue;
+        }
+        // Module lines end with the code, read-only and read-write sizes; other lines name the directory or
+        // library of the modules that follow
+        numbers = end;
+        for (int field = 0; field < 3 && numbers > line; field++)
+        {
+            while (numbers > line && isspace((unsigned char)numbers[-1]))
+            {
+                numbers--;
+            }
+            while (numbers > line && isdigit((unsigned char)numbers[-1]))
+            {
+                numbers--;
+            }
+        }
+        if (sscanf(numbers, "%u %u %u", &code, &readOnly, &readWrite) != 3 || sscanf(line, "%255s", name) != 1)
+        {
+            if (line[0] != '\0' && strchr(line, '+') == NULL && strstr(line, "Module") == NULL)
+            {
+                isLibrary = end - line > 4 && strcmp(end - 4, ".lib") == 0;
+            }
+            continue;
+        }
+        if (strcmp(name, "Grand") == 0)
+        {
+            break;
+        }
+        if (strcmp(name, "Total:") == 0 || strcmp(name, "Linker") == 0)
+        {
+            continue;
+        }
+        if (strcmp(name, "Stack:") == 0)
+        {
+            *stackSize = readWrite;
+            continue;
+        }
+        total += readWrite;
+        budget = findBudget(name);
+        if (budget == NULL && isLibrary)
+        {
+            printf("  %-32s %5u\n", name, readWrite);
+        }
+        else if (budget == NULL)
+        {
+            printf("  %-32s %5u  no budget\n", name, readWrite);
+            failures++;
+        }
+        else
+        {
+            printf("  %-32s %5u of %5u%s\n", name, readWrite, budget->bytes,
+                   readWrite > budget->bytes ? "  over budget" : "");
+            failures += readWrite > budget->bytes;
+        }
+    }
+    fclose(input);
+    if (!isInSummary)
+    {
+        fprintf(stderr, "%s: no module summary\n", path);
+        return -1;
+    }
+    printf("  %-32s %5u of %5u with the stack of %u\n", "total", total + *stackSize, SRAM_SIZE, *stackSize);
+    return failures + (total + *stackSize > SRAM_SIZE);
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-m map] [-e caller=callee]... [-u bytes] [listing.asm]...\n", program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *mapPath = NULL;
+    char *edges[64];
+    int edgeCount = 0;
+    uint32_t stackSize = 512;   // --stack_size of the CCS project, replaced by the map
+    int failures = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "m:e:u:")) != -1)
+    {
+        switch (option)
+        {
+            case 'm': mapPath = optarg; break;
+            case 'e':
+                if (strchr(optarg, '=') == NULL || edgeCount == (int)(sizeof(edges) / sizeof(edges[0])))
+                {
+                    usage(argv[0]);
+                    return 2;
+                }
+                edges[edgeCount++] = optarg;
+                break;
+            case 'u': unresolvedSize = (uint32_t)strtoul(optarg, NULL, 0); break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (mapPath == NULL && optind == argc)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if (mapPath != NULL)
+    {
+        int result = checkRam(mapPath, &stackSize);
+
+        if (result < 0)
+        {
+            return 1;
+        }
+        failures += result;
+    }
+    for (int i = optind; i < argc; i++)
+    {
+        if (readListing(argv[i]) != 0)
+        {
+            return 1;
+        }
+    }
+    for (int i = 0; i < edgeCount; i++)
+    {
+        char *callee = strchr(edges[i], '=');
+
+        *callee++ = '\0';
+        addCall(findFunction(edges[i], true), findFunction(callee, true));
+    }
+    if (optind < argc)
+    {
+        const char *deepestCommand;
+        const char *deepestHandler;
+        uint32_t commandDepth;
+        uint32_t handlerDepth;
+        uint32_t worst;
+
+        printf("worst-case stack depth, bytes:\n");
+        commandDepth = printEntryPoints(commands, sizeof(commands) / sizeof(commands[0]), &deepestCommand);
+        printf("interrupt handlers:\n");
+        handlerDepth = printEntryPoints(handlers, sizeof(handlers) / sizeof(handlers[0]), &deepestHandler);
+        worst = commandDepth + (deepestHandler != NULL ? EXCEPTION_FRAME_SIZE + handlerDepth : 0);
+        printUnresolved();
+        printf("worst case %u of %u bytes of stack: %s %u", worst, stackSize,
+               deepestCommand != NULL ? deepestCommand : "-", commandDepth);
+        if (deepestHandler != NULL)
+        {
+            printf(" + exception frame %u + %s %u", EXCEPTION_FRAME_SIZE, deepestHandler, handlerDepth);
+        }
+        printf("\n");
+        failures += worst > stackSize;
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,466 @@
+/*
+ * Host client of the RPC bridge served by lib/rpc_server.c.
+ *
+ *   cc -O2 -I lib -I utils -c host/rpc_client.c lib/rpc_protocol.c
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "rpc_client.h"
+#include "dlog.h"
+#include "uart_capture.h"
+
+static speed_t toSpeed(int baudRate)
+{
+    switch (baudRate)
+    {
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        default:     return B115200;
+    }
+}
+
+static int64_t nowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static int writeAll(int fd, const uint8_t *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * @brief  Open a serial device in raw mode
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int rpcClientOpen(RpcClient *client, const char *device, int baudRate)
+{
+    struct termios tty;
+    int fd = open(device, O_RDWR | O_NOCTTY);
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (tcgetattr(fd, &tty) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, toSpeed(baudRate));
+    cfsetospeed(&tty, toSpeed(baudRate));
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tty) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+    rpcClientAttach(client, fd);
+    return 0;
+}
+
+/**
+ * @brief  Connect to the Unix socket of host/dy50d.c
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int rpcClientConnect(RpcClient *client, const char *socketPath)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    rpcClientAttach(client, fd);
+    return 0;
+}
+
+/**
+ * @brief  Use an already open descriptor, e.g. a pipe or socket to a simulated board
+ */
+void rpcClientAttach(RpcClient *client, int fd)
+{
+    memset(client, 0, sizeof(*client));
+    client->fd = fd;
+    client->nextRequestId = 1;
+    rpcResetParser(&client->parser);
+}
+
+void rpcClientClose(RpcClient *client)
+{
+    if (client->fd >= 0)
+    {
+        close(client->fd);
+        client->fd = -1;
+    }
+}
+
+static int sendFrame(RpcClient *client, uint8_t flags, uint16_t requestId, uint8_t opcode,
+                     const uint8_t *payload, uint16_t length)
+{
+    static RpcFrame frame;
+    uint8_t buffer[RPC_MAX_FRAME];
+
+    if (length > RPC_MAX_PAYLOAD)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    frame.flags = flags;
+    frame.requestId = requestId;
+    frame.opcode = opcode;
+    frame.length = length;
+    if (length > 0)
+    {
+        memcpy(frame.payload, payload, length);
+    }
+    return writeAll(client->fd, buffer, rpcEncodeFrame(&frame, buffer));
+}
+
+/**
+ * @brief  Send a request without waiting for its response
+ * @param  handler                           - Called from rpcClientPoll() for every response frame
+ * @return Request ID, or -1 if RPC_CLIENT_WINDOW requests are already in flight (errno EBUSY) or sending failed
+ */
+int rpcClientSubmit(RpcClient *client, uint8_t opcode, const uint8_t *payload, uint16_t length,
+                    RpcResponseHandler handler, void *context)
+{
+    RpcPending *slot = NULL;
+    uint16_t requestId;
+
+    for (int i = 0; i < RPC_CLIENT_WINDOW; i++)
+    {
+        if (!client->pending[i].inUse)
+        {
+            slot = &client->pending[i];
+            break;
+        }
+    }
+    if (slot == NULL)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+    requestId = client->nextRequestId++;
+    if (client->nextRequestId == 0)
+    {
+        client->nextRequestId = 1;
+    }
+    if (sendFrame(client, 0, requestId, opcode, payload, length) != 0)
+    {
+        return -1;
+    }
+    slot->inUse = true;
+    slot->requestId = requestId;
+    slot->handler = handler;
+    slot->context = context;
+    return requestId;
+}
+
+/**
+ * @brief  Send one data frame of a streamed request, e.g. the template of RPC_OP_DOWNLOAD_TEMPLATE
+ */
+int rpcClientSendStream(RpcClient *client, uint16_t requestId, uint8_t opcode, const uint8_t *payload,
+                        uint16_t length, bool isLast)
+{
+    return sendFrame(client, isLast ? 0 : RPC_FLAG_MORE, requestId, opcode, payload, length);
+}
+
+// Deferred log records share the UART with the responses; skip them so their bytes cannot fake a frame start
+static bool skipLogRecord(RpcClient *client, uint8_t byte)
+{
+    if (client->logHeaderCount > 0)
+    {
+        client->logHeaderCount++;
+        if (client->logHeaderCount == 3)
+        {
+            client->logBytesToSkip = DLOG_RECORD_HEADER_SIZE - 3 + 4 * (byte <= DLOG_MAX_ARGUMENTS ? byte : 0);
+            client->logHeaderCount = 0;
+        }
+        return true;
+    }
+    if (client->logBytesToSkip > 0)
+    {
+        client->logBytesToSkip--;
+        return true;
+    }
+    if (client->parser.count == 0 && byte == DLOG_SYNC)
+    {
+        client->logHeaderCount = 1;
+        return true;
+    }
+    return false;
+}
+
+static void dispatch(RpcClient *client, const RpcFrame *frame)
+{
+    client->framesReceived++;
+    for (int i = 0; i < RPC_CLIENT_WINDOW; i++)
+    {
+        RpcPending *slot = &client->pending[i];
+        if (slot->inUse && slot->requestId == frame->requestId)
+        {
+            if ((frame->flags & RPC_FLAG_MORE) == 0)
+            {
+                slot->inUse = false;
+            }
+            if (slot->handler != NULL)
+            {
+                slot->handler(frame, slot->context);
+            }
+            return;
+        }
+    }
+    client->unmatchedFrames++;
+}
+
+/**
+ * @brief  Read and dispatch responses
+ * @param  timeoutMs                         - Time to wait for the first byte, 0 to only take what is buffered
+ * @return Number of frames dispatched, -1 on a read error
+ */
+int rpcClientPoll(RpcClient *client, int timeoutMs)
+{
+    uint8_t buffer[512];
+    int dispatched = 0;
+    fd_set readable;
+    struct timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+
+    FD_ZERO(&readable);
+    FD_SET(client->fd, &readable);
+    if (select(client->fd + 1, &readable, NULL, NULL, &timeout) <= 0)
+    {
+        return 0;
+    }
+
+    ssize_t received = read(client->fd, buffer, sizeof(buffer));
+    if (received < 0)
+    {
+        return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+    }
+    for (ssize_t i = 0; i < received; i++)
+    {
+        if (skipLogRecord(client, buffer[i]))
+        {
+            continue;
+        }
+        if (rpcParseByte(&client->parser, buffer[i]) && (client->parser.frame.flags & RPC_FLAG_RESPONSE))
+        {
+            dispatch(client, &client->parser.frame);
+            dispatched++;
+        }
+    }
+    return dispatched;
+}
+
+/**
+ * @brief  Number of requests still waiting for their final response
+ */
+int rpcClientPending(const RpcClient *client)
+{
+    int count = 0;
+    for (int i = 0; i < RPC_CLIENT_WINDOW; i++)
+    {
+        count += client->pending[i].inUse;
+    }
+    return count;
+}
+
+typedef struct
+{
+    RpcFrame *response;
+    bool isDone;
+    uint8_t *data;              // Stream destination, NULL for plain calls
+    size_t capacity;
+    size_t length;
+    bool isTruncated;
+} CallState;
+
+static void collectResponse(const RpcFrame *frame, void *context)
+{
+    CallState *state = (CallState *)context;
+
+    if (state->data != NULL && (frame->flags & RPC_FLAG_MORE))
+    {
+        if (state->length + frame->length > state->capacity)
+        {
+            state->isTruncated = true;
+            return;
+        }
+        memcpy(state->data + state->length, frame->payload, frame->length);
+        state->length += frame->length;
+        return;
+    }
+    *state->response = *frame;
+    state->isDone = (frame->flags & RPC_FLAG_MORE) == 0 || state->data == NULL;
+}
+
+static int waitFor(RpcClient *client, CallState *state)
+{
+    int64_t deadline = nowMs() + RPC_CLIENT_TIMEOUT_MS;
+
+    while (!state->isDone)
+    {
+        int64_t remaining = deadline - nowMs();
+        if (remaining <= 0)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (rpcClientPoll(client, (int)remaining) < 0)
+        {
+            return -1;
+        }
+    }
+    return (state->response->flags & RPC_FLAG_ERROR) ? -1 : 0;
+}
+
+/**
+ * @brief  Send a request and wait for its response. Other requests in flight keep being dispatched meanwhile.
+ * @return 0 on success, -1 on timeout, I/O error or an RPC_FLAG_ERROR response
+ */
+int rpcClientCall(RpcClient *client, uint8_t opcode, const uint8_t *payload, uint16_t length, RpcFrame *response)
+{
+    CallState state = { response, false, NULL, 0, 0, false };
+
+    if (rpcClientSubmit(client, opcode, payload, length, collectResponse, &state) < 0)
+    {
+        return -1;
+    }
+    return waitFor(client, &state);
+}
+
+static int uploadStream(RpcClient *client, uint8_t opcode, const uint8_t *payload, uint16_t payloadLength,
+                        uint8_t *data, size_t capacity, size_t *length)
+{
+    RpcFrame response;
+    CallState state = { &response, false, data, capacity, 0, false };
+
+    if (rpcClientSubmit(client, opcode, payload, payloadLength, collectResponse, &state) < 0 ||
+        waitFor(client, &state) != 0)
+    {
+        return -1;
+    }
+    *length = state.length;
+    return (state.isTruncated || response.payload[0] != 0) ? -1 : 0;
+}
+
+/**
+ * @brief  Upload the character file or template in a CharBuffer of the sensor
+ * @return 0 on success, -1 on a link error, a sensor error or if the template did not fit in capacity
+ */
+int rpcClientUploadTemplate(RpcClient *client, uint8_t buffer, uint8_t *data, size_t capacity, size_t *length)
+{
+    return uploadStream(client, RPC_OP_UPLOAD_TEMPLATE, &buffer, 1, data, capacity, length);
+}
+
+/**
+ * @brief  Upload the image in the sensor's ImageBuffer, 4 bits per pixel
+ */
+int rpcClientUploadImage(RpcClient *client, uint8_t *data, size_t capacity, size_t *length)
+{
+    return uploadStream(client, RPC_OP_UPLOAD_IMAGE, NULL, 0, data, capacity, length);
+}
+
+/**
+ * @brief  Read the board's access event journal from a sequence number on, JOURNAL_RECORD_SIZE bytes per record
+ * @return 0 on success, -1 on a link error or if the records did not fit in capacity
+ */
+int rpcClientReadJournal(RpcClient *client, uint32_t firstSequence, uint8_t *data, size_t capacity, size_t *length)
+{
+    uint8_t payload[4];
+
+    rpcPutU32(payload, firstSequence);
+    return uploadStream(client, RPC_OP_READ_JOURNAL, payload, sizeof(payload), data, capacity, length);
+}
+
+/**
+ * @brief  Remove the recorded sensor UART traffic from the board's capture ring, see utils/uart_capture.h
+ * @param  dropped                           - Set to the number of records lost because the ring was full
+ * @return 0 on success, -1 on a link error or if the records did not fit in capacity
+ */
+int rpcClientReadCapture(RpcClient *client, uint8_t *data, size_t capacity, size_t *length, uint32_t *dropped)
+{
+    uint8_t command = CAPTURE_COMMAND_READ;
+    RpcFrame response;
+    CallState state = { &response, false, data, capacity, 0, false };
+
+    if (rpcClientSubmit(client, RPC_OP_CAPTURE, &command, 1, collectResponse, &state) < 0 ||
+        waitFor(client, &state) != 0)
+    {
+        return -1;
+    }
+    *length = state.length;
+    *dropped = response.length >= 5 ? rpcGetU32(&response.payload[1]) : 0;
+    return (state.isTruncated || response.payload[0] != 0) ? -1 : 0;
+}
+
+/**
+ * @brief  Download a character file or template into a CharBuffer of the sensor
+ * @param  packetLength                      - Data packet size configured on the sensor, SensorParams.packet_len
+ * @return 0 on success, -1 otherwise
+ */
+int rpcClientDownloadTemplate(RpcClient *client, uint8_t buffer, const uint8_t *data, size_t length,
+                              uint16_t packetLength)
+{
+    RpcFrame response;
+    CallState state = { &response, false, NULL, 0, 0, false };
+    int requestId = rpcClientSubmit(client, RPC_OP_DOWNLOAD_TEMPLATE, &buffer, 1, collectResponse, &state);
+
+    if (requestId < 0 || waitFor(client, &state) != 0 || response.payload[0] != 0)
+    {
+        return -1;
+    }
+    state.isDone = false;
+    for (size_t offset = 0; offset < length; offset += packetLength)
+    {
+        uint16_t chunk = (length - offset < packetLength) ? (uint16_t)(length - offset) : packetLength;
+        if (rpcClientSendStream(client, (uint16_t)requestId, RPC_OP_DOWNLOAD_TEMPLATE, data + offset, chunk,
+                                offset + chunk >= length) != 0)
+        {
+            return -1;
+        }
+    }
+    if (waitFor(client, &state) != 0)
+    {
+        return -1;
+    }
+    return response.payload[0] == 0 ? 0 : -1;
+}
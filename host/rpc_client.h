@@ -0,0 +1,59 @@
+#ifndef RPC_CLIENT_H
+#define RPC_CLIENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "rpc_protocol.h"
+
+/* ***** Defines ***** */
+
+#define RPC_CLIENT_WINDOW                       8    // Requests in flight; bounded by the board's receive ring
+#define RPC_CLIENT_TIMEOUT_MS                   3000
+
+/* ***** Structures ***** */
+
+// Called for every response frame of a request; the request is complete when RPC_FLAG_MORE is clear
+typedef void (*RpcResponseHandler)(const RpcFrame *frame, void *context);
+
+typedef struct
+{
+    bool inUse;
+    uint16_t requestId;
+    RpcResponseHandler handler;
+    void *context;
+} RpcPending;
+
+typedef struct
+{
+    int fd;
+    RpcParser parser;
+    uint16_t nextRequestId;
+    RpcPending pending[RPC_CLIENT_WINDOW];
+    uint16_t logBytesToSkip;    // Remaining bytes of a deferred log record interleaved with the responses
+    uint8_t logHeaderCount;
+    uint32_t framesReceived;
+    uint32_t unmatchedFrames;   // Responses whose request ID is not in flight
+} RpcClient;
+
+/* ***** Functions ***** */
+
+int rpcClientOpen(RpcClient *client, const char *device, int baudRate);
+int rpcClientConnect(RpcClient *client, const char *socketPath);
+void rpcClientAttach(RpcClient *client, int fd);
+void rpcClientClose(RpcClient *client);
+int rpcClientSubmit(RpcClient *client, uint8_t opcode, const uint8_t *payload, uint16_t length,
+                    RpcResponseHandler handler, void *context);
+int rpcClientSendStream(RpcClient *client, uint16_t requestId, uint8_t opcode, const uint8_t *payload,
+                        uint16_t length, bool isLast);
+int rpcClientPoll(RpcClient *client, int timeoutMs);
+int rpcClientPending(const RpcClient *client);
+int rpcClientCall(RpcClient *client, uint8_t opcode, const uint8_t *payload, uint16_t length, RpcFrame *response);
+int rpcClientUploadTemplate(RpcClient *client, uint8_t buffer, uint8_t *data, size_t capacity, size_t *length);
+int rpcClientUploadImage(RpcClient *client, uint8_t *data, size_t capacity, size_t *length);
+int rpcClientReadJournal(RpcClient *client, uint32_t firstSequence, uint8_t *data, size_t capacity, size_t *length);
+int rpcClientReadCapture(RpcClient *client, uint8_t *data, size_t capacity, size_t *length, uint32_t *dropped);
+int rpcClientDownloadTemplate(RpcClient *client, uint8_t buffer, const uint8_t *data, size_t length,
+                              uint16_t packetLength);
+
+#endif /* RPC_CLIENT_H */
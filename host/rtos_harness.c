@@ -0,0 +1,285 @@
+/*
+ * Test of lib/dy50_rtos.c on the FreeRTOS POSIX port: several tasks share one simulated module of host/sensor_sim.c.
+ *
+ *   K=path/to/FreeRTOS-Kernel P=$K/portable/ThirdParty/GCC/Posix
+ *   cc -O2 -DDY50_HOST -DDY50_USE_FREERTOS -I . -I lib -I host -I $K/include -I $P -I $P/utils -o rtos_harness \
+ *      host/rtos_harness.c lib/dy50_rtos.c lib/dy50.c lib/sensor_command.c lib/checksum.c lib/packet_parser.c \
+ *      lib/wire_frame.c host/host_transport.c host/sensor_sim.c $K/tasks.c $K/queue.c $K/list.c $K/timers.c \
+ *      $K/portable/MemMang/heap_3.c $P/port.c $P/utils/wait_for_event.c -lpthread
+ *   rtos_harness [-w workers] [-n rounds] [-l latency ms]
+ *
+ * The module runs in a task of its own and answers every command after the latency, so a task waiting for a
+ * response is blocked for that long. Every worker verifies its own library page with loadModel() of CharBuffer1 and
+ * fingerVerify(), holding lockDriver() across both; a command of another worker in between would replace
+ * CharBuffer1 and fail the match. A probe task with a call timeout of 1 ms sends VfyPwd while the workers hold the
+ * driver and must get FINGERPRINT_BUSY at times, never a wrong answer.
+ *
+ * The run fails on any failed verification or unexpected status, and if the idle task got less than
+ * HARNESS_MIN_IDLE_PERCENT of the time: a task waiting for the sensor must block, not spin.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "semphr.h"
+#include "task.h"
+#include "dy50.h"
+#include "dy50_rtos.h"
+#include "sensor_sim.h"
+
+#define HARNESS_MAX_WORKERS                     8
+#define HARNESS_FIRST_FINGER                    100  // Finger of the page of worker 0, the others follow
+#define HARNESS_MIN_IDLE_PERCENT                50
+#define HARNESS_QUEUE_DEPTH                     8    // Frames on their way to the module
+#define HARNESS_TASK_STACK                      (configMINIMAL_STACK_SIZE * 4)
+
+// A frame written by the driver, on its way to the module task
+typedef struct
+{
+    uint16_t length;
+    uint8_t bytes[PACKET_MAX_SIZE];
+} SensorFrame;
+
+typedef struct
+{
+    uint32_t rounds;
+    uint32_t verified;
+    uint32_t failed;
+    uint8_t lastFailure;
+} WorkerResult;
+
+typedef struct
+{
+    uint32_t probes;
+    uint32_t busy;
+    uint32_t unexpected;
+} ProbeResult;
+
+static SensorSim sim;
+static QueueHandle_t toSensor;
+static SemaphoreHandle_t finished;          // Given by every worker and the probe when done
+static struct timespec startTime;
+static uint32_t workerCount = 3;
+static uint32_t rounds = 50;
+static uint32_t latencyMs = 2;
+static WorkerResult workerResults[HARNESS_MAX_WORKERS];
+static ProbeResult probeResult;
+static volatile bool areWorkersDone;
+
+uint32_t harnessRunTimeUs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((now.tv_sec - startTime.tv_sec) * 1000000 + (now.tv_nsec - startTime.tv_nsec) / 1000);
+}
+
+void harnessAssert(const char *file, int line)
+{
+    fprintf(stderr, "assertion failed at %s:%d\n", file, line);
+    exit(2);
+}
+
+// Transport clock of the driver, so response timeouts and the kernel agree on time
+static uint32_t kernelMs(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+// SensorWriter: bytes the driver sends, called from the task holding the driver
+static void driverWrite(const uint8_t *data, uint16_t length, void *context)
+{
+    SensorFrame frame;
+
+    (void)context;
+    frame.length = (length < sizeof(frame.bytes)) ? length : sizeof(frame.bytes);
+    memcpy(frame.bytes, data, frame.length);
+    xQueueSend(toSensor, &frame, portMAX_DELAY);
+}
+
+// SimWriter: the module's answer reaches the driver like bytes from the UART interrupt handler
+static void sensorWrite(const uint8_t *data, uint16_t length, void *context)
+{
+    (void)context;
+    hostTransportReceive(0, data, length);
+}
+
+static void sensorTask(void *parameters)
+{
+    SensorFrame frame;
+
+    (void)parameters;
+    simPowerOn(&sim);
+    for (;;)
+    {
+        xQueueReceive(toSensor, &frame, portMAX_DELAY);
+        vTaskDelay(pdMS_TO_TICKS(latencyMs));
+        simReceive(&sim, frame.bytes, frame.length);
+    }
+}
+
+static void workerTask(void *parameters)
+{
+    uint32_t index = (uint32_t)(uintptr_t)parameters;
+    WorkerResult *result = &workerResults[index];
+    uint16_t page = (uint16_t)index;
+
+    for (result->rounds = 0; result->rounds < rounds; result->rounds++)
+    {
+        FingerPageAndConfidence match = { page, 0, FINGERPRINT_BUSY };
+        uint8_t statusCode = FINGERPRINT_BUSY;
+
+        if (lockDriver())
+        {
+            statusCode = loadModel(1, page);
+            if (statusCode == FINGERPRINT_OK)
+            {
+                match = fingerVerify(page);
+                statusCode = match.statusCode;
+            }
+            unlockDriver();
+        }
+        if (statusCode == FINGERPRINT_OK)
+        {
+            result->verified++;
+        }
+        else
+        {
+            result->failed++;
+            result->lastFailure = statusCode;
+        }
+    }
+    xSemaphoreGive(finished);
+    vTaskDelete(NULL);
+}
+
+static void probeTask(void *parameters)
+{
+    (void)parameters;
+    dy50RtosSetCallTimeout(1);
+    while (!areWorkersDone)
+    {
+        uint8_t statusCode = checkPassword(DEFAULT_PASSWORD);
+
+        probeResult.probes++;
+        if (statusCode == FINGERPRINT_BUSY)
+        {
+            probeResult.busy++;
+        }
+        else if (statusCode != FINGERPRINT_OK)
+        {
+            probeResult.unexpected++;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    xSemaphoreGive(finished);
+    vTaskDelete(NULL);
+}
+
+static void supervisorTask(void *parameters)
+{
+    uint32_t startUs;
+    uint32_t startIdle;
+    uint32_t elapsedUs;
+    uint32_t idlePercent;
+    uint32_t failures = 0;
+    uint8_t statusCode;
+
+    (void)parameters;
+    statusCode = sensorBegin(DEFAULT_PASSWORD);
+    if (statusCode != FINGERPRINT_OK)
+    {
+        printf("sensorBegin failed: 0x%02x\n", statusCode);
+        exit(1);
+    }
+
+    startUs = harnessRunTimeUs();
+    startIdle = ulTaskGetIdleRunTimeCounter();
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        xTaskCreate(workerTask, "worker", HARNESS_TASK_STACK, (void *)(uintptr_t)i, 2, NULL);
+    }
+    xTaskCreate(probeTask, "probe", HARNESS_TASK_STACK, NULL, 2, NULL);
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        xSemaphoreTake(finished, portMAX_DELAY);
+    }
+    areWorkersDone = true;
+    xSemaphoreTake(finished, portMAX_DELAY);
+    elapsedUs = harnessRunTimeUs() - startUs;
+    idlePercent = (uint32_t)((uint64_t)(ulTaskGetIdleRunTimeCounter() - startIdle) * 100 /
+                             (elapsedUs ? elapsedUs : 1));
+
+    printf("%-8s %8s %8s %8s %8s\n", "task", "rounds", "ok", "failed", "last");
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        const WorkerResult *result = &workerResults[i];
+        printf("worker%-2u %8u %8u %8u     0x%02x\n", i, result->rounds, result->verified, result->failed,
+               result->lastFailure);
+        failures += result->failed;
+    }
+    printf("probe    %8u %8u %8u     %u busy\n", probeResult.probes,
+           probeResult.probes - probeResult.busy - probeResult.unexpected, probeResult.unexpected, probeResult.busy);
+    printf("%u commands in %.1f ms, idle %u%%\n", sim.commandsReceived, elapsedUs / 1000.0, idlePercent);
+
+    if (probeResult.busy == 0 && workerCount > 0)
+    {
+        printf("FAIL: the probe never found the driver held\n");
+        failures++;
+    }
+    if (idlePercent < HARNESS_MIN_IDLE_PERCENT)
+    {
+        printf("FAIL: idle %u%% is below %u%%, waiting tasks use the CPU\n", idlePercent, HARNESS_MIN_IDLE_PERCENT);
+        failures++;
+    }
+    failures += probeResult.unexpected;
+    printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+    exit(failures == 0 ? 0 : 1);
+}
+
+int main(int argc, char **argv)
+{
+    int option;
+
+    while ((option = getopt(argc, argv, "w:n:l:")) != -1)
+    {
+        switch (option)
+        {
+            case 'w': workerCount = (uint32_t)atoi(optarg); break;
+            case 'n': rounds = (uint32_t)atoi(optarg); break;
+            case 'l': latencyMs = (uint32_t)atoi(optarg); break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if (optind != argc || workerCount > HARNESS_MAX_WORKERS || latencyMs == 0)
+    {
+        fprintf(stderr, "usage: %s [-w workers, at most %u] [-n rounds] [-l latency ms, at least 1]\n", argv[0],
+                HARNESS_MAX_WORKERS);
+        return 2;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    init();
+    hostTransportSetClock(kernelMs);
+    simInit(&sim, sensorWrite, NULL);
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        simMakeTemplate(sim.library[i], HARNESS_FIRST_FINGER + i);
+        sim.isOccupied[i] = true;
+    }
+    hostTransportConnect(0, driverWrite, NULL);
+
+    toSensor = xQueueCreate(HARNESS_QUEUE_DEPTH, sizeof(SensorFrame));
+    finished = xSemaphoreCreateCounting(HARNESS_MAX_WORKERS + 1, 0);
+    if (toSensor == NULL || finished == NULL || !dy50RtosInit(0))
+    {
+        fprintf(stderr, "kernel objects could not be allocated\n");
+        return 1;
+    }
+    xTaskCreate(sensorTask, "sensor", HARNESS_TASK_STACK, NULL, 3, NULL);
+    xTaskCreate(supervisorTask, "supervisor", HARNESS_TASK_STACK, NULL, 1, NULL);
+    vTaskStartScheduler();
+    return 1; // Only reached if the scheduler could not start
+}
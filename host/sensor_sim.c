@@ -0,0 +1,871 @@
+/*
+ * Simulated DY50 module, see sensor_sim.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sensor_sim.h"
+#include "dy50.h"
+
+#define TEMPLATE_MAGIC                          0x5A // First byte of every valid character file or template
+#define FLASH_HEADER_SIZE                       22   // Fields in front of the pages, see sensor_sim.h
+
+/**
+ * @brief  Send one packet to the MCU, as changed by the fault of the current command
+ */
+static void emitPacket(SensorSim *sim, uint8_t type, const uint8_t *data, uint16_t dataLength)
+{
+    static const uint8_t noise[] = { FINGERPRINT_STARTCODE_HIGH, FINGERPRINT_STARTCODE_LOW, 0x5A };
+    WireFrame frame;
+    uint16_t size = buildWireFrame(&frame, sim->address, type, data, dataLength);
+    uint8_t *bytes = wireFrameBytes(&frame);
+    bool isFirst = !sim->isResponseStarted;
+
+    sim->isResponseStarted = true;
+    if (sim->activeFault != NULL)
+    {
+        switch (sim->activeFault->kind)
+        {
+            case SIM_FAULT_DROP:
+                return;
+            case SIM_FAULT_CORRUPT:
+                bytes[size - 1] ^= isFirst ? 0xFF : 0;
+                break;
+            case SIM_FAULT_TRUNCATE:
+                if (!isFirst)
+                {
+                    return;
+                }
+                size /= 2;
+                break;
+            case SIM_FAULT_NOISE:
+                if (isFirst)
+                {
+                    sim->writer(noise, sizeof(noise), sim->writerContext);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    sim->writer(bytes, size, sim->writerContext);
+}
+
+static void acknowledge(SensorSim *sim, uint8_t code)
+{
+    emitPacket(sim, FINGERPRINT_ACKPACKET, &code, 1);
+}
+
+/**
+ * @brief  Send a buffer as data packets of the configured size, the last one as an end packet
+ */
+static void emitDataPackets(SensorSim *sim, const uint8_t *data, uint32_t length)
+{
+    uint16_t packetSize = 32 << sim->packetSizeCode;
+
+    for (uint32_t offset = 0; offset < length; offset += packetSize)
+    {
+        uint16_t chunk = (length - offset < packetSize) ? (uint16_t)(length - offset) : packetSize;
+        uint8_t type = (offset + chunk >= length) ? FINGERPRINT_ENDDATAPACKET : FINGERPRINT_DATAPACKET;
+        emitPacket(sim, type, &data[offset], chunk);
+    }
+}
+
+static uint32_t readU32(const uint8_t *bytes)
+{
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+static uint16_t readU16(const uint8_t *bytes)
+{
+    return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+static uint32_t templateFinger(const uint8_t *buffer)
+{
+    return ((uint32_t)buffer[1] << 24) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 8) | buffer[4];
+}
+
+static bool isTemplateValid(const uint8_t *buffer)
+{
+    return buffer[0] == TEMPLATE_MAGIC;
+}
+
+/**
+ * @brief  Deterministic template of a finger: magic, finger id and a pseudo-random body derived from the id
+ */
+void simMakeTemplate(uint8_t *buffer, uint32_t fingerId)
+{
+    uint32_t state = fingerId * 2654435761u + 1;
+
+    buffer[0] = TEMPLATE_MAGIC;
+    buffer[1] = (uint8_t)(fingerId >> 24);
+    buffer[2] = (uint8_t)(fingerId >> 16);
+    buffer[3] = (uint8_t)(fingerId >> 8);
+    buffer[4] = (uint8_t)fingerId;
+    for (uint16_t i = 5; i < SIM_TEMPLATE_SIZE; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        buffer[i] = (uint8_t)state;
+    }
+}
+
+uint16_t simTemplateCount(const SensorSim *sim)
+{
+    uint16_t count = 0;
+    for (uint16_t page = 0; page < SIM_CAPACITY; page++)
+    {
+        count += sim->isOccupied[page];
+    }
+    return count;
+}
+
+/**
+ * @brief  Match score of a finger, stable per finger so that repeated searches agree
+ */
+static uint16_t matchScore(uint32_t fingerId)
+{
+    return (uint16_t)(60 + (fingerId * 37) % 140);
+}
+
+/**
+ * @brief  Score of a character file against a template. Impostor pairs score 0 to 59 with a geometric tail, stable
+ *         per pair, so that only security levels below the default accept them.
+ */
+static uint16_t pairScore(uint32_t probeFinger, uint32_t templateFinger)
+{
+    uint32_t mix = probeFinger * 2654435761u ^ templateFinger * 2246822519u;
+    uint16_t score;
+
+    if (probeFinger == templateFinger)
+    {
+        return matchScore(probeFinger);
+    }
+    mix ^= mix >> 15;
+    mix *= 0x2C1B3C6Du;
+    mix ^= mix >> 12;
+    score = (uint16_t)(6 * __builtin_ctz(mix | 0x80000000u) + (mix >> 26) % 6);
+    return score < 60 ? score : 59;
+}
+
+// Lowest score a search accepts per security level; genuine scores start at 60
+static uint16_t acceptThreshold(uint16_t securityLevel)
+{
+    static const uint16_t thresholds[] = { 40, 50, 60, 75, 90 };
+
+    if (securityLevel < 1)
+    {
+        securityLevel = 1;
+    }
+    return thresholds[(securityLevel <= 5 ? securityLevel : 5) - 1];
+}
+
+static uint8_t *selectBuffer(SensorSim *sim, uint8_t bufferId)
+{
+    return sim->charBuffer[(bufferId == 2) ? 1 : 0];
+}
+
+/**
+ * @brief  Image of the finger on the window: concentric ridges around a centre derived from the finger id
+ */
+static void renderImage(uint32_t fingerId, uint8_t *image)
+{
+    uint16_t centreX = 96 + (fingerId * 13) % 64;
+    uint16_t centreY = 112 + (fingerId * 29) % 64;
+
+    for (uint16_t y = 0; y < SIM_IMAGE_HEIGHT; y++)
+    {
+        for (uint16_t x = 0; x < SIM_IMAGE_WIDTH; x += 2)
+        {
+            uint8_t pixels[2];
+            for (uint8_t k = 0; k < 2; k++)
+            {
+                int32_t dx = (int32_t)(x + k) - centreX;
+                int32_t dy = (int32_t)y - centreY;
+                uint32_t radius = (uint32_t)(dx * dx + dy * dy) / 64;
+                pixels[k] = (radius & 0x4) ? 0x3 : 0xC;
+            }
+            image[(y * SIM_IMAGE_WIDTH + x) / 2] = (uint8_t)((pixels[0] << 4) | pixels[1]);
+        }
+    }
+}
+
+static void sendImage(SensorSim *sim)
+{
+    static uint8_t image[SIM_IMAGE_SIZE];
+
+    if (!sim->isImageValid)
+    {
+        acknowledge(sim, FINGERPRINT_UPLOADFAIL);
+        return;
+    }
+    acknowledge(sim, FINGERPRINT_OK);
+    renderImage(sim->imageFingerId, image);
+    emitDataPackets(sim, image, SIM_IMAGE_SIZE);
+}
+
+static void search(SensorSim *sim, const uint8_t *parameters)
+{
+    const uint8_t *buffer = selectBuffer(sim, parameters[0]);
+    uint16_t start = readU16(&parameters[1]);
+    uint16_t count = readU16(&parameters[3]);
+    uint16_t bestScore = acceptThreshold(sim->securityLevel);
+    uint8_t result[5] = {FINGERPRINT_NOTFOUND};
+
+    if (isTemplateValid(buffer))
+    {
+        // Best scoring page, the first one on a tie
+        for (uint32_t page = start; page < (uint32_t)start + count && page < SIM_CAPACITY; page++)
+        {
+            uint16_t score;
+            if (!sim->isOccupied[page])
+            {
+                continue;
+            }
+            score = pairScore(templateFinger(buffer), templateFinger(sim->library[page]));
+            if (score > bestScore || (score == bestScore && result[0] != FINGERPRINT_OK))
+            {
+                bestScore = score;
+                result[0] = FINGERPRINT_OK;
+                result[1] = (uint8_t)(page >> 8);
+                result[2] = (uint8_t)page;
+                result[3] = (uint8_t)(score >> 8);
+                result[4] = (uint8_t)score;
+            }
+        }
+    }
+    emitPacket(sim, FINGERPRINT_ACKPACKET, result, 5);
+}
+
+static void match(SensorSim *sim)
+{
+    uint8_t result[3] = {FINGERPRINT_NOMATCH};
+    uint16_t score = 0;
+
+    if (isTemplateValid(sim->charBuffer[0]) && isTemplateValid(sim->charBuffer[1]))
+    {
+        score = pairScore(templateFinger(sim->charBuffer[0]), templateFinger(sim->charBuffer[1]));
+        if (score >= acceptThreshold(sim->securityLevel))
+        {
+            result[0] = FINGERPRINT_OK;
+        }
+    }
+    result[1] = (uint8_t)(score >> 8);
+    result[2] = (uint8_t)score;
+    emitPacket(sim, FINGERPRINT_ACKPACKET, result, 3);
+}
+
+static void readParameters(SensorSim *sim)
+{
+    uint8_t result[17] = {FINGERPRINT_OK};
+
+    result[5] = (uint8_t)(SIM_CAPACITY >> 8);
+    result[6] = (uint8_t)SIM_CAPACITY;
+    result[7] = (uint8_t)(sim->securityLevel >> 8);
+    result[8] = (uint8_t)sim->securityLevel;
+    result[9] = (uint8_t)(sim->address >> 24);
+    result[10] = (uint8_t)(sim->address >> 16);
+    result[11] = (uint8_t)(sim->address >> 8);
+    result[12] = (uint8_t)sim->address;
+    result[14] = sim->packetSizeCode;
+    result[16] = sim->baudMultiplier;
+    emitPacket(sim, FINGERPRINT_ACKPACKET, result, 17);
+}
+
+/**
+ * @brief  SetSysPara with the ranges of the module
+ */
+static uint8_t setParameter(SensorSim *sim, uint8_t parameter, uint8_t value)
+{
+    switch (parameter)
+    {
+        case SYSPARAM_BAUD_RATE:
+            if (value < 1 || value > 12)
+            {
+                return FINGERPRINT_INVALIDREG;
+            }
+            sim->baudMultiplier = value;
+            return FINGERPRINT_OK;
+        case SYSPARAM_SECURITY_LEVEL:
+            if (value < 1 || value > 5)
+            {
+                return FINGERPRINT_INVALIDREG;
+            }
+            sim->securityLevel = value;
+            return FINGERPRINT_OK;
+        case SYSPARAM_PACKET_SIZE:
+            if (value > 3)
+            {
+                return FINGERPRINT_INVALIDREG;
+            }
+            sim->packetSizeCode = value;
+            return FINGERPRINT_OK;
+        default:
+            return FINGERPRINT_INVALIDREG;
+    }
+}
+
+// Takes the next entry of the finger script, if any is left
+static void advanceFingerScript(SensorSim *sim)
+{
+    uint32_t entry;
+
+    if (sim->scriptPosition == sim->scriptLength)
+    {
+        return;
+    }
+    entry = sim->fingerScript[sim->scriptPosition++];
+    sim->isFingerPresent = (entry != SIM_NO_FINGER);
+    if (sim->isFingerPresent)
+    {
+        sim->fingerId = entry;
+    }
+}
+
+static void executeCommand(SensorSim *sim, const uint8_t *data, uint16_t length)
+{
+    uint8_t *buffer;
+    uint16_t page;
+
+    sim->commandsReceived++;
+    if (sim->activeFault != NULL && sim->activeFault->kind == SIM_FAULT_CODE)
+    {
+        acknowledge(sim, (uint8_t)sim->activeFault->value);
+        return;
+    }
+    switch (data[0])
+    {
+        case FINGERPRINT_VERIFYPASSWORD:
+            acknowledge(sim, (length >= 5 && readU32(&data[1]) == sim->password) ? FINGERPRINT_OK : FINGERPRINT_PASSFAIL);
+            break;
+        case FINGERPRINT_SETPASSWORD:
+            sim->password = readU32(&data[1]);
+            acknowledge(sim, FINGERPRINT_OK);
+            break;
+        case FINGERPRINT_SETSYSPARAM:
+            acknowledge(sim, length >= 3 ? setParameter(sim, data[1], data[2]) : FINGERPRINT_PACKETRECIEVEERR);
+            break;
+        case FINGERPRINT_READSYSPARAM:
+            readParameters(sim);
+            break;
+        case FINGERPRINT_TEMPLATECOUNT:
+        {
+            uint16_t count = simTemplateCount(sim);
+            uint8_t result[3] = {FINGERPRINT_OK, (uint8_t)(count >> 8), (uint8_t)count};
+            emitPacket(sim, FINGERPRINT_ACKPACKET, result, 3);
+            break;
+        }
+        case FINGERPRINT_READINDEX:
+        {
+            uint8_t result[1 + INDEX_PAGE_SIZE] = {FINGERPRINT_OK};
+            for (uint16_t i = 0; i < INDEX_PAGE_PAGES; i++)
+            {
+                page = (uint16_t)(data[1] * INDEX_PAGE_PAGES + i);
+                if (page < SIM_CAPACITY && sim->isOccupied[page])
+                {
+                    result[1 + i / 8] |= (uint8_t)(1 << (i % 8));
+                }
+            }
+            emitPacket(sim, FINGERPRINT_ACKPACKET, result, sizeof(result));
+            break;
+        }
+        case FINGERPRINT_GETIMAGE:
+            advanceFingerScript(sim);
+            sim->isImageValid = sim->isFingerPresent;
+            sim->imageFingerId = sim->fingerId;
+            acknowledge(sim, sim->isFingerPresent ? FINGERPRINT_OK : FINGERPRINT_NOFINGER);
+            break;
+        case FINGERPRINT_IMAGE2TZ:
+            if (!sim->isImageValid)
+            {
+                acknowledge(sim, FINGERPRINT_INVALIDIMAGE);
+                break;
+            }
+            simMakeTemplate(selectBuffer(sim, data[1]), sim->imageFingerId);
+            acknowledge(sim, FINGERPRINT_OK);
+            break;
+        case FINGERPRINT_REGMODEL:
+            if (!isTemplateValid(sim->charBuffer[0]) || !isTemplateValid(sim->charBuffer[1]) ||
+                templateFinger(sim->charBuffer[0]) != templateFinger(sim->charBuffer[1]))
+            {
+                acknowledge(sim, FINGERPRINT_ENROLLMISMATCH);
+                break;
+            }
+            memcpy(sim->charBuffer[1], sim->charBuffer[0], SIM_TEMPLATE_SIZE);
+            acknowledge(sim, FINGERPRINT_OK);
+            break;
+        case FINGERPRINT_STORE:
+            page = readU16(&data[2]);
+            if (page >= SIM_CAPACITY)
+            {
+                acknowledge(sim, FINGERPRINT_BADLOCATION);
+                break;
+            }
+            memcpy(sim->library[page], selectBuffer(sim, data[1]), SIM_TEMPLATE_SIZE);
+            sim->isOccupied[page] = true;
+            acknowledge(sim, FINGERPRINT_OK);
+            break;
+        case FINGERPRINT_LOAD:
+            page = readU16(&data[2]);
+            if (page >= SIM_CAPACITY)
+            {
+                acknowledge(sim, FINGERPRINT_BADLOCATION);
+                break;
+            }
+            if (!sim->isOccupied[page])
+            {
+                acknowledge(sim, FINGERPRINT_DBRANGEFAIL);
+                break;
+            }
+            memcpy(selectBuffer(sim, data[1]), sim->library[page], SIM_TEMPLATE_SIZE);
+            acknowledge(sim, FINGERPRINT_OK);
+            break;
+        case FINGERPRINT_UPLOAD:
+            buffer = selectBuffer(sim, data[1]);
+            acknowledge(sim, FINGERPRINT_OK);
+            emitDataPackets(sim, buffer, SIM_TEMPLATE_SIZE);
+            break;
+        case FINGERPRINT_DOWNLOAD:
+            sim->downloadBuffer = (data[1] == 2) ? 1 : 0;
+            sim->downloadOffset = 0;
+            acknowledge(sim, FINGERPRINT_OK);
+            break;
+        case FINGERPRINT_UPLOADIMAGE:
+            sendImage(sim);
+            break;
+        case FINGERPRINT_MATCH:
+            match(sim);
+            break;
+        case FINGERPRINT_SEARCH:
+            search(sim, &data[1]);
+            break;
+        case FINGERPRINT_DELETE:
+        {
+            uint16_t count = readU16(&data[3]);
+            page = readU16(&data[1]);
+            if ((uint32_t)page + count > SIM_CAPACITY)
+            {
+                acknowledge(sim, FINGERPRINT_DELETEFAIL);
+                break;
+            }
+            for (uint16_t i = 0; i < count; i++)
+            {
+                sim->isOccupied[page + i] = false;
+            }
+            acknowledge(sim, FINGERPRINT_OK);
+            break;
+        }
+        case FINGERPRINT_EMPTY:
+            memset(sim->isOccupied, 0, sizeof(sim->isOccupied));
+            acknowledge(sim, FINGERPRINT_OK);
+            break;
+        case FINGERPRINT_LEDON:
+        case FINGERPRINT_LEDOFF:
+            sim->isLedOn = (data[0] == FINGERPRINT_LEDON);
+            acknowledge(sim, FINGERPRINT_OK);
+            break;
+        case FINGERPRINT_AURALEDCONFIG:
+            acknowledge(sim, FINGERPRINT_OK);
+            break;
+        default:
+            acknowledge(sim, FINGERPRINT_PACKETRECIEVEERR);
+            break;
+    }
+}
+
+static bool isFaultMatching(const SimFault *fault, uint8_t command)
+{
+    return fault->command == SIM_ANY_COMMAND || fault->command == command;
+}
+
+/**
+ * @brief  Fault that applies to the next command with an instruction code, the first one listed if several do
+ * @return NULL if the command is not affected
+ */
+static const SimFault *findFault(const SensorSim *sim, uint8_t command)
+{
+    for (uint8_t i = 0; i < sim->faultCount; i++)
+    {
+        const SimFault *fault = &sim->faults[i];
+
+        if (isFaultMatching(fault, command) && fault->seen >= fault->skip &&
+            (fault->count == 0 || fault->seen - fault->skip < fault->count) &&
+            (fault->period <= 1 || (fault->seen - fault->skip) % fault->period == 0))
+        {
+            return fault;
+        }
+    }
+    return NULL;
+}
+
+static void countFaultCommand(SensorSim *sim, uint8_t command)
+{
+    for (uint8_t i = 0; i < sim->faultCount; i++)
+    {
+        sim->faults[i].seen += isFaultMatching(&sim->faults[i], command);
+    }
+}
+
+/**
+ * @brief  Store a data packet of a template download in the selected character buffer
+ */
+static void receiveDataPacket(SensorSim *sim, const Packet *packet)
+{
+    uint16_t length = packet->length - 2;
+
+    if (sim->downloadBuffer < 0)
+    {
+        return;
+    }
+    if (sim->downloadOffset + length > SIM_TEMPLATE_SIZE)
+    {
+        length = SIM_TEMPLATE_SIZE - sim->downloadOffset;
+    }
+    memcpy(&sim->charBuffer[sim->downloadBuffer][sim->downloadOffset], packet->data, length);
+    sim->downloadOffset += length;
+    if (packet->type == FINGERPRINT_ENDDATAPACKET)
+    {
+        sim->downloadBuffer = -1;
+    }
+}
+
+void simInit(SensorSim *sim, SimWriter writer, void *context)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->address = SIM_DEFAULT_ADDRESS;
+    sim->securityLevel = 3;
+    sim->packetSizeCode = 2;
+    sim->baudMultiplier = 6;
+    sim->downloadBuffer = -1;
+    sim->writer = writer;
+    sim->writerContext = context;
+    resetPacketParser(&sim->parser);
+}
+
+/**
+ * @brief  Send the handshake byte the module emits once it is ready after power-up
+ */
+void simPowerOn(SensorSim *sim)
+{
+    uint8_t handshake = SENSOR_HANDSHAKE_BYTE;
+    sim->writer(&handshake, 1, sim->writerContext);
+}
+
+/**
+ * @brief  Bytes sent by the MCU to the module
+ */
+void simReceive(SensorSim *sim, const uint8_t *data, uint16_t length)
+{
+    Packet packet;
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        switch (parsePacketByte(&sim->parser, data[i]))
+        {
+            case PARSER_PACKET_OK:
+                getParsedPacket(&sim->parser, &packet);
+                if (packet.type == FINGERPRINT_COMMANDPACKET && packet.length > 2)
+                {
+                    sim->activeFault = findFault(sim, packet.data[0]);
+                    countFaultCommand(sim, packet.data[0]);
+                    sim->isResponseStarted = false;
+                    sim->faultsInjected += (sim->activeFault != NULL);
+                    executeCommand(sim, packet.data, packet.length - 2);
+                    sim->activeFault = NULL;
+                }
+                else if (packet.type == FINGERPRINT_DATAPACKET || packet.type == FINGERPRINT_ENDDATAPACKET)
+                {
+                    receiveDataPacket(sim, &packet);
+                }
+                break;
+            case PARSER_PACKET_BADSUM:
+                sim->badPackets++;
+                acknowledge(sim, FINGERPRINT_PACKETRECIEVEERR);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void simPlaceFinger(SensorSim *sim, uint32_t fingerId)
+{
+    sim->isFingerPresent = true;
+    sim->fingerId = fingerId;
+}
+
+void simRemoveFinger(SensorSim *sim)
+{
+    sim->isFingerPresent = false;
+}
+
+/**
+ * @brief  Script what the following GenImg commands find on the window, replacing any earlier script
+ * @param  script                            - Comma separated entries: a finger number, or - for an empty window,
+ *                                             each optionally repeated with *N, e.g. "-*3,7,7,-,8"
+ * @return false if the script is malformed or longer than SIM_MAX_SCRIPT entries
+ */
+bool simSetFingerScript(SensorSim *sim, const char *script)
+{
+    uint16_t length = 0;
+
+    while (*script != '\0')
+    {
+        uint32_t entry;
+        unsigned long repeat = 1;
+        char *end;
+
+        if (*script == '-')
+        {
+            entry = SIM_NO_FINGER;
+            end = (char *)script + 1;
+        }
+        else
+        {
+            entry = (uint32_t)strtoul(script, &end, 0);
+            if (end == script || entry == SIM_NO_FINGER)
+            {
+                return false;
+            }
+        }
+        if (*end == '*')
+        {
+            script = end + 1;
+            repeat = strtoul(script, &end, 0);
+            if (end == script)
+            {
+                return false;
+            }
+        }
+        if (*end != ',' && *end != '\0')
+        {
+            return false;
+        }
+        for (; repeat > 0; repeat--)
+        {
+            if (length == SIM_MAX_SCRIPT)
+            {
+                return false;
+            }
+            sim->fingerScript[length++] = entry;
+        }
+        script = end + (*end == ',');
+    }
+    sim->scriptLength = length;
+    sim->scriptPosition = 0;
+    return true;
+}
+
+/**
+ * @brief  Whether the next GenImg finds a finger, from the script or else from the finger on the window
+ */
+bool simNextCaptureHasFinger(const SensorSim *sim)
+{
+    if (sim->scriptPosition < sim->scriptLength)
+    {
+        return sim->fingerScript[sim->scriptPosition] != SIM_NO_FINGER;
+    }
+    return sim->isFingerPresent;
+}
+
+/**
+ * @brief  Add a fault; when several apply to a command, the one added first is injected
+ * @return false if SIM_MAX_FAULTS are already set
+ */
+bool simInjectFault(SensorSim *sim, const SimFault *fault)
+{
+    if (sim->faultCount == SIM_MAX_FAULTS)
+    {
+        return false;
+    }
+    sim->faults[sim->faultCount] = *fault;
+    sim->faults[sim->faultCount].seen = 0;
+    sim->faultCount++;
+    return true;
+}
+
+/**
+ * @brief  Parse "KIND[:COMMAND[:SKIP[:COUNT[:VALUE[:PERIOD]]]]]", e.g. "drop:0x01:2:1" loses the response to the
+ *         third GenImg and "corrupt:any:0:0:0:50" corrupts every fiftieth response. KIND is drop, corrupt, truncate,
+ *         noise, code or stall; COMMAND an instruction code or "any", the default.
+ * @return false if the text is not a fault
+ */
+bool simParseFault(const char *text, SimFault *fault)
+{
+    static const struct { const char *name; SimFaultKind kind; } kinds[] =
+    {
+        { "drop", SIM_FAULT_DROP }, { "corrupt", SIM_FAULT_CORRUPT }, { "truncate", SIM_FAULT_TRUNCATE },
+        { "noise", SIM_FAULT_NOISE }, { "code", SIM_FAULT_CODE }, { "stall", SIM_FAULT_STALL },
+    };
+    uint32_t *numbers[] = { &fault->skip, &fault->count, &fault->value, &fault->period };
+    size_t nameLength = strcspn(text, ":");
+    size_t i;
+    char *end;
+
+    memset(fault, 0, sizeof(*fault));
+    for (i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++)
+    {
+        if (strlen(kinds[i].name) == nameLength && strncmp(text, kinds[i].name, nameLength) == 0)
+        {
+            break;
+        }
+    }
+    if (i == sizeof(kinds) / sizeof(kinds[0]))
+    {
+        return false;
+    }
+    fault->kind = kinds[i].kind;
+    fault->command = SIM_ANY_COMMAND;
+    text += nameLength;
+    if (*text == '\0')
+    {
+        return true;
+    }
+    text++;
+    if (strncmp(text, "any", 3) == 0)
+    {
+        end = (char *)text + 3;
+    }
+    else
+    {
+        unsigned long command = strtoul(text, &end, 0);
+
+        if (end == text || command > 0xFF)
+        {
+            return false;
+        }
+        fault->command = (uint8_t)command;
+    }
+    for (i = 0; i < sizeof(numbers) / sizeof(numbers[0]) && *end == ':'; i++)
+    {
+        text = end + 1;
+        *numbers[i] = (uint32_t)strtoul(text, &end, 0);
+        if (end == text)
+        {
+            return false;
+        }
+    }
+    return *end == '\0';
+}
+
+/**
+ * @brief  Delay of a SIM_FAULT_STALL that applies to the next command with an instruction code, for the timing model
+ * @return Milliseconds, 0 if no stall applies
+ */
+uint32_t simPendingStallMs(const SensorSim *sim, uint8_t command)
+{
+    const SimFault *fault = findFault(sim, command);
+
+    return (fault != NULL && fault->kind == SIM_FAULT_STALL) ? fault->value : 0;
+}
+
+static void putLittleEndian(uint8_t *bytes, uint32_t value, uint8_t size)
+{
+    for (uint8_t i = 0; i < size; i++)
+    {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t getLittleEndian(const uint8_t *bytes, uint8_t size)
+{
+    uint32_t value = 0;
+
+    for (uint8_t i = 0; i < size; i++)
+    {
+        value |= (uint32_t)bytes[i] << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * @brief  Write the template library and the settings kept in the flash of the module, see sensor_sim.h
+ * @return false if the file cannot be written
+ */
+bool simSaveFlash(const SensorSim *sim, const char *path)
+{
+    uint8_t header[FLASH_HEADER_SIZE];
+    FILE *output = fopen(path, "wb");
+    bool isWritten;
+
+    if (output == NULL)
+    {
+        return false;
+    }
+    memcpy(header, SIM_FLASH_MAGIC, 8);
+    putLittleEndian(&header[8], sim->address, 4);
+    putLittleEndian(&header[12], sim->password, 4);
+    putLittleEndian(&header[16], sim->securityLevel, 2);
+    header[18] = sim->packetSizeCode;
+    header[19] = sim->baudMultiplier;
+    putLittleEndian(&header[20], simTemplateCount(sim), 2);
+    isWritten = fwrite(header, 1, FLASH_HEADER_SIZE, output) == FLASH_HEADER_SIZE;
+    for (uint16_t page = 0; page < SIM_CAPACITY && isWritten; page++)
+    {
+        if (sim->isOccupied[page])
+        {
+            putLittleEndian(header, page, 2);
+            isWritten = fwrite(header, 1, 2, output) == 2 &&
+                        fwrite(sim->library[page], 1, SIM_TEMPLATE_SIZE, output) == SIM_TEMPLATE_SIZE;
+        }
+    }
+    return fclose(output) == 0 && isWritten;
+}
+
+/**
+ * @brief  Restore what simSaveFlash() wrote, replacing the library and the settings. The module is left unchanged
+ *         if the file is missing or malformed.
+ * @return false if the file cannot be read or is not a flash file
+ */
+bool simLoadFlash(SensorSim *sim, const char *path)
+{
+    static bool isOccupied[SIM_CAPACITY];
+    static uint8_t library[SIM_CAPACITY][SIM_TEMPLATE_SIZE];
+    uint8_t header[FLASH_HEADER_SIZE];
+    FILE *input = fopen(path, "rb");
+    uint16_t count;
+    bool isRead;
+
+    if (input == NULL)
+    {
+        return false;
+    }
+    isRead = fread(header, 1, FLASH_HEADER_SIZE, input) == FLASH_HEADER_SIZE && memcmp(header, SIM_FLASH_MAGIC, 8) == 0;
+    count = isRead ? (uint16_t)getLittleEndian(&header[20], 2) : 0;
+    memset(isOccupied, 0, sizeof(isOccupied));
+    for (uint16_t i = 0; i < count && isRead; i++)
+    {
+        uint8_t pageBytes[2];
+        uint16_t page;
+
+        isRead = fread(pageBytes, 1, 2, input) == 2;
+        page = (uint16_t)getLittleEndian(pageBytes, 2);
+        isRead = isRead && page < SIM_CAPACITY &&
+                 fread(library[page], 1, SIM_TEMPLATE_SIZE, input) == SIM_TEMPLATE_SIZE;
+        if (isRead)
+        {
+            isOccupied[page] = true;
+        }
+    }
+    fclose(input);
+    if (!isRead)
+    {
+        return false;
+    }
+    sim->address = getLittleEndian(&header[8], 4);
+    sim->password = getLittleEndian(&header[12], 4);
+    sim->securityLevel = (uint16_t)getLittleEndian(&header[16], 2);
+    sim->packetSizeCode = header[18];
+    sim->baudMultiplier = header[19];
+    memcpy(sim->isOccupied, isOccupied, sizeof(isOccupied));
+    for (uint16_t page = 0; page < SIM_CAPACITY; page++)
+    {
+        if (isOccupied[page])
+        {
+            memcpy(sim->library[page], library[page], SIM_TEMPLATE_SIZE);
+        }
+    }
+    return true;
+}
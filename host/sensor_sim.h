@@ -0,0 +1,126 @@
+#ifndef SENSOR_SIM_H
+#define SENSOR_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "packet_parser.h"
+
+/*
+ * Simulated DY50 module for host builds. It parses the command packets written by the driver and answers like the
+ * real module. Fingers are identified by a number; a template or character file records the finger it was made from.
+ * Two of them score 60 or more if the numbers are equal and less otherwise; a search accepts the best page that
+ * reaches the threshold of the security level, so levels 1 and 2 let some impostors through and 4 and 5 reject
+ * some genuine fingers.
+ *
+ * For functional tests the module can also be driven by a finger script, a list of what every GenImg finds on the
+ * window, and by injected faults that break the response to chosen commands. simSaveFlash() and simLoadFlash() keep
+ * the template library and the settings in a file across runs. Latencies are added by host/sensor_timing.c.
+ *
+ * Flash file layout, multi-byte fields little endian:
+ *   SIM_FLASH_MAGIC (8) | address (4) | password (4) | security level (2) | packet size code (1) |
+ *   baud multiplier (1) | page count (2) | page count times: page (2) | template (SIM_TEMPLATE_SIZE)
+ */
+
+/* ***** Defines ***** */
+
+#define SIM_CAPACITY                            1000
+#define SIM_TEMPLATE_SIZE                       512
+#define SIM_IMAGE_WIDTH                         256
+#define SIM_IMAGE_HEIGHT                        288
+#define SIM_IMAGE_SIZE                          (SIM_IMAGE_WIDTH * SIM_IMAGE_HEIGHT / 2) // 4 bits per pixel
+#define SIM_DEFAULT_ADDRESS                     0xFFFFFFFF
+#define SIM_DATA_PACKET_SIZE                    128  // Packet size code 2
+#define SIM_MAX_SCRIPT                          256  // Entries of a finger script
+#define SIM_NO_FINGER                           0xFFFFFFFF // Finger script entry of an empty window
+#define SIM_MAX_FAULTS                          8
+#define SIM_ANY_COMMAND                         0x00 // SimFault.command matching every instruction code
+#define SIM_FLASH_MAGIC                         "DY50SIM\x01"
+
+/* ***** Structures ***** */
+
+// Output of the simulated module, i.e. the bytes the MCU receives
+typedef void (*SimWriter)(const uint8_t *data, uint16_t length, void *context);
+
+typedef enum
+{
+    SIM_FAULT_DROP,             // The command is executed, its response is lost
+    SIM_FAULT_CORRUPT,          // The first response packet has a wrong checksum
+    SIM_FAULT_TRUNCATE,         // Only the first half of the first response packet is sent
+    SIM_FAULT_NOISE,            // Stray bytes on the line in front of the response
+    SIM_FAULT_CODE,             // The command is not executed but answered with the confirmation code value
+    SIM_FAULT_STALL             // The response is value ms late; only with host/sensor_timing.c
+} SimFaultKind;
+
+// Applies to the matching commands after the first skip ones, to count of them or all if count is 0, and within
+// those to every period-th one
+typedef struct
+{
+    SimFaultKind kind;
+    uint8_t command;            // Instruction code, SIM_ANY_COMMAND for all
+    uint32_t skip;
+    uint32_t count;
+    uint32_t value;
+    uint32_t period;            // 0 or 1 for every command
+    uint32_t seen;              // Matching commands received so far
+} SimFault;
+
+typedef struct
+{
+    // Configuration
+    uint32_t address;
+    uint32_t password;
+    uint16_t securityLevel;
+    uint8_t packetSizeCode;                     // Data packet payload is 32 << packetSizeCode bytes
+    uint8_t baudMultiplier;                     // Baud rate is 9600 * baudMultiplier
+
+    // Finger on the window and captured image
+    bool isFingerPresent;
+    uint32_t fingerId;
+    bool isImageValid;
+    uint32_t imageFingerId;
+    uint32_t fingerScript[SIM_MAX_SCRIPT];      // Finger found by each GenImg, SIM_NO_FINGER for none
+    uint16_t scriptLength;
+    uint16_t scriptPosition;                    // Next entry; afterwards the window keeps the last state
+
+    // Character buffers and template library
+    uint8_t charBuffer[2][SIM_TEMPLATE_SIZE];
+    uint8_t library[SIM_CAPACITY][SIM_TEMPLATE_SIZE];
+    bool isOccupied[SIM_CAPACITY];
+    bool isLedOn;
+
+    // Template download in progress, -1 if none
+    int8_t downloadBuffer;
+    uint16_t downloadOffset;
+
+    PacketParser parser;
+    SimWriter writer;
+    void *writerContext;
+    uint32_t commandsReceived;
+    uint32_t badPackets;
+
+    // Fault injection
+    SimFault faults[SIM_MAX_FAULTS];
+    uint8_t faultCount;
+    const SimFault *activeFault;                // Fault of the command being executed
+    bool isResponseStarted;                     // A packet of the current response was sent
+    uint32_t faultsInjected;
+} SensorSim;
+
+/* ***** Functions ***** */
+
+void simInit(SensorSim *sim, SimWriter writer, void *context);
+void simPowerOn(SensorSim *sim);
+void simReceive(SensorSim *sim, const uint8_t *data, uint16_t length);
+void simPlaceFinger(SensorSim *sim, uint32_t fingerId);
+void simRemoveFinger(SensorSim *sim);
+void simMakeTemplate(uint8_t *buffer, uint32_t fingerId);
+uint16_t simTemplateCount(const SensorSim *sim);
+bool simSetFingerScript(SensorSim *sim, const char *script);
+bool simNextCaptureHasFinger(const SensorSim *sim);
+bool simInjectFault(SensorSim *sim, const SimFault *fault);
+bool simParseFault(const char *text, SimFault *fault);
+uint32_t simPendingStallMs(const SensorSim *sim, uint8_t command);
+bool simSaveFlash(const SensorSim *sim, const char *path);
+bool simLoadFlash(SensorSim *sim, const char *path);
+
+#endif /* SENSOR_SIM_H */
@@ -0,0 +1,320 @@
+/*
+ * Virtual-time link and module model, see sensor_timing.h.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sensor_timing.h"
+#include "host_transport.h"
+#include "dy50.h"
+
+// A packet of the module, handed to the driver when the clock reaches deliverAtUs
+typedef struct
+{
+    uint64_t deliverAtUs;
+    uint16_t length;
+    uint8_t data[PACKET_MAX_SIZE];
+} Delivery;
+
+typedef struct
+{
+    SensorSim *sim;
+    uint64_t commandLineFreeUs;     // End of the last byte sent to the module
+    uint64_t responseLineFreeUs;    // End of the last byte sent by the module
+    uint64_t readyUs;               // End of the module's current processing
+    Delivery deliveries[TIMING_MAX_DELIVERIES];
+    uint16_t deliveryHead;
+    uint16_t deliveryCount;
+} TimedPort;
+
+static TimingModel model;
+static TimedPort ports[HOST_MAX_SENSORS];
+static uint64_t nowUs;
+static uint64_t randomState;
+static TimingUserHook userHook;
+static void *userContext;
+
+static double randomUnit(void)
+{
+    // xorshift64*, in (0, 1]
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    return ((randomState * 2685821657736338717ull) >> 11) * (1.0 / 9007199254740992.0) + (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief  Draw a value, never negative
+ */
+double sampleDistribution(const Distribution *distribution)
+{
+    double value;
+
+    switch (distribution->kind)
+    {
+        case DISTRIBUTION_UNIFORM:
+            value = distribution->a + (distribution->b - distribution->a) * randomUnit();
+            break;
+        case DISTRIBUTION_NORMAL:
+            value = distribution->a + distribution->b * sqrt(-2.0 * log(randomUnit())) * cos(2.0 * M_PI * randomUnit());
+            break;
+        case DISTRIBUTION_EXPONENTIAL:
+            value = distribution->a - distribution->b * log(randomUnit());
+            break;
+        default:
+            value = distribution->a;
+            break;
+    }
+    return value > 0 ? value : 0;
+}
+
+/**
+ * @brief  Parse "fixed:A", "uniform:A:B", "normal:MEAN:SD" or "exp:OFFSET:MEAN"; a plain number is fixed
+ * @return false if the text is not a distribution
+ */
+bool parseDistribution(const char *text, Distribution *distribution)
+{
+    static const struct { const char *name; DistributionKind kind; } kinds[] =
+    {
+        { "fixed", DISTRIBUTION_FIXED }, { "uniform", DISTRIBUTION_UNIFORM }, { "normal", DISTRIBUTION_NORMAL },
+        { "exp", DISTRIBUTION_EXPONENTIAL },
+    };
+    const char *colon = strchr(text, ':');
+    char *end;
+
+    distribution->kind = DISTRIBUTION_FIXED;
+    distribution->b = 0;
+    if (colon != NULL)
+    {
+        size_t nameLength = (size_t)(colon - text);
+        size_t i;
+        for (i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++)
+        {
+            if (strlen(kinds[i].name) == nameLength && strncmp(text, kinds[i].name, nameLength) == 0)
+            {
+                break;
+            }
+        }
+        if (i == sizeof(kinds) / sizeof(kinds[0]))
+        {
+            return false;
+        }
+        distribution->kind = kinds[i].kind;
+        text = colon + 1;
+    }
+    distribution->a = strtod(text, &end);
+    if (end == text)
+    {
+        return false;
+    }
+    if (distribution->kind != DISTRIBUTION_FIXED)
+    {
+        if (*end != ':')
+        {
+            return false;
+        }
+        text = end + 1;
+        distribution->b = strtod(text, &end);
+        if (end == text)
+        {
+            return false;
+        }
+    }
+    return *end == '\0';
+}
+
+static uint64_t wireTimeUs(uint16_t length)
+{
+    return (uint64_t)length * 10 * 1000000 / model.baudRate;
+}
+
+static uint64_t sampleUs(const Distribution *distribution)
+{
+    return (uint64_t)(sampleDistribution(distribution) * 1000.0);
+}
+
+static uint64_t searchTimeUs(const SensorSim *sim, const uint8_t *parameters)
+{
+    uint32_t start = (uint32_t)(parameters[2] << 8 | parameters[3]);
+    uint32_t count = (uint32_t)(parameters[4] << 8 | parameters[5]);
+    uint32_t occupied = 0;
+
+    for (uint32_t page = start; page < start + count && page < SIM_CAPACITY; page++)
+    {
+        occupied += sim->isOccupied[page];
+    }
+    return sampleUs(&model.searchBase) + (uint64_t)(sampleDistribution(&model.searchPerTemplate) * 1000.0 * occupied);
+}
+
+/**
+ * @brief  Processing time of a command received by the module
+ */
+static uint64_t commandTimeUs(const SensorSim *sim, const WireFrame *frame)
+{
+    switch (frame->payload[0])
+    {
+        case FINGERPRINT_GETIMAGE:
+            return sampleUs(simNextCaptureHasFinger(sim) ? &model.capture : &model.command);
+        case FINGERPRINT_IMAGE2TZ:
+            return sampleUs(&model.extract);
+        case FINGERPRINT_REGMODEL:
+            return sampleUs(&model.merge);
+        case FINGERPRINT_STORE:
+        case FINGERPRINT_DELETE:
+        case FINGERPRINT_EMPTY:
+            return sampleUs(&model.flashWrite);
+        case FINGERPRINT_SEARCH:
+            return searchTimeUs(sim, frame->payload);
+        case FINGERPRINT_MATCH:
+            return sampleUs(&model.searchBase) + sampleUs(&model.searchPerTemplate); // A search of one template
+        default:
+            return sampleUs(&model.command);
+    }
+}
+
+/**
+ * @brief  Processing time of a packet received by the module, including an injected stall; data packets are stored
+ *         as they arrive
+ */
+static uint64_t processingTimeUs(const SensorSim *sim, const WireFrame *frame)
+{
+    if (frame->type != FINGERPRINT_COMMANDPACKET)
+    {
+        return 0;
+    }
+    return commandTimeUs(sim, frame) + (uint64_t)simPendingStallMs(sim, frame->payload[0]) * 1000;
+}
+
+// Output of the module: queued until the clock reaches the end of the packet on the line
+static void moduleWrite(const uint8_t *data, uint16_t length, void *context)
+{
+    TimedPort *port = (TimedPort *)context;
+    Delivery *delivery;
+    uint64_t start;
+
+    if (port->deliveryCount == TIMING_MAX_DELIVERIES || length > PACKET_MAX_SIZE)
+    {
+        return; // Lost on the line; the driver times out
+    }
+    start = port->readyUs > port->responseLineFreeUs ? port->readyUs : port->responseLineFreeUs;
+    port->responseLineFreeUs = start + wireTimeUs(length);
+    delivery = &port->deliveries[(port->deliveryHead + port->deliveryCount) % TIMING_MAX_DELIVERIES];
+    delivery->deliverAtUs = port->responseLineFreeUs;
+    delivery->length = length;
+    memcpy(delivery->data, data, length);
+    port->deliveryCount++;
+}
+
+// Output of the driver. The driver writes one complete frame per call, see sendFrame().
+static void driverWrite(const uint8_t *data, uint16_t length, void *context)
+{
+    TimedPort *port = (TimedPort *)context;
+    WireFrame frame;
+    uint64_t arrival = (nowUs > port->commandLineFreeUs ? nowUs : port->commandLineFreeUs) + wireTimeUs(length);
+
+    port->commandLineFreeUs = arrival;
+    if (userHook != NULL)
+    {
+        userHook((uint8_t)(port - ports), port->sim, arrival, userContext);
+    }
+    memcpy(&frame, data, length < sizeof(frame) ? length : sizeof(frame));
+    port->readyUs = (arrival > port->readyUs ? arrival : port->readyUs) + processingTimeUs(port->sim, &frame);
+    simReceive(port->sim, data, length);
+}
+
+// Hand every packet that is complete at the current time to the transport
+static bool deliverDue(void)
+{
+    bool isDelivered = false;
+
+    for (uint8_t i = 0; i < HOST_MAX_SENSORS; i++)
+    {
+        TimedPort *port = &ports[i];
+        while (port->deliveryCount > 0 && port->deliveries[port->deliveryHead].deliverAtUs <= nowUs)
+        {
+            Delivery *delivery = &port->deliveries[port->deliveryHead];
+            hostTransportReceive(i, delivery->data, delivery->length);
+            port->deliveryHead = (port->deliveryHead + 1) % TIMING_MAX_DELIVERIES;
+            port->deliveryCount--;
+            isDelivered = true;
+        }
+    }
+    return isDelivered;
+}
+
+// Frame wait hook of the transport: jump to the next packet, or to the timeout if none arrives before it
+static bool waitForFrame(uint32_t timeoutMs)
+{
+    uint64_t deadline = nowUs + (uint64_t)timeoutMs * 1000;
+    uint64_t next = deadline;
+
+    for (uint8_t i = 0; i < HOST_MAX_SENSORS; i++)
+    {
+        TimedPort *port = &ports[i];
+        if (port->deliveryCount > 0 && port->deliveries[port->deliveryHead].deliverAtUs < next)
+        {
+            next = port->deliveries[port->deliveryHead].deliverAtUs;
+        }
+    }
+    if (next > nowUs)
+    {
+        nowUs = next;
+    }
+    return deliverDue();
+}
+
+static uint32_t virtualClockMs(void)
+{
+    return (uint32_t)(nowUs / 1000);
+}
+
+/**
+ * @brief  Install the model on the host transport. Call after init(); the clock starts at 0.
+ * @param  seed                              - Seed of the processing time draws, non-zero
+ */
+void timingInit(const TimingModel *timing, uint64_t seed)
+{
+    model = *timing;
+    nowUs = 0;
+    randomState = seed != 0 ? seed : 1;
+    memset(ports, 0, sizeof(ports));
+    hostTransportSetClock(virtualClockMs);
+    setFrameWaitHooks(waitForFrame, NULL);
+}
+
+/**
+ * @brief  Connect a simulated module to a port of the host transport through the model
+ */
+void timingAttach(uint8_t port, SensorSim *sim)
+{
+    if (port < HOST_MAX_SENSORS)
+    {
+        ports[port].sim = sim;
+        sim->writer = moduleWrite;
+        sim->writerContext = &ports[port];
+        hostTransportConnect(port, driverWrite, &ports[port]);
+    }
+}
+
+void timingSetUserHook(TimingUserHook hook, void *context)
+{
+    userHook = hook;
+    userContext = context;
+}
+
+uint64_t timingNowUs(void)
+{
+    return nowUs;
+}
+
+/**
+ * @brief  Let time pass without a command, e.g. while the next user approaches the sensor
+ */
+void timingAdvanceTo(uint64_t timeUs)
+{
+    if (timeUs > nowUs)
+    {
+        nowUs = timeUs;
+    }
+    deliverDue();
+}
@@ -0,0 +1,63 @@
+#ifndef SENSOR_TIMING_H
+#define SENSOR_TIMING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sensor_sim.h"
+
+/*
+ * Virtual-time model of the link and the module for host builds. It sits between host/host_transport.c and
+ * host/sensor_sim.c: every byte takes 10 bit times on its line, every command takes a processing time drawn from
+ * the model, and the answer is handed to the driver only when the virtual clock reaches the end of its last byte.
+ * The clock advances only while the driver waits, so a run is deterministic for a seed and independent of the speed
+ * of the host. A SIM_FAULT_STALL injected into the module adds its delay to the drawn processing time.
+ */
+
+/* ***** Defines ***** */
+
+#define TIMING_MAX_DELIVERIES                   512  // Packets in flight per port; an image upload is 289
+
+/* ***** Structures ***** */
+
+typedef enum
+{
+    DISTRIBUTION_FIXED,         // a
+    DISTRIBUTION_UNIFORM,       // a to b
+    DISTRIBUTION_NORMAL,        // Mean a, standard deviation b, clipped at 0
+    DISTRIBUTION_EXPONENTIAL    // a plus an exponential tail of mean b
+} DistributionKind;
+
+typedef struct
+{
+    DistributionKind kind;
+    double a;
+    double b;
+} Distribution;
+
+// Processing times in milliseconds
+typedef struct
+{
+    uint32_t baudRate;
+    Distribution capture;           // GenImg with a finger on the window
+    Distribution extract;           // Img2Tz
+    Distribution merge;             // RegModel
+    Distribution flashWrite;        // Store, Delete, Empty
+    Distribution searchBase;        // Search and Match, independent of the gallery
+    Distribution searchPerTemplate; // Search, per occupied page in the searched range; Match compares one
+    Distribution command;           // Any other command, including GenImg without a finger
+} TimingModel;
+
+// Called before a command is executed so that the scenario can put a finger on the window or lift it
+typedef void (*TimingUserHook)(uint8_t port, SensorSim *sim, uint64_t nowUs, void *context);
+
+/* ***** Functions ***** */
+
+void timingInit(const TimingModel *model, uint64_t seed);
+void timingAttach(uint8_t port, SensorSim *sim);
+void timingSetUserHook(TimingUserHook hook, void *context);
+uint64_t timingNowUs(void);
+void timingAdvanceTo(uint64_t timeUs);
+double sampleDistribution(const Distribution *distribution);
+bool parseDistribution(const char *text, Distribution *distribution);
+
+#endif /* SENSOR_TIMING_H */
@@ -0,0 +1,212 @@
+/*
+ * Protocol round trip of the host build of the driver against the simulated module of host/sensor_sim.c.
+ *
+ *   cc -O2 -DDY50_HOST -I . -I lib -I host -I utils -o sim_roundtrip host/sim_roundtrip.c host/host_transport.c \
+ *      host/sensor_sim.c lib/dy50.c lib/sensor_command.c lib/checksum.c lib/packet_parser.c lib/wire_frame.c -lpthread
+ *   sim_roundtrip
+ *
+ * Every driver call is answered at once by the module in the calling thread, so the run is deterministic and only
+ * waits for the two responses the fault steps drop. The steps build on each other: a finger is enrolled, found by a
+ * search and matched after a load, its character file is uploaded and downloaded into the other buffer, the library
+ * is emptied, and finally injected faults check that a lost response is repeated or reported as a timeout. Failed
+ * checks are listed and fail the run.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "dy50.h"
+#include "sensor_sim.h"
+
+#define ENROL_FINGER                            7
+#define OTHER_FINGER                            8
+#define ENROL_PAGE                              5
+#define DOWNLOAD_PAGE                           9
+#define FAULT_TIMEOUT                           50   // Response timeout of the fault steps, in ms
+
+#define CHECK(condition)                        check((condition), #condition, __LINE__)
+
+// Character file collected by the DataPacketHandler of uploadModel()
+typedef struct
+{
+    uint8_t data[SIM_TEMPLATE_SIZE];
+    uint16_t length;
+    uint16_t packets;
+    bool isLastSeen;
+} Upload;
+
+static SensorSim sim;
+static uint32_t checks;
+static uint32_t failures;
+
+static void check(bool isPassed, const char *condition, int line)
+{
+    checks++;
+    if (!isPassed)
+    {
+        failures++;
+        printf("line %d: %s\n", line, condition);
+    }
+}
+
+// SensorWriter: the module reads the bytes the driver sends
+static void driverWrite(const uint8_t *data, uint16_t length, void *context)
+{
+    simReceive((SensorSim *)context, data, length);
+}
+
+// SimWriter: the answer reaches the driver like bytes from the UART interrupt handler
+static void sensorWrite(const uint8_t *data, uint16_t length, void *context)
+{
+    (void)context;
+    hostTransportReceive(0, data, length);
+}
+
+static void collectUpload(const uint8_t *data, uint16_t length, bool isLast, void *context)
+{
+    Upload *upload = context;
+    uint16_t room = sizeof(upload->data) - upload->length;
+
+    memcpy(&upload->data[upload->length], data, (length < room) ? length : room);
+    upload->length += length;
+    upload->packets++;
+    upload->isLastSeen = isLast;
+}
+
+// Capture of the finger on the window into a CharBuffer
+static uint8_t captureInto(uint32_t finger, uint8_t buffer)
+{
+    uint8_t statusCode;
+
+    simPlaceFinger(&sim, finger);
+    statusCode = getImage();
+    if (statusCode == FINGERPRINT_OK)
+    {
+        statusCode = image2Tz(buffer);
+    }
+    simRemoveFinger(&sim);
+    return statusCode;
+}
+
+static void testEnrol(void)
+{
+    CHECK(captureInto(ENROL_FINGER, 1) == FINGERPRINT_OK);
+    CHECK(captureInto(ENROL_FINGER, 2) == FINGERPRINT_OK);
+    CHECK(createModel() == FINGERPRINT_OK);
+    CHECK(storeModel(1, ENROL_PAGE) == FINGERPRINT_OK);
+    CHECK(sim.isOccupied[ENROL_PAGE]);
+    CHECK(getTemplateCount() == 1);
+
+    CHECK(captureInto(ENROL_FINGER, 1) == FINGERPRINT_OK);
+    CHECK(captureInto(OTHER_FINGER, 2) == FINGERPRINT_OK);
+    CHECK(createModel() == FINGERPRINT_ENROLLMISMATCH);
+}
+
+static void testSearch(void)
+{
+    FingerPageAndConfidence match;
+
+    CHECK(captureInto(ENROL_FINGER, 1) == FINGERPRINT_OK);
+    match = fingerSearch(1);
+    CHECK(match.statusCode == FINGERPRINT_OK);
+    CHECK(match.fingerprintPage == ENROL_PAGE);
+
+    CHECK(captureInto(OTHER_FINGER, 1) == FINGERPRINT_OK);
+    CHECK(fingerSearch(1).statusCode == FINGERPRINT_NOTFOUND);
+}
+
+static void testLoadAndMatch(void)
+{
+    uint16_t confidence = 0;
+
+    CHECK(loadModel(2, ENROL_PAGE) == FINGERPRINT_OK);
+    CHECK(captureInto(ENROL_FINGER, 1) == FINGERPRINT_OK);
+    CHECK(fingerMatch(&confidence) == FINGERPRINT_OK);
+    CHECK(confidence >= 60);
+
+    CHECK(captureInto(OTHER_FINGER, 1) == FINGERPRINT_OK);
+    CHECK(fingerMatch(&confidence) == FINGERPRINT_NOMATCH);
+}
+
+static void testUploadAndDownload(void)
+{
+    Upload upload = { { 0 }, 0, 0, false };
+    uint16_t packetLength = getParameters().packet_len;
+
+    CHECK(loadModel(1, ENROL_PAGE) == FINGERPRINT_OK);
+    CHECK(uploadModel(1, collectUpload, &upload) == FINGERPRINT_OK);
+    CHECK(upload.length == SIM_TEMPLATE_SIZE);
+    CHECK(upload.packets == SIM_TEMPLATE_SIZE / packetLength);
+    CHECK(upload.isLastSeen);
+    CHECK(memcmp(upload.data, sim.library[ENROL_PAGE], SIM_TEMPLATE_SIZE) == 0);
+
+    CHECK(packetLength > 0 && SIM_TEMPLATE_SIZE % packetLength == 0);
+    CHECK(beginDownloadModel(2) == FINGERPRINT_OK);
+    for (uint16_t offset = 0; packetLength > 0 && offset < SIM_TEMPLATE_SIZE; offset += packetLength)
+    {
+        sendDataPacket(&upload.data[offset], packetLength, offset + packetLength >= SIM_TEMPLATE_SIZE);
+    }
+    CHECK(memcmp(sim.charBuffer[1], upload.data, SIM_TEMPLATE_SIZE) == 0);
+    CHECK(storeModel(2, DOWNLOAD_PAGE) == FINGERPRINT_OK);
+    CHECK(getTemplateCount() == 2);
+
+    CHECK(captureInto(ENROL_FINGER, 1) == FINGERPRINT_OK);
+    setSearchWindow(DOWNLOAD_PAGE, 1);
+    CHECK(fingerSearch(1).fingerprintPage == DOWNLOAD_PAGE);
+    setSearchWindow(0, SIM_CAPACITY);
+}
+
+static void testEmpty(void)
+{
+    CHECK(emptyDatabase() == FINGERPRINT_OK);
+    CHECK(getTemplateCount() == 0);
+    CHECK(simTemplateCount(&sim) == 0);
+    CHECK(loadModel(1, ENROL_PAGE) != FINGERPRINT_OK);
+}
+
+static void testFaults(void)
+{
+    SimFault drop = { SIM_FAULT_DROP, SIM_ANY_COMMAND, 0, 1, 0, 0, 0 };
+    SimFault corrupt = { SIM_FAULT_CORRUPT, SIM_ANY_COMMAND, 0, 1, 0, 0, 0 };
+    uint8_t bitmap[INDEX_PAGE_SIZE];
+    uint32_t commands;
+
+    // One lost response of an idempotent command is repeated
+    setRetryPolicy(1, FAULT_TIMEOUT);
+    CHECK(simInjectFault(&sim, &drop));
+    commands = sim.commandsReceived;
+    CHECK(readIndexTable(0, bitmap) == FINGERPRINT_OK);
+    CHECK(sim.commandsReceived == commands + 2);
+
+    // Without retries it is reported, and the next command is answered normally
+    setRetryPolicy(0, FAULT_TIMEOUT);
+    drop.seen = 0;
+    sim.faultCount = 0;
+    CHECK(simInjectFault(&sim, &drop));
+    CHECK(checkPassword(DEFAULT_PASSWORD) == FINGERPRINT_TIMEOUT);
+    CHECK(checkPassword(DEFAULT_PASSWORD) == FINGERPRINT_OK);
+
+    // A response with a bad checksum is never taken for an answer
+    sim.faultCount = 0;
+    CHECK(simInjectFault(&sim, &corrupt));
+    CHECK(checkPassword(DEFAULT_PASSWORD) != FINGERPRINT_OK);
+    CHECK(checkPassword(DEFAULT_PASSWORD) == FINGERPRINT_OK);
+    CHECK(sim.faultsInjected == 3);
+}
+
+int main(void)
+{
+    init();
+    simInit(&sim, sensorWrite, NULL);
+    hostTransportConnect(0, driverWrite, &sim);
+    simPowerOn(&sim);
+    CHECK(sensorBegin(DEFAULT_PASSWORD) == FINGERPRINT_OK);
+
+    testEnrol();
+    testSearch();
+    testLoadAndMatch();
+    testUploadAndDownload();
+    testEmpty();
+    testFaults();
+
+    printf("%u checks, %u failed\n", checks, failures);
+    return failures == 0 ? 0 : 1;
+}
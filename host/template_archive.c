@@ -0,0 +1,362 @@
+/*
+ * Template archive, see template_archive.h.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "template_archive.h"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Archives are used in place and need a little endian host"
+#endif
+
+static uint32_t crcTable[256];
+
+static size_t alignUp(size_t value)
+{
+    return (value + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+}
+
+/**
+ * @brief  CRC-32 (IEEE 802.3), continued from a previous value; start with 0
+ */
+uint32_t archiveCrc32(uint32_t crc, const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    if (crcTable[1] == 0)
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t value = i;
+            for (uint8_t bit = 0; bit < 8; bit++)
+            {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            crcTable[i] = value;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc = crcTable[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t headerCrc(const ArchiveHeader *header)
+{
+    ArchiveHeader copy = *header;
+    copy.headerCrc = 0;
+    return archiveCrc32(0, &copy, sizeof(copy));
+}
+
+static uint32_t recordCrc(const ArchiveRecordHeader *record, uint32_t templateSize)
+{
+    uint32_t crc = archiveCrc32(0, &record->page, sizeof(record->page));
+    return archiveCrc32(crc, &record->flags, sizeof(ArchiveRecordHeader) - offsetof(ArchiveRecordHeader, flags) +
+                        templateSize);
+}
+
+static bool isHeaderValid(const ArchiveHeader *header)
+{
+    return memcmp(header->magic, ARCHIVE_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version <= ARCHIVE_VERSION && header->headerSize == sizeof(ArchiveHeader) &&
+           header->headerCrc == headerCrc(header) && header->templateSize <= ARCHIVE_MAX_TEMPLATE_SIZE &&
+           header->recordStride >= sizeof(ArchiveRecordHeader) + header->templateSize &&
+           header->recordStride % ARCHIVE_ALIGNMENT == 0;
+}
+
+/* ***** Writer ***** */
+
+static int writeBlock(ArchiveWriter *writer, const void *data, size_t length)
+{
+    return fwrite(data, 1, length, writer->file) == length ? 0 : -1;
+}
+
+/**
+ * @brief  Start an archive; the header is written immediately
+ * @param  file                              - Output opened for writing, may be a pipe
+ * @param  templateSize                      - Bytes per template, SHARD_TEMPLATE_SIZE for DY50 modules
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int archiveWriterOpen(ArchiveWriter *writer, FILE *file, uint32_t templateSize)
+{
+    memset(writer, 0, sizeof(*writer));
+    if (templateSize == 0 || templateSize > ARCHIVE_MAX_TEMPLATE_SIZE)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    writer->file = file;
+    memcpy(writer->header.magic, ARCHIVE_MAGIC, sizeof(writer->header.magic));
+    writer->header.version = ARCHIVE_VERSION;
+    writer->header.headerSize = sizeof(ArchiveHeader);
+    writer->header.templateSize = templateSize;
+    writer->header.recordStride = (uint32_t)alignUp(sizeof(ArchiveRecordHeader) + templateSize);
+    writer->header.recordsOffset = sizeof(ArchiveHeader);
+    writer->header.createdTime = (int64_t)time(NULL);
+    writer->header.headerCrc = headerCrc(&writer->header);
+    writer->record = calloc(1, writer->header.recordStride);
+    if (writer->record == NULL)
+    {
+        return -1;
+    }
+    return writeBlock(writer, &writer->header, sizeof(writer->header));
+}
+
+/**
+ * @brief  Append the template of a page
+ * @param  data                              - templateSize bytes
+ * @param  metadata                          - User ID and enrolment time, NULL if unknown
+ * @return 0 on success, -1 with errno EEXIST if the page was already written, EINVAL for ARCHIVE_NO_RECORD
+ */
+int archiveWriterAdd(ArchiveWriter *writer, uint32_t page, const uint8_t *data, const ArchiveMetadata *metadata)
+{
+    ArchiveRecordHeader *record = (ArchiveRecordHeader *)writer->record;
+    uint32_t templateSize = writer->header.templateSize;
+
+    if (page == ARCHIVE_NO_RECORD || writer->header.recordCount == ARCHIVE_NO_RECORD - 1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (page >= writer->indexCapacity)
+    {
+        uint32_t capacity = writer->indexCapacity > 0 ? writer->indexCapacity : 1024;
+        uint32_t *index;
+        while (capacity <= page && capacity < ARCHIVE_NO_RECORD / 2)
+        {
+            capacity *= 2;
+        }
+        if (capacity <= page)
+        {
+            capacity = page + 1;
+        }
+        index = realloc(writer->index, (size_t)capacity * sizeof(uint32_t));
+        if (index == NULL)
+        {
+            return -1;
+        }
+        memset(&index[writer->indexCapacity], 0xFF, (size_t)(capacity - writer->indexCapacity) * sizeof(uint32_t));
+        writer->index = index;
+        writer->indexCapacity = capacity;
+    }
+    if (writer->index[page] != ARCHIVE_NO_RECORD)
+    {
+        errno = EEXIST;
+        return -1;
+    }
+
+    memset(writer->record, 0, writer->header.recordStride);
+    record->magic = ARCHIVE_RECORD_MAGIC;
+    record->page = page;
+    if (metadata != NULL)
+    {
+        record->flags = RECORD_HAS_METADATA;
+        record->userId = metadata->userId;
+        record->enrolTime = metadata->enrolTime;
+        writer->header.flags |= ARCHIVE_HAS_METADATA;
+    }
+    memcpy(writer->record + sizeof(ArchiveRecordHeader), data, templateSize);
+    record->crc = recordCrc(record, templateSize);
+    if (writeBlock(writer, writer->record, writer->header.recordStride) != 0)
+    {
+        return -1;
+    }
+    writer->index[page] = writer->header.recordCount++;
+    if (page >= writer->header.pageCount)
+    {
+        writer->header.pageCount = page + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief  Write the index and the trailer, complete the header if the output is seekable and release the writer.
+ *         The file itself is not closed.
+ * @return 0 on success, -1 if writing failed
+ */
+int archiveWriterClose(ArchiveWriter *writer)
+{
+    ArchiveHeader *header = &writer->header;
+    uint32_t indexHead[ARCHIVE_ALIGNMENT / sizeof(uint32_t)] = { ARCHIVE_INDEX_MAGIC, header->pageCount };
+    uint8_t padding[ARCHIVE_ALIGNMENT] = {};
+    size_t indexBytes = (size_t)header->pageCount * sizeof(uint32_t);
+    int result;
+
+    header->indexOffset = header->recordsOffset + (uint64_t)header->recordCount * header->recordStride +
+                          sizeof(indexHead);
+    header->flags |= ARCHIVE_COMPLETE;
+    header->headerCrc = headerCrc(header);
+
+    result = writeBlock(writer, indexHead, sizeof(indexHead));
+    if (result == 0 && indexBytes > 0)
+    {
+        result = writeBlock(writer, writer->index, indexBytes);
+    }
+    if (result == 0)
+    {
+        result = writeBlock(writer, padding, alignUp(indexBytes) - indexBytes);
+    }
+    if (result == 0)
+    {
+        result = writeBlock(writer, header, sizeof(*header));
+    }
+    if (result == 0 && fseek(writer->file, 0, SEEK_SET) == 0)
+    {
+        result = writeBlock(writer, header, sizeof(*header));
+        fseek(writer->file, 0, SEEK_END);
+    }
+    if (fflush(writer->file) != 0)
+    {
+        result = -1;
+    }
+    free(writer->index);
+    free(writer->record);
+    writer->index = NULL;
+    writer->record = NULL;
+    return result;
+}
+
+/* ***** Mapped reader ***** */
+
+// Offsets come from the file, so offset + length may wrap around; compare without adding
+static bool isRangeInside(uint64_t offset, uint64_t length, size_t size)
+{
+    return offset <= size && length <= size - offset;
+}
+
+/**
+ * @brief  Map an archive read-only and locate its index; records are used in place
+ * @return 0 on success, -1 with errno set otherwise (EBADMSG for a damaged or incomplete archive)
+ */
+int archiveMapOpen(ArchiveMap *archive, const char *path)
+{
+    struct stat status;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    const ArchiveHeader *header;
+
+    memset(archive, 0, sizeof(*archive));
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < 2 * sizeof(ArchiveHeader))
+    {
+        close(fd);
+        errno = EBADMSG;
+        return -1;
+    }
+    archive->size = (size_t)status.st_size;
+    archive->base = mmap(NULL, archive->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (archive->base == MAP_FAILED)
+    {
+        archive->base = NULL;
+        return -1;
+    }
+
+    header = (const ArchiveHeader *)archive->base;
+    if (!isHeaderValid(header) || (header->flags & ARCHIVE_COMPLETE) == 0)
+    {
+        header = (const ArchiveHeader *)(archive->base + archive->size - sizeof(ArchiveHeader)); // Streamed
+    }
+    if (!isHeaderValid(header) || (header->flags & ARCHIVE_COMPLETE) == 0 ||
+        !isRangeInside(header->recordsOffset, (uint64_t)header->recordCount * header->recordStride, archive->size) ||
+        !isRangeInside(header->indexOffset, (uint64_t)header->pageCount * sizeof(uint32_t), archive->size) ||
+        header->indexOffset % sizeof(uint32_t) != 0)
+    {
+        archiveMapClose(archive);
+        errno = EBADMSG;
+        return -1;
+    }
+    archive->header = header;
+    archive->records = archive->base + header->recordsOffset;
+    archive->index = (const uint32_t *)(archive->base + header->indexOffset);
+    return 0;
+}
+
+void archiveMapClose(ArchiveMap *archive)
+{
+    if (archive->base != NULL)
+    {
+        munmap((void *)archive->base, archive->size);
+    }
+    memset(archive, 0, sizeof(*archive));
+}
+
+/**
+ * @brief  Check the checksum of a record; lookups do not, so that loading a gallery touches no template
+ */
+bool archiveRecordIsValid(const ArchiveMap *archive, const ArchiveRecordHeader *record)
+{
+    return record->magic == ARCHIVE_RECORD_MAGIC && record->crc == recordCrc(record, archive->header->templateSize);
+}
+
+/* ***** Stream reader ***** */
+
+/**
+ * @brief  Read the header of an archive from a file or pipe
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int archiveStreamOpen(ArchiveStream *stream, FILE *file)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->file = file;
+    if (fread(&stream->header, 1, sizeof(stream->header), file) != sizeof(stream->header) ||
+        !isHeaderValid(&stream->header))
+    {
+        errno = EBADMSG;
+        return -1;
+    }
+    stream->record = malloc(stream->header.recordStride);
+    return stream->record != NULL ? 0 : -1;
+}
+
+/**
+ * @brief  Read the next record
+ * @param  record                            - Set to the record, valid until the next call
+ * @return 1 for a record, 0 at the end of the records, -1 on a read error or a damaged record (errno EBADMSG). The
+ *         stream stays at the next record after a checksum error, so the caller may skip the record.
+ */
+int archiveStreamNext(ArchiveStream *stream, const ArchiveRecordHeader **record)
+{
+    ArchiveRecordHeader *next = (ArchiveRecordHeader *)stream->record;
+    uint32_t stride = stream->header.recordStride;
+
+    if (fread(&next->magic, 1, sizeof(next->magic), stream->file) != sizeof(next->magic))
+    {
+        errno = EBADMSG; // Truncated before the index
+        return -1;
+    }
+    if (next->magic == ARCHIVE_INDEX_MAGIC)
+    {
+        return 0;
+    }
+    if (next->magic != ARCHIVE_RECORD_MAGIC ||
+        fread(stream->record + sizeof(next->magic), 1, stride - sizeof(next->magic), stream->file) !=
+        stride - sizeof(next->magic))
+    {
+        errno = EBADMSG;
+        return -1;
+    }
+    *record = next;
+    if (next->crc != recordCrc(next, stream->header.templateSize))
+    {
+        errno = EBADMSG;
+        return -1;
+    }
+    return 1;
+}
+
+void archiveStreamClose(ArchiveStream *stream)
+{
+    free(stream->record);
+    stream->record = NULL;
+}
@@ -0,0 +1,152 @@
+#ifndef TEMPLATE_ARCHIVE_H
+#define TEMPLATE_ARCHIVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Template archive: a file of fingerprint templates that host tools map into memory and use in place.
+ *
+ * Layout, all fields little endian, every section 64-byte aligned:
+ *   ArchiveHeader                      64 bytes
+ *   records                            recordCount * recordStride bytes, in the order they were written
+ *   index header                       ARCHIVE_INDEX_MAGIC, pageCount (8 bytes, padded to 64)
+ *   index                              pageCount uint32 record numbers, ARCHIVE_NO_RECORD for empty pages
+ *   trailer                            copy of the final ArchiveHeader, 64 bytes
+ *
+ * A record is an ArchiveRecordHeader followed by templateSize bytes of template and padding up to recordStride. The
+ * record of a page is found in O(1) through the index; nothing has to be parsed or copied to use a record.
+ *
+ * The writer only appends, so an archive can be written to a pipe. The header at the start is then incomplete
+ * (ARCHIVE_COMPLETE clear) and the trailer is authoritative; when the output is seekable the header is rewritten on
+ * close. A streaming reader needs neither: it reads records until it meets the index header.
+ *
+ * Pages are gallery slots. Backups of a single module use its library pages; galleries combining several modules
+ * may number the slots as they like, up to 2^32 - 2.
+ */
+
+/* ***** Defines ***** */
+
+#define ARCHIVE_MAGIC                           "DY50TPL"   // 8 bytes including the terminator
+#define ARCHIVE_VERSION                         1
+#define ARCHIVE_ALIGNMENT                       64
+#define ARCHIVE_RECORD_MAGIC                    0x43455254u // "TREC"
+#define ARCHIVE_INDEX_MAGIC                     0x58444E49u // "INDX"
+#define ARCHIVE_NO_RECORD                       0xFFFFFFFFu
+#define ARCHIVE_MAX_TEMPLATE_SIZE               4096
+
+#define ARCHIVE_COMPLETE                        0x0001 // Header flag: counts and index offset are valid
+#define ARCHIVE_HAS_METADATA                    0x0002 // Header flag: some records carry metadata
+
+#define RECORD_HAS_METADATA                     0x0001 // Record flag: userId and enrolTime are set
+
+/* ***** Structures ***** */
+
+typedef struct
+{
+    char magic[8];              // ARCHIVE_MAGIC
+    uint16_t version;           // ARCHIVE_VERSION; readers reject newer major versions
+    uint16_t headerSize;        // sizeof(ArchiveHeader)
+    uint32_t flags;             // ARCHIVE_ flags
+    uint32_t templateSize;      // Bytes of template in every record
+    uint32_t recordStride;      // Distance between records, a multiple of ARCHIVE_ALIGNMENT
+    uint32_t recordCount;
+    uint32_t pageCount;         // Index entries, highest page + 1
+    uint64_t recordsOffset;     // File offset of record 0
+    uint64_t indexOffset;       // File offset of the index entries
+    int64_t createdTime;        // Unix seconds
+    uint32_t headerCrc;         // CRC-32 of the header with this field zero
+    uint32_t reserved;
+} ArchiveHeader;
+
+typedef struct
+{
+    uint32_t magic;             // ARCHIVE_RECORD_MAGIC
+    uint32_t page;
+    uint32_t crc;               // CRC-32 of the record from flags to the end of the template, and of page
+    uint32_t flags;             // RECORD_ flags
+    uint32_t userId;            // Valid with RECORD_HAS_METADATA
+    uint32_t reserved;
+    int64_t enrolTime;          // Unix seconds, valid with RECORD_HAS_METADATA
+} ArchiveRecordHeader;
+
+_Static_assert(sizeof(ArchiveHeader) == ARCHIVE_ALIGNMENT, "ArchiveHeader must fill one aligned block");
+_Static_assert(sizeof(ArchiveRecordHeader) == 32, "ArchiveRecordHeader layout is part of the format");
+
+typedef struct
+{
+    uint32_t userId;
+    int64_t enrolTime;
+} ArchiveMetadata;
+
+// Appends records to a file or pipe
+typedef struct
+{
+    FILE *file;
+    ArchiveHeader header;
+    uint32_t *index;            // Record number of every page so far
+    uint32_t indexCapacity;
+    uint8_t *record;            // Assembly buffer of one record
+} ArchiveWriter;
+
+// Archive mapped into memory
+typedef struct
+{
+    const uint8_t *base;
+    size_t size;
+    const ArchiveHeader *header; // Complete header, from the start of the file or the trailer
+    const uint32_t *index;
+    const uint8_t *records;
+} ArchiveMap;
+
+// Reads records one after the other from a file or pipe
+typedef struct
+{
+    FILE *file;
+    ArchiveHeader header;
+    uint8_t *record;
+} ArchiveStream;
+
+/* ***** Functions ***** */
+
+uint32_t archiveCrc32(uint32_t crc, const void *data, size_t length);
+
+int archiveWriterOpen(ArchiveWriter *writer, FILE *file, uint32_t templateSize);
+int archiveWriterAdd(ArchiveWriter *writer, uint32_t page, const uint8_t *data, const ArchiveMetadata *metadata);
+int archiveWriterClose(ArchiveWriter *writer);
+
+int archiveMapOpen(ArchiveMap *archive, const char *path);
+void archiveMapClose(ArchiveMap *archive);
+bool archiveRecordIsValid(const ArchiveMap *archive, const ArchiveRecordHeader *record);
+
+int archiveStreamOpen(ArchiveStream *stream, FILE *file);
+int archiveStreamNext(ArchiveStream *stream, const ArchiveRecordHeader **record);
+void archiveStreamClose(ArchiveStream *stream);
+
+static inline const ArchiveRecordHeader *archiveRecordAt(const ArchiveMap *archive, uint32_t record)
+{
+    return (const ArchiveRecordHeader *)(archive->records + (size_t)record * archive->header->recordStride);
+}
+
+/**
+ * @brief  Record of a page in O(1)
+ * @return NULL if the page is empty, beyond the index, or its index entry points past the last record
+ */
+static inline const ArchiveRecordHeader *archiveFindPage(const ArchiveMap *archive, uint32_t page)
+{
+    // ARCHIVE_NO_RECORD is never below recordCount, so one comparison covers empty pages and damaged entries
+    if (page >= archive->header->pageCount || archive->index[page] >= archive->header->recordCount)
+    {
+        return NULL;
+    }
+    return archiveRecordAt(archive, archive->index[page]);
+}
+
+static inline const uint8_t *archiveRecordTemplate(const ArchiveRecordHeader *record)
+{
+    return (const uint8_t *)(record + 1);
+}
+
+#endif /* TEMPLATE_ARCHIVE_H */
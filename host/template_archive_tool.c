@@ -0,0 +1,400 @@
+/*
+ * Backup, restore and inspection of template archives, see template_archive.h.
+ *
+ *   cc -O2 -I lib -I host -I utils -o template_archive host/template_archive_tool.c host/template_archive.c \
+ *      host/rpc_client.c lib/rpc_protocol.c
+ *
+ *   template_archive backup  (-d device [-b baud] | -u socket) [-n sensor] [-m metadata] archive|-
+ *   template_archive restore (-d device [-b baud] | -u socket) [-n sensor] archive|-
+ *   template_archive list    archive
+ *   template_archive verify  archive
+ *   template_archive extract archive page output
+ *
+ * backup and restore stream, so they can be chained through a pipe or ssh without a temporary file. The metadata file
+ * of a backup holds one "page userId enrolTime" line per page whose owner is known.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "template_archive.h"
+#include "rpc_client.h"
+#include "config.h"
+
+#define TEMPLATE_SIZE                           512  // Character file of a DY50 module
+#define TEMPLATE_BUFFER                         1    // CharBuffer used for the transfers
+
+typedef struct
+{
+    const char *device;
+    const char *socketPath;
+    int baudRate;
+    int sensor;                 // -1 to keep the default route
+    const char *metadataPath;
+} Options;
+
+/**
+ * @brief  Connect to the board or the daemon, select the sensor and read its capacity and packet length
+ */
+static int openSensor(RpcClient *client, const Options *options, uint16_t *capacity, uint16_t *packetLength)
+{
+    RpcFrame response;
+    int result = options->socketPath != NULL ? rpcClientConnect(client, options->socketPath)
+                                             : rpcClientOpen(client, options->device, options->baudRate);
+
+    if (result != 0)
+    {
+        fprintf(stderr, "%s: %s\n", options->socketPath != NULL ? options->socketPath : options->device,
+                strerror(errno));
+        return -1;
+    }
+    if (options->sensor >= 0)
+    {
+        uint8_t index = (uint8_t)options->sensor;
+        if (rpcClientCall(client, RPC_OP_SELECT_SENSOR, &index, 1, &response) != 0 || response.payload[0] != 0)
+        {
+            fprintf(stderr, "cannot select sensor %d\n", options->sensor);
+            return -1;
+        }
+    }
+    if (rpcClientCall(client, RPC_OP_GET_PARAMETERS, NULL, 0, &response) != 0 || response.length < 16)
+    {
+        fprintf(stderr, "cannot read the sensor parameters\n");
+        return -1;
+    }
+    *capacity = rpcGetU16(&response.payload[4]);
+    *packetLength = rpcGetU16(&response.payload[12]);
+    return 0;
+}
+
+/**
+ * @brief  Read "page userId enrolTime" lines into a table indexed by page
+ */
+static ArchiveMetadata *loadMetadata(const char *path, uint16_t capacity, bool **isKnown)
+{
+    FILE *file = fopen(path, "r");
+    ArchiveMetadata *metadata = calloc(capacity, sizeof(ArchiveMetadata));
+    unsigned long page;
+    unsigned long userId;
+    long long enrolTime;
+    char line[128];
+
+    *isKnown = calloc(capacity, sizeof(bool));
+    if (file == NULL || metadata == NULL || *isKnown == NULL)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (sscanf(line, "%lu %lu %lld", &page, &userId, &enrolTime) == 3 && page < capacity)
+        {
+            metadata[page].userId = (uint32_t)userId;
+            metadata[page].enrolTime = enrolTime;
+            (*isKnown)[page] = true;
+        }
+    }
+    fclose(file);
+    return metadata;
+}
+
+static int backup(const Options *options, const char *path)
+{
+    RpcClient client;
+    ArchiveWriter writer;
+    ArchiveMetadata *metadata = NULL;
+    bool *isKnown = NULL;
+    FILE *output = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    uint8_t data[TEMPLATE_SIZE];
+    uint16_t capacity;
+    uint16_t packetLength;
+    uint32_t saved = 0;
+    int result = 0;
+
+    if (output == NULL)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (openSensor(&client, options, &capacity, &packetLength) != 0 ||
+        archiveWriterOpen(&writer, output, TEMPLATE_SIZE) != 0)
+    {
+        return 1;
+    }
+    if (options->metadataPath != NULL)
+    {
+        metadata = loadMetadata(options->metadataPath, capacity, &isKnown);
+    }
+
+    for (uint16_t page = 0; page < capacity && result == 0; page++)
+    {
+        uint8_t request[3] = { TEMPLATE_BUFFER };
+        RpcFrame response;
+        size_t length;
+
+        rpcPutU16(&request[1], page);
+        if (rpcClientCall(&client, RPC_OP_LOAD_MODEL, request, sizeof(request), &response) != 0)
+        {
+            fprintf(stderr, "page %u: %s\n", page, strerror(errno));
+            result = 1;
+        }
+        else if (response.payload[0] != 0)
+        {
+            continue; // Empty page
+        }
+        else if (rpcClientUploadTemplate(&client, TEMPLATE_BUFFER, data, sizeof(data), &length) != 0 ||
+                 length != TEMPLATE_SIZE)
+        {
+            fprintf(stderr, "page %u: upload failed\n", page);
+            result = 1;
+        }
+        else if (archiveWriterAdd(&writer, page, data, metadata != NULL && isKnown[page] ? &metadata[page] : NULL))
+        {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            result = 1;
+        }
+        else
+        {
+            saved++;
+        }
+    }
+
+    if (archiveWriterClose(&writer) != 0 || (output != stdout && fclose(output) != 0))
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        result = 1;
+    }
+    rpcClientClose(&client);
+    free(metadata);
+    free(isKnown);
+    fprintf(stderr, "%u of %u pages saved\n", saved, capacity);
+    return result;
+}
+
+static int restore(const Options *options, const char *path)
+{
+    RpcClient client;
+    ArchiveStream stream;
+    const ArchiveRecordHeader *record;
+    FILE *input = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    uint16_t capacity;
+    uint16_t packetLength;
+    uint32_t restored = 0;
+    uint32_t skipped = 0;
+    int status;
+
+    if (input == NULL || archiveStreamOpen(&stream, input) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (stream.header.templateSize != TEMPLATE_SIZE)
+    {
+        fprintf(stderr, "%s: templates of %u bytes do not fit the sensor\n", path, stream.header.templateSize);
+        return 1;
+    }
+    if (openSensor(&client, options, &capacity, &packetLength) != 0)
+    {
+        return 1;
+    }
+
+    for (;;)
+    {
+        uint8_t request[3] = { TEMPLATE_BUFFER };
+        RpcFrame response;
+
+        record = NULL;
+        status = archiveStreamNext(&stream, &record);
+        if (status == 0)
+        {
+            break;
+        }
+        if (status < 0)
+        {
+            if (record == NULL)
+            {
+                fprintf(stderr, "%s: truncated or damaged archive\n", path);
+                break;
+            }
+            fprintf(stderr, "page %u: bad checksum, skipped\n", record->page);
+            skipped++;
+            continue;
+        }
+        if (record->page >= capacity)
+        {
+            fprintf(stderr, "page %u: beyond the capacity of %u, skipped\n", record->page, capacity);
+            skipped++;
+            continue;
+        }
+        rpcPutU16(&request[1], (uint16_t)record->page);
+        if (rpcClientDownloadTemplate(&client, TEMPLATE_BUFFER, archiveRecordTemplate(record), TEMPLATE_SIZE,
+                                      packetLength) != 0 ||
+            rpcClientCall(&client, RPC_OP_STORE_MODEL, request, sizeof(request), &response) != 0 ||
+            response.payload[0] != 0)
+        {
+            fprintf(stderr, "page %u: restore failed\n", record->page);
+            skipped++;
+            continue;
+        }
+        restored++;
+    }
+
+    archiveStreamClose(&stream);
+    rpcClientClose(&client);
+    if (input != stdin)
+    {
+        fclose(input);
+    }
+    fprintf(stderr, "%u pages restored, %u skipped\n", restored, skipped);
+    return (status == 0 && skipped == 0) ? 0 : 1;
+}
+
+static int openMap(ArchiveMap *archive, const char *path)
+{
+    if (archiveMapOpen(archive, path) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", path, errno == EBADMSG ? "not a complete template archive" : strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int list(const char *path)
+{
+    ArchiveMap archive;
+    const ArchiveHeader *header;
+
+    if (openMap(&archive, path) != 0)
+    {
+        return 1;
+    }
+    header = archive.header;
+    printf("version %u, %u records of %u bytes, %u pages, created %lld\n", header->version, header->recordCount,
+           header->templateSize, header->pageCount, (long long)header->createdTime);
+    for (uint32_t page = 0; page < header->pageCount; page++)
+    {
+        const ArchiveRecordHeader *record = archiveFindPage(&archive, page);
+        if (record == NULL)
+        {
+            continue;
+        }
+        if (record->flags & RECORD_HAS_METADATA)
+        {
+            printf("%u\tuser %u\tenrolled %lld\n", page, record->userId, (long long)record->enrolTime);
+        }
+        else
+        {
+            printf("%u\n", page);
+        }
+    }
+    archiveMapClose(&archive);
+    return 0;
+}
+
+static int verify(const char *path)
+{
+    ArchiveMap archive;
+    uint32_t bad = 0;
+
+    if (openMap(&archive, path) != 0)
+    {
+        return 1;
+    }
+    for (uint32_t i = 0; i < archive.header->recordCount; i++)
+    {
+        const ArchiveRecordHeader *record = archiveRecordAt(&archive, i);
+        if (!archiveRecordIsValid(&archive, record) || archiveFindPage(&archive, record->page) != record)
+        {
+            printf("record %u: damaged\n", i);
+            bad++;
+        }
+    }
+    printf("%u of %u records damaged\n", bad, archive.header->recordCount);
+    archiveMapClose(&archive);
+    return bad == 0 ? 0 : 1;
+}
+
+static int extract(const char *path, const char *pageText, const char *outputPath)
+{
+    ArchiveMap archive;
+    const ArchiveRecordHeader *record;
+    FILE *output;
+    int result = 0;
+
+    if (openMap(&archive, path) != 0)
+    {
+        return 1;
+    }
+    record = archiveFindPage(&archive, (uint32_t)strtoul(pageText, NULL, 0));
+    if (record == NULL || !archiveRecordIsValid(&archive, record))
+    {
+        fprintf(stderr, "page %s: %s\n", pageText, record == NULL ? "not in the archive" : "damaged");
+        archiveMapClose(&archive);
+        return 1;
+    }
+    output = strcmp(outputPath, "-") == 0 ? stdout : fopen(outputPath, "wb");
+    if (output == NULL || fwrite(archiveRecordTemplate(record), 1, archive.header->templateSize, output) !=
+        archive.header->templateSize || (output != stdout && fclose(output) != 0))
+    {
+        fprintf(stderr, "%s: %s\n", outputPath, strerror(errno));
+        result = 1;
+    }
+    archiveMapClose(&archive);
+    return result;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s backup  (-d device [-b baud] | -u socket) [-n sensor] [-m metadata] archive|-\n"
+            "       %s restore (-d device [-b baud] | -u socket) [-n sensor] archive|-\n"
+            "       %s list|verify archive\n"
+            "       %s extract archive page output|-\n",
+            program, program, program, program);
+}
+
+int main(int argc, char **argv)
+{
+    Options options = { NULL, NULL, UART_SENSOR_BAUD, -1, NULL };
+    const char *command = argc > 1 ? argv[1] : "";
+    int option;
+
+    if (strcmp(command, "list") == 0 && argc == 3)
+    {
+        return list(argv[2]);
+    }
+    if (strcmp(command, "verify") == 0 && argc == 3)
+    {
+        return verify(argv[2]);
+    }
+    if (strcmp(command, "extract") == 0 && argc == 5)
+    {
+        return extract(argv[2], argv[3], argv[4]);
+    }
+    if (strcmp(command, "backup") != 0 && strcmp(command, "restore") != 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    optind = 2;
+    while ((option = getopt(argc, argv, "d:b:u:n:m:")) != -1)
+    {
+        switch (option)
+        {
+            case 'd': options.device = optarg; break;
+            case 'b': options.baudRate = atoi(optarg); break;
+            case 'u': options.socketPath = optarg; break;
+            case 'n': options.sensor = atoi(optarg); break;
+            case 'm': options.metadataPath = optarg; break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc - 1 || (options.device == NULL) == (options.socketPath == NULL))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    return strcmp(command, "backup") == 0 ? backup(&options, argv[optind]) : restore(&options, argv[optind]);
+}
@@ -0,0 +1,182 @@
+/*
+ * Control of the sensor UART capture of the board, see utils/uart_capture.h, and listing of saved captures.
+ *
+ *   cc -O2 -I lib -I host -I utils -o uart_capture host/uart_capture_tool.c host/rpc_client.c lib/rpc_protocol.c
+ *   uart_capture -d device [-b baud] start|stop
+ *   uart_capture -d device [-b baud] [-s sensor baud] save file
+ *   uart_capture print file
+ *
+ * save drains the ring into a capture file for host/uart_replay.c and can be repeated while the capture runs; every
+ * call writes a new file with the records since the previous one. print lists a file one record per line.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "uart_capture.h"
+#include "rpc_client.h"
+#include "config.h"
+
+#define MAX_CAPTURE_SIZE                        (1 << 20)
+
+static int runCommand(RpcClient *client, uint8_t command)
+{
+    RpcFrame response;
+
+    if (rpcClientCall(client, RPC_OP_CAPTURE, &command, 1, &response) != 0 || response.payload[0] != 0)
+    {
+        fprintf(stderr, "capture command failed: %s\n", strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+static int save(RpcClient *client, const char *path, uint32_t sensorBaud)
+{
+    static uint8_t records[MAX_CAPTURE_SIZE];
+    uint8_t header[CAPTURE_FILE_HEADER_SIZE];
+    size_t length;
+    uint32_t dropped;
+    FILE *output;
+
+    if (rpcClientReadCapture(client, records, sizeof(records), &length, &dropped) != 0)
+    {
+        fprintf(stderr, "reading the capture failed: %s\n", strerror(errno));
+        return 1;
+    }
+    memcpy(header, CAPTURE_FILE_MAGIC, 8);
+    rpcPutU32(&header[8], sensorBaud);
+    rpcPutU32(&header[12], dropped);
+    output = fopen(path, "wb");
+    if (output == NULL || fwrite(header, 1, sizeof(header), output) != sizeof(header) ||
+        fwrite(records, 1, length, output) != length || fclose(output) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "%zu bytes of records, %u dropped\n", length, dropped);
+    return 0;
+}
+
+static int print(const char *path)
+{
+    static uint8_t data[MAX_CAPTURE_SIZE];
+    FILE *input = fopen(path, "rb");
+    size_t size;
+    size_t offset = CAPTURE_FILE_HEADER_SIZE;
+    uint32_t firstUs = 0;
+
+    if (input == NULL)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    size = fread(data, 1, sizeof(data), input);
+    fclose(input);
+    if (size < CAPTURE_FILE_HEADER_SIZE || memcmp(data, CAPTURE_FILE_MAGIC, 8) != 0)
+    {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        return 1;
+    }
+    printf("# sensor baud %u, %u records dropped since the capture was started\n", rpcGetU32(&data[8]),
+           rpcGetU32(&data[12]));
+    while (offset + CAPTURE_RECORD_HEADER_SIZE <= size)
+    {
+        uint32_t timeUs = rpcGetU32(&data[offset]);
+        uint8_t flags = data[offset + 4];
+        uint8_t length = data[offset + 5];
+
+        if (offset + CAPTURE_RECORD_HEADER_SIZE + length > size)
+        {
+            fprintf(stderr, "%s: truncated record at offset %zu\n", path, offset);
+            return 1;
+        }
+        if (offset == CAPTURE_FILE_HEADER_SIZE)
+        {
+            firstUs = timeUs;
+        }
+        if (flags & CAPTURE_FLAG_AFTER_GAP)
+        {
+            printf("# records dropped\n");
+        }
+        printf("%10.3f %u %s", (timeUs - firstUs) / 1000.0, flags & CAPTURE_PORT_MASK,
+               (flags & CAPTURE_FLAG_TO_SENSOR) ? "->" : "<-");
+        for (uint8_t i = 0; i < length; i++)
+        {
+            printf(" %02X", data[offset + CAPTURE_RECORD_HEADER_SIZE + i]);
+        }
+        printf("\n");
+        offset += CAPTURE_RECORD_HEADER_SIZE + length;
+    }
+    return 0;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s -d device [-b baud] start|stop\n"
+            "       %s -d device [-b baud] [-s sensor baud] save file\n"
+            "       %s print file\n", program, program, program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *device = NULL;
+    const char *command;
+    int baudRate = UART_PRINT_BAUD;
+    uint32_t sensorBaud = UART_SENSOR_BAUD;
+    RpcClient client;
+    int option;
+    int result;
+
+    while ((option = getopt(argc, argv, "d:b:s:")) != -1)
+    {
+        switch (option)
+        {
+            case 'd': device = optarg; break;
+            case 'b': baudRate = atoi(optarg); break;
+            case 's': sensorBaud = (uint32_t)strtoul(optarg, NULL, 0); break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind == argc)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    command = argv[optind];
+    if (strcmp(command, "print") == 0 && optind + 2 == argc)
+    {
+        return print(argv[optind + 1]);
+    }
+    if (device == NULL || optind + (strcmp(command, "save") == 0 ? 2 : 1) != argc)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if (rpcClientOpen(&client, device, baudRate) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", device, strerror(errno));
+        return 1;
+    }
+    if (strcmp(command, "start") == 0)
+    {
+        result = runCommand(&client, CAPTURE_COMMAND_START);
+    }
+    else if (strcmp(command, "stop") == 0)
+    {
+        result = runCommand(&client, CAPTURE_COMMAND_STOP);
+    }
+    else if (strcmp(command, "save") == 0)
+    {
+        result = save(&client, argv[optind + 1], sensorBaud);
+    }
+    else
+    {
+        usage(argv[0]);
+        result = 2;
+    }
+    rpcClientClose(&client);
+    return result;
+}
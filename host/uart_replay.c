@@ -0,0 +1,957 @@
+/*
+ * Replay of a sensor UART capture, see utils/uart_capture.h, through the host build of the driver.
+ *
+ *   cc -O2 -DDY50_HOST -I . -I lib -I host -I utils -o uart_replay host/uart_replay.c host/host_transport.c \
+ *      lib/dy50.c lib/sensor_command.c lib/checksum.c lib/packet_parser.c lib/wire_frame.c -lpthread
+ *   uart_replay [-s speed] [-t tolerance ms] [-T timeout ms] [-r retries] [-v] capture
+ *
+ * Captures of several sensors need the SENSOR_COUNT of the board, e.g. -DSENSOR_COUNT=4.
+ *
+ * Every command the board sent in the capture is turned back into the driver call that sends it, e.g. LOAD of
+ * CharBuffer2 followed by MATCH into fingerVerify(), and the call is executed against the recorded answer. The bytes
+ * the board received after a command are handed to the transport at their original offsets from the command, one
+ * byte at a time; the time of every byte is worked out from the time its chunk was read and the baud rate. Idle time
+ * between commands is kept as well.
+ *
+ * With -s 0, the default, time is virtual: the clock jumps to the next byte while the driver waits, so a replay is
+ * deterministic and takes no longer than the processing. -s 1 replays in real time on the monotonic clock with the
+ * bytes fed from another thread, like the interrupt handler does on the board; -s 10 replays ten times faster.
+ *
+ * A call is a regression if it returns another result than the board got from the same answer (the parser or the
+ * retry handling changed), if the driver sent other bytes than the board did, or if it took longer than on the
+ * board by more than the tolerance (e.g. a response timeout shorter than the module's processing time, see -T).
+ * Regressions are listed and fail the run. Commands without a driver call of their own are skipped.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "dy50.h"
+#include "uart_capture.h"
+
+#define REPLAY_MAX_CAPTURE                      (16 << 20)
+#define NO_RESPONSE                             UINT32_MAX
+
+// A byte received from the sensor, relative to the time of the command it followed
+typedef struct
+{
+    uint32_t offsetUs;
+    uint8_t byte;
+} RxByte;
+
+// A frame the board sent in the capture and the bytes it received on the same port until the next frame
+typedef struct
+{
+    uint64_t timeUs;
+    uint8_t port;
+    uint16_t length;            // Bytes of wire recorded, complete at wireFrameSize()
+    WireFrame wire;
+    RxByte *rx;
+    uint32_t rxCount;
+    uint32_t rxCapacity;
+    uint8_t code;               // Confirmation code the driver got from the response, or its link error
+    uint8_t ack[5];             // Confirmation code and the first parameters of the acknowledgement
+    uint16_t dataPackets;       // Data packets after the acknowledgement, up to the end packet
+    bool hasEndPacket;
+    uint32_t responseEndUs;     // Offset of the end of the last complete packet, NO_RESPONSE if none
+    bool isConsumed;
+} CapturedFrame;
+
+// A byte scheduled for the transport
+typedef struct
+{
+    uint64_t dueUs;
+    uint8_t byte;
+} Delivery;
+
+typedef struct
+{
+    Delivery *deliveries;
+    uint32_t head;
+    uint32_t count;
+    uint32_t capacity;
+} DeliveryQueue;
+
+typedef struct
+{
+    uint8_t code;
+    bool hasMatch;              // page and confidence are valid
+    uint16_t page;
+    uint16_t confidence;
+    bool hasPackets;            // packets is valid
+    uint16_t packets;
+} CallResult;
+
+typedef struct
+{
+    const char *name;
+    uint32_t first;             // First frame of the step
+    uint32_t last;              // Last frame of the step, on the same port
+} Step;
+
+static CapturedFrame *frames;
+static uint32_t frameCount;
+static uint32_t sensorBaud;
+static Step step;               // Step being replayed; the driver's frames are matched against its frames
+static DeliveryQueue queues[HOST_MAX_SENSORS];
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueCondition = PTHREAD_COND_INITIALIZER;
+static double speed;            // 0 for virtual time
+static uint64_t nowUs;          // Virtual clock
+static struct timespec realStart;
+static bool isFrameSignalled;
+static bool isStopping;
+static uint32_t txDivergences;
+static uint32_t extraFrames;
+static uint8_t maxRetries = DEFAULT_MAX_RETRIES;
+
+/* ***** Capture file ***** */
+
+static uint8_t instructionOf(const CapturedFrame *frame)
+{
+    return frame->wire.payload[0];
+}
+
+static bool isLinkError(uint8_t code)
+{
+    return code == FINGERPRINT_TIMEOUT || code == FINGERPRINT_BADPACKET || code == FINGERPRINT_PACKETRECIEVEERR;
+}
+
+static void appendRx(CapturedFrame *frame, uint32_t offsetUs, uint8_t byte)
+{
+    if (frame->rxCount == frame->rxCapacity)
+    {
+        frame->rxCapacity = frame->rxCapacity ? frame->rxCapacity * 2 : 64;
+        frame->rx = realloc(frame->rx, frame->rxCapacity * sizeof(RxByte));
+        if (frame->rx == NULL)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    frame->rx[frame->rxCount].offsetUs = offsetUs;
+    frame->rx[frame->rxCount++].byte = byte;
+}
+
+/**
+ * @brief  Find the next packet in the received bytes. Kept apart from lib/packet_parser.c on purpose: it decides what
+ *         the board got, which the parser under test is compared against.
+ * @param  position                          - Byte to start at, moved past the packet
+ * @param  endUs                             - Set to the offset of the last byte of the packet
+ * @param  isChecksumValid                   - Set to whether the checksum matches
+ * @return false if no complete packet follows
+ */
+static bool nextPacket(const CapturedFrame *frame, uint32_t *position, WireFrame *packet, uint32_t *endUs,
+                       bool *isChecksumValid)
+{
+    for (uint32_t start = *position; start + PACKET_HEADER_SIZE <= frame->rxCount; start++)
+    {
+        uint8_t *bytes = wireFrameBytes(packet);
+        uint16_t length;
+        uint16_t sum = 0;
+
+        if (frame->rx[start].byte != FINGERPRINT_STARTCODE_HIGH ||
+            frame->rx[start + 1].byte != FINGERPRINT_STARTCODE_LOW)
+        {
+            continue;
+        }
+        for (uint16_t i = 0; i < PACKET_HEADER_SIZE; i++)
+        {
+            bytes[i] = frame->rx[start + i].byte;
+        }
+        length = wireFrameLength(packet);
+        if (length < PACKET_CHECKSUM_SIZE || length > PACKET_MAX_DATA + PACKET_CHECKSUM_SIZE)
+        {
+            continue;
+        }
+        if (start + PACKET_HEADER_SIZE + length > frame->rxCount)
+        {
+            return false;
+        }
+        for (uint16_t i = 0; i < length; i++)
+        {
+            packet->payload[i] = frame->rx[start + PACKET_HEADER_SIZE + i].byte;
+        }
+        for (uint16_t i = 6; i < PACKET_HEADER_SIZE + length - PACKET_CHECKSUM_SIZE; i++)
+        {
+            sum += bytes[i];
+        }
+        *position = start + PACKET_HEADER_SIZE + length;
+        *endUs = frame->rx[*position - 1].offsetUs;
+        *isChecksumValid = (sum == wireFrameChecksum(packet));
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief  Work out what the board made of the bytes received after a frame, as transact() and receiveDataPackets()
+ *         do
+ */
+static void analyzeResponse(CapturedFrame *frame)
+{
+    WireFrame packet;
+    uint32_t position = 0;
+    uint32_t endUs;
+    bool isChecksumValid;
+
+    frame->code = FINGERPRINT_TIMEOUT;
+    frame->responseEndUs = NO_RESPONSE;
+    if (!nextPacket(frame, &position, &packet, &endUs, &isChecksumValid))
+    {
+        return;
+    }
+    frame->responseEndUs = endUs;
+    if (!isChecksumValid || packet.type != FINGERPRINT_ACKPACKET)
+    {
+        frame->code = FINGERPRINT_BADPACKET;
+        return;
+    }
+    frame->code = packet.payload[0];
+    memcpy(frame->ack, packet.payload, sizeof(frame->ack));
+    while (!frame->hasEndPacket && nextPacket(frame, &position, &packet, &endUs, &isChecksumValid) &&
+           isChecksumValid && (packet.type == FINGERPRINT_DATAPACKET || packet.type == FINGERPRINT_ENDDATAPACKET))
+    {
+        frame->responseEndUs = endUs;
+        frame->dataPackets++;
+        frame->hasEndPacket = (packet.type == FINGERPRINT_ENDDATAPACKET);
+    }
+}
+
+/**
+ * @brief  Split a capture file into the frames sent by the board and the bytes received after each of them
+ * @return false if the file is not a capture
+ */
+static bool loadCapture(const uint8_t *data, size_t size)
+{
+    CapturedFrame *lastFrames[HOST_MAX_SENSORS] = { NULL }; // Per port, receives the following bytes
+    uint64_t timeUs = 0;
+    uint32_t lastUs = 0;
+    uint32_t byteUs;
+    uint32_t txRecords = 0;
+    size_t offset;
+
+    if (size < CAPTURE_FILE_HEADER_SIZE || memcmp(data, CAPTURE_FILE_MAGIC, 8) != 0)
+    {
+        return false;
+    }
+    sensorBaud = (uint32_t)data[8] | (uint32_t)data[9] << 8 | (uint32_t)data[10] << 16 | (uint32_t)data[11] << 24;
+    byteUs = 10 * 1000000 / (sensorBaud ? sensorBaud : UART_SENSOR_BAUD);
+    for (offset = CAPTURE_FILE_HEADER_SIZE; offset + CAPTURE_RECORD_HEADER_SIZE <= size;
+         offset += CAPTURE_RECORD_HEADER_SIZE + data[offset + 5])
+    {
+        txRecords += (data[offset + 4] & CAPTURE_FLAG_TO_SENSOR) != 0;
+    }
+    frames = calloc(txRecords + 1, sizeof(CapturedFrame));
+    if (frames == NULL)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    offset = CAPTURE_FILE_HEADER_SIZE;
+    while (offset + CAPTURE_RECORD_HEADER_SIZE <= size)
+    {
+        const uint8_t *record = &data[offset];
+        uint32_t recordUs = (uint32_t)record[0] | (uint32_t)record[1] << 8 | (uint32_t)record[2] << 16 |
+                            (uint32_t)record[3] << 24;
+        uint8_t port = record[4] & CAPTURE_PORT_MASK;
+        uint8_t length = record[5];
+        const uint8_t *bytes = &record[CAPTURE_RECORD_HEADER_SIZE];
+        CapturedFrame *frame = lastFrames[port];
+
+        if (offset + CAPTURE_RECORD_HEADER_SIZE + length > size)
+        {
+            break;
+        }
+        timeUs += (offset == CAPTURE_FILE_HEADER_SIZE) ? 0 : (uint32_t)(recordUs - lastUs); // The time wraps
+        lastUs = recordUs;
+        offset += CAPTURE_RECORD_HEADER_SIZE + length;
+        if (record[4] & CAPTURE_FLAG_AFTER_GAP)
+        {
+            // Bytes after a gap cannot be assigned to the frame before it
+            memset(lastFrames, 0, sizeof(lastFrames));
+            frame = NULL;
+        }
+
+        if (record[4] & CAPTURE_FLAG_TO_SENSOR)
+        {
+            // Frames longer than a record continue in the next record with the same time
+            bool isContinued = frame != NULL && frame->timeUs == timeUs && frame->length >= PACKET_HEADER_SIZE &&
+                               frame->length < wireFrameSize(&frame->wire);
+            if (!isContinued)
+            {
+                frame = &frames[frameCount++];
+                frame->timeUs = timeUs;
+                frame->port = port;
+                lastFrames[port] = frame;
+            }
+            for (uint8_t i = 0; i < length && frame->length < PACKET_MAX_SIZE; i++)
+            {
+                wireFrameBytes(&frame->wire)[frame->length++] = bytes[i];
+            }
+        }
+        else if (frame != NULL)
+        {
+            // Stamped when the last byte of the chunk was read, the ones before arrived a byte time apart
+            for (uint8_t i = 0; i < length; i++)
+            {
+                uint64_t arrivalUs = timeUs - (uint64_t)(length - 1 - i) * byteUs;
+                appendRx(frame, arrivalUs > frame->timeUs ? (uint32_t)(arrivalUs - frame->timeUs) : 0, bytes[i]);
+            }
+        }
+    }
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        analyzeResponse(&frames[i]);
+    }
+    return true;
+}
+
+/* ***** Time and delivery ***** */
+
+static uint64_t realUs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)((now.tv_sec - realStart.tv_sec) * 1000000 + (now.tv_nsec - realStart.tv_nsec) / 1000);
+}
+
+// Time of the session: virtual, or real time multiplied by the speed
+static uint64_t sessionUs(void)
+{
+    return speed > 0 ? (uint64_t)(realUs() * speed) : nowUs;
+}
+
+static uint32_t sessionMs(void)
+{
+    return (uint32_t)(sessionUs() / 1000);
+}
+
+static void schedule(uint8_t port, uint64_t dueUs, uint8_t byte)
+{
+    DeliveryQueue *queue = &queues[port];
+    uint32_t position;
+
+    if (queue->head == queue->count)
+    {
+        queue->head = 0;
+        queue->count = 0;
+    }
+    if (queue->count == queue->capacity)
+    {
+        queue->capacity = queue->capacity ? queue->capacity * 2 : 1024;
+        queue->deliveries = realloc(queue->deliveries, queue->capacity * sizeof(Delivery));
+        if (queue->deliveries == NULL)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    // Bytes of a repeated command can be due before the late bytes of the first attempt
+    position = queue->count++;
+    while (position > queue->head && queue->deliveries[position - 1].dueUs > dueUs)
+    {
+        queue->deliveries[position] = queue->deliveries[position - 1];
+        position--;
+    }
+    queue->deliveries[position].dueUs = dueUs;
+    queue->deliveries[position].byte = byte;
+}
+
+// Earliest scheduled byte of any port, UINT64_MAX if none. Called with queueLock held.
+static uint64_t nextDueUs(void)
+{
+    uint64_t next = UINT64_MAX;
+
+    for (uint8_t i = 0; i < HOST_MAX_SENSORS; i++)
+    {
+        if (queues[i].head < queues[i].count && queues[i].deliveries[queues[i].head].dueUs < next)
+        {
+            next = queues[i].deliveries[queues[i].head].dueUs;
+        }
+    }
+    return next;
+}
+
+// Hand every byte that is due at the given time to the transport. Called with queueLock held.
+static bool deliverDue(uint64_t atUs)
+{
+    bool isDelivered = false;
+
+    for (uint8_t i = 0; i < HOST_MAX_SENSORS; i++)
+    {
+        DeliveryQueue *queue = &queues[i];
+        while (queue->head < queue->count && queue->deliveries[queue->head].dueUs <= atUs)
+        {
+            uint8_t byte = queue->deliveries[queue->head++].byte;
+
+            pthread_mutex_unlock(&queueLock);
+            hostTransportReceive(i, &byte, 1);
+            pthread_mutex_lock(&queueLock);
+            isDelivered = true;
+        }
+    }
+    return isDelivered;
+}
+
+// Frame wait hook in virtual time: jump to the next byte, or to the timeout if none is due before it
+static bool waitVirtual(uint32_t timeoutMs)
+{
+    uint64_t deadline = nowUs + (uint64_t)timeoutMs * 1000;
+    uint64_t next;
+    bool isDelivered;
+
+    pthread_mutex_lock(&queueLock);
+    next = nextDueUs();
+    nowUs = next < deadline ? (next > nowUs ? next : nowUs) : deadline;
+    isDelivered = deliverDue(nowUs);
+    pthread_mutex_unlock(&queueLock);
+    return isDelivered;
+}
+
+static void deadlineIn(struct timespec *deadline, uint64_t sessionDelayUs)
+{
+    uint64_t delayNs = (uint64_t)(sessionDelayUs / speed) * 1000;
+
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += (time_t)(delayNs / 1000000000);
+    deadline->tv_nsec += (long)(delayNs % 1000000000);
+    if (deadline->tv_nsec >= 1000000000)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+// Frame wait hook in real time: sleep until a byte was handed to the transport or the timeout expires
+static bool waitReal(uint32_t timeoutMs)
+{
+    struct timespec deadline;
+    bool isSignalled;
+
+    deadlineIn(&deadline, (uint64_t)timeoutMs * 1000);
+    pthread_mutex_lock(&queueLock);
+    if (!isFrameSignalled)
+    {
+        pthread_cond_timedwait(&queueCondition, &queueLock, &deadline);
+    }
+    isSignalled = isFrameSignalled;
+    isFrameSignalled = false;
+    pthread_mutex_unlock(&queueLock);
+    return isSignalled;
+}
+
+static void signalReal(void)
+{
+    pthread_mutex_lock(&queueLock);
+    isFrameSignalled = true;
+    pthread_cond_broadcast(&queueCondition);
+    pthread_mutex_unlock(&queueLock);
+}
+
+// Plays the part of the UART interrupt handlers in real time
+static void *feedBytes(void *argument)
+{
+    (void)argument;
+    pthread_mutex_lock(&queueLock);
+    while (!isStopping)
+    {
+        uint64_t next = nextDueUs();
+        uint64_t now = sessionUs();
+
+        if (next <= now)
+        {
+            deliverDue(now);
+        }
+        else if (next == UINT64_MAX)
+        {
+            pthread_cond_wait(&queueCondition, &queueLock);
+        }
+        else
+        {
+            struct timespec deadline;
+            deadlineIn(&deadline, next - now);
+            pthread_cond_timedwait(&queueCondition, &queueLock, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&queueLock);
+    return NULL;
+}
+
+// Let the session time pass up to the given time
+static void advanceTo(uint64_t timeUs)
+{
+    uint64_t now = sessionUs();
+
+    if (timeUs <= now)
+    {
+        return;
+    }
+    if (speed > 0)
+    {
+        usleep((useconds_t)((timeUs - now) / speed));
+        return;
+    }
+    pthread_mutex_lock(&queueLock);
+    nowUs = timeUs;
+    deliverDue(nowUs);
+    pthread_mutex_unlock(&queueLock);
+}
+
+// Output of the driver: matched with the next frame of the step on the port, whose answer is scheduled
+static void driverWrite(const uint8_t *data, uint16_t length, void *context)
+{
+    uint8_t port = (uint8_t)(uintptr_t)context;
+    uint64_t sentUs = sessionUs();
+    CapturedFrame *frame = NULL;
+
+    for (uint32_t i = step.first; i <= step.last && i < frameCount; i++)
+    {
+        if (frames[i].port == port && !frames[i].isConsumed)
+        {
+            frame = &frames[i];
+            break;
+        }
+    }
+    if (frame == NULL)
+    {
+        extraFrames++; // Sent more than the board did, e.g. a repetition; nothing answers it
+        return;
+    }
+    frame->isConsumed = true;
+    if (frame->length != length || memcmp(&frame->wire, data, length) != 0)
+    {
+        txDivergences++;
+        fprintf(stderr, "frame %u: the driver sent other bytes than the board\n", (uint32_t)(frame - frames));
+    }
+    pthread_mutex_lock(&queueLock);
+    for (uint32_t i = 0; i < frame->rxCount; i++)
+    {
+        schedule(port, sentUs + frame->rx[i].offsetUs, frame->rx[i].byte);
+    }
+    pthread_cond_broadcast(&queueCondition);
+    pthread_mutex_unlock(&queueLock);
+}
+
+/* ***** Steps ***** */
+
+static uint32_t nextOnPort(uint32_t index)
+{
+    for (uint32_t i = index + 1; i < frameCount; i++)
+    {
+        if (frames[i].port == frames[index].port)
+        {
+            return i;
+        }
+    }
+    return frameCount;
+}
+
+// Last repetition of a frame by the retry handling: the same bytes sent again after a link error
+static uint32_t lastRepetition(uint32_t index)
+{
+    uint32_t next;
+
+    while (isLinkError(frames[index].code) && (next = nextOnPort(index)) < frameCount &&
+           frames[next].length == frames[index].length &&
+           memcmp(&frames[next].wire, &frames[index].wire, frames[index].length) == 0)
+    {
+        index = next;
+    }
+    return index;
+}
+
+static bool isCommand(uint32_t index, uint8_t instruction)
+{
+    return index < frameCount && frames[index].wire.type == FINGERPRINT_COMMANDPACKET &&
+           instructionOf(&frames[index]) == instruction;
+}
+
+static void countPacket(const uint8_t *data, uint16_t length, bool isLast, void *context)
+{
+    (void)data;
+    (void)length;
+    (void)isLast;
+    (*(uint16_t *)context)++;
+}
+
+static void setMatch(CallResult *result, FingerPageAndConfidence match)
+{
+    result->code = match.statusCode;
+    result->hasMatch = true;
+    result->page = match.fingerprintPage;
+    result->confidence = match.confidence;
+}
+
+/**
+ * @brief  Repeat sendSearch() and receiveSearchResult() like executeCommand() repeats a search of fingerSearch()
+ */
+static FingerPageAndConfidence searchWithRetries(const uint8_t *p)
+{
+    FingerPageAndConfidence match = { 0, 0, FINGERPRINT_TIMEOUT };
+    uint8_t attempts = maxRetries + 1;
+
+    for (uint8_t attempt = 0; attempt < attempts; attempt++)
+    {
+        if (attempt > 0)
+        {
+            flushReceiver();
+        }
+        sendSearch(p[0], (uint16_t)(p[1] << 8 | p[2]), (uint16_t)(p[3] << 8 | p[4]));
+        match = receiveSearchResult();
+        if (!isLinkError(match.statusCode))
+        {
+            break;
+        }
+    }
+    return match;
+}
+
+/**
+ * @brief  Execute the driver call that sends the frame at step.first and set step.last and step.name
+ * @return false if the frame has no driver call of its own
+ */
+static bool executeStep(CallResult *result)
+{
+    const CapturedFrame *frame = &frames[step.first];
+    const uint8_t *p = &frame->wire.payload[1];     // Parameters of a command
+    uint16_t pageParameter = (uint16_t)(p[1] << 8 | p[2]);
+    uint8_t type = frame->wire.type;
+
+    memset(result, 0, sizeof(*result));
+    step.last = lastRepetition(step.first);
+    if (type == FINGERPRINT_DATAPACKET || type == FINGERPRINT_ENDDATAPACKET)
+    {
+        step.name = "data";
+        sendDataPacket((uint8_t *)frame->wire.payload, wireFrameDataLength(&frame->wire),
+                       type == FINGERPRINT_ENDDATAPACKET);
+        result->code = frame->code;
+        return true;
+    }
+    if (type != FINGERPRINT_COMMANDPACKET)
+    {
+        return false;
+    }
+
+    invalidateShadow(); // Every command has to reach the link even if the driver could answer it
+    switch (instructionOf(frame))
+    {
+        case FINGERPRINT_GETIMAGE:
+            step.name = "getImage";
+            result->code = getImage();
+            break;
+        case FINGERPRINT_IMAGE2TZ:
+            step.name = "image2Tz";
+            result->code = image2Tz(p[0]);
+            break;
+        case FINGERPRINT_REGMODEL:
+            step.name = "createModel";
+            result->code = createModel();
+            break;
+        case FINGERPRINT_STORE:
+            step.name = "storeModel";
+            result->code = storeModel(p[0], pageParameter);
+            break;
+        case FINGERPRINT_LOAD:
+        {
+            uint32_t match = nextOnPort(step.last);
+
+            if (p[0] == 2 && frames[step.last].code == FINGERPRINT_OK && isCommand(match, FINGERPRINT_MATCH))
+            {
+                step.name = "fingerVerify";
+                step.last = lastRepetition(match);
+                setMatch(result, fingerVerify(pageParameter));
+            }
+            else
+            {
+                step.name = "loadModel";
+                result->code = loadModel(p[0], pageParameter);
+            }
+            break;
+        }
+        case FINGERPRINT_SEARCH:
+            step.name = "search";
+            setMatch(result, searchWithRetries(p));
+            break;
+        case FINGERPRINT_DELETE:
+            step.name = "deleteModel";
+            result->code = deleteModel((uint16_t)(p[0] << 8 | p[1]), p[3]);
+            break;
+        case FINGERPRINT_EMPTY:
+            step.name = "emptyDatabase";
+            result->code = emptyDatabase();
+            break;
+        case FINGERPRINT_SETSYSPARAM:
+            step.name = "setSystemParameter";
+            result->code = setSystemParameter(p[0], p[1]);
+            break;
+        case FINGERPRINT_READSYSPARAM:
+            step.name = "getParameters";
+            getParameters();
+            result->code = frames[step.last].code; // Not returned by the driver
+            break;
+        case FINGERPRINT_VERIFYPASSWORD:
+            step.name = "checkPassword";
+            result->code = checkPassword((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]);
+            break;
+        case FINGERPRINT_SETPASSWORD:
+            step.name = "setPassword";
+            result->code = setPassword((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]);
+            break;
+        case FINGERPRINT_TEMPLATECOUNT:
+            step.name = "getTemplateCount";
+            result->page = getTemplateCount();
+            result->code = frames[step.last].code;
+            result->hasMatch = (result->code == FINGERPRINT_OK);
+            break;
+        case FINGERPRINT_LEDON:
+        case FINGERPRINT_LEDOFF:
+            step.name = "LEDcontrol";
+            result->code = LEDcontrol(instructionOf(frame) == FINGERPRINT_LEDON);
+            break;
+        case FINGERPRINT_AURALEDCONFIG:
+            step.name = "auraControl";
+            result->code = auraControl(p[0], p[1], p[2], p[3]);
+            break;
+        case FINGERPRINT_UPLOAD:
+            step.name = "uploadModel";
+            result->code = uploadModel(p[0], countPacket, &result->packets);
+            result->hasPackets = true;
+            break;
+        case FINGERPRINT_UPLOADIMAGE:
+            step.name = "uploadImage";
+            result->code = uploadImage(countPacket, &result->packets);
+            result->hasPackets = true;
+            break;
+        case FINGERPRINT_DOWNLOAD:
+            step.name = "beginDownloadModel";
+            result->code = beginDownloadModel(p[0]);
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief  Result the board got, from the answer to the last frame of the step
+ */
+static void expectedResult(const CallResult *replayed, CallResult *expected)
+{
+    const CapturedFrame *frame = &frames[step.last];
+
+    memset(expected, 0, sizeof(*expected));
+    expected->code = frame->code;
+    if (replayed->hasMatch && frame->code == FINGERPRINT_OK)
+    {
+        expected->hasMatch = true;
+        if (instructionOf(&frames[step.first]) == FINGERPRINT_TEMPLATECOUNT)
+        {
+            expected->page = (uint16_t)(frame->ack[1] << 8 | frame->ack[2]);
+            expected->confidence = replayed->confidence;
+        }
+        else if (instructionOf(frame) == FINGERPRINT_MATCH)
+        {
+            expected->page = replayed->page;
+            expected->confidence = (uint16_t)(frame->ack[1] << 8 | frame->ack[2]);
+        }
+        else
+        {
+            expected->page = (uint16_t)(frame->ack[1] << 8 | frame->ack[2]);
+            expected->confidence = (uint16_t)(frame->ack[3] << 8 | frame->ack[4]);
+        }
+    }
+    else if (replayed->hasMatch)
+    {
+        *expected = *replayed;
+        expected->code = frame->code;
+    }
+    if (replayed->hasPackets)
+    {
+        expected->hasPackets = true;
+        expected->packets = frame->dataPackets;
+        if (frame->code == FINGERPRINT_OK && !frame->hasEndPacket)
+        {
+            expected->code = FINGERPRINT_TIMEOUT;
+        }
+    }
+}
+
+static bool isSameResult(const CallResult *a, const CallResult *b)
+{
+    return a->code == b->code && (!a->hasMatch || (a->page == b->page && a->confidence == b->confidence)) &&
+           (!a->hasPackets || a->packets == b->packets);
+}
+
+static int compareUs(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentileMs(uint64_t *values, uint32_t count, double fraction)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    qsort(values, count, sizeof(*values), compareUs);
+    return values[(uint32_t)(fraction * (count - 1) + 0.5)] / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t capture[REPLAY_MAX_CAPTURE];
+    uint64_t *fieldLatencies;
+    uint64_t *replayLatencies;
+    uint32_t latencyCount = 0;
+    uint32_t toleranceUs = 2000;
+    uint32_t timeoutMs = DEFAULTTIMEOUT;
+    uint32_t steps = 0;
+    uint32_t skipped = 0;
+    uint32_t mismatches = 0;
+    uint32_t slowCalls = 0;
+    uint64_t previousFieldUs = 0;
+    uint64_t previousReplayUs = 0;
+    bool isVerbose = false;
+    pthread_t feeder;
+    FILE *input;
+    size_t size;
+    int option;
+
+    while ((option = getopt(argc, argv, "s:t:T:r:v")) != -1)
+    {
+        switch (option)
+        {
+            case 's': speed = atof(optarg); break;
+            case 't': toleranceUs = (uint32_t)(atof(optarg) * 1000); break;
+            case 'T': timeoutMs = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'r': maxRetries = (uint8_t)atoi(optarg); break;
+            case 'v': isVerbose = true; break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-s speed] [-t tolerance ms] [-T timeout ms] [-r retries] [-v] capture\n",
+                argv[0]);
+        return 2;
+    }
+    input = fopen(argv[optind], "rb");
+    if (input == NULL)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    size = fread(capture, 1, sizeof(capture), input);
+    fclose(input);
+    if (!loadCapture(capture, size))
+    {
+        fprintf(stderr, "%s: not a capture file\n", argv[optind]);
+        return 1;
+    }
+    fieldLatencies = calloc(frameCount + 1, sizeof(uint64_t));
+    replayLatencies = calloc(frameCount + 1, sizeof(uint64_t));
+
+    init();
+    clock_gettime(CLOCK_MONOTONIC, &realStart);
+    hostTransportSetClock(sessionMs);
+    for (uint8_t i = 0; i < HOST_MAX_SENSORS; i++)
+    {
+        hostTransportConnect(i, driverWrite, (void *)(uintptr_t)i);
+    }
+    if (speed > 0)
+    {
+        setFrameWaitHooks(waitReal, signalReal);
+        pthread_create(&feeder, NULL, feedBytes, NULL);
+    }
+    else
+    {
+        setFrameWaitHooks(waitVirtual, NULL);
+    }
+    setRetryPolicy(maxRetries, timeoutMs);
+
+    if (isVerbose)
+    {
+        printf("frame,time_ms,port,call,expected,replayed,field_ms,replay_ms\n");
+    }
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        CallResult replayed;
+        CallResult expected;
+        uint64_t startUs;
+        uint64_t replayUs;
+        uint64_t fieldUs = NO_RESPONSE;
+        uint32_t extraBefore = extraFrames;
+        bool isSlow;
+        bool isSame;
+
+        if (frames[i].isConsumed)
+        {
+            continue;
+        }
+        // Keep the idle time between commands
+        if (steps > 0)
+        {
+            advanceTo(previousReplayUs + (frames[i].timeUs - previousFieldUs));
+        }
+        step.first = i;
+        step.last = i;
+        step.name = NULL;
+        selectSensor(frames[i].port);
+        startUs = sessionUs();
+        if (!executeStep(&replayed))
+        {
+            frames[i].isConsumed = true;
+            skipped++;
+            continue;
+        }
+        replayUs = sessionUs() - startUs;
+        for (uint32_t j = step.first; j <= step.last; j++)
+        {
+            frames[j].isConsumed |= (frames[j].port == frames[i].port);
+        }
+        previousFieldUs = frames[i].timeUs;
+        previousReplayUs = startUs;
+        steps++;
+
+        expectedResult(&replayed, &expected);
+        isSame = isSameResult(&expected, &replayed);
+        if (frames[step.last].responseEndUs != NO_RESPONSE)
+        {
+            fieldUs = frames[step.last].timeUs + frames[step.last].responseEndUs - frames[i].timeUs;
+            fieldLatencies[latencyCount] = fieldUs;
+            replayLatencies[latencyCount++] = replayUs;
+        }
+        isSlow = fieldUs != NO_RESPONSE && replayUs > fieldUs + toleranceUs;
+        mismatches += !isSame;
+        slowCalls += isSlow;
+        if (isVerbose || !isSame || isSlow || extraFrames != extraBefore)
+        {
+            printf("%u,%.3f,%u,%s,0x%02X,0x%02X,%.3f,%.3f%s%s%s\n", i, frames[i].timeUs / 1000.0, frames[i].port,
+                   step.name, expected.code, replayed.code, fieldUs != NO_RESPONSE ? fieldUs / 1000.0 : -1.0,
+                   replayUs / 1000.0, isSame ? "" : ",mismatch", isSlow ? ",slow" : "",
+                   extraFrames != extraBefore ? ",extra" : "");
+        }
+    }
+
+    if (speed > 0)
+    {
+        pthread_mutex_lock(&queueLock);
+        isStopping = true;
+        pthread_cond_broadcast(&queueCondition);
+        pthread_mutex_unlock(&queueLock);
+        pthread_join(feeder, NULL);
+    }
+    fprintf(stderr, "%u frames, %u calls replayed, %u frames skipped\n", frameCount, steps, skipped);
+    fprintf(stderr, "latency field p50 %.1f ms p95 %.1f ms, replay p50 %.1f ms p95 %.1f ms\n",
+            percentileMs(fieldLatencies, latencyCount, 0.5), percentileMs(fieldLatencies, latencyCount, 0.95),
+            percentileMs(replayLatencies, latencyCount, 0.5), percentileMs(replayLatencies, latencyCount, 0.95));
+    fprintf(stderr, "%u result mismatches, %u slower than %.1f ms over the field, %u diverging frames, "
+            "%u extra frames\n", mismatches, slowCalls, toleranceUs / 1000.0, txDivergences, extraFrames);
+    return (mismatches || slowCalls || txDivergences || extraFrames) ? 1 : 0;
+}
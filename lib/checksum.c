@@ -0,0 +1,84 @@
+#include <string.h>
+#include "checksum.h"
+
+#if defined(__TI_ARM__) && defined(__TI_ARM_V7M4__)
+#define SUM_WORDS_USADA8                   // Cortex-M4 DSP extension, TI compiler intrinsic
+#elif defined(__ARM_FEATURE_SIMD32)
+#include <arm_acle.h>
+#define _usada8(a, b, c)                   __usada8(a, b, c)
+#define SUM_WORDS_USADA8                   // Cortex-M4 DSP extension, ACLE intrinsic
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SUM_BLOCKS_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SUM_BLOCKS_SSE2
+#endif
+
+/**
+ * @brief  Load four bytes from an address without alignment requirements. Compiles to a single LDR on Cortex-M4.
+ */
+static inline uint32_t loadWord(const uint8_t *data)
+{
+    uint32_t word;
+    memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+/**
+ * @brief  Sum a block of bytes, four or sixteen at a time where the target supports it.
+ * @param  data                              - Bytes to sum
+ * @param  length                            - Number of bytes
+ * @return Sum of all bytes. The packet checksum is the lower 16 bits of the sum.
+ * @note   Cortex-M4 uses USADA8, which adds the four byte lanes of a word to an accumulator in one cycle. Host builds
+ *         use PSADBW (SSE2) or pairwise widening adds (NEON); other targets fold two 16-bit lanes per 32-bit add.
+ *         On Cortex-M4 this is estimated from instruction counts at about 1.5 cycles per byte against 5 for a byte
+ *         loop; it has not been measured on the board. host/checksum_bench.c times the host builds.
+ */
+uint32_t sumBytes(const uint8_t *data, uint16_t length)
+{
+    uint32_t sum = 0;
+    uint16_t i = 0;
+
+#if defined(SUM_WORDS_USADA8)
+    for (; i + 4 <= length; i += 4)
+    {
+        sum = _usada8(loadWord(&data[i]), 0, sum);
+    }
+#elif defined(SUM_BLOCKS_SSE2)
+    __m128i accumulator = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)&data[i]);
+        accumulator = _mm_add_epi64(accumulator, _mm_sad_epu8(block, _mm_setzero_si128()));
+    }
+    sum = (uint32_t)_mm_cvtsi128_si32(accumulator) + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(accumulator, 8));
+#elif defined(SUM_BLOCKS_NEON)
+    uint32x4_t accumulator = vdupq_n_u32(0);
+    for (; i + 16 <= length; i += 16)
+    {
+        accumulator = vpadalq_u16(accumulator, vpaddlq_u8(vld1q_u8(&data[i])));
+    }
+    sum = vgetq_lane_u32(accumulator, 0) + vgetq_lane_u32(accumulator, 1) +
+          vgetq_lane_u32(accumulator, 2) + vgetq_lane_u32(accumulator, 3);
+#else
+    // Two 16-bit lanes per add, folded every 512 bytes before a lane can overflow
+    while (i + 4 <= length)
+    {
+        uint32_t lanes = 0;
+        uint16_t blockEnd = (length - i > 512) ? i + 512 : length;
+        for (; i + 4 <= blockEnd; i += 4)
+        {
+            uint32_t word = loadWord(&data[i]);
+            lanes += (word & 0x00FF00FF) + ((word >> 8) & 0x00FF00FF);
+        }
+        sum += (lanes & 0xFFFF) + (lanes >> 16);
+    }
+#endif
+
+    for (; i < length; i++)
+    {
+        sum += data[i];
+    }
+    return sum;
+}
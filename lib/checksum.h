@@ -0,0 +1,18 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+
+/* ***** Functions ***** */
+
+uint32_t sumBytes(const uint8_t *data, uint16_t length);
+
+/**
+ * @brief  Add one byte to a running packet checksum. Used where bytes are produced or received one at a time.
+ */
+static inline uint16_t updateChecksum(uint16_t checksum, uint8_t byte)
+{
+    return (uint16_t)(checksum + byte);
+}
+
+#endif /* CHECKSUM_H */
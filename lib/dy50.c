@@ -1,34 +1,283 @@
 #include "dy50.h"
+#include "checksum.h"
+#include "sensor_command.h"
+#include <stddef.h>
 
-static Packet createPacket(uint32_t sensorAddress, uint8_t type, uint8_t* content, uint8_t contentLength);
+static BootMetrics bootMetrics;
+static RetryPolicy retryPolicy = { DEFAULT_MAX_RETRIES, DEFAULTTIMEOUT };
+static RetryStats retryStats;
+static bool (*driverLock)(void);    // Exclusive use of the sensor across tasks, see setDriverLockHooks()
+static void (*driverUnlock)(void);
+
+// What the driver knows about the sensor's mutable state. Every field is only trusted while its flag is set.
+typedef struct
+{
+    bool isLedKnown;
+    bool isLedOn;
+    bool isAuraKnown;
+    uint8_t aura[4];            // Control, speed, color and count of the last aura configuration
+    bool areParametersKnown;
+    SensorParams parameters;
+    bool isTemplateCountKnown;
+    uint16_t templateCount;
+    bool isBufferKnown[2];      // Page 0xFFFF is a valid argument, so it cannot mark an unknown buffer
+    uint16_t bufferPage[2];     // Library page held by CharBuffer1 and CharBuffer2
+    uint16_t searchStart;       // Window of fingerSearch(), see setSearchWindow(); not reset by invalidateShadow()
+    uint16_t searchPages;       // 0 for the whole library
+} SensorShadow;
+
+static SensorShadow shadows[MAX_SENSOR_COUNT];
+static SensorShadow* shadow = &shadows[0];   // Shadow of the selected sensor, see selectSensor()
+static ShadowStats shadowStats;
+
+/**
+ * @brief  Check whether a confirmation word reports a failure of the link rather than of the command
+ */
+static bool isLinkError(uint8_t result)
+{
+    return result == FINGERPRINT_TIMEOUT || result == FINGERPRINT_BADPACKET || result == FINGERPRINT_PACKETRECIEVEERR;
+}
+
+/**
+ * @brief  Wait a limited time for the acknowledge packet of a command and decode it straight from the receive queue
+ * @param  command                           - Descriptor of the command, NULL to only read the confirmation word
+ * @param  result                            - Receives the fields of the descriptor, may be NULL if it has none
+ * @param  timeoutMs                         - Response timeout in milliseconds
+ * @return Confirmation word of the response, FINGERPRINT_TIMEOUT if nothing was received or FINGERPRINT_BADPACKET
+ *         if the response failed its checksum
+ */
+static uint8_t receiveResponse(const CommandDescriptor* command, void* result, uint32_t timeoutMs)
+{
+    const WireFrame* response = awaitResponseFrame(timeoutMs);
+    uint8_t statusCode;
+
+    if (response == NULL)
+    {
+        return FINGERPRINT_TIMEOUT;
+    }
+    if (response->type != FINGERPRINT_ACKPACKET || !isResponseChecksumValid() ||
+        wireFrameLength(response) <= PACKET_CHECKSUM_SIZE)
+    {
+        statusCode = FINGERPRINT_BADPACKET;
+    }
+    else
+    {
+        statusCode = response->payload[0];
+        if (command != NULL)
+        {
+            decodeResponse(command, response, result);
+        }
+    }
+    releaseResponseFrame();
+    return statusCode;
+}
+
+/**
+ * @brief  Send a single command packet and wait a limited time for a valid response
+ * @param  frame                             - Command packet built by encodeCommand()
+ * @param  size                              - Number of bytes of the packet
+ * @param  command                           - Descriptor of the command
+ * @param  result                            - Receives the fields of the response, see decodeResponse()
+ * @param  timeoutMs                         - Response timeout in milliseconds
+ * @return Confirmation word, see receiveResponse()
+ */
+static uint8_t transact(const WireFrame* frame, uint16_t size, const CommandDescriptor* command, void* result,
+                        uint32_t timeoutMs)
+{
+    sendFrame(frame, size);
+    return receiveResponse(command, result, timeoutMs);
+}
+
+/**
+ * @brief  Execute a command according to the retry policy. Idempotent commands are repeated after a timeout, a
+ *         corrupted response or FINGERPRINT_PACKETRECIEVEERR; the receiver is flushed before every repetition.
+ *         Commands with side effects are sent once and the failure is reported to the caller.
+ * @param  id                                - Entry of the command table
+ * @param  arguments                         - One value per parameter of the command, may be NULL if it has none
+ * @param  result                            - Receives the fields of the response, may be NULL if it has none
+ * @return Confirmation word of the last attempt, FINGERPRINT_TIMEOUT or FINGERPRINT_BADPACKET on a link failure
+ */
+static uint8_t executeCommand(CommandId id, const uint32_t* arguments, void* result)
+{
+    const CommandDescriptor* command = &sensorCommands[id];
+    uint8_t attempts = command->isIdempotent ? retryPolicy.maxRetries + 1 : 1;
+    uint32_t failedAt = 0;
+    uint8_t statusCode = FINGERPRINT_TIMEOUT;
+    uint8_t attempt;
+    WireFrame frame;
+    uint16_t size;
+
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    size = encodeCommand(&frame, command, arguments);
+    retryStats.commands++;
+    for (attempt = 0; attempt < attempts; attempt++)
+    {
+        if (attempt > 0)
+        {
+            retryStats.retries++;
+            flushReceiver();
+        }
+        statusCode = transact(&frame, size, command, result, retryPolicy.timeoutMs);
+        if (!isLinkError(statusCode))
+        {
+            break;
+        }
+        if (attempt == 0)
+        {
+            failedAt = getTickCount();
+        }
+    }
+
+    if (isLinkError(statusCode))
+    {
+        retryStats.failures++;
+        flushReceiver(); // Leave a clean receiver for the next command
+        invalidateShadow(); // The command may or may not have been executed
+    }
+    else if (attempt > 0)
+    {
+        uint32_t recoveryMs = getTickCount() - failedAt;
+        retryStats.recovered++;
+        retryStats.lastRecoveryMs = recoveryMs;
+        if (recoveryMs > retryStats.maxRecoveryMs)
+        {
+            retryStats.maxRecoveryMs = recoveryMs;
+        }
+    }
+    unlockDriver();
+    return statusCode;
+}
+
+/**
+ * @brief  Install the functions that serialize access to the sensor when several tasks use the driver. Every command
+ *         takes the lock; multi-packet operations hold it until their last packet. The lock must be recursive.
+ * @param  lock                              - Acquires the lock, returns false if it could not be acquired in time
+ * @param  unlock                            - Releases the lock
+ */
+void setDriverLockHooks(bool (*lock)(void), void (*unlock)(void))
+{
+    driverLock = lock;
+    driverUnlock = unlock;
+}
+
+/**
+ * @brief  Take exclusive use of the sensor for a sequence of commands, e.g. a template download. Without lock hooks
+ *         this always succeeds.
+ * @return false if the lock timed out
+ */
+bool lockDriver(void)
+{
+    return driverLock == NULL || driverLock();
+}
+
+/**
+ * @brief  Release the lock taken with lockDriver()
+ */
+void unlockDriver(void)
+{
+    if (driverUnlock != NULL)
+    {
+        driverUnlock();
+    }
+}
+
+/**
+ * @brief  Configure how link errors are handled by the command layer
+ * @param  maxRetries                        - Number of repetitions of an idempotent command after a link error
+ * @param  timeoutMs                         - Time to wait for every response in milliseconds
+ */
+void setRetryPolicy(uint8_t maxRetries, uint32_t timeoutMs)
+{
+    retryPolicy.maxRetries = maxRetries;
+    retryPolicy.timeoutMs = timeoutMs;
+}
+
+/**
+ * @brief  Link error statistics of the command layer since startup
+ * @return Number of executed commands, repetitions, recovered and failed commands and recovery latency
+ */
+RetryStats getRetryStats(void)
+{
+    return retryStats;
+}
+
+/**
+ * @brief  Forget the shadowed sensor state, e.g. after the module was power cycled or changed by another host. The
+ *         next commands go to the sensor again.
+ */
+void invalidateShadow(void)
+{
+    shadow->isLedKnown = false;
+    shadow->isAuraKnown = false;
+    shadow->areParametersKnown = false;
+    shadow->isTemplateCountKnown = false;
+    shadow->isBufferKnown[0] = false;
+    shadow->isBufferKnown[1] = false;
+}
 
 /**
- * @brief  Construct a packet of raw data
- * @param  sensorAddress                     - Every sensor has an 4 byte address
- * @param  type                              - Packet type
- * @param  content                           - Array of bytes which represents the content/data/instructions of a packet
- * @param  contentLength                     - length of content array
- * @return struct Packet
+ * @brief  Round trips saved by the shadow since startup
+ * @return Number of commands of every kind that completed without UART traffic
  */
-Packet createPacket(uint32_t sensorAddress, uint8_t type,
-                    uint8_t* content, uint8_t contentLength)
+ShadowStats getShadowStats(void)
 {
-    Packet packet;
-    uint8_t* bytePointer = (uint8_t*)&sensorAddress;
-    const uint8_t sizeOfChecksum = 0x02;
-    packet.start_code = FINGERPRINT_STARTCODE;
-    packet.address[0] = *bytePointer++;
-    packet.address[1] = *bytePointer++;
-    packet.address[2] = *bytePointer++;
-    packet.address[3] = *bytePointer++;
-    packet.type = type;
-    packet.length = contentLength + sizeOfChecksum;
-    for(int i = 0; i < contentLength; i++)
+    return shadowStats;
+}
+
+/**
+ * @brief  Direct the following commands to another module when SENSOR_COUNT modules are connected. Each module has
+ *         its own shadow; retry and shadow statistics are shared. With several tasks, hold lockDriver() from the
+ *         selection to the last command.
+ * @param  index                             - Sensor number, 0 to SENSOR_COUNT - 1
+ */
+void selectSensor(uint8_t index)
+{
+    if (index < SENSOR_COUNT)
     {
-        packet.data[i] = content[i];
+        selectSensorPort(index);
+        shadow = &shadows[index];
     }
-    packet.checksum = calculateChecksum(&packet);
-    return packet;
+}
+
+uint8_t getSelectedSensor(void)
+{
+    return getSelectedSensorPort();
+}
+
+/**
+ * @brief  Record what a CharBuffer holds; buffer IDs other than 1 and 2 are ignored
+ * @param  buffer                            - CharBuffer ID
+ * @param  isKnown                           - false if the content is unknown, e.g. after Img2Tz
+ * @param  page                              - Library page whose template the buffer holds if isKnown is set
+ */
+static void setShadowBuffer(uint8_t buffer, bool isKnown, uint16_t page)
+{
+    if (buffer == 1 || buffer == 2)
+    {
+        shadow->isBufferKnown[buffer - 1] = isKnown;
+        shadow->bufferPage[buffer - 1] = page;
+    }
+}
+
+/**
+ * @brief  Check whether a CharBuffer is known to hold the template of a library page
+ */
+static bool isShadowBufferPage(uint8_t buffer, uint16_t page)
+{
+    return (buffer == 1 || buffer == 2) && shadow->isBufferKnown[buffer - 1] && shadow->bufferPage[buffer - 1] == page;
+}
+
+/**
+ * @brief  Forget which library pages the CharBuffers hold, after the library was changed
+ */
+static void forgetLibraryState(void)
+{
+    shadow->isTemplateCountKnown = false;
+    shadow->isBufferKnown[0] = false;
+    shadow->isBufferKnown[1] = false;
 }
 
 /**
@@ -41,21 +290,48 @@ Packet createPacket(uint32_t sensorAddress, uint8_t type,
  */
 uint8_t setPassword(uint32_t password)
 {
-    Packet packet = {};
-    Packet response = {};
-    uint8_t content[5] = {};
+    uint32_t arguments[1] = { password };
 
-    content[0] = FINGERPRINT_SETPASSWORD;
-    content[1] = (uint8_t) (password >> 24);
-    content[2] = (uint8_t) (password >> 16);
-    content[3] = (uint8_t) (password >> 8);
-    content[4] = (uint8_t) (password & 0xFF);
+    return executeCommand(COMMAND_SET_PASSWORD, arguments, NULL);
+}
 
-    packet = createPacket(DEFAULT_MODULE_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 5);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
+/**
+ * @brief  Write a system parameter of the module; the module keeps it in flash
+ * @param  parameter                         - SYSPARAM_BAUD_RATE, SYSPARAM_SECURITY_LEVEL or SYSPARAM_PACKET_SIZE
+ * @param  value                             - New value, see the parameter numbers in dy50.h
+ * @return                                   - 0x00 if the parameter was written, 0x1A for an invalid parameter
+ * @note   A new baud rate takes effect after the acknowledge packet; the UART of the MCU is not reconfigured.
+ */
+uint8_t setSystemParameter(uint8_t parameter, uint8_t value)
+{
+    uint32_t arguments[2] = { parameter, value };
+    uint8_t statusCode;
 
-    return response.data[0];
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    statusCode = executeCommand(COMMAND_SET_SYSTEM_PARAMETER, arguments, NULL);
+    if (statusCode == FINGERPRINT_OK && shadow->areParametersKnown)
+    {
+        switch (parameter)
+        {
+            case SYSPARAM_BAUD_RATE:
+                shadow->parameters.baud_rate = (uint16_t)(value * 9600);
+                break;
+            case SYSPARAM_SECURITY_LEVEL:
+                shadow->parameters.security_level = value;
+                break;
+            case SYSPARAM_PACKET_SIZE:
+                shadow->parameters.packet_len = (uint16_t)(32 << value);
+                break;
+            default:
+                shadow->areParametersKnown = false;
+                break;
+        }
+    }
+    unlockDriver();
+    return statusCode;
 }
 
 /**
@@ -65,23 +341,79 @@ uint8_t setPassword(uint32_t password)
  */
 uint16_t getTemplateCount(void)
 {
-    uint8_t content[1] = {};
-    Packet response = {};
-    Packet packet = {};
-    uint16_t templateCount;
+    uint16_t templateCount = 0;
 
-    content[0] = FINGERPRINT_TEMPLATECOUNT;
-    packet = createPacket(DEFAULT_MODULE_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 1);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
-
-    templateCount = response.data[1];
-    templateCount <<= 8;
-    templateCount |= response.data[2];
+    if (!lockDriver())
+    {
+        return 0;
+    }
+    if (shadow->isTemplateCountKnown)
+    {
+        shadowStats.templateCount++;
+        unlockDriver();
+        return shadow->templateCount;
+    }
+    if (executeCommand(COMMAND_TEMPLATE_COUNT, NULL, &templateCount) == FINGERPRINT_OK)
+    {
+        shadow->templateCount = templateCount;
+        shadow->isTemplateCountKnown = true;
+    }
+    unlockDriver();
 
     return templateCount;
 }
 
+/**
+ * @brief  Read one page of the index table, the occupancy bits of the library
+ * @param  indexPage                         - 0 for library pages 0 to 255, 1 for 256 to 511 and so on
+ * @param  bitmap                            - Receives INDEX_PAGE_SIZE bytes; bit n of byte m is set if page
+ *                                             indexPage * INDEX_PAGE_PAGES + m * 8 + n holds a template
+ * @return Confirmation word, bitmap is only written on FINGERPRINT_OK
+ */
+uint8_t readIndexTable(uint8_t indexPage, uint8_t* bitmap)
+{
+    uint32_t arguments[1] = { indexPage };
+
+    return executeCommand(COMMAND_READ_INDEX, arguments, bitmap);
+}
+
+/**
+ * @brief  Limit the pages fingerSearch() covers on the selected sensor, e.g. to the occupied prefix of a compacted
+ *         library (see lib/dy50_compact.h) or to the pages of one group. Search time grows with the pages searched,
+ *         not with the templates. storeModel() widens the window when it stores beyond its end.
+ * @param  startPage                         - First page to search
+ * @param  pageCount                         - Number of pages, 0 for the whole library
+ */
+void setSearchWindow(uint16_t startPage, uint16_t pageCount)
+{
+    shadow->searchStart = startPage;
+    shadow->searchPages = pageCount;
+}
+
+/**
+ * @brief  Pages fingerSearch() covers on the selected sensor, for searches started with sendSearch()
+ * @param  startPage                         - Receives the first page to search
+ * @param  pageCount                         - Receives the number of pages, the capacity without a window
+ */
+void getSearchWindow(uint16_t* startPage, uint16_t* pageCount)
+{
+    *startPage = shadow->searchStart;
+    *pageCount = (shadow->searchPages != 0) ? shadow->searchPages : getParameters().capacity; // From searchStart
+}
+
+/**
+ * @brief  Set page and confidence of a failed search to its confirmation word, as callers of fingerSearch() expect
+ */
+static FingerPageAndConfidence finishSearchResult(FingerPageAndConfidence pageAndConfidence)
+{
+    if (pageAndConfidence.statusCode != FINGERPRINT_OK)
+    {
+        pageAndConfidence.fingerprintPage = pageAndConfidence.statusCode;
+        pageAndConfidence.confidence = pageAndConfidence.statusCode;
+    }
+    return pageAndConfidence;
+}
+
 /**
  * @brief  Search for the fingerprint in CharBuffer1 or CharBuffer2
  * @param  bufferId  - Number of the buffer 0x1 for CharBuffer1 or 0x2 for CharBuffer2
@@ -95,45 +427,109 @@ uint16_t getTemplateCount(void)
  */
 FingerPageAndConfidence fingerSearch(uint8_t bufferId)
 {
-    FingerPageAndConfidence pageAndConfidence;
-    uint8_t content[6] = {};
-    Packet packet = {};
-    Packet response = {};
-    SensorParams params = getParameters();
-
-    content[0] = FINGERPRINT_SEARCH;
-    content[1] = bufferId; //CharBuffer
-    content[2] = 0x00;
-    content[3] = 0x00;
-    content[4] = (uint8_t) (params.capacity >> 8);
-    content[5] = (uint8_t) (params.capacity & 0xFF);
+    FingerPageAndConfidence pageAndConfidence = { 0, 0, FINGERPRINT_BUSY };
+    uint32_t arguments[3];
+    uint16_t startPage;
+    uint16_t pageCount;
 
-    packet = createPacket(DEFAULT_MODULE_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 6);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
+    if (!lockDriver())
+    {
+        return finishSearchResult(pageAndConfidence);
+    }
+    getSearchWindow(&startPage, &pageCount);
+    arguments[0] = bufferId;
+    arguments[1] = startPage;
+    arguments[2] = pageCount;
 
-    if(response.data[0] == 0x00)
+    pageAndConfidence.statusCode = executeCommand(COMMAND_SEARCH, arguments, &pageAndConfidence);
+    pageAndConfidence = finishSearchResult(pageAndConfidence);
+    if (bootMetrics.firstIdentifyMs == 0 &&
+        (pageAndConfidence.statusCode == FINGERPRINT_OK || pageAndConfidence.statusCode == FINGERPRINT_NOTFOUND))
     {
-        pageAndConfidence.fingerprintPage = 0xFFFF;
-        pageAndConfidence.confidence = 0xFFFF;
+        bootMetrics.firstIdentifyMs = getTickCount();
+    }
+    unlockDriver();
+    return pageAndConfidence;
+}
 
-        pageAndConfidence.fingerprintPage = response.data[1];
-        pageAndConfidence.fingerprintPage <<= 8;
-        pageAndConfidence.fingerprintPage |= response.data[2];
+/**
+ * @brief  Compare the character file in CharBuffer1 with the template of one library page (1:1 verification), e.g.
+ *         the page of a card or PIN presented first. Unlike fingerSearch() the time does not grow with the library.
+ * @param  page                              - Library page of the claimed identity
+ * @return FingerPageAndConfidence with the page and the match score. The status codes:
+ *             0x00 Match
+ *             0x08 No match
+ *             0x0C or 0x0B from loading the page, e.g. for an empty page
+ *             0x0B also without any command if the page is beyond the capacity or the capacity cannot be read
+ * @note   CharBuffer2 holds the template of the page afterwards, so verifying the same page again skips the load.
+ */
+FingerPageAndConfidence fingerVerify(uint16_t page)
+{
+    FingerPageAndConfidence pageAndConfidence = { page, 0, FINGERPRINT_BUSY };
 
-        pageAndConfidence.confidence = response.data[3];
-        pageAndConfidence.confidence <<= 8;
-        pageAndConfidence.confidence |= response.data[4];
+    if (!lockDriver())
+    {
+        return pageAndConfidence;
     }
-    else
+    // Checked here as well as in loadModel(), so that a verification never falls back to whatever CharBuffer2 holds
+    pageAndConfidence.statusCode = (page < getParameters().capacity) ? loadModel(2, page) : FINGERPRINT_BADLOCATION;
+    if (pageAndConfidence.statusCode == FINGERPRINT_OK)
     {
-        pageAndConfidence.fingerprintPage = response.data[0];
-        pageAndConfidence.confidence = response.data[0];
+        pageAndConfidence.statusCode = fingerMatch(&pageAndConfidence.confidence);
     }
-    pageAndConfidence.statusCode = response.data[0];
+    unlockDriver();
     return pageAndConfidence;
 }
 
+/**
+ * @brief  Compare the character files or templates in CharBuffer1 and CharBuffer2; neither buffer changes
+ * @param  confidence                        - Receives the match score if the module sent one
+ * @return Confirmation word                 - 0x00 Match
+ *                                             0x08 No match
+ */
+uint8_t fingerMatch(uint16_t* confidence)
+{
+    FingerPageAndConfidence pageAndConfidence = { 0, 0, FINGERPRINT_OK };
+    uint8_t statusCode = executeCommand(COMMAND_MATCH, NULL, &pageAndConfidence);
+
+    *confidence = pageAndConfidence.confidence;
+    return statusCode;
+}
+
+/**
+ * @brief  Start a search on the selected sensor without waiting for the result, so that several sensors can search
+ *         at the same time. Must be followed by receiveSearchResult() on the same sensor; hold lockDriver() in between
+ *         when several tasks use the driver.
+ * @param  bufferId                          - CharBuffer with the character file to search for
+ * @param  startPage                         - First library page to search
+ * @param  pageCount                         - Number of pages to search
+ */
+void sendSearch(uint8_t bufferId, uint16_t startPage, uint16_t pageCount)
+{
+    uint32_t arguments[3] = { bufferId, startPage, pageCount };
+    WireFrame frame;
+    uint16_t size = encodeCommand(&frame, &sensorCommands[COMMAND_SEARCH], arguments);
+
+    sendFrame(&frame, size);
+}
+
+/**
+ * @brief  Wait for the result of a search started with sendSearch() on the selected sensor
+ * @return Like fingerSearch(); statusCode is FINGERPRINT_TIMEOUT or FINGERPRINT_BADPACKET on a link error
+ */
+FingerPageAndConfidence receiveSearchResult(void)
+{
+    FingerPageAndConfidence pageAndConfidence = { 0, 0, FINGERPRINT_OK };
+
+    pageAndConfidence.statusCode = receiveResponse(&sensorCommands[COMMAND_SEARCH], &pageAndConfidence,
+                                                   retryPolicy.timeoutMs);
+    if (isLinkError(pageAndConfidence.statusCode))
+    {
+        flushReceiver();
+    }
+    return finishSearchResult(pageAndConfidence);
+}
+
 /**
  * @brief  Control built in LED on the sensor
  * @param  isOn                              - If set, the led is activated
@@ -141,21 +537,64 @@ FingerPageAndConfidence fingerSearch(uint8_t bufferId)
  */
 uint8_t LEDcontrol(bool isOn)
 {
-    uint8_t content[1] = {};
-    Packet packet = {};
-    Packet response = {};
-    if (isOn)
+    uint8_t statusCode;
+
+    if (!lockDriver())
     {
-        content[0] = FINGERPRINT_LEDON;
+        return FINGERPRINT_BUSY;
     }
-    else
+    if (shadow->isLedKnown && shadow->isLedOn == isOn)
+    {
+        shadowStats.led++;
+        unlockDriver();
+        return FINGERPRINT_OK;
+    }
+    statusCode = executeCommand(isOn ? COMMAND_LED_ON : COMMAND_LED_OFF, NULL, NULL);
+    if (statusCode == FINGERPRINT_OK)
+    {
+        shadow->isLedOn = isOn;
+        shadow->isLedKnown = true;
+    }
+    unlockDriver();
+    return statusCode;
+}
+
+/**
+ * @brief  Configure the aura LED ring of modules that have one
+ * @param  control                           - AURA_BREATHING, AURA_FLASHING, AURA_ALWAYS_ON, AURA_ALWAYS_OFF,
+ *                                             AURA_GRADUAL_ON or AURA_GRADUAL_OFF
+ * @param  speed                             - Effect speed, 0 is the fastest
+ * @param  color                             - AURA_RED, AURA_BLUE or AURA_PURPLE
+ * @param  count                             - Number of cycles of a breathing or flashing effect, 0 for endless
+ * @return                                   - result of the operation
+ * @note   A configuration identical to the active one is not sent again, except a flashing effect with a finite
+ *         count, which the module performs anew on every request.
+ */
+uint8_t auraControl(uint8_t control, uint8_t speed, uint8_t color, uint8_t count)
+{
+    uint32_t arguments[4] = { control, speed, color, count };
+    uint8_t statusCode;
+    bool isRepeatable = (control == AURA_FLASHING || control == AURA_BREATHING) && count != 0;
+
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    if (!isRepeatable && shadow->isAuraKnown && shadow->aura[0] == control && shadow->aura[1] == speed &&
+        shadow->aura[2] == color && shadow->aura[3] == count)
+    {
+        shadowStats.aura++;
+        unlockDriver();
+        return FINGERPRINT_OK;
+    }
+    statusCode = executeCommand(COMMAND_AURA, arguments, NULL);
+    shadow->isAuraKnown = (statusCode == FINGERPRINT_OK);
+    for (uint8_t i = 0; i < 4; i++)
     {
-        content[0] = FINGERPRINT_LEDOFF;
+        shadow->aura[i] = (uint8_t)arguments[i];
     }
-    packet = createPacket(SENSOR_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 1);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
-    return response.data[0];
+    unlockDriver();
+    return statusCode;
 }
 
 /**
@@ -166,14 +605,22 @@ uint8_t LEDcontrol(bool isOn)
  */
 uint8_t emptyDatabase(void)
 {
-    uint8_t content[1] = { FINGERPRINT_EMPTY };
-    Packet packet = {};
-    Packet response = {};
-    packet = createPacket(SENSOR_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 1);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
+    uint8_t statusCode;
+
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    statusCode = executeCommand(COMMAND_EMPTY, NULL, NULL);
+    forgetLibraryState();
+    if (statusCode == FINGERPRINT_OK)
+    {
+        shadow->templateCount = 0;
+        shadow->isTemplateCountKnown = true;
+    }
+    unlockDriver();
 
-    return response.data[0];
+    return statusCode;
 }
 
 /**
@@ -187,37 +634,172 @@ uint8_t emptyDatabase(void)
  */
 uint8_t deleteModel(uint16_t templateNum, uint8_t numberOfTemplates)
 {
-    uint8_t content[5] = {};
-    Packet packet = {};
-    Packet response = {};
+    uint32_t arguments[2] = { templateNum, numberOfTemplates };
+    uint8_t statusCode;
 
-    content[0] = FINGERPRINT_DELETE;
-    content[1] = (uint8_t) (templateNum >> 8); // location of a template
-    content[2] = (uint8_t) (templateNum & 0xFF);
-    content[3] = 0x00; // number of templates to be deleted
-    content[4] = 0x01; // number of templates to be deleted
-    packet = createPacket(SENSOR_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 5);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    statusCode = executeCommand(COMMAND_DELETE, arguments, NULL);
+    forgetLibraryState();
+    unlockDriver();
+    return statusCode;
+}
+
+/**
+ * @brief  Receive the data packets that follow an upload command until the end packet
+ * @param  onData                            - Called for every data packet, may be NULL to discard the data
+ * @param  context                           - Passed to onData
+ * @return 0x00 if all packets were received, FINGERPRINT_TIMEOUT or FINGERPRINT_BADPACKET otherwise
+ */
+static uint8_t receiveDataPackets(DataPacketHandler onData, void* context)
+{
+    bool isLast;
 
-    return response.data[0];
+    do
+    {
+        const WireFrame* packet = awaitResponseFrame(retryPolicy.timeoutMs);
+
+        if (packet == NULL)
+        {
+            flushReceiver();
+            return FINGERPRINT_TIMEOUT;
+        }
+        isLast = (packet->type == FINGERPRINT_ENDDATAPACKET);
+        if (!isResponseChecksumValid() || (packet->type != FINGERPRINT_DATAPACKET && !isLast))
+        {
+            releaseResponseFrame();
+            flushReceiver();
+            return FINGERPRINT_BADPACKET;
+        }
+        if (onData != NULL)
+        {
+            onData(packet->payload, wireFrameDataLength(packet), isLast, context); // Straight from the receive queue
+        }
+        releaseResponseFrame();
+    } while (!isLast);
+
+    return FINGERPRINT_OK;
 }
 
 /**
- * GET MULTIPLE DATA PACKETS??
+ * @brief  Execute an upload command and receive its data packets, holding the driver lock throughout
+ */
+static uint8_t executeUpload(CommandId id, const uint32_t* arguments, DataPacketHandler onData, void* context)
+{
+    uint8_t result;
+
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    result = executeCommand(id, arguments, NULL);
+    if (result == FINGERPRINT_OK)
+    {
+        result = receiveDataPackets(onData, context);
+    }
+    unlockDriver();
+    return result;
+}
+
+/**
+ * @brief  Upload the character file or template in CharBuffer1 or CharBuffer2 to the MCU
+ * @param  buffer                            - CharBuffer ID
+ * @param  onData                            - Called with the payload of every data packet as it arrives. The packet
+ *                                             size is SensorParams.packet_len; isLast is set for the final packet.
+ * @param  context                           - Passed to onData
+ * @return Confirmation word                 - 0x00 Upload successful
+ *                                             0x01 Error in receiving the package
+ *                                             0x0d Error when uploading template
+ */
+uint8_t uploadModel(uint8_t buffer, DataPacketHandler onData, void* context)
+{
+    uint32_t arguments[1] = { buffer };
+
+    return executeUpload(COMMAND_UPLOAD, arguments, onData, context);
+}
+
+/**
+ * @brief  Upload the character file in CharBuffer1 and discard it
+ * @return Confirmation word, see uploadModel()
  */
 uint8_t getModel(void)
 {
-    uint8_t content[2] = {};
-    Packet packet = {};
-    Packet response = {};
+    return uploadModel(1, NULL, NULL);
+}
 
-    content[0] = FINGERPRINT_UPLOAD;
-    content[1] = 0x01; //transfer from CharBuffer 1
-    packet = createPacket(SENSOR_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 2);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
-    return response.data[0];
+/**
+ * @brief  Upload the image in ImageBuffer to the MCU. Every pixel is transferred as 4 bits, two pixels per byte.
+ * @param  onData                            - Called with the payload of every data packet as it arrives
+ * @param  context                           - Passed to onData
+ * @return Confirmation word                 - 0x00 Upload successful
+ *                                             0x01 Error in receiving the package
+ *                                             0x0f Error when uploading image
+ */
+uint8_t uploadImage(DataPacketHandler onData, void* context)
+{
+    return executeUpload(COMMAND_UPLOAD_IMAGE, NULL, onData, context);
+}
+
+/**
+ * @brief  Prepare the module to receive a character file or template into CharBuffer1 or CharBuffer2. On success the
+ *         file has to be sent with sendDataPacket(), packet by packet. When several tasks use the driver, hold
+ *         lockDriver() from here to the last packet.
+ * @param  buffer                            - CharBuffer ID
+ * @return Confirmation word                 - 0x00 Module is ready to receive the data packets
+ *                                             0x01 Error in receiving the package
+ *                                             0x0e Module cannot receive the following data packets
+ */
+uint8_t beginDownloadModel(uint8_t buffer)
+{
+    uint32_t arguments[1] = { buffer };
+    uint8_t statusCode;
+
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    statusCode = executeCommand(COMMAND_DOWNLOAD, arguments, NULL);
+    setShadowBuffer(buffer, false, 0);
+    unlockDriver();
+    return statusCode;
+}
+
+/**
+ * @brief  Send one data packet of a transfer started with beginDownloadModel(). The module does not acknowledge data
+ *         packets.
+ * @param  data                              - Payload, SensorParams.packet_len bytes
+ * @param  length                            - Payload length, at most PACKET_MAX_DATA; a longer packet is not sent
+ * @param  isLast                            - Set for the final packet of the transfer
+ */
+void sendDataPacket(uint8_t* data, uint16_t length, bool isLast)
+{
+    WireFrame frame;
+    uint16_t size = buildWireFrame(&frame, SENSOR_ADDRESS,
+                                   isLast ? FINGERPRINT_ENDDATAPACKET : FINGERPRINT_DATAPACKET, data, length);
+    if (size > 0)
+    {
+        sendFrame(&frame, size);
+    }
+}
+
+/**
+ * @brief  Send one data packet to several sensors at once, each of which must have accepted beginDownloadModel()
+ * @param  sensorMask                        - Bit n selects sensor n
+ * @param  data                              - Payload, SensorParams.packet_len bytes
+ * @param  length                            - Payload length, at most PACKET_MAX_DATA; a longer packet is not sent
+ * @param  isLast                            - Set for the final packet of the transfer
+ */
+void broadcastDataPacket(uint8_t sensorMask, uint8_t* data, uint16_t length, bool isLast)
+{
+    WireFrame frame;
+    uint16_t size = buildWireFrame(&frame, SENSOR_ADDRESS,
+                                   isLast ? FINGERPRINT_ENDDATAPACKET : FINGERPRINT_DATAPACKET, data, length);
+    if (size > 0)
+    {
+        broadcastFrame(sensorMask, &frame, size);
+    }
 }
 
 /**
@@ -232,18 +814,30 @@ uint8_t getModel(void)
  */
 uint8_t loadModel(uint8_t buffer, uint16_t templateID)
 {
-    uint8_t content[4] = {};
-    Packet packet = {};
-    Packet response = {};
+    uint32_t arguments[2] = { buffer, templateID };
+    uint16_t capacity;
+    uint8_t statusCode;
 
-    content[0] = FINGERPRINT_LOAD;
-    content[1] = buffer; //CharBuffer number
-    content[2] = (uint8_t) (templateID >> 8);
-    content[3] = (uint8_t) (templateID & 0xFF);
-    packet = createPacket(SENSOR_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 4);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
-    return response.data[0];
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    capacity = getParameters().capacity;
+    if (shadow->areParametersKnown && templateID >= capacity)
+    {
+        unlockDriver(); // Never answered from the shadow, whatever the buffer holds
+        return FINGERPRINT_BADLOCATION;
+    }
+    if (isShadowBufferPage(buffer, templateID))
+    {
+        shadowStats.load++;
+        unlockDriver();
+        return FINGERPRINT_OK;
+    }
+    statusCode = executeCommand(COMMAND_LOAD, arguments, NULL);
+    setShadowBuffer(buffer, statusCode == FINGERPRINT_OK, templateID);
+    unlockDriver();
+    return statusCode;
 }
 
 /**
@@ -258,19 +852,27 @@ uint8_t loadModel(uint8_t buffer, uint16_t templateID)
  */
 uint8_t storeModel(uint8_t buffer, uint16_t pageID)
 {
-    uint8_t content[4] = {};
-    Packet packet = {};
-    Packet response = {};
+    uint32_t arguments[2] = { buffer, pageID };
+    uint8_t statusCode;
 
-    content[0] = FINGERPRINT_STORE;
-    content[1] = buffer; //CharBuffer number
-    content[2] = (uint8_t) (pageID >> 8);
-    content[3] = (uint8_t) (pageID & 0xFF);
-    packet = createPacket(SENSOR_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 4);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    statusCode = executeCommand(COMMAND_STORE, arguments, NULL);
+    forgetLibraryState();
+    if (statusCode == FINGERPRINT_OK)
+    {
+        setShadowBuffer(buffer, true, pageID); // The buffer now holds exactly what the page holds
+    }
+    if (shadow->searchPages != 0 && pageID >= shadow->searchStart + shadow->searchPages &&
+        statusCode == FINGERPRINT_OK)
+    {
+        shadow->searchPages = (uint16_t)(pageID + 1 - shadow->searchStart);
+    }
+    unlockDriver();
 
-    return response.data[0];
+    return statusCode;
 }
 
 /**
@@ -282,16 +884,18 @@ uint8_t storeModel(uint8_t buffer, uint16_t pageID)
  */
 uint8_t createModel(void)
 {
-    uint8_t content[1] = {};
-    Packet packet = {};
-    Packet response = {};
+    uint8_t statusCode;
 
-    content[0] = FINGERPRINT_REGMODEL;
-    packet = createPacket(SENSOR_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 1);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    statusCode = executeCommand(COMMAND_REGISTER_MODEL, NULL, NULL);
+    shadow->isBufferKnown[0] = false;
+    shadow->isBufferKnown[1] = false;
+    unlockDriver();
 
-    return response.data[0];
+    return statusCode;
 }
 
 /**
@@ -306,17 +910,18 @@ uint8_t createModel(void)
  */
 uint8_t image2Tz(uint8_t buffer)
 {
-    uint8_t content[2] = {};
-    Packet packet = {};
-    Packet response = {};
+    uint32_t arguments[1] = { buffer };
+    uint8_t statusCode;
 
-    content[0] = FINGERPRINT_IMAGE2TZ;
-    content[1] = buffer;
-    packet = createPacket(SENSOR_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 2);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    statusCode = executeCommand(COMMAND_IMAGE_TO_CHARACTER, arguments, NULL);
+    setShadowBuffer(buffer, false, 0);
+    unlockDriver();
 
-    return response.data[0];
+    return statusCode;
 }
 
 /**
@@ -328,14 +933,7 @@ uint8_t image2Tz(uint8_t buffer)
  */
 uint8_t getImage(void)
 {
-    uint8_t content[1] = { FINGERPRINT_GETIMAGE };
-    Packet packet = {};
-    Packet response = {};
-    packet = createPacket(SENSOR_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 1);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
-
-    return response.data[0];
+    return executeCommand(COMMAND_GET_IMAGE, NULL, NULL);
 }
 
 /**
@@ -354,40 +952,24 @@ uint8_t getImage(void)
  */
 SensorParams getParameters(void)
 {
-    SensorParams params;
-    uint8_t content[1] = {};
-    Packet packet = {};
-    Packet response = {};
-
-    content[0] = FINGERPRINT_READSYSPARAM;
-    packet = createPacket(SENSOR_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 1);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
+    SensorParams params = { .packet_len = 32 }; // Size code 0 if the module does not answer
 
-    params.status_reg = ((uint16_t) response.data[1] << 8) | response.data[2];
-    params.system_id = ((uint16_t) response.data[3] << 8) | response.data[4];
-    params.capacity = ((uint16_t) response.data[5] << 8) | response.data[6];
-    params.security_level = ((uint16_t) response.data[7] << 8) | response.data[8];
-    params.device_addr = ((uint32_t) response.data[9] << 24) | ((uint32_t) response.data[10] << 16)|
-                  ((uint32_t) response.data[11] << 8) | (uint32_t) response.data[12];
-    params.packet_len = ((uint16_t) response.data[13] << 8) | response.data[14];
-    if (params.packet_len == 0)
+    if (!lockDriver())
     {
-        params.packet_len = 32;
+        return shadow->parameters; // Last parameters read, zero if none
     }
-    else if (params.packet_len == 1)
+    if (shadow->areParametersKnown)
     {
-        params.packet_len = 64;
+        shadowStats.parameters++;
+        unlockDriver();
+        return shadow->parameters;
     }
-    else if (params.packet_len == 2)
+    if (executeCommand(COMMAND_READ_SYSTEM_PARAMETERS, NULL, &params) == FINGERPRINT_OK)
     {
-        params.packet_len = 128;
+        shadow->parameters = params;
+        shadow->areParametersKnown = true;
     }
-    else if (params.packet_len == 3)
-    {
-        params.packet_len = 256;
-    }
-    params.baud_rate = (((uint16_t) response.data[15] << 8) | response.data[16]) * 9600;
+    unlockDriver();
 
     return params;
 }
@@ -400,35 +982,85 @@ SensorParams getParameters(void)
  */
 uint8_t checkPassword(uint32_t password)
 {
-    Packet response = {};
-    Packet packet = {};
-    uint8_t content[5] = {};
+    uint32_t arguments[1] = { password };
+
+    return executeCommand(COMMAND_VERIFY_PASSWORD, arguments, NULL);
+}
+
+/**
+ * @brief  Send a password verification and wait a limited time for the answer
+ * @param  password                         - Password to verify
+ * @param  timeoutMs                        - Response timeout in milliseconds
+ * @return Confirmation word, or FINGERPRINT_TIMEOUT if the module did not answer
+ */
+static uint8_t probePassword(uint32_t password, uint32_t timeoutMs)
+{
+    const CommandDescriptor* command = &sensorCommands[COMMAND_VERIFY_PASSWORD];
+    uint32_t arguments[1] = { password };
+    WireFrame frame;
+    uint16_t size = encodeCommand(&frame, command, arguments);
 
-    content[0] = FINGERPRINT_VERIFYPASSWORD;
-    content[1] = (uint8_t) (password >> 24);
-    content[2] = (uint8_t) (password >> 16);
-    content[3] = (uint8_t) (password >> 8);
-    content[3] = (uint8_t) (password);
-    packet = createPacket(SENSOR_ADDRESS, FINGERPRINT_COMMANDPACKET, content, 5);
-    sendPacket(&packet);
-    response = awaitReponsePacket();
-    return response.data[0];
+    flushReceiver(); // Discard a late answer to a previous probe
+    return transact(&frame, size, command, NULL, timeoutMs);
+}
+
+/**
+ * @brief  Wait until the module is ready and verify the handshake password. Must be called after init(); any
+ *         application setup done between the two overlaps with the module's power-up.
+ * @param  password                         - Handshake password, DEFAULT_PASSWORD unless changed with setPassword()
+ * @return Confirmation word                - 0x00 Module is ready and the password is correct
+ *                                            0x13 Password is incorrect
+ *                                            0xFF Module did not respond within STARTUP_TIMEOUT
+ * @note   Readiness is taken from the handshake byte the module sends after power-up. If the handshake was missed,
+ *         e.g. after a reset of the MCU alone, the module is probed with short password verifications instead.
+ */
+uint8_t sensorBegin(uint32_t password)
+{
+    uint32_t start = getTickCount();
+    uint32_t readyTick = 0;
+    uint8_t result = FINGERPRINT_TIMEOUT;
+
+    invalidateShadow(); // Nothing is known about a module that was just powered up
+    while (getTickCount() - start < STARTUP_TIMEOUT)
+    {
+        if (isSensorHandshakeReceived(&readyTick))
+        {
+            bootMetrics.handshakeReceived = true;
+            bootMetrics.sensorReadyMs = readyTick;
+            result = probePassword(password, DEFAULTTIMEOUT);
+            break;
+        }
+        result = probePassword(password, PROBE_TIMEOUT);
+        if (result != FINGERPRINT_TIMEOUT)
+        {
+            bootMetrics.sensorReadyMs = getTickCount();
+            break;
+        }
+    }
+    if (result == FINGERPRINT_OK)
+    {
+        bootMetrics.passwordVerifiedMs = getTickCount();
+    }
+    return result;
+}
+
+/**
+ * @brief  Startup timing of the module
+ * @return Time to sensor readiness, to password verification and to the first identification since init()
+ */
+BootMetrics getBootMetrics(void)
+{
+    return bootMetrics;
 }
 
 /**
  * @brief  Calculate and return checksum of the provided packet
  * @param  packet - Pointer to the packet
  * @return Checksum of the provided packet
+ * @note   Frames built by buildWireFrame() and received packets already carry their checksum; this is meant for
+ *         Packet structures filled by the application.
  */
 uint16_t calculateChecksum(Packet *packet)
 {
-    uint16_t calculatedSum = 0;
-    uint16_t contentSum = 0;
-    int i = 0;
-    for (i = 0; i < packet->length - 0x2; i++)
-    {
-        contentSum += packet->data[i];
-    }
-    calculatedSum = packet->type + packet->length + contentSum;
-    return calculatedSum;
+    return (uint16_t)(packet->type + packet->length + sumBytes(packet->data, packet->length - 0x2));
 }
@@ -4,9 +4,13 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "utils/config.h"
+#ifdef DY50_HOST
+#include "host_transport.h"         // Host build, the sensor is reached through host/host_transport.c
+#else
 #include "driverlib/rom_map.h"
 #include "inc/hw_memmap.h"
 #include "utils/tm4c123gxl_utils.h"
+#endif
 
 /* ***** Defines ***** */
 
@@ -15,6 +19,7 @@
 #define DEFAULT_MODULE_ADDRESS                  0xFFFFFFFF
 #define FINGERPRINT_PASSVERIFY                  0x21 // Verify the fingerprint passed
 #define FINGERPRINT_TEMPLATECOUNT               0x1D // Read finger template numbers
+#define FINGERPRINT_READINDEX                   0x1F // Read the occupancy bits of 256 library pages
 #define FINGERPRINT_COMMANDPACKET               0x1  // Command packet
 #define FINGERPRINT_LEDON                       0x50 // Turn on the onboard LED
 #define FINGERPRINT_LEDOFF                      0x51 // Turn off the onboard LED
@@ -22,11 +27,15 @@
 #define FINGERPRINT_DELETE                      0x0C // Delete templates
 #define FINGERPRINT_EMPTY                       0x0D // Empty library
 #define FINGERPRINT_UPLOAD                      0x08 // Upload template
+#define FINGERPRINT_DOWNLOAD                    0x09 // Download template
+#define FINGERPRINT_UPLOADIMAGE                 0x0A // Upload image
 #define FINGERPRINT_LOAD                        0x07 // Read/load template
 #define FINGERPRINT_STORE                       0x06 // Store template
+#define FINGERPRINT_MATCH                       0x03 // Compare the contents of CharBuffer1 and CharBuffer2
 #define FINGERPRINT_REGMODEL                    0x05 // Combine character files and generate template
 #define FINGERPRINT_IMAGE2TZ                    0x02 // Generate character file from image
 #define FINGERPRINT_GETIMAGE                    0x01 // Collect finger image
+#define FINGERPRINT_SETSYSPARAM                 0x0E // Write a system parameter
 #define FINGERPRINT_READSYSPARAM                0x0F // Read system parameters
 #define FINGERPRINT_VERIFYPASSWORD              0x13 // Verifies the password
 #define FINGERPRINT_OK                          0x00 // Command execution is complete
@@ -58,8 +67,27 @@
 #define FINGERPRINT_ENDDATAPACKET               0x8  // End of data packet
 #define FINGERPRINT_TIMEOUT                     0xFF // Timeout was reached
 #define FINGERPRINT_BADPACKET                   0xFE // Bad packet was sent
+#define FINGERPRINT_BUSY                        0xFD // Driver is used by another task and the lock timed out
 #define FINGERPRINT_AURALEDCONFIG               0x35 // Aura LED control
 #define DEFAULTTIMEOUT                          1000 // UART reading timeout in milliseconds
+#define DEFAULT_PASSWORD                        0x00000000 // Factory handshake password
+#define STARTUP_TIMEOUT                         1000 // Maximum time sensorBegin() waits for the module in ms
+#define DEFAULT_MAX_RETRIES                     2    // Repetitions of an idempotent command after a link error
+#define PROBE_TIMEOUT                           50   // Response timeout of a single readiness probe in ms
+#define AURA_BREATHING                          0x01 // Aura LED control codes
+#define AURA_FLASHING                           0x02
+#define AURA_ALWAYS_ON                          0x03
+#define AURA_ALWAYS_OFF                         0x04
+#define AURA_GRADUAL_ON                         0x05
+#define AURA_GRADUAL_OFF                        0x06
+#define AURA_RED                                0x01 // Aura LED colors
+#define AURA_BLUE                               0x02
+#define AURA_PURPLE                             0x03
+#define SYSPARAM_BAUD_RATE                      4    // Parameter numbers of setSystemParameter(); 9600 * value baud
+#define SYSPARAM_SECURITY_LEVEL                 5    // 1 to 5, higher levels accept fewer matches
+#define SYSPARAM_PACKET_SIZE                    6    // 0 to 3 for data packets of 32 to 256 bytes
+#define INDEX_PAGE_PAGES                        256  // Library pages covered by one page of the index table
+#define INDEX_PAGE_SIZE                         (INDEX_PAGE_PAGES / 8) // Bytes of one index page, bit 0 is the lowest
 
 /* ***** Functions ***** */
 
@@ -71,13 +99,38 @@ uint8_t emptyDatabase(void);
 uint8_t storeModel(uint8_t buffer, uint16_t pageID);
 uint8_t loadModel(uint8_t buffer, uint16_t location);
 uint8_t getModel(void);
+uint8_t uploadModel(uint8_t buffer, DataPacketHandler onData, void* context);
+uint8_t uploadImage(DataPacketHandler onData, void* context);
+uint8_t beginDownloadModel(uint8_t buffer);
+void sendDataPacket(uint8_t* data, uint16_t length, bool isLast);
+void broadcastDataPacket(uint8_t sensorMask, uint8_t* data, uint16_t length, bool isLast);
 uint8_t deleteModel(uint16_t templateNum, uint8_t numberOfTemplates);
 uint8_t fingerFastSearch(void);
 FingerPageAndConfidence fingerSearch(uint8_t bufferId);
+FingerPageAndConfidence fingerVerify(uint16_t page);
+uint8_t fingerMatch(uint16_t* confidence);
+void sendSearch(uint8_t bufferId, uint16_t startPage, uint16_t pageCount);
+FingerPageAndConfidence receiveSearchResult(void);
 uint16_t getTemplateCount(void);
+uint8_t readIndexTable(uint8_t indexPage, uint8_t* bitmap);
+void setSearchWindow(uint16_t startPage, uint16_t pageCount);
+void getSearchWindow(uint16_t* startPage, uint16_t* pageCount);
 uint8_t setPassword(uint32_t password);
+uint8_t setSystemParameter(uint8_t parameter, uint8_t value);
 uint8_t LEDcontrol(bool on);
+uint8_t auraControl(uint8_t control, uint8_t speed, uint8_t color, uint8_t count);
 uint8_t checkPassword(uint32_t password);
 uint16_t calculateChecksum(Packet *packet);
+uint8_t sensorBegin(uint32_t password);
+BootMetrics getBootMetrics(void);
+void setRetryPolicy(uint8_t maxRetries, uint32_t timeoutMs);
+RetryStats getRetryStats(void);
+void setDriverLockHooks(bool (*lock)(void), void (*unlock)(void));
+bool lockDriver(void);
+void unlockDriver(void);
+void invalidateShadow(void);
+ShadowStats getShadowStats(void);
+void selectSensor(uint8_t index);
+uint8_t getSelectedSensor(void);
 
 #endif // DY50_H
@@ -0,0 +1,244 @@
+#include "dy50_compact.h"
+#include "page_map.h"
+#include <string.h>
+
+#define COMPACT_EMPTY                           0xFF // pageGroup entry of an empty page
+#define NO_PAGE                                 0xFFFF
+
+static uint8_t occupancy[PAGE_MAP_MAX_PAGES / 8];   // Index table, one bit per page
+static uint8_t pageGroup[PAGE_MAP_MAX_PAGES];       // Group of the template on every page, COMPACT_EMPTY if none
+
+/**
+ * @brief  Carry out the steps of a move that the page map has not recorded yet
+ * @return FINGERPRINT_OK once the old page is deleted, otherwise the confirmation word of the failing command or
+ *         FINGERPRINT_FLASHERR if the map could not be written
+ */
+static uint8_t finishMove(const PageMapMove* move)
+{
+    uint8_t statusCode;
+
+    if (move->kind == PAGE_MAP_MOVE_BEGIN)
+    {
+        // The old page is intact until the commit, so the copy can always be repeated
+        statusCode = loadModel(1, move->from);
+        if (statusCode == FINGERPRINT_OK)
+        {
+            statusCode = storeModel(1, move->to);
+        }
+        if (statusCode != FINGERPRINT_OK)
+        {
+            return statusCode;
+        }
+        if (!pageMapCommitMove())
+        {
+            return FINGERPRINT_FLASHERR;
+        }
+    }
+    statusCode = deleteModel(move->from, 1);
+    if (statusCode != FINGERPRINT_OK)
+    {
+        return statusCode;
+    }
+    return pageMapEndMove() ? FINGERPRINT_OK : FINGERPRINT_FLASHERR;
+}
+
+/**
+ * @brief  Move the template of a page to a free page and record the new owner
+ */
+static uint8_t moveTemplate(uint16_t from, uint16_t to)
+{
+    PageMapMove move = { PAGE_MAP_MOVE_BEGIN, from, to, pageMapUser(from) };
+
+    if (move.user == PAGE_MAP_FREE)
+    {
+        move.user = PAGE_MAP_UNOWNED; // Stored without the map, e.g. through RPC_OP_STORE_MODEL
+    }
+    if (!pageMapBeginMove(move.from, move.to, move.user))
+    {
+        return FINGERPRINT_FLASHERR;
+    }
+    return finishMove(&move);
+}
+
+/**
+ * @brief  Read the index table of the selected sensor into occupancy
+ */
+static uint8_t readOccupancy(uint16_t capacity)
+{
+    uint8_t statusCode = FINGERPRINT_OK;
+
+    memset(occupancy, 0, sizeof(occupancy));
+    for (uint8_t indexPage = 0; indexPage * INDEX_PAGE_PAGES < capacity && statusCode == FINGERPRINT_OK; indexPage++)
+    {
+        statusCode = readIndexTable(indexPage, &occupancy[indexPage * INDEX_PAGE_SIZE]);
+    }
+    return statusCode;
+}
+
+/**
+ * @brief  Highest page from start down to end, exclusive, that holds a template of a group
+ * @return The page, NO_PAGE if there is none
+ */
+static uint16_t findFromTop(uint16_t start, uint16_t end, uint8_t group)
+{
+    while (start-- > end)
+    {
+        if (pageGroup[start] == group)
+        {
+            return start;
+        }
+    }
+    return NO_PAGE;
+}
+
+/**
+ * @brief  Finish a template move that was interrupted by a reset and limit fingerSearch() to the pages up to the last
+ *         occupied one. Call after sensorBegin() and pageMapInit().
+ * @return FINGERPRINT_OK, or the confirmation word of the command that failed to finish the move
+ */
+uint8_t compactResume(void)
+{
+    PageMapMove move;
+    uint8_t statusCode = FINGERPRINT_OK;
+
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    if (pageMapPendingMove(&move))
+    {
+        statusCode = finishMove(&move);
+    }
+    setSearchWindow(0, pageMapSearchPages(getParameters().capacity));
+    unlockDriver();
+    return statusCode;
+}
+
+/**
+ * @brief  Move all templates of the selected sensor to the lowest pages, ordered by group, and limit fingerSearch() to
+ *         them. Templates already on a page of their group's range stay; the others are placed from the top of the
+ *         library, and a template of another group in the way is first moved to a free page of a later group.
+ * @param  groupOf                           - Group of a user, NULL to keep all templates in one group
+ * @return Result with the page range of every group. On a failure the library and the map are consistent, with the
+ *         moves done so far.
+ * @note   Takes about 1 s per moved template with a real module. A full library is already dense; its groups are only
+ *         reordered while a page is free.
+ */
+CompactResult compactLibrary(UserGroupFunction groupOf)
+{
+    CompactResult result;
+    uint16_t capacity;
+
+    memset(&result, 0, sizeof(result));
+    if (!lockDriver())
+    {
+        result.statusCode = FINGERPRINT_BUSY;
+        return result;
+    }
+    result.statusCode = compactResume();
+    capacity = getParameters().capacity;
+    if (capacity > PAGE_MAP_MAX_PAGES)
+    {
+        capacity = PAGE_MAP_MAX_PAGES;
+    }
+    if (result.statusCode == FINGERPRINT_OK)
+    {
+        result.statusCode = readOccupancy(capacity);
+    }
+    if (result.statusCode != FINGERPRINT_OK)
+    {
+        unlockDriver();
+        return result;
+    }
+
+    // Group of every template and the page range of every group
+    memset(pageGroup, COMPACT_EMPTY, sizeof(pageGroup));
+    for (uint16_t page = 0; page < capacity; page++)
+    {
+        if (occupancy[page / 8] & (1 << (page % 8)))
+        {
+            uint16_t user = pageMapUser(page);
+            uint8_t group = (groupOf != NULL) ? groupOf(user != PAGE_MAP_FREE ? user : PAGE_MAP_UNOWNED) : 0;
+            pageGroup[page] = (group < COMPACT_MAX_GROUPS) ? group : COMPACT_MAX_GROUPS - 1;
+            result.groupPages[pageGroup[page]]++;
+            result.templates++;
+        }
+    }
+    for (uint8_t group = 1; group < COMPACT_MAX_GROUPS; group++)
+    {
+        result.groupStart[group] = (uint16_t)(result.groupStart[group - 1] + result.groupPages[group - 1]);
+    }
+
+    // Fill the range of every group in turn; the ranges before it are complete
+    for (uint8_t group = 0; group < COMPACT_MAX_GROUPS && result.statusCode == FINGERPRINT_OK; group++)
+    {
+        uint16_t end = (uint16_t)(result.groupStart[group] + result.groupPages[group]);
+        uint16_t page = result.groupStart[group];
+
+        while (page < end && result.statusCode == FINGERPRINT_OK)
+        {
+            uint16_t target = page;
+            uint16_t source;
+
+            if (pageGroup[page] == group)
+            {
+                page++;
+                continue;
+            }
+            if (pageGroup[page] != COMPACT_EMPTY)
+            {
+                // Evict the template to a free page of the later ranges, or fill a free page of this range first,
+                // which frees a page above it
+                uint16_t spare = findFromTop(capacity, end, COMPACT_EMPTY);
+                if (spare == NO_PAGE)
+                {
+                    target = findFromTop(end, page, COMPACT_EMPTY);
+                    if (target == NO_PAGE)
+                    {
+                        break; // Full library
+                    }
+                }
+                else
+                {
+                    result.statusCode = moveTemplate(page, spare);
+                    if (result.statusCode != FINGERPRINT_OK)
+                    {
+                        break;
+                    }
+                    pageGroup[spare] = pageGroup[page];
+                    pageGroup[page] = COMPACT_EMPTY;
+                    result.moves++;
+                }
+            }
+            source = findFromTop(capacity, end, group); // Exists, the range lacks a template of the group
+            result.statusCode = moveTemplate(source, target);
+            if (result.statusCode == FINGERPRINT_OK)
+            {
+                pageGroup[target] = group;
+                pageGroup[source] = COMPACT_EMPTY;
+                result.moves++;
+            }
+        }
+    }
+
+    // Record the layout explicitly, so that new enrolments take the lowest free page. After a failure pageGroup may
+    // miss the last move, the map alone is right.
+    if (result.statusCode == FINGERPRINT_OK)
+    {
+        memset(occupancy, 0, sizeof(occupancy));
+        for (uint16_t page = 0; page < capacity; page++)
+        {
+            if (pageGroup[page] != COMPACT_EMPTY)
+            {
+                occupancy[page / 8] |= (uint8_t)(1 << (page % 8));
+            }
+        }
+        if (!pageMapRewrite(occupancy))
+        {
+            result.statusCode = FINGERPRINT_FLASHERR;
+        }
+    }
+    setSearchWindow(0, pageMapSearchPages(capacity));
+    unlockDriver();
+    return result;
+}
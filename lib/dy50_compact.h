@@ -0,0 +1,43 @@
+#ifndef DY50_COMPACT_H
+#define DY50_COMPACT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "dy50.h"
+
+/*
+ * Compaction of the template library of the selected sensor. Enrolments and deletions scatter the templates over the
+ * whole capacity, and a search takes time for every page of its range, occupied or not. compactLibrary() reads the
+ * index table and moves the templates to the lowest pages, optionally ordered by a group of their user, so that
+ * fingerSearch() and the searches of single groups only cover occupied pages.
+ *
+ * A template is moved by loading it into CharBuffer1 and storing it on a free page; the old page is deleted only after
+ * the page map (utils/page_map.h) gives the user the new page. Every move is recorded there before, during and after
+ * the copy, so a reset never loses a template: compactResume() at the next boot finishes the interrupted move, and
+ * compactLibrary() can simply be started again to finish the layout.
+ */
+
+/* ***** Defines ***** */
+
+#define COMPACT_MAX_GROUPS                      8    // Groups 0 to 7; higher groups are placed with group 7
+
+/* ***** Structures ***** */
+
+// Group of a user, or of PAGE_MAP_UNOWNED; templates are placed in ascending group order
+typedef uint8_t (*UserGroupFunction)(uint16_t user);
+
+typedef struct
+{
+    uint8_t statusCode;         // FINGERPRINT_OK or the confirmation word of the command that failed
+    uint16_t templates;         // Occupied pages, the first ones of the library afterwards
+    uint16_t moves;             // Templates copied to another page
+    uint16_t groupStart[COMPACT_MAX_GROUPS]; // First page of every group
+    uint16_t groupPages[COMPACT_MAX_GROUPS]; // Templates of every group
+} CompactResult;
+
+/* ***** Functions ***** */
+
+uint8_t compactResume(void);
+CompactResult compactLibrary(UserGroupFunction groupOf);
+
+#endif /* DY50_COMPACT_H */
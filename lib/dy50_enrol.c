@@ -0,0 +1,212 @@
+#include <stddef.h>
+#include "dy50_enrol.h"
+#include "dy50.h"
+#include "page_map.h"
+
+#define TEMPLATE_BUFFER                         1    // First sample, then the template merged from two samples
+#define SAMPLE_BUFFER                           2
+
+/**
+ * @brief  Ask the user for the next action and restart the wait for it
+ */
+static void promptUser(EnrolJob *enrol, EnrolPrompt prompt)
+{
+    enrol->prompt = prompt;
+    enrol->waitStartMs = getTickCount();
+    if (enrol->onPrompt != NULL)
+    {
+        enrol->onPrompt(enrol);
+    }
+}
+
+/**
+ * @brief  End the job
+ * @return true, for the step function
+ */
+static bool finishEnrol(EnrolJob *enrol, uint8_t statusCode)
+{
+    enrol->job.result = statusCode;
+    return true;
+}
+
+/**
+ * @brief  Whether a sample was rejected because of the finger rather than the module or the link
+ */
+static bool isRetakeable(uint8_t statusCode)
+{
+    return statusCode == FINGERPRINT_IMAGEMESS || statusCode == FINGERPRINT_FEATUREFAIL ||
+           statusCode == FINGERPRINT_INVALIDIMAGE || statusCode == FINGERPRINT_ENROLLMISMATCH ||
+           statusCode == FINGERPRINT_NOMATCH;
+}
+
+/**
+ * @brief  Poll the window once
+ * @param  isPresent                         - Wait for a finger to be put on, otherwise for it to be lifted
+ * @return FINGERPRINT_OK once the finger is in the wanted state, FINGERPRINT_NOFINGER while it is not yet or after a
+ *         failed capture, which tells nothing about the finger, or the confirmation word of a command error
+ */
+static uint8_t pollWindow(EnrolJob *enrol, bool isPresent)
+{
+    uint8_t statusCode = getImage();
+
+    if ((statusCode == FINGERPRINT_OK || statusCode == FINGERPRINT_NOFINGER) &&
+        (statusCode == FINGERPRINT_NOFINGER) != isPresent)
+    {
+        return FINGERPRINT_OK;
+    }
+    if (statusCode == FINGERPRINT_OK || statusCode == FINGERPRINT_NOFINGER || statusCode == FINGERPRINT_IMAGEFAIL)
+    {
+        return (getTickCount() - enrol->waitStartMs >= ENROL_FINGER_TIMEOUT_MS) ? FINGERPRINT_TIMEOUT :
+                                                                                   FINGERPRINT_NOFINGER;
+    }
+    return statusCode;
+}
+
+/**
+ * @brief  Convert the captured image; the second sample is merged with the first, every further one is compared with
+ *         the template
+ */
+static uint8_t takeSample(const EnrolJob *enrol)
+{
+    uint16_t confidence;
+    uint8_t statusCode;
+
+    if (enrol->sample == 0)
+    {
+        return image2Tz(TEMPLATE_BUFFER);
+    }
+    statusCode = image2Tz(SAMPLE_BUFFER);
+    if (statusCode == FINGERPRINT_OK)
+    {
+        statusCode = (enrol->sample == 1) ? createModel() : fingerMatch(&confidence);
+    }
+    return statusCode;
+}
+
+static bool enrolStep(Job *job)
+{
+    EnrolJob *enrol = (EnrolJob *)job->context;
+    uint8_t statusCode;
+
+    if (enrol->page == PAGE_MAP_NO_PAGE)
+    {
+        enrol->page = pageMapAllocate(enrol->user, getParameters().capacity);
+        if (enrol->page == PAGE_MAP_NO_PAGE)
+        {
+            return finishEnrol(enrol, FINGERPRINT_BADLOCATION);
+        }
+        promptUser(enrol, ENROL_PLACE_FINGER);
+    }
+
+    switch (enrol->state)
+    {
+        case ENROL_STATE_WAIT_FINGER:
+            statusCode = pollWindow(enrol, true);
+            if (statusCode == FINGERPRINT_OK)
+            {
+                enrol->state = ENROL_STATE_CONVERT;
+            }
+            else if (statusCode != FINGERPRINT_NOFINGER)
+            {
+                return finishEnrol(enrol, statusCode);
+            }
+            break;
+        case ENROL_STATE_CONVERT:
+            statusCode = takeSample(enrol);
+            if (statusCode == FINGERPRINT_OK)
+            {
+                enrol->sample++;
+                if (enrol->sample == enrol->samples)
+                {
+                    enrol->state = ENROL_STATE_STORE; // The user lifts the finger while the template is stored
+                    break;
+                }
+                // The first sample is searched for while the finger is lifted
+                enrol->state = (enrol->sample == 1) ? ENROL_STATE_SEARCH : ENROL_STATE_WAIT_REMOVAL;
+                promptUser(enrol, ENROL_REMOVE_FINGER);
+            }
+            else if (isRetakeable(statusCode) && enrol->retakes < ENROL_MAX_RETAKES)
+            {
+                enrol->retakes++;
+                enrol->lastStatus = statusCode;
+                enrol->state = ENROL_STATE_WAIT_REMOVAL;
+                promptUser(enrol, ENROL_RETAKE_SAMPLE);
+            }
+            else
+            {
+                return finishEnrol(enrol, statusCode);
+            }
+            break;
+        case ENROL_STATE_SEARCH:
+            enrol->duplicate = fingerSearch(TEMPLATE_BUFFER);
+            if (enrol->duplicate.statusCode == FINGERPRINT_OK)
+            {
+                enrol->duplicate.fingerprintPage = pageMapUser(enrol->duplicate.fingerprintPage);
+                if (enrol->duplicate.fingerprintPage != enrol->user) // A user may replace the own template
+                {
+                    return finishEnrol(enrol, ENROL_DUPLICATE);
+                }
+            }
+            else if (enrol->duplicate.statusCode != FINGERPRINT_NOTFOUND)
+            {
+                return finishEnrol(enrol, enrol->duplicate.statusCode);
+            }
+            enrol->state = ENROL_STATE_WAIT_REMOVAL;
+            break;
+        case ENROL_STATE_WAIT_REMOVAL:
+            statusCode = pollWindow(enrol, false);
+            if (statusCode == FINGERPRINT_OK)
+            {
+                enrol->state = ENROL_STATE_WAIT_FINGER;
+                promptUser(enrol, ENROL_PLACE_FINGER);
+            }
+            else if (statusCode != FINGERPRINT_NOFINGER)
+            {
+                return finishEnrol(enrol, statusCode);
+            }
+            break;
+        default:
+            statusCode = storeModel(TEMPLATE_BUFFER, enrol->page);
+            if (statusCode == FINGERPRINT_OK && pageMapUser(enrol->page) != enrol->user &&
+                !pageMapAssign(enrol->page, enrol->user))
+            {
+                statusCode = FINGERPRINT_FLASHERR;
+            }
+            return finishEnrol(enrol, statusCode);
+    }
+    return false;
+}
+
+/**
+ * @brief  Prepare an enrolment job; submit it with schedulerSubmit(), usually with PRIORITY_INTERACTIVE. job.result
+ *         is FINGERPRINT_OK once the template is stored on page, ENROL_DUPLICATE if the finger belongs to another
+ *         user already, FINGERPRINT_TIMEOUT if the user did not put on or lift the finger in time, or the
+ *         confirmation word of the step that failed.
+ * @param  enrol                             - Job storage
+ * @param  user                              - User ID; the template replaces the user's template or takes the page
+ *                                             pageMapAllocate() chooses
+ * @param  samples                           - Samples to take, ENROL_MIN_SAMPLES to ENROL_MAX_SAMPLES
+ * @param  onPrompt                          - Tells the user to put on or lift the finger, may be NULL
+ * @param  onDone                            - Called when the job is finished
+ */
+void initEnrolJob(EnrolJob *enrol, uint16_t user, uint8_t samples, EnrolPromptHandler onPrompt, JobDone onDone)
+{
+    enrol->job.step = enrolStep;
+    enrol->job.onDone = onDone;
+    enrol->job.context = enrol;
+    enrol->job.result = FINGERPRINT_OK;
+    enrol->user = user;
+    enrol->page = PAGE_MAP_NO_PAGE;
+    enrol->samples = (samples < ENROL_MIN_SAMPLES) ? ENROL_MIN_SAMPLES :
+                     (samples > ENROL_MAX_SAMPLES) ? ENROL_MAX_SAMPLES : samples;
+    enrol->sample = 0;
+    enrol->retakes = 0;
+    enrol->lastStatus = FINGERPRINT_OK;
+    enrol->state = ENROL_STATE_WAIT_FINGER;
+    enrol->prompt = ENROL_PLACE_FINGER;
+    enrol->waitStartMs = 0;
+    enrol->duplicate.statusCode = FINGERPRINT_NOTFOUND;
+    enrol->duplicate.fingerprintPage = 0;
+    enrol->duplicate.confidence = 0;
+    enrol->onPrompt = onPrompt;
+}
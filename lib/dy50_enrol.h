@@ -0,0 +1,76 @@
+#ifndef DY50_ENROL_H
+#define DY50_ENROL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "scheduler.h"
+
+/*
+ * Enrolment as a job of lib/scheduler.h. Every step is one sensor transaction, so waiting for the finger to be put on
+ * or lifted never blocks the caller; schedulerPoll() returns after each poll of the window.
+ *
+ * The first sample is converted into CharBuffer1 and searched for in the library while the user lifts the finger, so
+ * a finger that is already enrolled under another user is refused before the next sample is asked for. The second
+ * sample is converted into CharBuffer2 and merged with RegModel, which stores the template in both CharBuffers.
+ * RegModel is only documented for two character files, so every further sample is not merged but converted into
+ * CharBuffer2 and compared with the template by Match: it confirms that the template recognises the finger. The
+ * conversion and the merge or comparison run in the same step, so a background job cannot overwrite CharBuffer2 in
+ * between. A sample that cannot be converted or does not match is taken again, up to ENROL_MAX_RETAKES times.
+ *
+ * The template is stored on the page utils/page_map.h chooses for the user, see pageMapAllocate(), and the page map
+ * records the user once the template is stored.
+ */
+
+/* ***** Defines ***** */
+
+#define ENROL_MIN_SAMPLES                       2
+#define ENROL_MAX_SAMPLES                       6
+#define ENROL_DEFAULT_SAMPLES                   2
+#define ENROL_MAX_RETAKES                       3    // Samples taken again before the enrolment fails
+#define ENROL_FINGER_TIMEOUT_MS                 10000 // Wait for the finger to be put on or lifted
+#define ENROL_DUPLICATE                         0xFC // job.result: the finger is enrolled already, see duplicate
+
+/* ***** Structures ***** */
+
+typedef enum
+{
+    ENROL_PLACE_FINGER,         // Put the finger on the window for sample
+    ENROL_REMOVE_FINGER,        // Sample taken, lift the finger
+    ENROL_RETAKE_SAMPLE         // Sample rejected with lastStatus, lift the finger and put it on again
+} EnrolPrompt;
+
+typedef enum
+{
+    ENROL_STATE_WAIT_FINGER,
+    ENROL_STATE_CONVERT,
+    ENROL_STATE_SEARCH,
+    ENROL_STATE_WAIT_REMOVAL,
+    ENROL_STATE_STORE
+} EnrolState;
+
+typedef struct EnrolJob EnrolJob;
+
+// Tells the user what to do next; prompt and sample hold the request
+typedef void (*EnrolPromptHandler)(const EnrolJob *enrol);
+
+struct EnrolJob
+{
+    Job job;
+    uint16_t user;
+    uint16_t page;              // Library page the template is stored on
+    uint8_t samples;            // Samples to take, two merged and the others compared with the template
+    uint8_t sample;             // Samples accepted so far
+    uint8_t retakes;            // Samples taken again
+    uint8_t lastStatus;         // Confirmation word of the last rejected sample
+    EnrolState state;
+    EnrolPrompt prompt;
+    uint32_t waitStartMs;       // Start of the current wait for the finger
+    FingerPageAndConfidence duplicate; // User and confidence of the match if job.result is ENROL_DUPLICATE
+    EnrolPromptHandler onPrompt;
+};
+
+/* ***** Functions ***** */
+
+void initEnrolJob(EnrolJob *enrol, uint16_t user, uint8_t samples, EnrolPromptHandler onPrompt, JobDone onDone);
+
+#endif /* DY50_ENROL_H */
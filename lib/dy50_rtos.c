@@ -0,0 +1,109 @@
+#ifdef DY50_USE_FREERTOS
+
+#include "dy50_rtos.h"
+#include "dy50.h"
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+static SemaphoreHandle_t driverMutex;       // Recursive, held for the duration of a command
+static SemaphoreHandle_t frameReceived;     // Given for every complete packet, see frameReceivedSignal()
+static SemaphoreHandle_t transmitDone;      // Given when a uDMA transmit transfer is done, board only
+static uint32_t defaultCallTimeout;
+
+// Per-task timeouts are stored in the task's thread local storage; 0 selects the default
+static TickType_t callTimeoutTicks(void)
+{
+    uint32_t timeoutMs = (uint32_t)(uintptr_t)pvTaskGetThreadLocalStoragePointer(NULL, DY50_RTOS_TLS_INDEX);
+    return pdMS_TO_TICKS(timeoutMs != 0 ? timeoutMs : defaultCallTimeout);
+}
+
+static bool takeDriver(void)
+{
+    return xSemaphoreTakeRecursive(driverMutex, callTimeoutTicks()) == pdTRUE;
+}
+
+static void giveDriver(void)
+{
+    xSemaphoreGiveRecursive(driverMutex);
+}
+
+static bool waitForFrame(uint32_t timeoutMs)
+{
+    return xSemaphoreTake(frameReceived, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
+
+// The board gives from the UART interrupt handler; host/host_transport.c signals from the sending task or thread
+static void giveFromHandler(SemaphoreHandle_t semaphore)
+{
+#ifdef DY50_HOST
+    xSemaphoreGive(semaphore);
+#else
+    BaseType_t isHigherPriorityTaskWoken = pdFALSE;
+    xSemaphoreGiveFromISR(semaphore, &isHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(isHigherPriorityTaskWoken);
+#endif
+}
+
+static void frameReceivedSignal(void)
+{
+    giveFromHandler(frameReceived);
+}
+
+static bool waitForTransmit(uint32_t timeoutMs)
+{
+    return xSemaphoreTake(transmitDone, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
+
+static void transmitDoneSignal(void)
+{
+    giveFromHandler(transmitDone);
+}
+
+/**
+ * @brief  Make the driver safe for use from several tasks. Call once after init() and before the scheduler starts,
+ *         then call sensorBegin() from a task.
+ * @param  defaultCallTimeoutMs              - How long a command waits for a command of another task to finish,
+ *                                             0 for DY50_RTOS_DEFAULT_CALL_TIMEOUT
+ * @return false if the kernel objects could not be allocated
+ * @note   The sensor UART interrupt must have a priority numerically at or above
+ *         configMAX_SYSCALL_INTERRUPT_PRIORITY so that it may give the semaphores.
+ */
+bool dy50RtosInit(uint32_t defaultCallTimeoutMs)
+{
+    driverMutex = xSemaphoreCreateRecursiveMutex();
+    frameReceived = xSemaphoreCreateBinary();
+    transmitDone = xSemaphoreCreateBinary();
+    if (driverMutex == NULL || frameReceived == NULL || transmitDone == NULL)
+    {
+        return false;
+    }
+    defaultCallTimeout = (defaultCallTimeoutMs != 0) ? defaultCallTimeoutMs : DY50_RTOS_DEFAULT_CALL_TIMEOUT;
+
+#ifndef DY50_HOST
+    {
+        const uint32_t sensorUartInts[MAX_SENSOR_COUNT] = SENSOR_UART_INTS;
+        for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+        {
+            MAP_IntPrioritySet(sensorUartInts[i], configMAX_SYSCALL_INTERRUPT_PRIORITY);
+        }
+    }
+#endif
+    setFrameWaitHooks(waitForFrame, frameReceivedSignal);
+    setTransmitWaitHooks(waitForTransmit, transmitDoneSignal);
+    setDriverLockHooks(takeDriver, giveDriver);
+    return true;
+}
+
+/**
+ * @brief  Set how long the calling task's commands wait for the sensor to become free
+ * @param  timeoutMs                         - Timeout in ms, 0 for the default passed to dy50RtosInit()
+ * @note   A command that cannot get the sensor in time returns FINGERPRINT_BUSY. The response timeout of a command
+ *         that has started is set with setRetryPolicy().
+ */
+void dy50RtosSetCallTimeout(uint32_t timeoutMs)
+{
+    vTaskSetThreadLocalStoragePointer(NULL, DY50_RTOS_TLS_INDEX, (void *)(uintptr_t)timeoutMs);
+}
+
+#endif // DY50_USE_FREERTOS
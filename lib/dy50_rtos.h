@@ -0,0 +1,28 @@
+#ifndef DY50_RTOS_H
+#define DY50_RTOS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * FreeRTOS integration of the driver, built when DY50_USE_FREERTOS is defined.
+ *
+ * Commands are serialized by a recursive mutex so any number of tasks can use the lib/dy50.c API, and a task waiting
+ * for the sensor blocks on binary semaphores given by the UART and uDMA interrupt handlers instead of spinning. In a
+ * DY50_HOST build host/host_transport.c signals frames from ordinary threads, so the semaphores are given with the
+ * task-level call there; host/rtos_harness.c runs this file that way on the FreeRTOS POSIX port.
+ */
+
+/* ***** Defines ***** */
+
+#define DY50_RTOS_DEFAULT_CALL_TIMEOUT          5000 // Longest wait for another task's command, in ms
+#ifndef DY50_RTOS_TLS_INDEX
+#define DY50_RTOS_TLS_INDEX                     0    // Thread local storage slot for per-task call timeouts
+#endif
+
+/* ***** Functions ***** */
+
+bool dy50RtosInit(uint32_t defaultCallTimeoutMs);
+void dy50RtosSetCallTimeout(uint32_t timeoutMs);
+
+#endif /* DY50_RTOS_H */
@@ -0,0 +1,274 @@
+#include "dy50_shard.h"
+
+static uint8_t templateBuffer[SHARD_TEMPLATE_SIZE];
+static uint16_t templateLength;
+static uint16_t templatePacketLength;   // Payload size of the data packets the template was uploaded in
+static bool isTemplateTruncated;
+
+// Collects the data packets of an uploaded template
+static void collectTemplate(const uint8_t* data, uint16_t length, bool isLast, void* context)
+{
+    (void)isLast;
+    (void)context;
+    if (templateLength == 0)
+    {
+        templatePacketLength = length;
+    }
+    for (uint16_t i = 0; i < length; i++)
+    {
+        if (templateLength < SHARD_TEMPLATE_SIZE)
+        {
+            templateBuffer[templateLength++] = data[i];
+        }
+        else
+        {
+            isTemplateTruncated = true;
+        }
+    }
+}
+
+/**
+ * @brief  Download the template held in templateBuffer to the selected sensors
+ * @return Mask of the sensors that received the template
+ */
+static uint8_t downloadTemplate(uint8_t sensorMask, uint8_t buffer)
+{
+    uint8_t broadcastMask = 0;
+    uint8_t receivedMask = 0;
+
+    for (uint8_t sensor = 0; sensor < SENSOR_COUNT; sensor++)
+    {
+        uint16_t packetLength;
+
+        if (!(sensorMask & (1 << sensor)))
+        {
+            continue;
+        }
+        selectSensor(sensor);
+        packetLength = getParameters().packet_len; // Before DownChar, the module then only accepts data packets
+        if (beginDownloadModel(buffer) != FINGERPRINT_OK)
+        {
+            continue;
+        }
+        receivedMask |= 1 << sensor;
+        if (packetLength == templatePacketLength)
+        {
+            broadcastMask |= 1 << sensor;
+        }
+        else
+        {
+            // A module configured for another packet size gets the template on its own
+            for (uint16_t offset = 0; offset < templateLength; offset += packetLength)
+            {
+                uint16_t length = (templateLength - offset < packetLength) ? templateLength - offset : packetLength;
+                sendDataPacket(&templateBuffer[offset], length, offset + length >= templateLength);
+            }
+        }
+    }
+
+    for (uint16_t offset = 0; broadcastMask != 0 && offset < templateLength; offset += templatePacketLength)
+    {
+        uint16_t length = (templateLength - offset < templatePacketLength) ? templateLength - offset
+                                                                           : templatePacketLength;
+        broadcastDataPacket(broadcastMask, &templateBuffer[offset], length, offset + length >= templateLength);
+    }
+    return receivedMask;
+}
+
+/**
+ * @brief  Upload a CharBuffer of one sensor into templateBuffer
+ */
+static uint8_t uploadTemplate(uint8_t sensor, uint8_t buffer)
+{
+    uint8_t result;
+
+    templateLength = 0;
+    isTemplateTruncated = false;
+    selectSensor(sensor);
+    result = uploadModel(buffer, collectTemplate, NULL);
+    if (result == FINGERPRINT_OK && isTemplateTruncated)
+    {
+        result = FINGERPRINT_UPLOADFEATUREFAIL;
+    }
+    return result;
+}
+
+/**
+ * @brief  Copy a character file or template from one sensor to others. The template is uploaded once and the data
+ *         packets are sent to all targets at the same time.
+ * @param  fromSensor                        - Sensor holding the template
+ * @param  fromBuffer                        - Its CharBuffer
+ * @param  toSensorMask                      - Bit n selects sensor n as a target
+ * @param  toBuffer                          - CharBuffer of the targets
+ * @return Confirmation word                 - 0x00 All targets received the template
+ *                                             0x0d Error when uploading template
+ *                                             0x0e A target cannot receive the data packets
+ */
+uint8_t copyTemplate(uint8_t fromSensor, uint8_t fromBuffer, uint8_t toSensorMask, uint8_t toBuffer)
+{
+    uint8_t previous = getSelectedSensor();
+    uint8_t result;
+
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    result = uploadTemplate(fromSensor, fromBuffer);
+    if (result == FINGERPRINT_OK && downloadTemplate(toSensorMask, toBuffer) != toSensorMask)
+    {
+        result = FINGERPRINT_PACKETRESPONSEFAIL;
+    }
+    selectSensor(previous);
+    unlockDriver();
+    return result;
+}
+
+/**
+ * @brief  Search the character file of a capture on all sensors at the same time
+ * @param  captureSensor                     - Sensor on which the finger was captured and converted
+ * @param  bufferId                          - CharBuffer holding the character file on the capture sensor; the same
+ *                                             buffer is overwritten on the other sensors
+ * @return Sensor, page and confidence of the best match. statusCode is 0x00 if any sensor found the finger and
+ *         0x09 only if every sensor searched and none found it. Otherwise it is the error of the first sensor that
+ *         did not answer, 0x0e if a sensor could not receive the character file, or FINGERPRINT_BUSY: a finger
+ *         enrolled on that sensor may exist.
+ * @note   Every sensor searches the window set with setSearchWindow() on it, like fingerSearch().
+ */
+ShardMatch shardedSearch(uint8_t captureSensor, uint8_t bufferId)
+{
+    ShardMatch best = { captureSensor, { 0, 0, FINGERPRINT_NOTFOUND } };
+    uint8_t previous = getSelectedSensor();
+    uint8_t searchMask = 1 << captureSensor;
+    uint8_t failure = FINGERPRINT_OK;   // First sensor that neither found the finger nor reported it missing
+    uint16_t startPage;
+    uint16_t pageCount;
+    uint8_t result;
+
+    if (!lockDriver())
+    {
+        best.match.statusCode = FINGERPRINT_BUSY;
+        return best;
+    }
+    result = uploadTemplate(captureSensor, bufferId);
+    if (result != FINGERPRINT_OK)
+    {
+        best.match.statusCode = result;
+        selectSensor(previous);
+        unlockDriver();
+        return best;
+    }
+
+    // The capture sensor searches while the others receive the character file
+    getSearchWindow(&startPage, &pageCount);
+    sendSearch(bufferId, startPage, pageCount);
+    searchMask |= downloadTemplate(ALL_SENSORS_MASK & ~searchMask, bufferId);
+    if (searchMask != ALL_SENSORS_MASK)
+    {
+        failure = FINGERPRINT_PACKETRESPONSEFAIL; // Those libraries are not searched
+    }
+    for (uint8_t sensor = 0; sensor < SENSOR_COUNT; sensor++)
+    {
+        if (sensor != captureSensor && (searchMask & (1 << sensor)))
+        {
+            selectSensor(sensor);
+            getSearchWindow(&startPage, &pageCount);
+            sendSearch(bufferId, startPage, pageCount);
+        }
+    }
+
+    for (uint8_t sensor = 0; sensor < SENSOR_COUNT; sensor++)
+    {
+        FingerPageAndConfidence match;
+
+        if (!(searchMask & (1 << sensor)))
+        {
+            continue;
+        }
+        selectSensor(sensor);
+        match = receiveSearchResult();
+        if (match.statusCode == FINGERPRINT_TIMEOUT || match.statusCode == FINGERPRINT_BADPACKET)
+        {
+            match = fingerSearch(bufferId); // Repeat on its own, with the retry policy
+        }
+        if (match.statusCode == FINGERPRINT_OK &&
+            (best.match.statusCode != FINGERPRINT_OK || match.confidence > best.match.confidence))
+        {
+            best.sensor = sensor;
+            best.match = match;
+        }
+        else if (match.statusCode != FINGERPRINT_OK && match.statusCode != FINGERPRINT_NOTFOUND &&
+                 failure == FINGERPRINT_OK)
+        {
+            failure = match.statusCode;
+        }
+    }
+    if (best.match.statusCode != FINGERPRINT_OK && failure != FINGERPRINT_OK)
+    {
+        best.match.statusCode = failure;
+    }
+
+    selectSensor(previous);
+    unlockDriver();
+    return best;
+}
+
+/**
+ * @brief  Choose the sensor for a new template: the one with the most free pages, so the shards stay balanced
+ */
+uint8_t selectEnrolmentShard(void)
+{
+    uint8_t previous = getSelectedSensor();
+    uint8_t shard = 0;
+    int32_t mostFree = -1;
+
+    if (!lockDriver())
+    {
+        return previous;
+    }
+    for (uint8_t sensor = 0; sensor < SENSOR_COUNT; sensor++)
+    {
+        int32_t free;
+
+        selectSensor(sensor);
+        free = (int32_t)getParameters().capacity - getTemplateCount();
+        if (free > mostFree)
+        {
+            mostFree = free;
+            shard = sensor;
+        }
+    }
+    selectSensor(previous);
+    unlockDriver();
+    return shard;
+}
+
+/**
+ * @brief  Store a template created on the capture sensor in the library of another sensor
+ * @param  captureSensor                     - Sensor holding the template, e.g. after createModel()
+ * @param  bufferId                          - Its CharBuffer
+ * @param  shard                             - Sensor to store the template on, see selectEnrolmentShard()
+ * @param  pageID                            - Page in the library of that sensor
+ * @return Confirmation word of the copy or of storeModel()
+ */
+uint8_t storeModelOnShard(uint8_t captureSensor, uint8_t bufferId, uint8_t shard, uint16_t pageID)
+{
+    uint8_t previous = getSelectedSensor();
+    uint8_t result = FINGERPRINT_OK;
+
+    if (!lockDriver())
+    {
+        return FINGERPRINT_BUSY;
+    }
+    if (shard != captureSensor)
+    {
+        result = copyTemplate(captureSensor, bufferId, 1 << shard, bufferId);
+    }
+    if (result == FINGERPRINT_OK)
+    {
+        selectSensor(shard);
+        result = storeModel(bufferId, pageID);
+    }
+    selectSensor(previous);
+    unlockDriver();
+    return result;
+}
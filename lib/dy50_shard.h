@@ -0,0 +1,27 @@
+#ifndef DY50_SHARD_H
+#define DY50_SHARD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "dy50.h"
+
+/*
+ * Identification across SENSOR_COUNT modules whose libraries hold disjoint parts of the gallery. The character file
+ * of a capture is uploaded once, downloaded to all other modules in parallel, and every module searches its own
+ * library at the same time. Search latency is that of the largest shard instead of the whole gallery, and the
+ * capacity is the sum of the modules' capacities. A template is identified by its sensor and page.
+ */
+
+/* ***** Defines ***** */
+
+#define SHARD_TEMPLATE_SIZE                     512  // Size of a character file or template
+#define ALL_SENSORS_MASK                        ((uint8_t) ((1 << SENSOR_COUNT) - 1))
+
+/* ***** Functions ***** */
+
+uint8_t copyTemplate(uint8_t fromSensor, uint8_t fromBuffer, uint8_t toSensorMask, uint8_t toBuffer);
+ShardMatch shardedSearch(uint8_t captureSensor, uint8_t bufferId);
+uint8_t selectEnrolmentShard(void);
+uint8_t storeModelOnShard(uint8_t captureSensor, uint8_t bufferId, uint8_t shard, uint16_t pageID);
+
+#endif /* DY50_SHARD_H */
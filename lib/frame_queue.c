@@ -0,0 +1,105 @@
+#include "frame_queue.h"
+#include <string.h>
+
+_Static_assert((FRAME_QUEUE_BYTES & (FRAME_QUEUE_BYTES - 1)) == 0, "FRAME_QUEUE_BYTES must be a power of two");
+_Static_assert((FRAME_QUEUE_DEPTH & (FRAME_QUEUE_DEPTH - 1)) == 0, "FRAME_QUEUE_DEPTH must be a power of two");
+_Static_assert(FRAME_QUEUE_BYTES >= PACKET_MAX_SIZE, "The arena must hold the largest frame");
+
+/**
+ * @brief  Empty the queue and clear its statistics. Only while neither side uses it, e.g. before the receive interrupt
+ *         is enabled.
+ */
+void frameQueueReset(FrameQueue *queue)
+{
+    queue->head = 0;
+    queue->tail = 0;
+    queue->byteHead = 0;
+    queue->byteTail = 0;
+    memset(&queue->stats, 0, sizeof(queue->stats));
+}
+
+/**
+ * @brief  Queue a complete frame; producer side, e.g. the UART interrupt handler
+ * @param  frame                             - Frame as received, wireFrameSize() bytes are copied
+ * @param  isValid                           - Whether its checksum matched
+ * @return false if the frame was dropped because the queue is full
+ */
+bool frameQueuePush(FrameQueue *queue, const WireFrame *frame, bool isValid)
+{
+    uint16_t size = wireFrameSize(frame);
+    uint16_t offset = queue->byteHead & (FRAME_QUEUE_BYTES - 1);
+    uint16_t skipped = (offset + size > FRAME_QUEUE_BYTES) ? FRAME_QUEUE_BYTES - offset : 0;
+    uint16_t depth = (uint16_t)(queue->head - queue->tail);
+    FrameSlot *slot = &queue->slots[queue->head & (FRAME_QUEUE_DEPTH - 1)];
+
+    if (size > PACKET_MAX_SIZE || depth == FRAME_QUEUE_DEPTH ||
+        (uint16_t)(queue->byteHead - queue->byteTail) + skipped + size > FRAME_QUEUE_BYTES)
+    {
+        queue->stats.dropped++;
+        return false;
+    }
+    if (skipped != 0)
+    {
+        offset = 0;
+    }
+    memcpy(&queue->bytes[offset], frame, size);
+    slot->offset = offset;
+    slot->used = (uint16_t)(skipped + size);
+    slot->isValid = isValid;
+    queue->byteHead += slot->used;
+    FRAME_QUEUE_BARRIER(); // The slot and its bytes are complete before the consumer can see them
+    queue->head++;
+    queue->stats.frames++;
+    if (depth + 1 > queue->stats.maxDepth)
+    {
+        queue->stats.maxDepth = (uint16_t)(depth + 1);
+    }
+    return true;
+}
+
+/**
+ * @brief  Oldest queued frame; consumer side. The frame stays valid until frameQueueRelease() or frameQueueDiscard().
+ * @param  isValid                           - Receives whether its checksum matched
+ * @return NULL if the queue is empty
+ */
+const WireFrame *frameQueuePeek(const FrameQueue *queue, bool *isValid)
+{
+    const FrameSlot *slot;
+
+    if (queue->tail == queue->head)
+    {
+        return NULL;
+    }
+    FRAME_QUEUE_BARRIER(); // Read the slot only after the head that published it
+    slot = &queue->slots[queue->tail & (FRAME_QUEUE_DEPTH - 1)];
+    *isValid = slot->isValid;
+    return (const WireFrame *)&queue->bytes[slot->offset];
+}
+
+/**
+ * @brief  Return the space of the frame returned by frameQueuePeek() to the producer; consumer side
+ */
+void frameQueueRelease(FrameQueue *queue)
+{
+    uint16_t used;
+
+    if (queue->tail == queue->head)
+    {
+        return;
+    }
+    used = queue->slots[queue->tail & (FRAME_QUEUE_DEPTH - 1)].used;
+    FRAME_QUEUE_BARRIER(); // The frame is read completely before its space is handed back
+    queue->byteTail += used;
+    queue->tail++;
+}
+
+/**
+ * @brief  Drop all queued frames; consumer side, frames the producer queues meanwhile may be kept
+ */
+void frameQueueDiscard(FrameQueue *queue)
+{
+    while (queue->tail != queue->head)
+    {
+        frameQueueRelease(queue);
+    }
+}
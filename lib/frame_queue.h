@@ -0,0 +1,73 @@
+#ifndef FRAME_QUEUE_H
+#define FRAME_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "wire_frame.h"
+
+/*
+ * Single-producer single-consumer queue of received frames between a UART interrupt handler and the command layer.
+ * Nothing is locked: the producer only writes head, byteHead and the slots and bytes it has not published yet, the
+ * consumer only writes tail and byteTail. Indices run freely and wrap at 2^16, which is why both sizes are powers of
+ * two.
+ *
+ * The frames are copied into an arena of FRAME_QUEUE_BYTES without wrapping around its end; a frame that does not fit
+ * in front of the end starts at offset 0 and its slot also accounts for the skipped bytes. The consumer therefore reads
+ * a frame in place with frameQueuePeek() and returns its space with frameQueueRelease(). When the arena or the slots
+ * are full, the producer drops the new frame and counts it; frames already queued are never overwritten.
+ *
+ * The arena holds three data packets of 128 bytes, the module's default, or eleven of 32 bytes. At 57600 baud a
+ * 128 byte packet takes 24 ms on the wire, so a transfer only loses a packet if the consumer is late by 50 ms.
+ */
+
+/* ***** Defines ***** */
+
+#define FRAME_QUEUE_BYTES                       512  // Arena size, a power of two of at least PACKET_MAX_SIZE
+#define FRAME_QUEUE_DEPTH                       16   // Slots, a power of two
+
+// Orders the slot and arena accesses before the index that publishes or releases them. On the single core of the
+// TM4C123 this is mainly a compiler barrier; DMB also keeps the order for other bus masters.
+#if defined(DY50_HOST)
+#define FRAME_QUEUE_BARRIER()                   __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#elif defined(__TI_ARM__)
+#define FRAME_QUEUE_BARRIER()                   __asm(" dmb")
+#else
+#define FRAME_QUEUE_BARRIER()                   __asm volatile ("dmb" ::: "memory")
+#endif
+
+/* ***** Structures ***** */
+
+typedef struct
+{
+    uint16_t offset;            // First byte of the frame in the arena
+    uint16_t used;              // Arena bytes taken, the frame and the bytes skipped in front of it
+    bool isValid;               // The checksum matched
+} FrameSlot;
+
+typedef struct
+{
+    uint32_t frames;            // Frames queued
+    uint32_t dropped;           // Frames lost because the queue was full
+    uint16_t maxDepth;          // Most frames waiting at the same time
+} FrameQueueStats;
+
+typedef struct
+{
+    uint8_t bytes[FRAME_QUEUE_BYTES];
+    FrameSlot slots[FRAME_QUEUE_DEPTH];
+    volatile uint16_t head;     // Slots published, written by the producer
+    volatile uint16_t tail;     // Slots released, written by the consumer
+    uint16_t byteHead;          // Arena bytes taken by published slots, producer only
+    volatile uint16_t byteTail; // Arena bytes released, written by the consumer
+    FrameQueueStats stats;      // Written by the producer
+} FrameQueue;
+
+/* ***** Functions ***** */
+
+void frameQueueReset(FrameQueue *queue);
+bool frameQueuePush(FrameQueue *queue, const WireFrame *frame, bool isValid);
+const WireFrame *frameQueuePeek(const FrameQueue *queue, bool *isValid);
+void frameQueueRelease(FrameQueue *queue);
+void frameQueueDiscard(FrameQueue *queue);
+
+#endif /* FRAME_QUEUE_H */
@@ -0,0 +1,79 @@
+#include "packet_parser.h"
+#include "checksum.h"
+
+/**
+ * @brief  Discard the packet being received and wait for the next start code
+ * @param  parser                            - Parser state
+ */
+void resetPacketParser(PacketParser *parser)
+{
+    parser->count = 0;
+    parser->expectedLength = 0;
+    parser->runningSum = 0;
+}
+
+/**
+ * @brief  Feed one received byte to the parser
+ * @param  parser                            - Parser state
+ * @param  byte                              - Received byte
+ * @return PARSER_PACKET_OK or PARSER_PACKET_BADSUM when the byte completes a packet, which can then be read with
+ *         getParsedPacket() until the next byte is fed. PARSER_OUTSIDE_PACKET for bytes between packets.
+ */
+ParserResult parsePacketByte(PacketParser *parser, uint8_t byte)
+{
+    uint16_t checksum;
+
+    if (parser->count == 0)
+    {
+        if (byte != FINGERPRINT_STARTCODE_HIGH)
+        {
+            return PARSER_OUTSIDE_PACKET;
+        }
+        parser->expectedLength = 0;
+        parser->runningSum = 0;
+    }
+    if (parser->count == 1 && byte != FINGERPRINT_STARTCODE_LOW)
+    {
+        resetPacketParser(parser);
+        return parsePacketByte(parser, byte);
+    }
+
+    wireFrameBytes(&parser->frame)[parser->count++] = byte;
+    if (parser->count <= 6)
+    {
+        return PARSER_IN_PROGRESS; // Start code and address are not part of the checksum
+    }
+    if (parser->count == PACKET_HEADER_SIZE)
+    {
+        uint16_t length = wireFrameLength(&parser->frame);
+        if (length < 2 || length > PACKET_MAX_DATA + 2)
+        {
+            resetPacketParser(parser);
+            return PARSER_PACKET_DROPPED;
+        }
+        parser->expectedLength = PACKET_HEADER_SIZE + length;
+    }
+    if (parser->expectedLength == 0 || parser->count <= parser->expectedLength - 2)
+    {
+        parser->runningSum = updateChecksum(parser->runningSum, byte);
+        return PARSER_IN_PROGRESS;
+    }
+    if (parser->count < parser->expectedLength)
+    {
+        return PARSER_IN_PROGRESS;
+    }
+
+    checksum = wireFrameChecksum(&parser->frame);
+    parser->count = 0; // The completed packet stays in the frame until the next start code arrives
+    return (checksum == parser->runningSum) ? PARSER_PACKET_OK : PARSER_PACKET_BADSUM;
+}
+
+/**
+ * @brief  Decode the packet completed by the last call to parsePacketByte()
+ * @param  parser                            - Parser state
+ * @param  packet                            - Populated with the packet fields
+ */
+void getParsedPacket(const PacketParser *parser, Packet *packet)
+{
+    wireFrameToPacket(&parser->frame, packet);
+}
@@ -0,0 +1,39 @@
+#ifndef PACKET_PARSER_H
+#define PACKET_PARSER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "types.h"
+#include "wire_frame.h"
+
+/* ***** Defines ***** */
+
+#define SENSOR_HANDSHAKE_BYTE                   0x55 // Sent once by the module when it is ready after power-up
+
+/* ***** Structures ***** */
+
+typedef enum
+{
+    PARSER_OUTSIDE_PACKET,      // Byte is not part of a packet
+    PARSER_IN_PROGRESS,         // Byte was stored, packet is not complete yet
+    PARSER_PACKET_OK,           // Packet is complete and its checksum matches
+    PARSER_PACKET_BADSUM,       // Packet is complete but its checksum does not match
+    PARSER_PACKET_DROPPED       // Header was invalid, the packet was discarded
+} ParserResult;
+
+// Byte-at-a-time receiver of sensor packets. The checksum is accumulated while the bytes arrive.
+typedef struct
+{
+    WireFrame frame;            // Packet being received, complete after PARSER_PACKET_OK or PARSER_PACKET_BADSUM
+    uint16_t count;             // Bytes of the current packet received so far
+    uint16_t expectedLength;    // Total size of the current packet, known once the header is complete
+    uint16_t runningSum;        // Sum of type, length and data bytes received so far
+} PacketParser;
+
+/* ***** Functions ***** */
+
+void resetPacketParser(PacketParser *parser);
+ParserResult parsePacketByte(PacketParser *parser, uint8_t byte);
+void getParsedPacket(const PacketParser *parser, Packet *packet);
+
+#endif /* PACKET_PARSER_H */
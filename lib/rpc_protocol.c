@@ -0,0 +1,128 @@
+#include "rpc_protocol.h"
+
+#define RPC_CRC_INIT                            0xFFFF
+
+// CRC-16/CCITT (polynomial 0x1021), one nibble per lookup
+static const uint16_t crcNibbleTable[16] =
+{
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+/**
+ * @brief  Continue a CRC-16/CCITT over a block of bytes
+ * @param  crc                               - CRC of the preceding bytes, 0xFFFF for the first block
+ * @param  data                              - Bytes to add
+ * @param  length                            - Number of bytes
+ * @return Updated CRC
+ */
+uint16_t rpcCrc16(uint16_t crc, const uint8_t *data, uint16_t length)
+{
+    while (length-- > 0)
+    {
+        crc = (crc << 4) ^ crcNibbleTable[(crc >> 12) ^ (*data >> 4)];
+        crc = (crc << 4) ^ crcNibbleTable[(crc >> 12) ^ (*data & 0x0F)];
+        data++;
+    }
+    return crc;
+}
+
+/**
+ * @brief  Discard the frame being received and wait for the next sync byte. A zero-initialized parser is already
+ *         in this state.
+ */
+void rpcResetParser(RpcParser *parser)
+{
+    parser->count = 0;
+    parser->crc = RPC_CRC_INIT;
+}
+
+/**
+ * @brief  Feed one received byte to the parser
+ * @param  parser                            - Parser state
+ * @param  byte                              - Received byte
+ * @return true when the byte completes a frame with a valid CRC; the frame is then in parser->frame. Frames with a
+ *         bad CRC or an oversized payload are dropped silently and the sender times out.
+ */
+bool rpcParseByte(RpcParser *parser, uint8_t byte)
+{
+    RpcFrame *frame = &parser->frame;
+    uint16_t payloadEnd;
+
+    if (parser->count == 0)
+    {
+        if (byte != RPC_SYNC)
+        {
+            return false;
+        }
+        parser->crc = RPC_CRC_INIT;
+    }
+    if (parser->count < RPC_HEADER_SIZE)
+    {
+        parser->header[parser->count++] = byte;
+        if (parser->count > 1)
+        {
+            parser->crc = rpcCrc16(parser->crc, &byte, 1);
+        }
+        if (parser->count == RPC_HEADER_SIZE)
+        {
+            frame->flags = parser->header[1];
+            frame->requestId = rpcGetU16(&parser->header[2]);
+            frame->opcode = parser->header[4];
+            frame->length = rpcGetU16(&parser->header[5]);
+            if (frame->length > RPC_MAX_PAYLOAD)
+            {
+                rpcResetParser(parser);
+            }
+        }
+        return false;
+    }
+
+    payloadEnd = RPC_HEADER_SIZE + frame->length;
+    if (parser->count < payloadEnd)
+    {
+        frame->payload[parser->count - RPC_HEADER_SIZE] = byte;
+        parser->crc = rpcCrc16(parser->crc, &byte, 1);
+        parser->count++;
+        return false;
+    }
+
+    // Two CRC bytes, low byte first
+    if (parser->count == payloadEnd)
+    {
+        parser->crcLow = byte;
+        parser->count++;
+        return false;
+    }
+    {
+        uint16_t received = (uint16_t)parser->crcLow | (uint16_t)byte << 8;
+        bool isValid = (received == parser->crc);
+        rpcResetParser(parser);
+        return isValid;
+    }
+}
+
+/**
+ * @brief  Serialize a frame including sync byte and CRC
+ * @param  frame                             - Frame to encode
+ * @param  buffer                            - Output, at least RPC_MAX_FRAME bytes
+ * @return Number of bytes written
+ */
+uint16_t rpcEncodeFrame(const RpcFrame *frame, uint8_t *buffer)
+{
+    uint16_t size = RPC_HEADER_SIZE + frame->length;
+    uint16_t crc;
+
+    buffer[0] = RPC_SYNC;
+    buffer[1] = frame->flags;
+    rpcPutU16(&buffer[2], frame->requestId);
+    buffer[4] = frame->opcode;
+    rpcPutU16(&buffer[5], frame->length);
+    for (uint16_t i = 0; i < frame->length; i++)
+    {
+        buffer[RPC_HEADER_SIZE + i] = frame->payload[i];
+    }
+    crc = rpcCrc16(RPC_CRC_INIT, &buffer[1], size - 1);
+    rpcPutU16(&buffer[size], crc);
+    return size + 2;
+}
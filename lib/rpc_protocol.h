@@ -0,0 +1,123 @@
+#ifndef RPC_PROTOCOL_H
+#define RPC_PROTOCOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Binary request/response protocol between a host controller and the board on the console UART.
+ *
+ * Frame, multi-byte fields little endian:
+ *   sync (1) | flags (1) | request ID (2) | opcode (1) | payload length (2) | payload | CRC-16/CCITT (2)
+ * The CRC covers everything from flags to the end of the payload.
+ *
+ * The host may send several requests without waiting; they are executed in order and every response frame carries
+ * the ID of its request. Streamed data (templates, images) is returned as several response frames with
+ * RPC_FLAG_MORE set on all but the last; streamed uploads to the sensor are sent the same way by the host.
+ *
+ * The sync byte is outside the ASCII range and differs from DLOG_SYNC, so RPC frames, deferred log records and
+ * console text can share the UART.
+ */
+
+/* ***** Defines ***** */
+
+#define RPC_SYNC                                0xD5
+#define RPC_HEADER_SIZE                         7    // Sync to payload length
+#define RPC_MAX_PAYLOAD                         264
+#define RPC_MAX_FRAME                           (RPC_HEADER_SIZE + RPC_MAX_PAYLOAD + 2)
+
+#define RPC_FLAG_RESPONSE                       0x01 // Sent by the board
+#define RPC_FLAG_MORE                           0x02 // More frames of the same request follow
+#define RPC_FLAG_ERROR                          0x04 // Request was rejected, payload[0] holds an RPC_ERROR_ code
+
+#define RPC_ERROR_UNKNOWN_OPCODE                0x01
+#define RPC_ERROR_BAD_LENGTH                    0x02
+#define RPC_ERROR_BUSY                          0x03 // Request queue is full, resend later
+#define RPC_ERROR_STREAM                        0x04 // Stream frame without a matching download in progress
+#define RPC_ERROR_NO_SENSOR                     0x05 // Sensor index out of range
+#define RPC_ERROR_DOWNLOAD                      0x06 // Sensor request while a template download is in progress
+
+// Opcodes. Request payload -> response payload; "status" is the sensor confirmation word.
+#define RPC_OP_PING                             0x00 // any -> same bytes
+#define RPC_OP_GET_IMAGE                        0x01 // - -> status
+#define RPC_OP_IMAGE2TZ                         0x02 // slot(1) -> status
+#define RPC_OP_CREATE_MODEL                     0x03 // - -> status
+#define RPC_OP_STORE_MODEL                      0x04 // buffer(1) page(2) -> status
+#define RPC_OP_LOAD_MODEL                       0x05 // buffer(1) page(2) -> status
+#define RPC_OP_DELETE_MODEL                     0x06 // page(2) count(1) -> status
+#define RPC_OP_EMPTY_DATABASE                   0x07 // - -> status
+#define RPC_OP_SEARCH                           0x08 // buffer(1) -> status(1) page(2) confidence(2)
+#define RPC_OP_TEMPLATE_COUNT                   0x09 // - -> count(2)
+#define RPC_OP_GET_PARAMETERS                   0x0A // - -> SensorParams fields in declaration order
+#define RPC_OP_LED                              0x0B // on(1) -> status
+#define RPC_OP_CHECK_PASSWORD                   0x0C // password(4) -> status
+#define RPC_OP_UPLOAD_TEMPLATE                  0x0D // buffer(1) -> data frames (MORE), then status(1)
+#define RPC_OP_UPLOAD_IMAGE                     0x0E // - -> data frames (MORE), then status(1)
+#define RPC_OP_DOWNLOAD_TEMPLATE                0x0F // buffer(1) -> status; then data frames (MORE) -> status(1);
+                                                     // every data frame but the last has the sensor's packet length
+#define RPC_OP_METRICS                          0x10 // - -> BootMetrics, RetryStats fields as uint32, then stack
+                                                     // size and high-water mark of utils/stack_monitor.h, then
+                                                     // dropped frames and deepest backlog of the receive queues
+#define RPC_OP_SELECT_SENSOR                    0x11 // index(1) -> status; routes the following requests
+#define RPC_OP_PORT_METRICS                     0x12 // - -> PortStats fields as uint32 (host/dy50d.c only)
+#define RPC_OP_SET_PARAMETER                    0x13 // parameter(1) value(1) -> status; SYSPARAM_ numbers of dy50.h
+#define RPC_OP_VERIFY                           0x14 // page(2) -> status(1) confidence(2); CharBuffer1 against one page,
+                                                     // 0x0B for a page beyond the capacity
+#define RPC_OP_READ_JOURNAL                     0x15 // first sequence(4) -> data frames of JournalRecords (MORE), then
+                                                     // status(1); records of utils/event_journal.h, board only
+#define RPC_OP_CAPTURE                          0x16 // command(1) -> status; CAPTURE_COMMAND_READ: data frames of
+                                                     // records (MORE), then status(1) dropped(4); sensor UART
+                                                     // traffic of utils/uart_capture.h, board only
+#define RPC_OP_COUNT                            0x17
+
+/* ***** Structures ***** */
+
+typedef struct
+{
+    uint8_t flags;
+    uint16_t requestId;
+    uint8_t opcode;
+    uint16_t length;
+    uint8_t payload[RPC_MAX_PAYLOAD];
+} RpcFrame;
+
+// Byte-at-a-time receiver of RPC frames
+typedef struct
+{
+    uint8_t header[RPC_HEADER_SIZE];
+    uint16_t count;             // Bytes of the current frame received so far
+    uint16_t crc;               // CRC accumulated over the received bytes
+    uint8_t crcLow;             // First received CRC byte
+    RpcFrame frame;             // Frame being received, valid once rpcParseByte() returns true
+} RpcParser;
+
+/* ***** Functions ***** */
+
+uint16_t rpcCrc16(uint16_t crc, const uint8_t *data, uint16_t length);
+void rpcResetParser(RpcParser *parser);
+bool rpcParseByte(RpcParser *parser, uint8_t byte);
+uint16_t rpcEncodeFrame(const RpcFrame *frame, uint8_t *buffer);
+
+static inline void rpcPutU16(uint8_t *buffer, uint16_t value)
+{
+    buffer[0] = (uint8_t) value;
+    buffer[1] = (uint8_t) (value >> 8);
+}
+
+static inline void rpcPutU32(uint8_t *buffer, uint32_t value)
+{
+    rpcPutU16(buffer, (uint16_t) value);
+    rpcPutU16(buffer + 2, (uint16_t) (value >> 16));
+}
+
+static inline uint16_t rpcGetU16(const uint8_t *buffer)
+{
+    return (uint16_t)buffer[0] | (uint16_t)buffer[1] << 8;
+}
+
+static inline uint32_t rpcGetU32(const uint8_t *buffer)
+{
+    return (uint32_t)rpcGetU16(buffer) | (uint32_t)rpcGetU16(buffer + 2) << 16;
+}
+
+#endif /* RPC_PROTOCOL_H */
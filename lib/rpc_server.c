@@ -0,0 +1,372 @@
+#include "rpc_server.h"
+#include "dy50.h"
+#include "host_link.h"
+#include "dlog.h"
+#include "event_journal.h"
+#include "uart_capture.h"
+#include "stack_monitor.h"
+
+static RpcParser requestParser;
+static RpcFrame responseFrame;
+static uint8_t txBuffer[RPC_MAX_FRAME];
+static bool isDownloadActive;           // A DOWNLOAD_TEMPLATE request is waiting for its data frames, the driver is
+                                        // locked until the last one
+static uint16_t downloadRequestId;
+static uint16_t downloadPacketLength;   // SensorParams.packet_len of the sensor receiving the download
+
+static void sendResponse(uint16_t requestId, uint8_t opcode, uint8_t flags, uint16_t length)
+{
+    uint16_t size;
+
+    responseFrame.flags = RPC_FLAG_RESPONSE | flags;
+    responseFrame.requestId = requestId;
+    responseFrame.opcode = opcode;
+    responseFrame.length = length;
+    size = rpcEncodeFrame(&responseFrame, txBuffer);
+    hostLinkWrite(txBuffer, size);
+}
+
+static void sendStatus(const RpcFrame *request, uint8_t status)
+{
+    responseFrame.payload[0] = status;
+    sendResponse(request->requestId, request->opcode, 0, 1);
+}
+
+static void sendError(const RpcFrame *request, uint8_t error)
+{
+    responseFrame.payload[0] = error;
+    sendResponse(request->requestId, request->opcode, RPC_FLAG_ERROR, 1);
+}
+
+// Forwards every uploaded data packet to the host as soon as it is received from the sensor
+static void streamDataPacket(const uint8_t* data, uint16_t length, bool isLast, void* context)
+{
+    const RpcFrame *request = (const RpcFrame *)context;
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        responseFrame.payload[i] = data[i];
+    }
+    sendResponse(request->requestId, request->opcode, RPC_FLAG_MORE, length);
+}
+
+static void handleMetrics(const RpcFrame *request)
+{
+    BootMetrics boot = getBootMetrics();
+    RetryStats retries = getRetryStats();
+    StackUsage stack = getStackUsage();
+    FrameQueueStats receive = getReceiveQueueStats();
+    uint8_t *payload = responseFrame.payload;
+
+    rpcPutU32(&payload[0], boot.sensorReadyMs);
+    rpcPutU32(&payload[4], boot.passwordVerifiedMs);
+    rpcPutU32(&payload[8], boot.firstIdentifyMs);
+    rpcPutU32(&payload[12], boot.handshakeReceived);
+    rpcPutU32(&payload[16], retries.commands);
+    rpcPutU32(&payload[20], retries.retries);
+    rpcPutU32(&payload[24], retries.recovered);
+    rpcPutU32(&payload[28], retries.failures);
+    rpcPutU32(&payload[32], retries.lastRecoveryMs);
+    rpcPutU32(&payload[36], retries.maxRecoveryMs);
+    rpcPutU32(&payload[40], hostLinkOverruns());
+    rpcPutU32(&payload[44], dlogDroppedRecords());
+    rpcPutU32(&payload[48], stack.size);
+    rpcPutU32(&payload[52], stack.maxUsed);
+    rpcPutU32(&payload[56], receive.dropped);
+    rpcPutU32(&payload[60], receive.maxDepth);
+    sendResponse(request->requestId, request->opcode, 0, 64);
+}
+
+// Streams the journal straight from flash, as many records per frame as fit
+static void handleReadJournal(const RpcFrame *request)
+{
+    uint32_t sequence = rpcGetU32(&request->payload[0]);
+    uint16_t count;
+
+    journalFlush();
+    while ((count = journalRead(sequence, responseFrame.payload, RPC_MAX_PAYLOAD / JOURNAL_RECORD_SIZE)) > 0)
+    {
+        sequence = rpcGetU32(&responseFrame.payload[(count - 1) * JOURNAL_RECORD_SIZE]) + 1;
+        sendResponse(request->requestId, request->opcode, RPC_FLAG_MORE, count * JOURNAL_RECORD_SIZE);
+    }
+    sendStatus(request, FINGERPRINT_OK);
+}
+
+// Starts, stops or drains the capture of the sensor UART traffic
+static void handleCapture(const RpcFrame *request)
+{
+    uint16_t length;
+
+    switch (request->payload[0])
+    {
+        case CAPTURE_COMMAND_START:
+            captureStart();
+            break;
+        case CAPTURE_COMMAND_STOP:
+            captureStop();
+            break;
+        case CAPTURE_COMMAND_READ:
+            while ((length = captureRead(responseFrame.payload, RPC_MAX_PAYLOAD)) > 0)
+            {
+                sendResponse(request->requestId, request->opcode, RPC_FLAG_MORE, length);
+            }
+            responseFrame.payload[0] = FINGERPRINT_OK;
+            rpcPutU32(&responseFrame.payload[1], getCaptureStats().dropped);
+            sendResponse(request->requestId, request->opcode, 0, 5);
+            return;
+        default:
+            sendError(request, RPC_ERROR_UNKNOWN_OPCODE);
+            return;
+    }
+    sendStatus(request, FINGERPRINT_OK);
+}
+
+static void endDownload(void)
+{
+    isDownloadActive = false;
+    unlockDriver();
+}
+
+// Starts a template download; the driver stays locked until the last data frame, so no other request or task can
+// send a command while the module waits for data packets
+static void handleDownloadStart(const RpcFrame *request)
+{
+    uint8_t statusCode = FINGERPRINT_BUSY;
+
+    if (isDownloadActive)
+    {
+        endDownload(); // A new download abandons the one the host did not finish
+    }
+    if (lockDriver())
+    {
+        downloadPacketLength = getParameters().packet_len;
+        statusCode = beginDownloadModel(request->payload[0]);
+        isDownloadActive = (statusCode == FINGERPRINT_OK);
+        downloadRequestId = request->requestId;
+        if (!isDownloadActive)
+        {
+            unlockDriver();
+        }
+    }
+    responseFrame.payload[0] = statusCode;
+    sendResponse(request->requestId, request->opcode, isDownloadActive ? RPC_FLAG_MORE : 0, 1);
+}
+
+// Data frames of a template download are forwarded to the sensor one packet each. Every frame but the last must
+// have the sensor's packet length; a frame of another length ends the download.
+static void handleDownloadData(const RpcFrame *request)
+{
+    bool isLast = (request->flags & RPC_FLAG_MORE) == 0;
+
+    if (!isDownloadActive || request->requestId != downloadRequestId)
+    {
+        sendError(request, RPC_ERROR_STREAM);
+        return;
+    }
+    if (request->length > PACKET_MAX_DATA || request->length > downloadPacketLength ||
+        (!isLast && request->length != downloadPacketLength))
+    {
+        endDownload();
+        sendError(request, RPC_ERROR_BAD_LENGTH);
+        return;
+    }
+    sendDataPacket((uint8_t*)request->payload, request->length, isLast);
+    if (isLast)
+    {
+        endDownload();
+        sendStatus(request, FINGERPRINT_OK);
+    }
+}
+
+// Requests that do not send anything to the sensor and may be served while a download is in progress
+static bool isSensorIdleRequest(uint8_t opcode)
+{
+    return opcode == RPC_OP_PING || opcode == RPC_OP_METRICS || opcode == RPC_OP_READ_JOURNAL ||
+           opcode == RPC_OP_CAPTURE;
+}
+
+static bool hasLength(const RpcFrame *request, uint16_t length)
+{
+    if (request->length != length)
+    {
+        sendError(request, RPC_ERROR_BAD_LENGTH);
+        return false;
+    }
+    return true;
+}
+
+static void handleRequest(const RpcFrame *request)
+{
+    const uint8_t *in = request->payload;
+    uint8_t *out = responseFrame.payload;
+
+    if (isDownloadActive && request->opcode != RPC_OP_DOWNLOAD_TEMPLATE && !isSensorIdleRequest(request->opcode))
+    {
+        sendError(request, RPC_ERROR_DOWNLOAD);
+        return;
+    }
+    switch (request->opcode)
+    {
+        case RPC_OP_PING:
+            for (uint16_t i = 0; i < request->length; i++)
+            {
+                out[i] = in[i];
+            }
+            sendResponse(request->requestId, request->opcode, 0, request->length);
+            break;
+        case RPC_OP_GET_IMAGE:
+            sendStatus(request, getImage());
+            break;
+        case RPC_OP_IMAGE2TZ:
+            if (hasLength(request, 1))
+            {
+                sendStatus(request, image2Tz(in[0]));
+            }
+            break;
+        case RPC_OP_CREATE_MODEL:
+            sendStatus(request, createModel());
+            break;
+        case RPC_OP_STORE_MODEL:
+            if (hasLength(request, 3))
+            {
+                sendStatus(request, storeModel(in[0], rpcGetU16(&in[1])));
+            }
+            break;
+        case RPC_OP_LOAD_MODEL:
+            if (hasLength(request, 3))
+            {
+                sendStatus(request, loadModel(in[0], rpcGetU16(&in[1])));
+            }
+            break;
+        case RPC_OP_DELETE_MODEL:
+            if (hasLength(request, 3))
+            {
+                sendStatus(request, deleteModel(rpcGetU16(&in[0]), in[2]));
+            }
+            break;
+        case RPC_OP_EMPTY_DATABASE:
+            sendStatus(request, emptyDatabase());
+            break;
+        case RPC_OP_SEARCH:
+            if (hasLength(request, 1))
+            {
+                FingerPageAndConfidence result = fingerSearch(in[0]);
+                out[0] = result.statusCode;
+                rpcPutU16(&out[1], result.fingerprintPage);
+                rpcPutU16(&out[3], result.confidence);
+                sendResponse(request->requestId, request->opcode, 0, 5);
+            }
+            break;
+        case RPC_OP_VERIFY:
+            if (hasLength(request, 2))
+            {
+                FingerPageAndConfidence result = fingerVerify(rpcGetU16(&in[0]));
+                out[0] = result.statusCode;
+                rpcPutU16(&out[1], result.confidence);
+                sendResponse(request->requestId, request->opcode, 0, 3);
+            }
+            break;
+        case RPC_OP_TEMPLATE_COUNT:
+            rpcPutU16(&out[0], getTemplateCount());
+            sendResponse(request->requestId, request->opcode, 0, 2);
+            break;
+        case RPC_OP_GET_PARAMETERS:
+        {
+            SensorParams params = getParameters();
+            rpcPutU16(&out[0], params.status_reg);
+            rpcPutU16(&out[2], params.system_id);
+            rpcPutU16(&out[4], params.capacity);
+            rpcPutU16(&out[6], params.security_level);
+            rpcPutU32(&out[8], params.device_addr);
+            rpcPutU16(&out[12], params.packet_len);
+            rpcPutU16(&out[14], params.baud_rate);
+            sendResponse(request->requestId, request->opcode, 0, 16);
+            break;
+        }
+        case RPC_OP_LED:
+            if (hasLength(request, 1))
+            {
+                sendStatus(request, LEDcontrol(in[0] != 0));
+            }
+            break;
+        case RPC_OP_SET_PARAMETER:
+            if (hasLength(request, 2))
+            {
+                sendStatus(request, setSystemParameter(in[0], in[1]));
+            }
+            break;
+        case RPC_OP_CHECK_PASSWORD:
+            if (hasLength(request, 4))
+            {
+                sendStatus(request, checkPassword(rpcGetU32(&in[0])));
+            }
+            break;
+        case RPC_OP_UPLOAD_TEMPLATE:
+            if (hasLength(request, 1))
+            {
+                sendStatus(request, uploadModel(in[0], streamDataPacket, (void*)request));
+            }
+            break;
+        case RPC_OP_UPLOAD_IMAGE:
+            sendStatus(request, uploadImage(streamDataPacket, (void*)request));
+            break;
+        case RPC_OP_DOWNLOAD_TEMPLATE:
+            if (isDownloadActive && request->requestId == downloadRequestId)
+            {
+                handleDownloadData(request);
+            }
+            else if (hasLength(request, 1))
+            {
+                handleDownloadStart(request);
+            }
+            break;
+        case RPC_OP_METRICS:
+            handleMetrics(request);
+            break;
+        case RPC_OP_READ_JOURNAL:
+            if (hasLength(request, 4))
+            {
+                handleReadJournal(request);
+            }
+            break;
+        case RPC_OP_CAPTURE:
+            if (hasLength(request, 1))
+            {
+                handleCapture(request);
+            }
+            break;
+        case RPC_OP_SELECT_SENSOR:
+            if (!hasLength(request, 1))
+            {
+                break;
+            }
+            if (in[0] >= SENSOR_COUNT)
+            {
+                sendError(request, RPC_ERROR_NO_SENSOR);
+                break;
+            }
+            selectSensor(in[0]);
+            sendStatus(request, FINGERPRINT_OK);
+            break;
+        default:
+            sendError(request, RPC_ERROR_UNKNOWN_OPCODE);
+            break;
+    }
+}
+
+/**
+ * @brief  Execute the requests received from the host since the last call, in the order they were sent. Call from the
+ *         main loop after init(), hostLinkInit() and sensorBegin().
+ */
+void rpcServerPoll(void)
+{
+    uint8_t byte;
+
+    while (hostLinkRead(&byte))
+    {
+        if (rpcParseByte(&requestParser, byte) && (requestParser.frame.flags & RPC_FLAG_RESPONSE) == 0)
+        {
+            handleRequest(&requestParser.frame);
+        }
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef RPC_SERVER_H
+#define RPC_SERVER_H
+
+#include "rpc_protocol.h"
+
+/* ***** Functions ***** */
+
+void rpcServerPoll(void);
+
+#endif /* RPC_SERVER_H */
@@ -0,0 +1,236 @@
+#include <stddef.h>
+#include "scheduler.h"
+#include "dy50.h"
+
+#define IDENTIFY_BUFFER                         1
+#define BACKGROUND_BUFFER                       2
+
+static Job *queueHead[PRIORITY_LEVELS];
+static Job *queueTail[PRIORITY_LEVELS];
+static SchedulerStats stats;
+
+/**
+ * @brief  Queue a job behind the other jobs of the same priority
+ * @param  job                               - Initialized job, its storage must stay valid until it is done
+ * @param  priority                          - Queue of the job
+ */
+void schedulerSubmit(Job *job, CommandPriority priority)
+{
+    job->priority = priority;
+    job->stepIndex = 0;
+    job->passedOver = 0;
+    job->submittedMs = getTickCount();
+    job->next = NULL;
+
+    if (queueTail[priority] == NULL)
+    {
+        queueHead[priority] = job;
+    }
+    else
+    {
+        queueTail[priority]->next = job;
+    }
+    queueTail[priority] = job;
+}
+
+/**
+ * @brief  Select the queue to run: the highest priority one, unless a lower priority job has been passed over
+ *         SCHEDULER_AGING_LIMIT times
+ */
+static int8_t selectQueue(bool *isAged)
+{
+    int8_t selected = -1;
+
+    *isAged = false;
+    for (int8_t priority = 0; priority < PRIORITY_LEVELS; priority++)
+    {
+        if (queueHead[priority] == NULL)
+        {
+            continue;
+        }
+        if (selected < 0)
+        {
+            selected = priority;
+        }
+        else if (queueHead[priority]->passedOver >= SCHEDULER_AGING_LIMIT)
+        {
+            *isAged = true;
+            return priority;
+        }
+    }
+    return selected;
+}
+
+/**
+ * @brief  Run one step of the selected job
+ * @return true if a step was run, false if all queues are empty
+ */
+bool schedulerPoll(void)
+{
+    bool isAged;
+    int8_t selected = selectQueue(&isAged);
+    Job *job;
+
+    if (selected < 0)
+    {
+        return false;
+    }
+    job = queueHead[selected];
+    if (job->stepIndex == 0)
+    {
+        uint32_t delay = getTickCount() - job->submittedMs;
+        if (delay > stats.maxStartDelayMs[selected])
+        {
+            stats.maxStartDelayMs[selected] = delay;
+        }
+    }
+    for (int8_t priority = 0; priority < PRIORITY_LEVELS; priority++)
+    {
+        if (priority != selected && queueHead[priority] != NULL && queueHead[priority]->passedOver < 0xFF)
+        {
+            queueHead[priority]->passedOver++;
+        }
+    }
+    job->passedOver = 0;
+    stats.steps[selected]++;
+    stats.agedSteps += isAged;
+
+    if (job->step(job))
+    {
+        queueHead[selected] = job->next;
+        if (queueHead[selected] == NULL)
+        {
+            queueTail[selected] = NULL;
+        }
+        if (job->onDone != NULL)
+        {
+            job->onDone(job);
+        }
+    }
+    else
+    {
+        job->stepIndex++;
+    }
+    return true;
+}
+
+bool schedulerIsIdle(void)
+{
+    for (uint8_t priority = 0; priority < PRIORITY_LEVELS; priority++)
+    {
+        if (queueHead[priority] != NULL)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+SchedulerStats getSchedulerStats(void)
+{
+    return stats;
+}
+
+static bool identifyStep(Job *job)
+{
+    IdentifyJob *identify = (IdentifyJob *)job->context;
+
+    switch (job->stepIndex)
+    {
+        case 0:
+            job->result = getImage();
+            break;
+        case 1:
+            job->result = image2Tz(IDENTIFY_BUFFER);
+            break;
+        default:
+            identify->match = fingerSearch(IDENTIFY_BUFFER);
+            job->result = identify->match.statusCode;
+            return true;
+    }
+    return job->result != FINGERPRINT_OK;
+}
+
+/**
+ * @brief  Prepare an identification job; submit it with schedulerSubmit(). The outcome is in job.result and match.
+ */
+void initIdentifyJob(IdentifyJob *identify, JobDone onDone)
+{
+    identify->job.step = identifyStep;
+    identify->job.onDone = onDone;
+    identify->job.context = identify;
+    identify->job.result = FINGERPRINT_OK;
+    identify->match.statusCode = FINGERPRINT_NOTFOUND;
+}
+
+static void forwardTemplatePacket(const uint8_t* data, uint16_t length, bool isLast, void* context)
+{
+    BackupJob *backup = (BackupJob *)context;
+    backup->onTemplate(backup->page, data, length, isLast, backup->handlerContext);
+}
+
+static bool backupStep(Job *job)
+{
+    BackupJob *backup = (BackupJob *)job->context;
+
+    if (backup->page >= backup->endPage)
+    {
+        job->result = FINGERPRINT_OK;
+        return true;
+    }
+    if (!backup->isLoaded)
+    {
+        job->result = loadModel(BACKGROUND_BUFFER, backup->page);
+        if (job->result == FINGERPRINT_OK)
+        {
+            backup->isLoaded = true;
+            return false;
+        }
+        if (job->result != FINGERPRINT_DBRANGEFAIL)
+        {
+            return true;
+        }
+        backup->page++;
+        return false;
+    }
+
+    // Without traffic unless another job used CharBuffer2 since, e.g. the merge of an enrolment
+    job->result = loadModel(BACKGROUND_BUFFER, backup->page);
+    if (job->result == FINGERPRINT_OK)
+    {
+        job->result = uploadModel(BACKGROUND_BUFFER, forwardTemplatePacket, backup);
+    }
+    if (job->result != FINGERPRINT_OK)
+    {
+        return true;
+    }
+    backup->isLoaded = false;
+    backup->templatesSaved++;
+    backup->page++;
+    return false;
+}
+
+/**
+ * @brief  Prepare a backup job; submit it with schedulerSubmit(), usually with PRIORITY_BACKGROUND. Every stored
+ *         template is loaded into CharBuffer2 and uploaded in its own step, so other jobs can run in between.
+ * @param  backup                            - Job storage
+ * @param  firstPage                         - First library page to back up
+ * @param  pageCount                         - Number of pages
+ * @param  onTemplate                        - Receives the data packets of every stored template
+ * @param  context                           - Passed to onTemplate
+ * @param  onDone                            - Called when the job is finished, job.result holds the outcome
+ */
+void initBackupJob(BackupJob *backup, uint16_t firstPage, uint16_t pageCount, TemplateHandler onTemplate,
+                   void *context, JobDone onDone)
+{
+    backup->job.step = backupStep;
+    backup->job.onDone = onDone;
+    backup->job.context = backup;
+    backup->job.result = FINGERPRINT_OK;
+    backup->page = firstPage;
+    backup->endPage = firstPage + pageCount;
+    backup->isLoaded = false;
+    backup->templatesSaved = 0;
+    backup->onTemplate = onTemplate;
+    backup->handlerContext = context;
+}
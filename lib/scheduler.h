@@ -0,0 +1,93 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "types.h"
+
+/*
+ * Priority scheduler for sensor work. A job is split into steps of one sensor transaction each (a command, or an
+ * upload command with its data packets). schedulerPoll() runs one step of the highest priority job, so an interactive
+ * job waits for at most the step that is already on the link. The module streams uploads and expects downloads
+ * without interruption, so a step cannot be preempted between its data packets.
+ *
+ * Jobs that run interleaved share the module's CharBuffers: interactive jobs use CharBuffer1, background jobs
+ * CharBuffer2. An enrolment (lib/dy50_enrol.h) also merges through CharBuffer2, which a BackupJob notices through
+ * the driver's shadow of the buffers.
+ */
+
+/* ***** Defines ***** */
+
+#define SCHEDULER_AGING_LIMIT                   8 // Steps of higher priority after which a waiting job runs anyway
+
+/* ***** Structures ***** */
+
+typedef enum
+{
+    PRIORITY_INTERACTIVE,       // A user is waiting, e.g. identification
+    PRIORITY_NORMAL,
+    PRIORITY_BACKGROUND,        // Bulk transfers such as a template backup
+    PRIORITY_LEVELS
+} CommandPriority;
+
+typedef struct Job Job;
+
+// Executes the next step of a job and returns true when the job is finished
+typedef bool (*JobStep)(Job *job);
+typedef void (*JobDone)(Job *job);
+
+// Queued unit of work. The storage is owned by the submitter and must stay valid until onDone is called.
+struct Job
+{
+    JobStep step;
+    JobDone onDone;             // May be NULL
+    void *context;
+    CommandPriority priority;
+    uint16_t stepIndex;         // Steps executed so far, available to the step function as state
+    uint8_t result;             // Confirmation code of the job, set by the step function
+    uint32_t submittedMs;
+    uint8_t passedOver;         // Steps of higher priority jobs run while this job was first in its queue
+    Job *next;
+};
+
+typedef struct
+{
+    uint32_t steps[PRIORITY_LEVELS];
+    uint32_t maxStartDelayMs[PRIORITY_LEVELS];  // Longest time from submission to the first step
+    uint32_t agedSteps;                         // Steps run because of SCHEDULER_AGING_LIMIT
+} SchedulerStats;
+
+// Identification of the finger on the sensor: GetImage, Img2Tz into CharBuffer1, Search
+typedef struct
+{
+    Job job;
+    FingerPageAndConfidence match;
+} IdentifyJob;
+
+// Receives a stored template during a backup, one data packet at a time
+typedef void (*TemplateHandler)(uint16_t page, const uint8_t *data, uint16_t length, bool isLast, void *context);
+
+// Upload of every stored template in a page range through CharBuffer2; empty pages are skipped
+typedef struct
+{
+    Job job;
+    uint16_t page;              // Next page to back up
+    uint16_t endPage;           // One past the last page
+    bool isLoaded;              // page is in CharBuffer2 and waits for its upload
+    uint16_t templatesSaved;
+    TemplateHandler onTemplate;
+    void *handlerContext;
+} BackupJob;
+
+/* ***** Functions ***** */
+
+void schedulerSubmit(Job *job, CommandPriority priority);
+bool schedulerPoll(void);
+bool schedulerIsIdle(void);
+SchedulerStats getSchedulerStats(void);
+
+void initIdentifyJob(IdentifyJob *identify, JobDone onDone);
+void initBackupJob(BackupJob *backup, uint16_t firstPage, uint16_t pageCount, TemplateHandler onTemplate,
+                   void *context, JobDone onDone);
+
+#endif /* SCHEDULER_H */
@@ -0,0 +1,132 @@
+#include "sensor_command.h"
+#include "dy50.h"
+#include <stddef.h>
+#include <string.h>
+
+static const ResponseField parameterFields[] =
+{
+    { FIELD_INTEGER, 2, offsetof(SensorParams, status_reg) },
+    { FIELD_INTEGER, 2, offsetof(SensorParams, system_id) },
+    { FIELD_INTEGER, 2, offsetof(SensorParams, capacity) },
+    { FIELD_INTEGER, 2, offsetof(SensorParams, security_level) },
+    { FIELD_INTEGER, 4, offsetof(SensorParams, device_addr) },
+    { FIELD_PACKET_SIZE, 2, offsetof(SensorParams, packet_len) },
+    { FIELD_BAUD_RATE, 2, offsetof(SensorParams, baud_rate) }
+};
+
+static const ResponseField searchFields[] =
+{
+    { FIELD_INTEGER, 2, offsetof(FingerPageAndConfidence, fingerprintPage) },
+    { FIELD_INTEGER, 2, offsetof(FingerPageAndConfidence, confidence) }
+};
+
+static const ResponseField matchFields[] = { { FIELD_INTEGER, 2, offsetof(FingerPageAndConfidence, confidence) } };
+static const ResponseField countFields[] = { { FIELD_INTEGER, 2, 0 } };          // Into a uint16_t
+static const ResponseField indexFields[] = { { FIELD_BYTES, INDEX_PAGE_SIZE, 0 } }; // Into the bitmap
+
+#define FIELDS(table)                           (uint8_t)(sizeof(table) / sizeof(table[0])), table
+#define NO_FIELDS                               0, NULL
+
+const CommandDescriptor sensorCommands[COMMAND_COUNT] =
+{
+    [COMMAND_SET_PASSWORD] =            { FINGERPRINT_SETPASSWORD, false, { 4 }, NO_FIELDS },
+    [COMMAND_SET_SYSTEM_PARAMETER] =    { FINGERPRINT_SETSYSPARAM, true, { 1, 1 }, NO_FIELDS },
+    [COMMAND_TEMPLATE_COUNT] =          { FINGERPRINT_TEMPLATECOUNT, true, { 0 }, FIELDS(countFields) },
+    [COMMAND_READ_INDEX] =              { FINGERPRINT_READINDEX, true, { 1 }, FIELDS(indexFields) },
+    [COMMAND_SEARCH] =                  { FINGERPRINT_SEARCH, true, { 1, 2, 2 }, FIELDS(searchFields) },
+    [COMMAND_MATCH] =                   { FINGERPRINT_MATCH, true, { 0 }, FIELDS(matchFields) },
+    [COMMAND_LED_ON] =                  { FINGERPRINT_LEDON, true, { 0 }, NO_FIELDS },
+    [COMMAND_LED_OFF] =                 { FINGERPRINT_LEDOFF, true, { 0 }, NO_FIELDS },
+    [COMMAND_AURA] =                    { FINGERPRINT_AURALEDCONFIG, true, { 1, 1, 1, 1 }, NO_FIELDS },
+    [COMMAND_EMPTY] =                   { FINGERPRINT_EMPTY, false, { 0 }, NO_FIELDS },
+    [COMMAND_DELETE] =                  { FINGERPRINT_DELETE, true, { 2, 2 }, NO_FIELDS },
+    [COMMAND_UPLOAD] =                  { FINGERPRINT_UPLOAD, true, { 1 }, NO_FIELDS },
+    [COMMAND_UPLOAD_IMAGE] =            { FINGERPRINT_UPLOADIMAGE, true, { 0 }, NO_FIELDS },
+    [COMMAND_DOWNLOAD] =                { FINGERPRINT_DOWNLOAD, true, { 1 }, NO_FIELDS },
+    [COMMAND_LOAD] =                    { FINGERPRINT_LOAD, true, { 1, 2 }, NO_FIELDS },
+    [COMMAND_STORE] =                   { FINGERPRINT_STORE, false, { 1, 2 }, NO_FIELDS },
+    [COMMAND_REGISTER_MODEL] =          { FINGERPRINT_REGMODEL, false, { 0 }, NO_FIELDS },
+    [COMMAND_IMAGE_TO_CHARACTER] =      { FINGERPRINT_IMAGE2TZ, true, { 1 }, NO_FIELDS },
+    [COMMAND_GET_IMAGE] =               { FINGERPRINT_GETIMAGE, true, { 0 }, NO_FIELDS },
+    [COMMAND_READ_SYSTEM_PARAMETERS] =  { FINGERPRINT_READSYSPARAM, true, { 0 }, FIELDS(parameterFields) },
+    [COMMAND_VERIFY_PASSWORD] =         { FINGERPRINT_VERIFYPASSWORD, true, { 4 }, NO_FIELDS }
+};
+
+/**
+ * @brief  Encode a command packet in place, the arguments big-endian with the sizes of the descriptor
+ * @param  frame                             - Receives the packet
+ * @param  command                           - Descriptor of the command
+ * @param  arguments                         - One value per parameter of the descriptor, may be NULL if it has none
+ * @return Number of bytes of the packet on the wire
+ */
+uint16_t encodeCommand(WireFrame* frame, const CommandDescriptor* command, const uint32_t* arguments)
+{
+    uint16_t length = 0;
+
+    frame->payload[length++] = command->opcode;
+    for (uint8_t i = 0; i < COMMAND_MAX_PARAMETERS && command->parameters[i] != 0; i++)
+    {
+        for (uint8_t shift = (uint8_t)(command->parameters[i] * 8); shift > 0; shift -= 8)
+        {
+            frame->payload[length++] = (uint8_t)(arguments[i] >> (shift - 8));
+        }
+    }
+    return sealWireFrame(frame, SENSOR_ADDRESS, FINGERPRINT_COMMANDPACKET, length);
+}
+
+/**
+ * @brief  Store the fields of an acknowledge packet into the members of the caller's structure. Fields the module did
+ *         not send, e.g. after an error, leave their members unchanged.
+ * @param  command                           - Descriptor of the command the packet answers
+ * @param  response                          - Acknowledge packet, still in the receive queue
+ * @param  result                            - Structure the field offsets refer to
+ */
+void decodeResponse(const CommandDescriptor* command, const WireFrame* response, void* result)
+{
+    uint16_t dataLength = wireFrameDataLength(response);
+    uint16_t position = 1; // After the confirmation word
+
+    for (uint8_t i = 0; i < command->fieldCount; i++)
+    {
+        const ResponseField* field = &command->fields[i];
+        const uint8_t* wire = &response->payload[position];
+        uint8_t* member = (uint8_t*)result + field->offset;
+        uint32_t value = 0;
+
+        position += field->size;
+        if (position > dataLength)
+        {
+            break;
+        }
+        if (field->decoder == FIELD_BYTES)
+        {
+            memcpy(member, wire, field->size);
+            continue;
+        }
+        for (uint8_t k = 0; k < field->size; k++)
+        {
+            value = value << 8 | wire[k];
+        }
+        if (field->decoder == FIELD_PACKET_SIZE && value <= 3)
+        {
+            value = 32u << value;
+        }
+        else if (field->decoder == FIELD_BAUD_RATE)
+        {
+            value *= 9600;
+        }
+
+        if (field->size == 4)
+        {
+            *(uint32_t*)member = value;
+        }
+        else if (field->size == 2)
+        {
+            *(uint16_t*)member = (uint16_t)value;
+        }
+        else
+        {
+            *member = (uint8_t)value;
+        }
+    }
+}
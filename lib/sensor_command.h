@@ -0,0 +1,82 @@
+#ifndef SENSOR_COMMAND_H
+#define SENSOR_COMMAND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "types.h"
+#include "wire_frame.h"
+
+/*
+ * Command table of the sensor: the request layout of every instruction and how its acknowledge is decoded. Shared by
+ * lib/dy50.c and host/dy50d.c, so both send the same bytes for the same command.
+ */
+
+/* ***** Defines ***** */
+
+#define COMMAND_MAX_PARAMETERS                  4    // Parameters following the instruction code
+
+/* ***** Structures ***** */
+
+// How a field of an acknowledge packet is stored into the caller's structure
+typedef enum
+{
+    FIELD_INTEGER,              // Big-endian integer into a member of the same size
+    FIELD_BYTES,                // Copied unchanged, e.g. a bitmap
+    FIELD_PACKET_SIZE,          // Size code 0 to 3 into a uint16_t of 32 to 256 bytes
+    FIELD_BAUD_RATE             // Multiple of 9600 into a uint16_t in baud
+} FieldDecoder;
+
+// Field of an acknowledge packet; the fields of a command follow the confirmation word without gaps
+typedef struct
+{
+    uint8_t decoder;            // FieldDecoder
+    uint8_t size;               // Bytes on the wire
+    uint8_t offset;             // Member of the result structure, offsetof()
+} ResponseField;
+
+// Everything that distinguishes one command from another: its request layout and how to decode its acknowledge
+typedef struct
+{
+    uint8_t opcode;             // Instruction code
+    bool isIdempotent;          // May be repeated after a link error, see executeCommand() of dy50.c
+    uint8_t parameters[COMMAND_MAX_PARAMETERS]; // Wire size of every argument, 1, 2 or 4; 0 after the last
+    uint8_t fieldCount;
+    const ResponseField* fields;
+} CommandDescriptor;
+
+typedef enum
+{
+    COMMAND_SET_PASSWORD,
+    COMMAND_SET_SYSTEM_PARAMETER,
+    COMMAND_TEMPLATE_COUNT,
+    COMMAND_READ_INDEX,
+    COMMAND_SEARCH,
+    COMMAND_MATCH,
+    COMMAND_LED_ON,
+    COMMAND_LED_OFF,
+    COMMAND_AURA,
+    COMMAND_EMPTY,
+    COMMAND_DELETE,
+    COMMAND_UPLOAD,
+    COMMAND_UPLOAD_IMAGE,
+    COMMAND_DOWNLOAD,
+    COMMAND_LOAD,
+    COMMAND_STORE,
+    COMMAND_REGISTER_MODEL,
+    COMMAND_IMAGE_TO_CHARACTER,
+    COMMAND_GET_IMAGE,
+    COMMAND_READ_SYSTEM_PARAMETERS,
+    COMMAND_VERIFY_PASSWORD,
+    COMMAND_COUNT
+} CommandId;
+
+/* ***** Variables ***** */
+
+extern const CommandDescriptor sensorCommands[COMMAND_COUNT];
+
+/* ***** Functions ***** */
+
+uint16_t encodeCommand(WireFrame* frame, const CommandDescriptor* command, const uint32_t* arguments);
+void decodeResponse(const CommandDescriptor* command, const WireFrame* response, void* result);
+
+#endif /* SENSOR_COMMAND_H */
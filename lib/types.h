@@ -2,6 +2,7 @@
 #define TYPES_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 /* ***** Structures ***** */
 
@@ -35,4 +36,51 @@ typedef struct
     uint8_t statusCode;
 } FingerPageAndConfidence;
 
+// Best match of a search across several sensors, see lib/dy50_shard.h
+typedef struct
+{
+    uint8_t sensor;             // Module whose library holds the match
+    FingerPageAndConfidence match;
+} ShardMatch;
+
+// Receives the payload of one data packet of a template or image upload
+typedef void (*DataPacketHandler)(const uint8_t* data, uint16_t length, bool isLast, void* context);
+
+// Startup timing collected by sensorBegin() and the first fingerSearch(), in milliseconds since init()
+typedef struct
+{
+    uint32_t sensorReadyMs;     // Handshake byte received or first successful probe
+    uint32_t passwordVerifiedMs;
+    uint32_t firstIdentifyMs;   // First fingerSearch() that found or missed, 0 if none yet
+    bool handshakeReceived;     // false if readiness was detected by probing
+} BootMetrics;
+
+// Link error handling of the command layer
+typedef struct
+{
+    uint8_t maxRetries;         // Repetitions of an idempotent command after a link error
+    uint32_t timeoutMs;         // Response timeout of a single attempt
+} RetryPolicy;
+
+// Link error statistics of the command layer
+typedef struct
+{
+    uint32_t commands;          // Commands executed
+    uint32_t retries;           // Repeated attempts
+    uint32_t recovered;         // Commands that succeeded after at least one repetition
+    uint32_t failures;          // Commands that failed because of the link after all attempts
+    uint32_t lastRecoveryMs;    // Time from the first failed attempt to the successful one
+    uint32_t maxRecoveryMs;
+} RetryStats;
+
+// Commands completed from the driver's shadow of the sensor state, without UART traffic
+typedef struct
+{
+    uint32_t led;               // LEDcontrol() with the state the LED already has
+    uint32_t aura;              // auraControl() with the configuration already active
+    uint32_t parameters;        // getParameters() after the parameters were read once
+    uint32_t templateCount;     // getTemplateCount() while no template was stored or deleted
+    uint32_t load;              // loadModel() of the page the CharBuffer already holds
+} ShadowStats;
+
 #endif /* TYPES_H */
@@ -0,0 +1,80 @@
+#include "wire_frame.h"
+#include "checksum.h"
+
+/**
+ * @brief  Complete a frame whose payload was written in place: header, length and checksum
+ * @param  frame                             - Frame with dataLength bytes of instruction and parameters, or data packet
+ *                                             payload, in frame->payload
+ * @param  address                           - Module address
+ * @param  type                              - Packet type
+ * @param  dataLength                        - Payload length, at most PACKET_MAX_DATA
+ * @return Size of the frame in bytes, 0 if dataLength is too large; the frame is not changed then
+ */
+uint16_t sealWireFrame(WireFrame *frame, uint32_t address, uint8_t type, uint16_t dataLength)
+{
+    uint16_t length = dataLength + PACKET_CHECKSUM_SIZE;
+    uint16_t checksum;
+
+    if (dataLength > PACKET_MAX_DATA)
+    {
+        return 0;
+    }
+
+    frame->startCode[0] = FINGERPRINT_STARTCODE_HIGH;
+    frame->startCode[1] = FINGERPRINT_STARTCODE_LOW;
+    frame->address[0] = (uint8_t)(address >> 24);
+    frame->address[1] = (uint8_t)(address >> 16);
+    frame->address[2] = (uint8_t)(address >> 8);
+    frame->address[3] = (uint8_t)address;
+    frame->type = type;
+    frame->length[0] = (uint8_t)(length >> 8);
+    frame->length[1] = (uint8_t)length;
+    checksum = (uint16_t)(type + (length >> 8) + (length & 0xFF) + sumBytes(frame->payload, dataLength));
+    frame->payload[dataLength] = (uint8_t)(checksum >> 8);
+    frame->payload[dataLength + 1] = (uint8_t)checksum;
+
+    return PACKET_HEADER_SIZE + length;
+}
+
+/**
+ * @brief  Build a complete frame in place, ready to be sent with a single transfer
+ * @param  frame                             - Frame to fill
+ * @param  address                           - Module address
+ * @param  type                              - Packet type
+ * @param  data                              - Instruction and parameters, or data packet payload
+ * @param  dataLength                        - Payload length, at most PACKET_MAX_DATA
+ * @return Size of the frame in bytes, 0 if dataLength is too large; the frame is not changed then
+ */
+uint16_t buildWireFrame(WireFrame *frame, uint32_t address, uint8_t type, const uint8_t *data, uint16_t dataLength)
+{
+    if (dataLength > PACKET_MAX_DATA)
+    {
+        return 0;
+    }
+    for (uint16_t i = 0; i < dataLength; i++)
+    {
+        frame->payload[i] = data[i];
+    }
+    return sealWireFrame(frame, address, type, dataLength);
+}
+
+/**
+ * @brief  Decode a frame into the host-endian Packet used by the command API
+ */
+void wireFrameToPacket(const WireFrame *frame, Packet *packet)
+{
+    uint16_t dataLength = wireFrameDataLength(frame);
+
+    packet->start_code = (uint16_t)(frame->startCode[0] << 8 | frame->startCode[1]);
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        packet->address[i] = frame->address[i];
+    }
+    packet->type = frame->type;
+    packet->length = wireFrameLength(frame);
+    for (uint16_t i = 0; i < dataLength; i++)
+    {
+        packet->data[i] = frame->payload[i];
+    }
+    packet->checksum = wireFrameChecksum(frame);
+}
@@ -0,0 +1,69 @@
+#ifndef WIRE_FRAME_H
+#define WIRE_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "types.h"
+
+/* ***** Defines ***** */
+
+#define FINGERPRINT_STARTCODE_HIGH              0xEF // First byte of every packet
+#define FINGERPRINT_STARTCODE_LOW               0x01 // Second byte of every packet
+#define PACKET_HEADER_SIZE                      9    // Start code, address, type and length
+#define PACKET_MAX_DATA                         256  // Largest payload, see Packet.data
+#define PACKET_CHECKSUM_SIZE                    2
+#define PACKET_MAX_SIZE                         (PACKET_HEADER_SIZE + PACKET_MAX_DATA + PACKET_CHECKSUM_SIZE)
+
+/* ***** Structures ***** */
+
+// A packet exactly as it is sent on the wire: big-endian, without padding. The checksum follows the data, so its
+// position depends on the length and it is read and written through the accessors below.
+typedef struct
+{
+    uint8_t startCode[2];
+    uint8_t address[4];
+    uint8_t type;
+    uint8_t length[2];                                      // Data and checksum size
+    uint8_t payload[PACKET_MAX_DATA + PACKET_CHECKSUM_SIZE];  // Data followed by the checksum
+} WireFrame;
+
+_Static_assert(sizeof(WireFrame) == PACKET_MAX_SIZE, "WireFrame must not contain padding");
+_Static_assert(offsetof(WireFrame, type) == 6, "WireFrame type must follow start code and address");
+_Static_assert(offsetof(WireFrame, payload) == PACKET_HEADER_SIZE, "WireFrame payload must follow the header");
+
+/* ***** Functions ***** */
+
+uint16_t sealWireFrame(WireFrame *frame, uint32_t address, uint8_t type, uint16_t dataLength);
+uint16_t buildWireFrame(WireFrame *frame, uint32_t address, uint8_t type, const uint8_t *data, uint16_t dataLength);
+void wireFrameToPacket(const WireFrame *frame, Packet *packet);
+
+static inline uint8_t *wireFrameBytes(WireFrame *frame)
+{
+    return (uint8_t *)frame;
+}
+
+static inline uint16_t wireFrameLength(const WireFrame *frame)
+{
+    return (uint16_t)(frame->length[0] << 8 | frame->length[1]);
+}
+
+static inline uint16_t wireFrameDataLength(const WireFrame *frame)
+{
+    return wireFrameLength(frame) - PACKET_CHECKSUM_SIZE;
+}
+
+/**
+ * @brief  Number of bytes of the frame on the wire
+ */
+static inline uint16_t wireFrameSize(const WireFrame *frame)
+{
+    return PACKET_HEADER_SIZE + wireFrameLength(frame);
+}
+
+static inline uint16_t wireFrameChecksum(const WireFrame *frame)
+{
+    const uint8_t *checksum = &frame->payload[wireFrameDataLength(frame)];
+    return (uint16_t)(checksum[0] << 8 | checksum[1]);
+}
+
+#endif /* WIRE_FRAME_H */
@@ -0,0 +1,168 @@
+#include "flows.h"
+#include "dy50.h"
+#include "dlog.h"
+#include "event_journal.h"
+#include "page_map.h"
+#include "dy50_enrol.h"
+
+static bool isEnrolDone;        // Set by the enrolment job of enrollFinger() when it finishes
+
+/**
+ * @brief  Poll the sensor until a finger is on it and its image is captured
+ */
+static void captureFinger(void)
+{
+    int p = -1;
+    while(p != FINGERPRINT_OK)
+    {
+        p = getImage(); // Capture the fingerprint image
+        dlog1(LOG_POLL_STATUS, p);
+    }
+    dlog(LOG_IMAGE_TAKEN);
+}
+
+/**
+ * @brief  Tell the user what the enrolment job needs next
+ */
+static void promptEnrol(const EnrolJob *enrol)
+{
+    switch (enrol->prompt)
+    {
+        case ENROL_PLACE_FINGER:
+            dlog(enrol->sample == 0 && enrol->retakes == 0 ? LOG_PLACE_FINGER : LOG_PLACE_SAME_FINGER);
+            break;
+        case ENROL_REMOVE_FINGER:
+            dlog(LOG_IMAGE_CONVERTED);
+            dlog(LOG_REMOVE_FINGER);
+            break;
+        default:
+            dlog2(LOG_SAMPLE_REJECTED, enrol->sample + 1, enrol->lastStatus);
+            break;
+    }
+}
+
+static void onEnrolDone(Job *job)
+{
+    (void)job;
+    isEnrolDone = true;
+}
+
+/**
+ * @brief  Enrol a finger with an EnrolJob of lib/dy50_enrol.h: ENROL_DEFAULT_SAMPLES captures of the same finger make
+ *         a template that is stored, unless the finger is enrolled under another user already
+ * @param  id                                - User ID; the template replaces the user's template or takes the page
+ *                                             pageMapAllocate() chooses
+ * @return Confirmation word of the failing step, ENROL_DUPLICATE for a finger enrolled already, FINGERPRINT_OK once
+ *         the template is stored
+ */
+uint8_t enrollFinger(uint16_t id)
+{
+    EnrolJob enrol;
+
+    isEnrolDone = false;
+    initEnrolJob(&enrol, id, ENROL_DEFAULT_SAMPLES, promptEnrol, onEnrolDone);
+    schedulerSubmit(&enrol.job, PRIORITY_INTERACTIVE);
+    while (!isEnrolDone) // Jobs submitted by others may keep the scheduler busy afterwards
+    {
+        schedulerPoll();
+    }
+    if (enrol.job.result == FINGERPRINT_OK)
+    {
+        dlog2(LOG_ENROLLED, enrol.samples, enrol.page);
+    }
+    else if (enrol.job.result == ENROL_DUPLICATE)
+    {
+        dlog2(LOG_ALREADY_ENROLLED, enrol.duplicate.fingerprintPage, enrol.duplicate.confidence);
+    }
+    else
+    {
+        dlog1(LOG_STATUS_EXITING, enrol.job.result);
+    }
+    return enrol.job.result;
+}
+
+/**
+ * @brief  Wait for a finger and search the library for it; the result is appended to the access event journal
+ * @return Result of the search with the user ID of the page in fingerprintPage; statusCode holds the failing
+ *         confirmation word if the image could not be converted
+ */
+FingerPageAndConfidence identifyFinger(void)
+{
+    FingerPageAndConfidence fingerprint;
+    int p = -1;
+
+    dlog(LOG_PLACE_FINGER);
+    captureFinger();
+    p = image2Tz(1);
+    if(p==FINGERPRINT_OK)
+    {
+        dlog(LOG_IMAGE_CONVERTED);
+    }
+    else
+    {
+        dlog(LOG_COULD_NOT_MATCH);
+        fingerprint.statusCode = p;
+        fingerprint.fingerprintPage = p;
+        fingerprint.confidence = p;
+        journalAppend(JOURNAL_EVENT_IDENTIFY, fingerprint.statusCode, 0, 0);
+        return fingerprint;
+    }
+    fingerprint = fingerSearch(1);
+    if(fingerprint.statusCode == FINGERPRINT_OK)
+    {
+        fingerprint.fingerprintPage = pageMapUser(fingerprint.fingerprintPage);
+        dlog2(LOG_FINGERPRINT_FOUND, fingerprint.fingerprintPage, fingerprint.confidence);
+    }
+    journalAppend(JOURNAL_EVENT_IDENTIFY, fingerprint.statusCode, fingerprint.fingerprintPage, fingerprint.confidence);
+    return fingerprint;
+}
+
+/**
+ * @brief  Wait for a finger and compare it with the template of one user only, e.g. after a card or PIN; the result is
+ *         appended to the access event journal
+ * @param  page                              - User ID of the claimed identity, translated to its library page
+ * @return Result of fingerVerify() with the user ID in fingerprintPage; statusCode holds the failing confirmation word
+ *         if the image could not be converted, FINGERPRINT_BADLOCATION without a capture if the user has no template
+ */
+FingerPageAndConfidence verifyFinger(uint16_t page)
+{
+    FingerPageAndConfidence fingerprint = { page, 0, FINGERPRINT_BADLOCATION };
+    uint16_t libraryPage = pageMapFind(page);
+    int p = -1;
+
+    if (libraryPage == PAGE_MAP_NO_PAGE)
+    {
+        // No template of the user; nothing may be compared, whatever CharBuffer2 still holds
+        dlog1(LOG_NOT_VERIFIED, page);
+        journalAppend(JOURNAL_EVENT_VERIFY, fingerprint.statusCode, page, 0);
+        return fingerprint;
+    }
+    dlog(LOG_PLACE_FINGER);
+    captureFinger();
+    p = image2Tz(1);
+    if(p==FINGERPRINT_OK)
+    {
+        dlog(LOG_IMAGE_CONVERTED);
+    }
+    else
+    {
+        dlog(LOG_COULD_NOT_MATCH);
+        fingerprint.statusCode = p;
+        fingerprint.fingerprintPage = page;
+        fingerprint.confidence = p;
+        journalAppend(JOURNAL_EVENT_VERIFY, fingerprint.statusCode, page, 0);
+        return fingerprint;
+    }
+    fingerprint = fingerVerify(libraryPage);
+    fingerprint.fingerprintPage = page;
+    if(fingerprint.statusCode == FINGERPRINT_OK)
+    {
+        dlog2(LOG_FINGERPRINT_VERIFIED, fingerprint.fingerprintPage, fingerprint.confidence);
+    }
+    else
+    {
+        dlog1(LOG_NOT_VERIFIED, page);
+    }
+    journalAppend(JOURNAL_EVENT_VERIFY, fingerprint.statusCode, page, fingerprint.confidence);
+    return fingerprint;
+}
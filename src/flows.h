@@ -0,0 +1,23 @@
+#ifndef FLOWS_H
+#define FLOWS_H
+
+#include <stdint.h>
+#include "types.h"
+
+/*
+ * Enrolment and identification as run by the applications in src/main.c. They only use lib/dy50.c, lib/dy50_enrol.c,
+ * lib/scheduler.c, utils/event_journal.c and utils/page_map.c, whose flash is emulated in a DY50_HOST build, so the
+ * host benchmark in host/identify_bench.c runs exactly the same sequences against a simulated sensor. Identify and
+ * verify results go to the journal once journalInit() has been called.
+ *
+ * The flows deal in user IDs, which utils/page_map.h translates to library pages once pageMapInit() has been called.
+ * Until the library is compacted with lib/dy50_compact.h, the page of a user is the page of the user's number.
+ */
+
+/* ***** Functions ***** */
+
+uint8_t enrollFinger(uint16_t id);
+FingerPageAndConfidence identifyFinger(void);
+FingerPageAndConfidence verifyFinger(uint16_t page);
+
+#endif /* FLOWS_H */
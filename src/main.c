@@ -1,83 +1,38 @@
 #include "dy50.h"
 #include "tm4c123gxl_utils.h"
 #include "config.h"
+#include "dlog.h"
+#include "host_link.h"
+#include "rpc_server.h"
+#include "flows.h"
+#include "event_journal.h"
+#include "page_map.h"
+#include "dy50_compact.h"
 #include <stdbool.h>
 
 //Enroll
 int main(void)
 {
     init();
-    LEDcontrol(true);
-    UARTprintf("Enter id of a fingerprint: ");
-    unsigned char id = UARTgetc();
-    UARTprintf("You entered %c\n", id);
-    int p = -1;
-    UARTprintf("Place your finger on the sensor.\n");
-    while(p != FINGERPRINT_OK)
-    {
-        p = getImage(); // Capture the fingerprint image
-        UARTprintf("p = %d\n", p);
-    }
-    UARTprintf("Image taken.\n");
-    UARTprintf("Storing the image in CharBuffer 1.\n");
-    p = image2Tz(1);          // Store it in the CharBuffer 1
-    if( p == FINGERPRINT_OK)
-    {
-        UARTprintf("Image converted.\n");
-        p = -1;
-    }
-    else
-    {
-        UARTprintf("p = %d\nExiting!", p);
-        return -1;
-    }
-    UARTprintf("Remove your finger from the sensor.\n");
-    while (p != FINGERPRINT_NOFINGER)
-    {
-      p = getImage();
-    }
-    UARTprintf("Place the same finger again\n");
-    while(p != FINGERPRINT_OK)
-    {
-        p = getImage(); // Capture the fingerprint image
-        UARTprintf("p = %d\n", p);
-    }
-    UARTprintf("Image taken.\n");
-    UARTprintf("Storing the image in CharBuffer 2.\n");
-    p = image2Tz(2);          // Store it in the CharBuffer 2
-    if( p == FINGERPRINT_OK)
-    {
-        UARTprintf("Image converted.\n");
-        p = -1;
-    }
-    else
-    {
-        UARTprintf("p = %d\n Exiting!", p);
-        return -1;
-    }
-    UARTprintf("Creating model for ID %d\n", id);
-    p = createModel();
-    if(p == FINGERPRINT_OK)
-    {
-        UARTprintf("The two finger prints matched, model created.\n");
-        p = -1;
-    }
-    else
+    pageMapInit();
+    if (sensorBegin(DEFAULT_PASSWORD) != FINGERPRINT_OK)
     {
-        UARTprintf("Prints did not match.\nExiting\n");
+        dlog(LOG_SENSOR_NOT_RESPONDING);
+        dlogFlush();
         return -1;
     }
-    UARTprintf("Storing model.\n");
-    p = storeModel(1, id);
-    if(p == FINGERPRINT_OK)
-    {
-        UARTprintf("Model stored!\n");
-    }
-    else
+    compactResume();
+    LEDcontrol(true);
+    dlog(LOG_ENTER_ID);
+    dlogFlush();
+    unsigned char id = UARTgetc();
+    dlog1(LOG_ENTERED_ID, id);
+    if (enrollFinger(id) != FINGERPRINT_OK)
     {
-        UARTprintf("p = %d\nExiting!\n", p);
+        dlogFlush();
         return -1;
     }
+    dlogFlush();
     return 0;
 }
 //
@@ -85,32 +40,18 @@ int main(void)
 //int main(void)
 //{
 //    init();
-//    UARTprintf("Place your finger on the sensor.\n");
-//    int p = -1;
-//    while(p!= FINGERPRINT_OK)
-//    {
-//        p = getImage();
-//        UARTprintf("p= %d\n", p);
-//    }
-//    p=-1;
-//    UARTprintf("Image taken.\n");
-//    p = image2Tz(1);
-//    if(p==FINGERPRINT_OK)
+//    journalInit();
+//    pageMapInit();
+//    if (sensorBegin(DEFAULT_PASSWORD) != FINGERPRINT_OK)
 //    {
-//        UARTprintf("Image converted.");
-//        p = -1;
-//    }
-//    else
-//    {
-//        UARTprintf("Could not match.\nExiting.\n");
+//        dlog(LOG_SENSOR_NOT_RESPONDING);
+//        dlogFlush();
 //        return -1;
 //    }
-//    FingerPageAndConfidence fingerprint = fingerSearch(1);
+//    compactResume();
+//    FingerPageAndConfidence fingerprint = identifyFinger();
 //    if(fingerprint.statusCode == FINGERPRINT_OK)
 //    {
-//        UARTprintf("Fingerprint found!\n");
-//        UARTprintf("Found by ID %d\n", fingerprint.fingerprintPage);
-//        UARTprintf("Confidence %d\n", fingerprint.confidence);
 //        if(fingerprint.fingerprintPage == 2)
 //        {
 //            UARTprintf("Monika<3\n");
@@ -120,5 +61,21 @@ int main(void)
 //            UARTprintf("Jovo\n");
 //        }
 //    }
+//    dlog1(LOG_BOOT_TO_IDENTIFY, getBootMetrics().firstIdentifyMs);
+//    dlogFlush();
+//    journalFlush();
+//}
 //
+////RPC bridge
+//int main(void)
+//{
+//    init();
+//    hostLinkInit();
+//    journalInit();
+//    sensorBegin(DEFAULT_PASSWORD);
+//    while(1)
+//    {
+//        rpcServerPoll();
+//        journalPoll();
+//    }
 //}
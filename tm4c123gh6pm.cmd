@@ -10,7 +10,9 @@
 
 MEMORY
 {
-    FLASH (RX) : origin = 0x00000000, length = 0x00040000
+    FLASH (RX) : origin = 0x00000000, length = 0x0003A000
+    /* 0x0003A000 - 0x0003BFFF: template page map, PAGE_MAP_FLASH_BASE in utils/config.h */
+    /* 0x0003C000 - 0x0003FFFF: access event journal, JOURNAL_FLASH_BASE in utils/config.h */
     SRAM (RWX) : origin = 0x20000000, length = 0x00008000
 }
 
@@ -41,6 +41,13 @@ static void IntDefaultHandler(void);
 //*****************************************************************************
 extern void _c_int00(void);
 
+//*****************************************************************************
+//
+// Stack painting for the high-water mark, see utils/stack_monitor.h.
+//
+//*****************************************************************************
+extern void stackPaint(void);
+
 //*****************************************************************************
 //
 // Linker variable that marks the top of the stack.
@@ -54,6 +61,23 @@ extern uint32_t __STACK_TOP;
 //
 //*****************************************************************************
 extern void UARTInterruptHandler();
+extern void SensorPort1IntHandler();
+extern void SensorPort2IntHandler();
+extern void SensorPort3IntHandler();
+#ifdef DY50_USE_FREERTOS
+extern void vPortSVCHandler(void);
+extern void xPortPendSVHandler(void);
+extern void xPortSysTickHandler(void);
+#define SVCHandler                              vPortSVCHandler
+#define PendSVHandler                           xPortPendSVHandler
+#define SysTickHandler                          xPortSysTickHandler
+#else
+extern void SysTickIntHandler();
+#define SVCHandler                              IntDefaultHandler
+#define PendSVHandler                           IntDefaultHandler
+#define SysTickHandler                          SysTickIntHandler
+#endif
+extern void HostLinkIntHandler();
 
 //*****************************************************************************
 //
@@ -77,17 +101,17 @@ void (* const g_pfnVectors[])(void) =
     0,                                      // Reserved
     0,                                      // Reserved
     0,                                      // Reserved
-    IntDefaultHandler,                      // SVCall handler
+    SVCHandler,                             // SVCall handler
     IntDefaultHandler,                      // Debug monitor handler
     0,                                      // Reserved
-    IntDefaultHandler,                      // The PendSV handler
-    IntDefaultHandler,                      // The SysTick handler
+    PendSVHandler,                          // The PendSV handler
+    SysTickHandler,                         // The SysTick handler
     IntDefaultHandler,                      // GPIO Port A
     IntDefaultHandler,                      // GPIO Port B
     IntDefaultHandler,                      // GPIO Port C
     IntDefaultHandler,                      // GPIO Port D
     IntDefaultHandler,                      // GPIO Port E
-    IntDefaultHandler,                      // UART0 Rx and Tx
+    HostLinkIntHandler,                     // UART0 Rx and Tx
     UARTInterruptHandler,                   // UART1 Rx and Tx
     IntDefaultHandler,                      // SSI0 Rx and Tx
     IntDefaultHandler,                      // I2C0 Master and Slave
@@ -141,9 +165,9 @@ void (* const g_pfnVectors[])(void) =
     IntDefaultHandler,                      // GPIO Port L
     IntDefaultHandler,                      // SSI2 Rx and Tx
     IntDefaultHandler,                      // SSI3 Rx and Tx
-    IntDefaultHandler,                      // UART3 Rx and Tx
-    IntDefaultHandler,                      // UART4 Rx and Tx
-    IntDefaultHandler,                      // UART5 Rx and Tx
+    SensorPort1IntHandler,                  // UART3 Rx and Tx
+    SensorPort2IntHandler,                  // UART4 Rx and Tx
+    SensorPort3IntHandler,                  // UART5 Rx and Tx
     IntDefaultHandler,                      // UART6 Rx and Tx
     IntDefaultHandler,                      // UART7 Rx and Tx
     0,                                      // Reserved
@@ -236,6 +260,11 @@ void (* const g_pfnVectors[])(void) =
 void
 ResetISR(void)
 {
+    //
+    // Paint the stack before anything else uses it.
+    //
+    stackPaint();
+
     //
     // Jump to the CCS C initialization routine.  This will enable the
     // floating-point unit as well, so that does not need to be done here.
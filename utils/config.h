@@ -1,9 +1,30 @@
 #define UART_PRINT_INTERFACE    0
 #define UART_PRINT_BAUD         115200
+#define UART_PRINT_BASE         UART0_BASE
 #define UART_SENSOR_INTERFACE   UART1_BASE
 #define UART_SENSOR_BAUD        57600
 #define SENSOR_ADDRESS          DEFAULT_MODULE_ADDRESS
 
+// Modules on separate UARTs, see lib/dy50_shard.h. Port 0 is UART_SENSOR_INTERFACE. The interrupt vectors of the
+// extra UARTs in tm4c123gh6pm_startup_ccs.c must match SENSOR_UART_BASES.
+#ifndef SENSOR_COUNT
+#define SENSOR_COUNT            1
+#endif
+#define MAX_SENSOR_COUNT        4
+#define SENSOR_UART_BASES       { UART_SENSOR_INTERFACE, UART3_BASE, UART4_BASE, UART5_BASE }
+#define SENSOR_UART_INTS        { INT_UART_ASSIGNMENT, INT_UART3, INT_UART4, INT_UART5 }
+#define SENSOR_UART_TX_DMA      { UDMA_CH23_UART1TX, UDMA_CH17_UART3TX, UDMA_CH19_UART4TX, UDMA_CH7_UART5TX }
+
 // UART number in the NVIC
 // INT_UARTx - x number of uart interface
 #define INT_UART_ASSIGNMENT     INT_UART1
+#define INT_UART_PRINT_ASSIGNMENT INT_UART0
+
+// Access event journal, see utils/event_journal.h. The region is excluded from FLASH in tm4c123gh6pm.cmd.
+#define JOURNAL_FLASH_BASE      0x0003C000
+#define JOURNAL_SECTOR_COUNT    16
+
+// Page to user map of the template library, see utils/page_map.h. The region is excluded from FLASH in
+// tm4c123gh6pm.cmd.
+#define PAGE_MAP_FLASH_BASE     0x0003A000
+#define PAGE_MAP_BANK_SECTORS   4       // Two banks
@@ -0,0 +1,115 @@
+#include "dlog.h"
+#include "tm4c123gxl_utils.h"
+#include "config.h"
+
+static uint8_t ring[DLOG_RING_SIZE];
+static volatile uint16_t ringHead; // Next byte to be written, only moved by dlogWrite()
+static volatile uint16_t ringTail; // First byte of the oldest record not sent completely, only moved by dlogDrain()
+static uint16_t sendPosition;       // Next byte to be sent, ahead of ringTail while a record is partly sent
+static uint16_t recordRemaining;    // Bytes of the partly sent record still to go, 0 between records
+static volatile uint32_t droppedRecords;
+
+static inline void putByte(uint16_t *position, uint8_t byte)
+{
+    ring[*position] = byte;
+    *position = (*position + 1) & (DLOG_RING_SIZE - 1);
+}
+
+static inline void putWord(uint16_t *position, uint32_t word)
+{
+    putByte(position, (uint8_t) word);
+    putByte(position, (uint8_t) (word >> 8));
+    putByte(position, (uint8_t) (word >> 16));
+    putByte(position, (uint8_t) (word >> 24));
+}
+
+/**
+ * @brief  Record a log entry. Only the format ID and the raw arguments are stored; formatting happens on the host.
+ *         Safe to call from interrupt handlers. Use the dlog()..dlog3() macros instead of calling this directly.
+ * @param  id                                - Format of the entry, see dlog_formats.h
+ * @param  argumentCount                     - Number of valid arguments, at most DLOG_MAX_ARGUMENTS
+ * @param  arg0                              - Arguments in the order of the conversions in the format string
+ * @note   If the ring is full the entry is dropped and counted, the caller never waits.
+ */
+void dlogWrite(DlogFormatId id, uint8_t argumentCount, uint32_t arg0, uint32_t arg1, uint32_t arg2)
+{
+    uint16_t recordSize = DLOG_RECORD_HEADER_SIZE + 4 * argumentCount;
+    uint16_t position;
+    bool wasMasked = MAP_IntMasterDisable();
+
+    position = ringHead;
+    if (((ringTail - position - 1) & (DLOG_RING_SIZE - 1)) < recordSize)
+    {
+        droppedRecords++;
+    }
+    else
+    {
+        putByte(&position, DLOG_SYNC);
+        putByte(&position, (uint8_t) id);
+        putByte(&position, argumentCount);
+        putWord(&position, getTickCount());
+        if (argumentCount > 0)
+        {
+            putWord(&position, arg0);
+        }
+        if (argumentCount > 1)
+        {
+            putWord(&position, arg1);
+        }
+        if (argumentCount > 2)
+        {
+            putWord(&position, arg2);
+        }
+        ringHead = position;
+    }
+
+    if (!wasMasked)
+    {
+        MAP_IntMasterEnable();
+    }
+}
+
+/**
+ * @brief  Move recorded entries to the console UART until its transmit FIFO is full. Meant to be called whenever the
+ *         application is idle, e.g. while waiting for the sensor; it never waits for the UART.
+ * @note   A record that does not fit into the FIFO is continued by the next call. Call dlogFlush() before
+ *         UARTprintf() output so that the text never lands inside a record.
+ */
+void dlogDrain(void)
+{
+    while (sendPosition != ringHead)
+    {
+        if (recordRemaining == 0)
+        {
+            recordRemaining = DLOG_RECORD_HEADER_SIZE + 4 * ring[(sendPosition + 2) & (DLOG_RING_SIZE - 1)];
+        }
+        if (!MAP_UARTCharPutNonBlocking(UART_PRINT_BASE, ring[sendPosition]))
+        {
+            return;
+        }
+        sendPosition = (sendPosition + 1) & (DLOG_RING_SIZE - 1);
+        if (--recordRemaining == 0)
+        {
+            ringTail = sendPosition; // The space of a record is released once it is sent completely
+        }
+    }
+}
+
+/**
+ * @brief  Send all recorded entries, including the rest of a partly sent one, waiting for the UART as needed
+ */
+void dlogFlush(void)
+{
+    while (ringTail != ringHead)
+    {
+        dlogDrain();
+    }
+}
+
+/**
+ * @brief  Number of entries lost because the ring was full
+ */
+uint32_t dlogDroppedRecords(void)
+{
+    return droppedRecords;
+}
@@ -0,0 +1,32 @@
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "dlog_formats.h"
+
+/* ***** Defines ***** */
+
+#define DLOG_SYNC                               0xA5 // First byte of every record, never part of console text
+#define DLOG_RING_SIZE                          512  // Bytes, must be a power of two
+#define DLOG_MAX_ARGUMENTS                      3
+
+/*
+ * Record layout on the wire, multi-byte fields little endian:
+ *   sync (1) | format ID (1) | argument count (1) | tick in ms (4) | arguments (4 each)
+ */
+#define DLOG_RECORD_HEADER_SIZE                 7
+
+/* ***** Functions ***** */
+
+void dlogWrite(DlogFormatId id, uint8_t argumentCount, uint32_t arg0, uint32_t arg1, uint32_t arg2);
+void dlogDrain(void);
+void dlogFlush(void);
+uint32_t dlogDroppedRecords(void);
+
+#define dlog(id)                    dlogWrite((id), 0, 0, 0, 0)
+#define dlog1(id, a)                dlogWrite((id), 1, (uint32_t)(a), 0, 0)
+#define dlog2(id, a, b)             dlogWrite((id), 2, (uint32_t)(a), (uint32_t)(b), 0)
+#define dlog3(id, a, b, c)          dlogWrite((id), 3, (uint32_t)(a), (uint32_t)(b), (uint32_t)(c))
+
+#endif /* DLOG_H */
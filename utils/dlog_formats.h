@@ -0,0 +1,45 @@
+#ifndef DLOG_FORMATS_H
+#define DLOG_FORMATS_H
+
+/*
+ * Format strings of the deferred log. Only the ID is sent by the firmware; host/dlog_decode.c includes this file to
+ * turn records back into text. Supported conversions are %d, %u, %x and %c with 32-bit arguments. Append new
+ * formats at the end so that logs captured with older firmware still decode.
+ *
+ * DLOG_FORMAT(id, text)
+ */
+#define DLOG_FORMATS \
+    DLOG_FORMAT(LOG_SENSOR_NOT_RESPONDING,  "Sensor not responding.\nExiting!\n") \
+    DLOG_FORMAT(LOG_ENTER_ID,               "Enter id of a fingerprint: ") \
+    DLOG_FORMAT(LOG_ENTERED_ID,             "You entered %c\n") \
+    DLOG_FORMAT(LOG_PLACE_FINGER,           "Place your finger on the sensor.\n") \
+    DLOG_FORMAT(LOG_POLL_STATUS,            "p = %d\n") \
+    DLOG_FORMAT(LOG_IMAGE_TAKEN,            "Image taken.\n") \
+    DLOG_FORMAT(LOG_STORING_IMAGE,          "Storing the image in CharBuffer %d.\n") \
+    DLOG_FORMAT(LOG_IMAGE_CONVERTED,        "Image converted.\n") \
+    DLOG_FORMAT(LOG_STATUS_EXITING,         "p = %d\nExiting!\n") \
+    DLOG_FORMAT(LOG_REMOVE_FINGER,          "Remove your finger from the sensor.\n") \
+    DLOG_FORMAT(LOG_PLACE_SAME_FINGER,      "Place the same finger again\n") \
+    DLOG_FORMAT(LOG_CREATING_MODEL,         "Creating model for ID %d\n") \
+    DLOG_FORMAT(LOG_MODEL_CREATED,          "The two finger prints matched, model created.\n") \
+    DLOG_FORMAT(LOG_PRINTS_MISMATCH,        "Prints did not match.\nExiting\n") \
+    DLOG_FORMAT(LOG_STORING_MODEL,          "Storing model.\n") \
+    DLOG_FORMAT(LOG_MODEL_STORED,           "Model stored!\n") \
+    DLOG_FORMAT(LOG_COULD_NOT_MATCH,        "Could not match.\nExiting.\n") \
+    DLOG_FORMAT(LOG_FINGERPRINT_FOUND,      "Fingerprint found!\nFound by ID %d\nConfidence %d\n") \
+    DLOG_FORMAT(LOG_BOOT_TO_IDENTIFY,       "Boot to first identify %u ms\n") \
+    DLOG_FORMAT(LOG_FINGERPRINT_VERIFIED,   "Fingerprint verified!\nID %d\nConfidence %d\n") \
+    DLOG_FORMAT(LOG_NOT_VERIFIED,           "Fingerprint does not match ID %d.\n") \
+    DLOG_FORMAT(LOG_SAMPLE_REJECTED,        "Sample %d rejected, p = %d\nRemove your finger and place it again.\n") \
+    DLOG_FORMAT(LOG_ALREADY_ENROLLED,       "Finger is enrolled already as ID %d, confidence %d.\nExiting!\n") \
+    DLOG_FORMAT(LOG_ENROLLED,               "Model of %d samples stored on page %d!\n")
+
+#define DLOG_FORMAT(id, text) id,
+typedef enum
+{
+    DLOG_FORMATS
+    DLOG_FORMAT_COUNT
+} DlogFormatId;
+#undef DLOG_FORMAT
+
+#endif /* DLOG_FORMATS_H */
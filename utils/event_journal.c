@@ -0,0 +1,449 @@
+#include "event_journal.h"
+#include "checksum.h"
+#include "config.h"
+#include <string.h>
+#ifdef DY50_HOST
+#include "host_transport.h"         // Host build, the flash region is emulated in RAM
+#else
+#include "tm4c123gxl_utils.h"
+#include "driverlib/flash.h"
+#endif
+
+#define ERASED_WORD                             0xFFFFFFFF
+
+static bool isReady;
+static uint8_t headSector;          // Sector receiving records
+static uint8_t headSlot;            // Next free record slot of headSector
+static bool isSpareErased;          // The sector after headSector is erased and can become the head
+static uint32_t spareEraseCount;    // Erase count written to the header of the spare sector
+static uint32_t nextSequence;       // Sequence number of the next appended record
+static uint8_t session;
+static JournalRecord stage[JOURNAL_STAGE_RECORDS]; // Appended records not yet programmed, oldest first
+static uint8_t stageCount;
+static uint32_t stagedSinceMs;      // Append time of stage[0]
+static JournalStats stats;
+
+/* ***** Flash access ***** */
+
+#ifdef DY50_HOST
+static uint8_t hostFlash[JOURNAL_SECTOR_COUNT * JOURNAL_SECTOR_SIZE];
+static bool isHostFlashErased;      // Set once, the emulated flash keeps its contents across journalInit() calls
+
+static const uint8_t *sectorBase(uint8_t sector)
+{
+    return &hostFlash[sector * JOURNAL_SECTOR_SIZE];
+}
+
+static void eraseSector(uint8_t sector)
+{
+    memset(&hostFlash[sector * JOURNAL_SECTOR_SIZE], 0xFF, JOURNAL_SECTOR_SIZE);
+}
+
+// Programming can only clear bits, as on the real flash
+static void programFlash(const uint8_t *address, const void *data, uint16_t length)
+{
+    uint8_t *target = &hostFlash[address - hostFlash];
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        target[i] &= ((const uint8_t *)data)[i];
+    }
+}
+#else
+static const uint8_t *sectorBase(uint8_t sector)
+{
+    return (const uint8_t *)(JOURNAL_FLASH_BASE + (uint32_t)sector * JOURNAL_SECTOR_SIZE);
+}
+
+static void eraseSector(uint8_t sector)
+{
+    MAP_FlashErase((uint32_t)sectorBase(sector));
+}
+
+// data must be word aligned and length a multiple of four
+static void programFlash(const uint8_t *address, const void *data, uint16_t length)
+{
+    MAP_FlashProgram((uint32_t *)data, (uint32_t)address, length);
+}
+#endif
+
+static const JournalSectorHeader *sectorHeader(uint8_t sector)
+{
+    return (const JournalSectorHeader *)sectorBase(sector);
+}
+
+static const JournalRecord *sectorRecords(uint8_t sector)
+{
+    return (const JournalRecord *)(sectorBase(sector) + sizeof(JournalSectorHeader));
+}
+
+static uint8_t nextSector(uint8_t sector)
+{
+    return (uint8_t)((sector + 1) % JOURNAL_SECTOR_COUNT);
+}
+
+/* ***** Layout ***** */
+
+static uint8_t recordCheck(const JournalRecord *record)
+{
+    return (uint8_t)~sumBytes((const uint8_t *)record, JOURNAL_RECORD_SIZE - 1);
+}
+
+static uint32_t headerCheck(const JournalSectorHeader *header)
+{
+    return ~(header->magic ^ header->eraseCount ^ header->firstSequence);
+}
+
+static bool isHeaderValid(const JournalSectorHeader *header)
+{
+    return header->magic == JOURNAL_MAGIC && header->check == headerCheck(header);
+}
+
+static bool isSectorErased(uint8_t sector)
+{
+    const uint32_t *words = (const uint32_t *)sectorBase(sector);
+
+    for (uint16_t i = 0; i < JOURNAL_SECTOR_SIZE / 4; i++)
+    {
+        if (words[i] != ERASED_WORD)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief  Session number of the newest intact record in the head sector or the one before it, 0 if there is none
+ */
+static uint8_t lastSession(void)
+{
+    uint8_t sector = headSector;
+    uint8_t slot = headSlot;
+
+    for (uint8_t pass = 0; pass < 2; pass++)
+    {
+        const JournalRecord *records = sectorRecords(sector);
+        while (slot-- > 0)
+        {
+            if (records[slot].check == recordCheck(&records[slot]))
+            {
+                return records[slot].session;
+            }
+        }
+        sector = (uint8_t)((sector + JOURNAL_SECTOR_COUNT - 1) % JOURNAL_SECTOR_COUNT);
+        slot = isHeaderValid(sectorHeader(sector)) ? JOURNAL_RECORDS_PER_SECTOR : 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief  Erase count to assume for a sector whose header is lost: the lowest one in use, as the ring erases all
+ *         sectors in turn. 0 on a new device.
+ */
+static uint32_t lowestEraseCount(void)
+{
+    bool isFound = false;
+    uint32_t lowest = 0;
+
+    for (uint8_t sector = 0; sector < JOURNAL_SECTOR_COUNT; sector++)
+    {
+        const JournalSectorHeader *header = sectorHeader(sector);
+        if (isHeaderValid(header) && (!isFound || header->eraseCount < lowest))
+        {
+            isFound = true;
+            lowest = header->eraseCount;
+        }
+    }
+    return lowest;
+}
+
+/* ***** Background work ***** */
+
+/**
+ * @brief  Erase the sector after the head, dropping the oldest records, so that the head can move on without waiting
+ */
+static void eraseSpare(void)
+{
+    uint8_t spare = nextSector(headSector);
+    const JournalSectorHeader *header = sectorHeader(spare);
+    uint32_t eraseCount = isHeaderValid(header) ? header->eraseCount : lowestEraseCount();
+
+    eraseSector(spare);
+    spareEraseCount = eraseCount + 1;
+    if (spareEraseCount > stats.maxEraseCount)
+    {
+        stats.maxEraseCount = spareEraseCount;
+    }
+    stats.erases++;
+    isSpareErased = true;
+}
+
+static void openSpare(uint32_t firstSequence)
+{
+    JournalSectorHeader header = { JOURNAL_MAGIC, spareEraseCount, firstSequence, 0 };
+
+    header.check = headerCheck(&header);
+    headSector = nextSector(headSector);
+    headSlot = 0;
+    isSpareErased = false;
+    programFlash(sectorBase(headSector), &header, sizeof(header));
+}
+
+/**
+ * @brief  Program the staged records, one flash operation per sector they fall into. Records that would need the
+ *         spare sector before it is erased stay staged.
+ */
+static void programStaged(void)
+{
+    uint8_t done = 0;
+
+    while (done < stageCount)
+    {
+        uint8_t count = stageCount - done;
+
+        if (headSlot == JOURNAL_RECORDS_PER_SECTOR)
+        {
+            if (!isSpareErased)
+            {
+                break;
+            }
+            openSpare(stage[done].sequence);
+        }
+        if (count > JOURNAL_RECORDS_PER_SECTOR - headSlot)
+        {
+            count = JOURNAL_RECORDS_PER_SECTOR - headSlot;
+        }
+        programFlash((const uint8_t *)&sectorRecords(headSector)[headSlot], &stage[done],
+                     (uint16_t)(count * JOURNAL_RECORD_SIZE));
+        headSlot += count;
+        done += count;
+        stats.batches++;
+    }
+    memmove(stage, &stage[done], (stageCount - done) * sizeof(JournalRecord));
+    stageCount -= done;
+}
+
+/* ***** Functions ***** */
+
+/**
+ * @brief  Recover the journal from flash. Call once after init() and before the first journalAppend(); appends are
+ *         ignored until then.
+ * @note   Reads the JOURNAL_SECTOR_COUNT sector headers, searches the newest sector for its first free slot and checks
+ *         whether the sector after it is erased; no flash is written.
+ */
+void journalInit(void)
+{
+    bool isFound = false;
+    uint32_t newest = 0;
+
+#ifdef DY50_HOST
+    if (!isHostFlashErased)
+    {
+        memset(hostFlash, 0xFF, sizeof(hostFlash));
+        isHostFlashErased = true;
+    }
+#endif
+    memset(&stats, 0, sizeof(stats));
+    stageCount = 0;
+    for (uint8_t sector = 0; sector < JOURNAL_SECTOR_COUNT; sector++)
+    {
+        const JournalSectorHeader *header = sectorHeader(sector);
+        if (!isHeaderValid(header))
+        {
+            continue;
+        }
+        if (header->eraseCount > stats.maxEraseCount)
+        {
+            stats.maxEraseCount = header->eraseCount;
+        }
+        if (!isFound || (int32_t)(header->firstSequence - newest) > 0)
+        {
+            isFound = true;
+            newest = header->firstSequence;
+            headSector = sector;
+        }
+    }
+
+    if (isFound)
+    {
+        // Programmed slots precede the erased ones; a torn record still has programmed bits in its sequence word
+        const JournalRecord *records = sectorRecords(headSector);
+        uint8_t low = 0;
+        uint8_t high = JOURNAL_RECORDS_PER_SECTOR;
+        while (low < high)
+        {
+            uint8_t middle = (uint8_t)((low + high) / 2);
+            if (records[middle].sequence != ERASED_WORD)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        headSlot = low;
+        nextSequence = newest + headSlot;
+        session = (uint8_t)(lastSession() + 1);
+    }
+    else
+    {
+        // Empty journal: the first records go to sector 0 once it is known to be erased
+        headSector = JOURNAL_SECTOR_COUNT - 1;
+        headSlot = JOURNAL_RECORDS_PER_SECTOR;
+        nextSequence = 0;
+        session = 0;
+    }
+
+    isSpareErased = isSectorErased(nextSector(headSector));
+    spareEraseCount = lowestEraseCount();
+    isReady = true;
+}
+
+/**
+ * @brief  Record an access event. Only copies the record into RAM, the flash is written by journalPoll().
+ * @param  event                             - JOURNAL_EVENT_ kind
+ * @return false if the journal is not initialised or the stage is full, in which case the record is dropped
+ * @note   Not safe to call from interrupt handlers.
+ */
+bool journalAppend(uint8_t event, uint8_t statusCode, uint16_t page, uint16_t confidence)
+{
+    JournalRecord *record;
+
+    if (!isReady)
+    {
+        return false;
+    }
+    if (stageCount == JOURNAL_STAGE_RECORDS)
+    {
+        stats.dropped++;
+        return false;
+    }
+    record = &stage[stageCount];
+    record->sequence = nextSequence++;
+    record->tickMs = getTickCount();
+    record->page = page;
+    record->confidence = confidence;
+    record->event = event;
+    record->statusCode = statusCode;
+    record->session = session;
+    record->check = recordCheck(record);
+    if (stageCount == 0)
+    {
+        stagedSinceMs = record->tickMs;
+    }
+    stageCount++;
+    stats.appended++;
+    return true;
+}
+
+/**
+ * @brief  Do at most one kind of flash operation: program the staged records once JOURNAL_BATCH_RECORDS have
+ *         accumulated or the oldest is JOURNAL_FLUSH_DELAY_MS old, otherwise erase the spare sector if it is not
+ *         erased yet. Meant for the idle loop of the application, between sensor transactions.
+ */
+void journalPoll(void)
+{
+    bool isDue = stageCount >= JOURNAL_BATCH_RECORDS ||
+                 (stageCount > 0 && getTickCount() - stagedSinceMs >= JOURNAL_FLUSH_DELAY_MS);
+
+    if (!isReady)
+    {
+        return;
+    }
+    if (isDue && (headSlot < JOURNAL_RECORDS_PER_SECTOR || isSpareErased))
+    {
+        programStaged();
+    }
+    else if (!isSpareErased)
+    {
+        eraseSpare();
+    }
+}
+
+/**
+ * @brief  Program all staged records now, erasing the spare sector first if they need it. Call before a reset or
+ *         power down and before reading the journal.
+ */
+void journalFlush(void)
+{
+    while (isReady && stageCount > 0)
+    {
+        if (headSlot == JOURNAL_RECORDS_PER_SECTOR && !isSpareErased)
+        {
+            eraseSpare();
+        }
+        programStaged();
+    }
+}
+
+/**
+ * @brief  Copy programmed records in sequence order, starting with the oldest one still in flash
+ * @param  firstSequence                     - Sequence number to start at; older records are skipped
+ * @param  data                              - Receives maxRecords * JOURNAL_RECORD_SIZE bytes in the flash layout,
+ *                                             need not be aligned
+ * @return Number of records copied, 0 when there are no more. Torn records are left out.
+ * @note   Staged records are not included; call journalFlush() first.
+ */
+uint16_t journalRead(uint32_t firstSequence, uint8_t *data, uint16_t maxRecords)
+{
+    uint16_t count = 0;
+    uint8_t sector = headSector;
+
+    if (!isReady)
+    {
+        return 0;
+    }
+    // From the sector after the head, the oldest, to the head
+    for (uint8_t i = 0; i < JOURNAL_SECTOR_COUNT && count < maxRecords; i++)
+    {
+        const JournalSectorHeader *header;
+        const JournalRecord *records;
+        uint8_t usedSlots;
+        uint8_t slot = 0;
+
+        sector = nextSector(sector);
+        header = sectorHeader(sector);
+        if (!isHeaderValid(header))
+        {
+            continue;
+        }
+        records = sectorRecords(sector);
+        usedSlots = (sector == headSector) ? headSlot : JOURNAL_RECORDS_PER_SECTOR;
+        if ((int32_t)(firstSequence - header->firstSequence) >= usedSlots)
+        {
+            continue;
+        }
+        if ((int32_t)(firstSequence - header->firstSequence) > 0)
+        {
+            slot = (uint8_t)(firstSequence - header->firstSequence);
+        }
+        for (; slot < usedSlots && count < maxRecords; slot++)
+        {
+            if (records[slot].check == recordCheck(&records[slot]) &&
+                records[slot].sequence == header->firstSequence + slot)
+            {
+                memcpy(&data[count * JOURNAL_RECORD_SIZE], &records[slot], JOURNAL_RECORD_SIZE);
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief  Sequence number the next appended record will get
+ */
+uint32_t journalNextSequence(void)
+{
+    return nextSequence;
+}
+
+/**
+ * @brief  Journal counters since journalInit()
+ */
+JournalStats getJournalStats(void)
+{
+    return stats;
+}
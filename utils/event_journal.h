@@ -0,0 +1,82 @@
+#ifndef EVENT_JOURNAL_H
+#define EVENT_JOURNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Append-only journal of access events (identify and verify results) in a reserved region at the top of the internal
+ * flash, see JOURNAL_FLASH_BASE in config.h and the FLASH length in tm4c123gh6pm.cmd.
+ *
+ * The region is a ring of 1 KB flash sectors. Every sector starts with a JournalSectorHeader followed by fixed-size
+ * JournalRecords that are programmed in order, so the free slots of a sector are always at its end. Record sequence
+ * numbers are contiguous within a sector, which makes the slot of any sequence number a subtraction.
+ *
+ * journalAppend() only copies the record to a RAM stage and never touches the flash. journalPoll(), called from the
+ * application's idle loop, programs staged records in batches and erases the sector after the newest one ahead of
+ * time, so that a full sector never has to wait for an erase. Erasing and programming stall instruction fetches from
+ * flash for milliseconds, during which the UART FIFOs keep filling; call journalPoll() only while no sensor response
+ * is expected. The ring moves through all sectors in turn, so every sector is erased equally often; the erase counts
+ * are kept in the sector headers.
+ *
+ * journalInit() recovers the state at boot from the sector headers and a binary search of the newest sector. A record
+ * torn by a reset while it was programmed fails its check byte and is skipped by journalRead().
+ */
+
+/* ***** Defines ***** */
+
+#define JOURNAL_SECTOR_SIZE                     1024 // Flash erase block of the TM4C123
+#define JOURNAL_RECORD_SIZE                     16
+#define JOURNAL_RECORDS_PER_SECTOR              ((JOURNAL_SECTOR_SIZE - JOURNAL_RECORD_SIZE) / JOURNAL_RECORD_SIZE)
+#define JOURNAL_MAGIC                           0x4C4E524A // "JRNL"
+#define JOURNAL_STAGE_RECORDS                   16   // Records held in RAM until they are programmed
+#define JOURNAL_BATCH_RECORDS                   8    // Staged records that start programming
+#define JOURNAL_FLUSH_DELAY_MS                  5000 // Age of the oldest staged record that starts programming
+
+// Event kinds
+#define JOURNAL_EVENT_IDENTIFY                  1    // identifyFinger(); page and confidence of the search
+#define JOURNAL_EVENT_VERIFY                    2    // verifyFinger(); page asked for and confidence of the match
+
+/* ***** Structures ***** */
+
+// Record layout in flash, little endian; the same bytes are returned by RPC_OP_READ_JOURNAL
+typedef struct
+{
+    uint32_t sequence;          // Counts every record ever appended, from 0
+    uint32_t tickMs;            // getTickCount() at the event, restarts at every boot
+    uint16_t page;
+    uint16_t confidence;
+    uint8_t event;              // JOURNAL_EVENT_ kind
+    uint8_t statusCode;         // Confirmation code of FingerPageAndConfidence
+    uint8_t session;            // Boot the record was made in, modulo 256
+    uint8_t check;              // Complement of the sum of the preceding bytes
+} JournalRecord;
+
+typedef struct
+{
+    uint32_t magic;             // JOURNAL_MAGIC once the sector is in use
+    uint32_t eraseCount;        // Erases of this sector over the life of the device
+    uint32_t firstSequence;     // Sequence number of the first record slot
+    uint32_t check;             // Complement of magic ^ eraseCount ^ firstSequence
+} JournalSectorHeader;
+
+typedef struct
+{
+    uint32_t appended;          // Records accepted by journalAppend()
+    uint32_t dropped;           // Records lost because the stage was full
+    uint32_t batches;           // Flash program operations
+    uint32_t erases;            // Sector erases since boot
+    uint32_t maxEraseCount;     // Highest erase count of any sector
+} JournalStats;
+
+/* ***** Functions ***** */
+
+void journalInit(void);
+bool journalAppend(uint8_t event, uint8_t statusCode, uint16_t page, uint16_t confidence);
+void journalPoll(void);
+void journalFlush(void);
+uint16_t journalRead(uint32_t firstSequence, uint8_t *data, uint16_t maxRecords);
+uint32_t journalNextSequence(void);
+JournalStats getJournalStats(void);
+
+#endif /* EVENT_JOURNAL_H */
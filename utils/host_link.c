@@ -0,0 +1,74 @@
+#include "host_link.h"
+#include "tm4c123gxl_utils.h"
+#include "config.h"
+
+static uint8_t rxRing[HOST_LINK_RX_SIZE];
+static volatile uint16_t rxHead; // Written by the interrupt handler
+static volatile uint16_t rxTail; // Written by hostLinkRead()
+static volatile uint32_t rxOverruns;
+
+/**
+ * @brief  Receive on the console UART in the background so that a host can queue several requests while the board is
+ *         busy with the sensor. Call after init().
+ */
+void hostLinkInit(void)
+{
+    rxHead = 0;
+    rxTail = 0;
+    MAP_IntEnable(INT_UART_PRINT_ASSIGNMENT);
+    MAP_UARTIntEnable(UART_PRINT_BASE, UART_INT_RX | UART_INT_RT);
+}
+
+void HostLinkIntHandler()
+{
+    uint32_t ui32Status = MAP_UARTIntStatus(UART_PRINT_BASE, true);
+    MAP_UARTIntClear(UART_PRINT_BASE, ui32Status);
+
+    while (MAP_UARTCharsAvail(UART_PRINT_BASE))
+    {
+        uint8_t byte = UARTCharGetNonBlocking(UART_PRINT_BASE);
+        uint16_t next = (rxHead + 1) & (HOST_LINK_RX_SIZE - 1);
+        if (next == rxTail)
+        {
+            rxOverruns++; // The frame CRC will fail and the host resends
+            continue;
+        }
+        rxRing[rxHead] = byte;
+        rxHead = next;
+    }
+}
+
+/**
+ * @brief  Take one received byte without waiting
+ * @param  byte                              - Populated with the byte
+ * @return false if nothing was received
+ */
+bool hostLinkRead(uint8_t *byte)
+{
+    if (rxTail == rxHead)
+    {
+        return false;
+    }
+    *byte = rxRing[rxTail];
+    rxTail = (rxTail + 1) & (HOST_LINK_RX_SIZE - 1);
+    return true;
+}
+
+/**
+ * @brief  Send a block of bytes, waiting for room in the transmit FIFO
+ */
+void hostLinkWrite(const uint8_t *data, uint16_t length)
+{
+    while (length-- > 0)
+    {
+        MAP_UARTCharPut(UART_PRINT_BASE, *data++);
+    }
+}
+
+/**
+ * @brief  Number of received bytes lost because the host sent faster than requests were consumed
+ */
+uint32_t hostLinkOverruns(void)
+{
+    return rxOverruns;
+}
@@ -0,0 +1,19 @@
+#ifndef HOST_LINK_H
+#define HOST_LINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ***** Defines ***** */
+
+#define HOST_LINK_RX_SIZE                       1024 // Bytes, must be a power of two
+
+/* ***** Functions ***** */
+
+void hostLinkInit(void);
+void HostLinkIntHandler();
+bool hostLinkRead(uint8_t *byte);
+void hostLinkWrite(const uint8_t *data, uint16_t length);
+uint32_t hostLinkOverruns(void);
+
+#endif /* HOST_LINK_H */
@@ -0,0 +1,485 @@
+#include "page_map.h"
+#include "checksum.h"
+#include "config.h"
+#include <string.h>
+#ifdef DY50_HOST
+#include "host_transport.h"         // Host build, the flash region is emulated in RAM
+#else
+#include "tm4c123gxl_utils.h"
+#include "driverlib/flash.h"
+#endif
+
+#define ERASED_WORD                             0xFFFFFFFF
+#define LOG_OFFSET                              (sizeof(PageMapHeader) + PAGE_MAP_MAX_PAGES * sizeof(uint16_t))
+
+_Static_assert(sizeof(PageMapRecord) == PAGE_MAP_RECORD_SIZE, "PageMapRecord layout is part of the flash format");
+_Static_assert(LOG_OFFSET + PAGE_MAP_LOG_RECORDS * PAGE_MAP_RECORD_SIZE <= PAGE_MAP_BANK_SIZE, "Bank overflow");
+
+// Source of programFlash(), which needs word-aligned data; a PageMapRecord alone is only halfword aligned
+typedef union
+{
+    PageMapRecord record;
+    uint16_t users[2];          // Two table entries
+    uint32_t words[PAGE_MAP_RECORD_SIZE / sizeof(uint32_t)];
+} FlashBuffer;
+
+static bool isReady;
+static uint8_t activeBank;
+static uint16_t logCount;           // Used log slots of the active bank, torn records included
+static bool isMovePending;          // The newest move record is not PAGE_MAP_MOVE_END
+static PageMapMove pending;
+static PageMapStats stats;
+
+/* ***** Flash access ***** */
+
+#ifdef DY50_HOST
+static uint8_t hostFlash[2 * PAGE_MAP_BANK_SIZE];
+static bool isHostFlashErased;      // Set once, the emulated flash keeps its contents across pageMapInit() calls
+
+static const uint8_t *bankBase(uint8_t bank)
+{
+    return &hostFlash[bank * PAGE_MAP_BANK_SIZE];
+}
+
+static void eraseSector(const uint8_t *address)
+{
+    memset(&hostFlash[address - hostFlash], 0xFF, PAGE_MAP_SECTOR_SIZE);
+}
+
+// Programming can only clear bits, as on the real flash
+static void programFlash(const uint8_t *address, const void *data, uint16_t length)
+{
+    uint8_t *target = &hostFlash[address - hostFlash];
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        target[i] &= ((const uint8_t *)data)[i];
+    }
+}
+#else
+static const uint8_t *bankBase(uint8_t bank)
+{
+    return (const uint8_t *)(PAGE_MAP_FLASH_BASE + (uint32_t)bank * PAGE_MAP_BANK_SIZE);
+}
+
+static void eraseSector(const uint8_t *address)
+{
+    MAP_FlashErase((uint32_t)address);
+}
+
+// data must be word aligned and length a multiple of four
+static void programFlash(const uint8_t *address, const void *data, uint16_t length)
+{
+    MAP_FlashProgram((uint32_t *)data, (uint32_t)address, length);
+}
+#endif
+
+static const PageMapHeader *bankHeader(uint8_t bank)
+{
+    return (const PageMapHeader *)bankBase(bank);
+}
+
+static const uint16_t *bankTable(uint8_t bank)
+{
+    return (const uint16_t *)(bankBase(bank) + sizeof(PageMapHeader));
+}
+
+static const PageMapRecord *bankLog(uint8_t bank)
+{
+    return (const PageMapRecord *)(bankBase(bank) + LOG_OFFSET);
+}
+
+static void eraseBank(uint8_t bank)
+{
+    for (uint8_t sector = 0; sector < PAGE_MAP_BANK_SECTORS; sector++)
+    {
+        eraseSector(bankBase(bank) + sector * PAGE_MAP_SECTOR_SIZE);
+    }
+}
+
+/* ***** Layout ***** */
+
+static uint8_t recordCheck(const PageMapRecord *record)
+{
+    return (uint8_t)~sumBytes((const uint8_t *)record, PAGE_MAP_RECORD_SIZE - 1);
+}
+
+static bool isRecordValid(const PageMapRecord *record)
+{
+    return record->check == recordCheck(record);
+}
+
+static bool isRecordErased(const PageMapRecord *record)
+{
+    const uint32_t *words = (const uint32_t *)record;
+
+    return words[0] == ERASED_WORD && words[1] == ERASED_WORD;
+}
+
+static uint32_t headerCheck(const PageMapHeader *header)
+{
+    return ~(header->magic ^ header->generation ^ header->pageCount);
+}
+
+static bool isHeaderValid(const PageMapHeader *header)
+{
+    return header->magic == PAGE_MAP_MAGIC && header->pageCount == PAGE_MAP_MAX_PAGES &&
+           header->check == headerCheck(header);
+}
+
+/**
+ * @brief  Owner of a page as recorded: the table entry of the active bank overridden by the newest log record that
+ *         mentions the page
+ * @return User, PAGE_MAP_IDENTITY, PAGE_MAP_FREE or PAGE_MAP_UNOWNED
+ */
+static uint16_t recordedUser(uint16_t page)
+{
+    const PageMapRecord *log = bankLog(activeBank);
+    uint16_t user = bankTable(activeBank)[page];
+
+    for (uint16_t slot = 0; slot < logCount; slot++)
+    {
+        if (!isRecordValid(&log[slot]))
+        {
+            continue;
+        }
+        if ((log[slot].kind == PAGE_MAP_ASSIGN || log[slot].kind == PAGE_MAP_MOVE_COMMIT) && log[slot].page == page)
+        {
+            user = log[slot].user;
+        }
+        else if (log[slot].kind == PAGE_MAP_MOVE_COMMIT && log[slot].from == page)
+        {
+            user = PAGE_MAP_FREE;
+        }
+    }
+    return user;
+}
+
+/**
+ * @brief  Program the header of a bank whose table and log are written, making it the newest one
+ */
+static void openBank(uint8_t bank, uint32_t generation)
+{
+    PageMapHeader header = { PAGE_MAP_MAGIC, generation, PAGE_MAP_MAX_PAGES, 0 };
+
+    header.check = headerCheck(&header);
+    programFlash((const uint8_t *)bankHeader(bank), &header, sizeof(header));
+    activeBank = bank;
+    stats.generation = generation;
+}
+
+/**
+ * @brief  Program a record at the end of the log, rewriting the table first when the log is full
+ */
+static bool appendRecord(uint8_t kind, uint16_t page, uint16_t user, uint16_t from)
+{
+    FlashBuffer buffer = { .record = { page, user, from, kind, 0 } };
+
+    if (!isReady || page >= PAGE_MAP_MAX_PAGES)
+    {
+        return false;
+    }
+    if (logCount == PAGE_MAP_LOG_RECORDS && !pageMapRewrite(NULL))
+    {
+        return false;
+    }
+    buffer.record.check = recordCheck(&buffer.record);
+    programFlash((const uint8_t *)&bankLog(activeBank)[logCount], &buffer.record, sizeof(buffer.record));
+    logCount++;
+    stats.logRecords = logCount;
+    return true;
+}
+
+/* ***** Functions ***** */
+
+/**
+ * @brief  Recover the map from flash. Call once after init() and before any other function of the map; they fail or
+ *         report the identity layout until then.
+ * @note   Erases and initializes bank 0 on a new device.
+ */
+void pageMapInit(void)
+{
+    bool isFound = false;
+    const PageMapRecord *log;
+
+#ifdef DY50_HOST
+    if (!isHostFlashErased)
+    {
+        memset(hostFlash, 0xFF, sizeof(hostFlash));
+        isHostFlashErased = true;
+    }
+#endif
+    memset(&stats, 0, sizeof(stats));
+    for (uint8_t bank = 0; bank < 2; bank++)
+    {
+        const PageMapHeader *header = bankHeader(bank);
+        if (isHeaderValid(header) && (!isFound || (int32_t)(header->generation - stats.generation) > 0))
+        {
+            isFound = true;
+            activeBank = bank;
+            stats.generation = header->generation;
+        }
+    }
+    if (!isFound)
+    {
+        eraseBank(0);
+        openBank(0, 1);
+    }
+
+    // Programmed slots precede the erased ones; a torn record is used but fails its check
+    log = bankLog(activeBank);
+    logCount = 0;
+    isMovePending = false;
+    while (logCount < PAGE_MAP_LOG_RECORDS && !isRecordErased(&log[logCount]))
+    {
+        const PageMapRecord *record = &log[logCount++];
+        if (isRecordValid(record) && record->kind >= PAGE_MAP_MOVE_BEGIN && record->kind <= PAGE_MAP_MOVE_END)
+        {
+            isMovePending = record->kind != PAGE_MAP_MOVE_END;
+            pending.kind = record->kind;
+            pending.from = record->from;
+            pending.to = record->page;
+            pending.user = record->user;
+        }
+    }
+    stats.logRecords = logCount;
+    isReady = true;
+}
+
+/**
+ * @brief  Owner of a library page
+ * @return User ID, PAGE_MAP_FREE if the page is known to be empty or PAGE_MAP_UNOWNED for a template of unknown owner
+ */
+uint16_t pageMapUser(uint16_t page)
+{
+    uint16_t user = (isReady && page < PAGE_MAP_MAX_PAGES) ? recordedUser(page) : PAGE_MAP_IDENTITY;
+
+    return user == PAGE_MAP_IDENTITY ? page : user;
+}
+
+/**
+ * @brief  Page of a user's template
+ * @return Library page, PAGE_MAP_NO_PAGE if the user has none. Users that were never moved or assigned are found on
+ *         the page of their number.
+ */
+uint16_t pageMapFind(uint16_t user)
+{
+    const PageMapRecord *log = bankLog(activeBank);
+    const uint16_t *table = bankTable(activeBank);
+
+    if (!isReady)
+    {
+        return user;
+    }
+    // Recent assignments first, then the table
+    for (uint16_t slot = logCount; slot-- > 0;)
+    {
+        if (isRecordValid(&log[slot]) && log[slot].user == user &&
+            (log[slot].kind == PAGE_MAP_ASSIGN || log[slot].kind == PAGE_MAP_MOVE_COMMIT) &&
+            pageMapUser(log[slot].page) == user)
+        {
+            return log[slot].page;
+        }
+    }
+    for (uint16_t page = 0; page < PAGE_MAP_MAX_PAGES; page++)
+    {
+        if ((table[page] == user || (table[page] == PAGE_MAP_IDENTITY && page == user)) &&
+            pageMapUser(page) == user)
+        {
+            return page;
+        }
+    }
+    return PAGE_MAP_NO_PAGE;
+}
+
+/**
+ * @brief  Page to store a new template of a user at: the page the user already has, the page of the user's number
+ *         while it was never assigned, or the lowest free page, which keeps a compacted library dense
+ * @param  capacity                          - Pages of the module's library
+ * @return Library page, PAGE_MAP_NO_PAGE if no page is free. The page is not reserved, call pageMapAssign() once the
+ *         template is stored.
+ */
+uint16_t pageMapAllocate(uint16_t user, uint16_t capacity)
+{
+    uint16_t page = pageMapFind(user);
+
+    if (capacity > PAGE_MAP_MAX_PAGES)
+    {
+        capacity = PAGE_MAP_MAX_PAGES;
+    }
+    if (page != PAGE_MAP_NO_PAGE && page < capacity)
+    {
+        return page;
+    }
+    if (!isReady)
+    {
+        return PAGE_MAP_NO_PAGE;
+    }
+    if (user < capacity && recordedUser(user) == PAGE_MAP_IDENTITY)
+    {
+        return user;
+    }
+    for (page = 0; page < capacity; page++)
+    {
+        if (recordedUser(page) == PAGE_MAP_FREE)
+        {
+            return page;
+        }
+    }
+    return PAGE_MAP_NO_PAGE;
+}
+
+/**
+ * @brief  Record the owner of a page, e.g. after a template was stored or deleted
+ * @param  user                              - User ID up to PAGE_MAP_MAX_USER, PAGE_MAP_FREE or PAGE_MAP_UNOWNED
+ * @return false if the map is not initialised or the page is beyond PAGE_MAP_MAX_PAGES
+ */
+bool pageMapAssign(uint16_t page, uint16_t user)
+{
+    return appendRecord(PAGE_MAP_ASSIGN, page, user, PAGE_MAP_NO_PAGE);
+}
+
+/**
+ * @brief  Record that the template of a user is about to be copied to another page. The map is unchanged until
+ *         pageMapCommitMove().
+ * @param  from                              - Page holding the template
+ * @param  to                                - Free page receiving the copy
+ */
+bool pageMapBeginMove(uint16_t from, uint16_t to, uint16_t user)
+{
+    if (!appendRecord(PAGE_MAP_MOVE_BEGIN, to, user, from))
+    {
+        return false;
+    }
+    isMovePending = true;
+    pending.kind = PAGE_MAP_MOVE_BEGIN;
+    pending.from = from;
+    pending.to = to;
+    pending.user = user;
+    return true;
+}
+
+/**
+ * @brief  Give the user of the move begun last the new page and free the old one, in one record. Call once the copy is
+ *         stored on the new page.
+ */
+bool pageMapCommitMove(void)
+{
+    if (!isMovePending || !appendRecord(PAGE_MAP_MOVE_COMMIT, pending.to, pending.user, pending.from))
+    {
+        return false;
+    }
+    pending.kind = PAGE_MAP_MOVE_COMMIT;
+    return true;
+}
+
+/**
+ * @brief  Complete the move begun last, once the template on the old page is deleted
+ */
+bool pageMapEndMove(void)
+{
+    if (!isMovePending || !appendRecord(PAGE_MAP_MOVE_END, pending.to, pending.user, pending.from))
+    {
+        return false;
+    }
+    isMovePending = false;
+    return true;
+}
+
+/**
+ * @brief  Move that was begun but not ended, e.g. because of a reset; see lib/dy50_compact.c for finishing it
+ * @param  move                              - Receives the move and the last step that was recorded
+ * @return false if no move is pending
+ */
+bool pageMapPendingMove(PageMapMove *move)
+{
+    if (isMovePending)
+    {
+        *move = pending;
+    }
+    return isMovePending;
+}
+
+/**
+ * @brief  Write the current map to the table of the other bank and start an empty log there. Done automatically when
+ *         the log is full; a pending move is carried over.
+ * @param  occupancy                         - NULL, or one bit per page as read with readIndexTable(), at least
+ *                                             PAGE_MAP_MAX_PAGES bits: empty pages become PAGE_MAP_FREE, occupied
+ *                                             pages of the identity layout get their user explicitly and occupied
+ *                                             pages recorded as free become PAGE_MAP_UNOWNED
+ * @return false if the map is not initialised
+ * @note   Erases PAGE_MAP_BANK_SECTORS sectors, which stalls instruction fetches from flash for tens of milliseconds.
+ */
+bool pageMapRewrite(const uint8_t *occupancy)
+{
+    uint8_t target = (uint8_t)(1 - activeBank);
+    const uint16_t *table = bankTable(target);
+
+    if (!isReady)
+    {
+        return false;
+    }
+    eraseBank(target);
+    for (uint16_t page = 0; page < PAGE_MAP_MAX_PAGES; page += 2)
+    {
+        FlashBuffer buffer;
+        uint16_t *users = buffer.users;
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            uint16_t current = (uint16_t)(page + i);
+            users[i] = recordedUser(current);
+            if (occupancy != NULL && !(occupancy[current / 8] & (1 << (current % 8))))
+            {
+                users[i] = PAGE_MAP_FREE;
+            }
+            else if (occupancy != NULL && users[i] == PAGE_MAP_IDENTITY)
+            {
+                users[i] = current;
+            }
+            else if (occupancy != NULL && users[i] == PAGE_MAP_FREE)
+            {
+                users[i] = PAGE_MAP_UNOWNED;
+            }
+        }
+        if (users[0] != PAGE_MAP_IDENTITY || users[1] != PAGE_MAP_IDENTITY)
+        {
+            programFlash((const uint8_t *)&table[page], buffer.users, sizeof(buffer.users));
+        }
+    }
+    if (isMovePending)
+    {
+        FlashBuffer buffer = { .record = { pending.to, pending.user, pending.from, pending.kind, 0 } };
+        buffer.record.check = recordCheck(&buffer.record);
+        programFlash((const uint8_t *)bankLog(target), &buffer.record, sizeof(buffer.record));
+    }
+    openBank(target, stats.generation + 1);
+    logCount = isMovePending ? 1 : 0;
+    stats.logRecords = logCount;
+    stats.rewrites++;
+    return true;
+}
+
+/**
+ * @brief  Pages a search has to cover: up to the highest page that is not known to be empty. After a compaction this
+ *         is the number of templates.
+ * @param  capacity                          - Pages of the module's library
+ */
+uint16_t pageMapSearchPages(uint16_t capacity)
+{
+    uint16_t page = capacity < PAGE_MAP_MAX_PAGES ? capacity : PAGE_MAP_MAX_PAGES;
+
+    if (!isReady)
+    {
+        return capacity;
+    }
+    while (page > 0 && recordedUser(page - 1) == PAGE_MAP_FREE)
+    {
+        page--;
+    }
+    return page;
+}
+
+PageMapStats getPageMapStats(void)
+{
+    return stats;
+}
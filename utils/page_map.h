@@ -0,0 +1,100 @@
+#ifndef PAGE_MAP_H
+#define PAGE_MAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Owner of every page of the template library, kept in a reserved region of the internal flash below the access event
+ * journal, see PAGE_MAP_FLASH_BASE in config.h and the FLASH length in tm4c123gh6pm.cmd. Until the library is
+ * compacted (lib/dy50_compact.h) the template of user n is on page n, which the map expresses with
+ * PAGE_MAP_IDENTITY, the value of erased flash.
+ *
+ * The region holds two banks of PAGE_MAP_BANK_SECTORS sectors. A bank starts with a PageMapHeader, followed by a table
+ * of one user per page and a log of PageMapRecords. A change programs one record at the end of the log; the owner of a
+ * page is the table entry overridden by the newest record that mentions the page. When the log is full the current
+ * state is written to the table of the other bank, whose header is programmed last and carries the next generation,
+ * so a reset at any point leaves one complete bank. pageMapInit() uses the valid bank of the highest generation.
+ *
+ * A template is moved to another page in three steps, each a record: PAGE_MAP_MOVE_BEGIN before the copy,
+ * PAGE_MAP_MOVE_COMMIT once the copy is stored, which gives the user the new page and frees the old one in a single
+ * record, and PAGE_MAP_MOVE_END once the old page is deleted. The newest of them tells a restart which steps of an
+ * interrupted move remain, see pageMapPendingMove(). Records torn by a reset fail their check byte and are ignored.
+ *
+ * The map describes the library of one module, the selected sensor when SENSOR_COUNT is 1.
+ */
+
+/* ***** Defines ***** */
+
+#define PAGE_MAP_SECTOR_SIZE                    1024 // Flash erase block of the TM4C123
+#define PAGE_MAP_BANK_SIZE                      (PAGE_MAP_BANK_SECTORS * PAGE_MAP_SECTOR_SIZE)
+#define PAGE_MAP_MAX_PAGES                      1024 // Table entries, at least the capacity of the module
+#define PAGE_MAP_RECORD_SIZE                    8
+#define PAGE_MAP_LOG_RECORDS                    ((PAGE_MAP_BANK_SIZE - 16 - PAGE_MAP_MAX_PAGES * 2) / 8)
+#define PAGE_MAP_MAGIC                          0x50414D50 // "PMAP"
+
+// Owners with a special meaning
+#define PAGE_MAP_IDENTITY                       0xFFFF // Never assigned; the page belongs to the user of its number
+#define PAGE_MAP_FREE                           0xFFFE // The page holds no template
+#define PAGE_MAP_UNOWNED                        0xFFFD // The page holds a template stored outside the map
+#define PAGE_MAP_MAX_USER                       0xFFFC
+#define PAGE_MAP_NO_PAGE                        0xFFFF // Returned by pageMapFind() and pageMapAllocate()
+
+// Record kinds
+#define PAGE_MAP_ASSIGN                         1    // page belongs to user
+#define PAGE_MAP_MOVE_BEGIN                     2    // The template of user is being copied from from to page
+#define PAGE_MAP_MOVE_COMMIT                    3    // page belongs to user, from is free
+#define PAGE_MAP_MOVE_END                       4    // from is deleted, the move is complete
+
+/* ***** Structures ***** */
+
+typedef struct
+{
+    uint32_t magic;             // PAGE_MAP_MAGIC once the bank is complete
+    uint32_t generation;        // Incremented by every rewrite of the table
+    uint32_t pageCount;         // PAGE_MAP_MAX_PAGES
+    uint32_t check;             // Complement of magic ^ generation ^ pageCount
+} PageMapHeader;
+
+// Log record layout in flash, little endian
+typedef struct
+{
+    uint16_t page;
+    uint16_t user;
+    uint16_t from;              // Source page of a move, PAGE_MAP_NO_PAGE for PAGE_MAP_ASSIGN
+    uint8_t kind;               // PAGE_MAP_ record kind
+    uint8_t check;              // Complement of the sum of the preceding bytes
+} PageMapRecord;
+
+// Move that a reset interrupted
+typedef struct
+{
+    uint8_t kind;               // PAGE_MAP_MOVE_BEGIN: the copy may be missing, PAGE_MAP_MOVE_COMMIT: from is undeleted
+    uint16_t from;
+    uint16_t to;
+    uint16_t user;
+} PageMapMove;
+
+typedef struct
+{
+    uint32_t generation;        // Of the active bank
+    uint16_t logRecords;        // Records in the log of the active bank
+    uint32_t rewrites;          // Table rewrites since boot
+} PageMapStats;
+
+/* ***** Functions ***** */
+
+void pageMapInit(void);
+uint16_t pageMapUser(uint16_t page);
+uint16_t pageMapFind(uint16_t user);
+uint16_t pageMapAllocate(uint16_t user, uint16_t capacity);
+bool pageMapAssign(uint16_t page, uint16_t user);
+bool pageMapBeginMove(uint16_t from, uint16_t to, uint16_t user);
+bool pageMapCommitMove(void);
+bool pageMapEndMove(void);
+bool pageMapPendingMove(PageMapMove *move);
+bool pageMapRewrite(const uint8_t *occupancy);
+uint16_t pageMapSearchPages(uint16_t capacity);
+PageMapStats getPageMapStats(void);
+
+#endif /* PAGE_MAP_H */
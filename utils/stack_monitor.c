@@ -0,0 +1,54 @@
+#include "stack_monitor.h"
+
+#ifdef DY50_HOST
+// Host build, the process stack is not painted
+void stackPaint(void)
+{
+}
+
+StackUsage getStackUsage(void)
+{
+    StackUsage usage = { 0, 0, false };
+
+    return usage;
+}
+#else
+extern uint32_t __stack;            // Lowest address of the .stack section, set by the linker
+extern uint32_t __STACK_TOP;        // End of the .stack section, see tm4c123gh6pm.cmd
+
+/**
+ * @brief  Fill the stack below the caller with STACK_PAINT_PATTERN. Called by ResetISR() before the C runtime is
+ *         initialized, so it uses no static data.
+ */
+void stackPaint(void)
+{
+    volatile uint32_t marker;
+    uint32_t *word = &__stack;
+    uint32_t *end = (uint32_t *)&marker - STACK_PAINT_MARGIN / sizeof(uint32_t);
+
+    while (word < end)
+    {
+        *word++ = STACK_PAINT_PATTERN;
+    }
+}
+
+/**
+ * @brief  Measure the deepest use of the stack since reset
+ * @return Size of the stack and the bytes above the lowest word that no longer holds the paint pattern
+ */
+StackUsage getStackUsage(void)
+{
+    const uint32_t *word = &__stack;
+    const uint32_t *top = &__STACK_TOP;
+    StackUsage usage;
+
+    while (word < top && *word == STACK_PAINT_PATTERN)
+    {
+        word++;
+    }
+    usage.size = (uint32_t)(top - &__stack) * sizeof(uint32_t);
+    usage.maxUsed = (uint32_t)(top - word) * sizeof(uint32_t);
+    usage.isExhausted = word == &__stack;
+    return usage;
+}
+#endif
@@ -0,0 +1,39 @@
+#ifndef STACK_MONITOR_H
+#define STACK_MONITOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * High-water mark of the system stack, the .stack section of tm4c123gh6pm.cmd (--stack_size in the CCS project).
+ *
+ * ResetISR() calls stackPaint() before the C runtime starts, which fills the unused stack with STACK_PAINT_PATTERN.
+ * Every word the program pushes overwrites the pattern, so getStackUsage() finds the deepest use since reset by
+ * scanning for the first overwritten word from the bottom. The scan only sees words that were written; a frame that
+ * skips over a buffer it never fills is missed, which host/ram_report.c covers with the worst case computed from
+ * the compiler's frame sizes. RPC_OP_METRICS reports the result.
+ *
+ * Under FreeRTOS the tasks run on their own stacks, see uxTaskGetStackHighWaterMark(); the system stack is then used
+ * by main() until the scheduler starts and by the interrupt handlers.
+ */
+
+/* ***** Defines ***** */
+
+#define STACK_PAINT_PATTERN                     0xDEADBEEF
+#define STACK_PAINT_MARGIN                      32   // Bytes below the frame of stackPaint() left unpainted
+
+/* ***** Structures ***** */
+
+typedef struct
+{
+    uint32_t size;              // Bytes of the system stack, 0 in a DY50_HOST build
+    uint32_t maxUsed;           // Deepest use since reset in bytes
+    bool isExhausted;           // The lowest word was overwritten, the stack may have overflowed into .bss
+} StackUsage;
+
+/* ***** Functions ***** */
+
+void stackPaint(void);
+StackUsage getStackUsage(void);
+
+#endif /* STACK_MONITOR_H */
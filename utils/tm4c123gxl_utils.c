@@ -1,11 +1,40 @@
 #include "tm4c123gxl_utils.h"
 #include "config.h"
+#include "dlog.h"
+#include "uart_capture.h"
 
-static uint32_t transmissionBytesCounter = 0;
-static uint8_t recvPacket[300];
-static uint16_t receivePacketLength;
-static bool isReceived;
-static Packet responsePacket; // Will be populated with received data in interrupt handler
+#define TRANSMIT_WAIT_TIMEOUT                   100  // Longest block before the uDMA channel is checked again, in ms
+
+// Receive state of one sensor UART, filled by its interrupt handler
+typedef struct
+{
+    uint32_t base;
+    uint32_t txDmaChannel;             // uDMA channel assignment of the transmit FIFO
+    PacketParser receiveParser;
+    FrameQueue receiveQueue;           // Complete frames, from the interrupt handler to the receive functions
+    bool isResponseValid;              // Checksum of the packet last taken from receiveQueue matched
+    volatile bool isHandshakeReceived;
+    volatile uint32_t handshakeTick;
+} SensorPort;
+
+static const uint32_t sensorUartBases[MAX_SENSOR_COUNT] = SENSOR_UART_BASES;
+static const uint32_t sensorUartInts[MAX_SENSOR_COUNT] = SENSOR_UART_INTS;
+static const uint32_t sensorUartTxDma[MAX_SENSOR_COUNT] = SENSOR_UART_TX_DMA;
+
+// uDMA channel control structures, primary set only. The controller requires 1024 byte alignment.
+#if defined(__TI_ARM__)
+#pragma DATA_ALIGN(dmaControlTable, 1024)
+static uint8_t dmaControlTable[512];
+#else
+static uint8_t dmaControlTable[512] __attribute__((aligned(1024)));
+#endif
+static SensorPort ports[SENSOR_COUNT];
+static SensorPort *port = &ports[0]; // Port used by sendPacket() and the receive functions
+static volatile uint32_t tickCount; // Milliseconds since init(), driven by SysTick
+static bool (*frameWait)(uint32_t timeoutMs);   // Blocks the caller until frameSignal() or the timeout
+static void (*frameSignal)(void);               // Called from the interrupt handler when a frame is complete
+static bool (*transmitWait)(uint32_t timeoutMs);    // Blocks the caller until transmitSignal() or the timeout
+static void (*transmitSignal)(void);                // Called from the interrupt handler when a uDMA transfer is done
 
 // Initialize system clock
 static void initSystemClock()
@@ -14,6 +43,17 @@ static void initSystemClock()
                    SYSCTL_OSC_MAIN | SYSCTL_XTAL_16MHZ);
 }
 
+// Configure SysTick to interrupt every millisecond. Under FreeRTOS the kernel owns SysTick.
+static void initSysTick()
+{
+#ifndef DY50_USE_FREERTOS
+    tickCount = 0;
+    MAP_SysTickPeriodSet(SysCtlClockGet() / 1000);
+    MAP_SysTickIntEnable();
+    MAP_SysTickEnable();
+#endif
+}
+
 static void configureUARTPrint(void)
 {
     // Enable the GPIO Peripheral used by the UART.
@@ -34,50 +74,89 @@ static void configureUARTPrint(void)
     UARTStdioConfig(UART_PRINT_INTERFACE, UART_PRINT_BAUD, 16000000);
 }
 
-static void getStructuredPacket()
-{
-    uint8_t* bytePointer = recvPacket;
-    // Create a packet of raw bytes
-    responsePacket.start_code = *(bytePointer++) << 8 | *(bytePointer++);
-    responsePacket.address[0] = *(bytePointer++);
-    responsePacket.address[1] = *(bytePointer++);
-    responsePacket.address[2] = *(bytePointer++);
-    responsePacket.address[3] = *(bytePointer++);
-    responsePacket.type = *(bytePointer++);
-    responsePacket.length = *(bytePointer++) << 8 | *(bytePointer++);
-    for(int i = 0; i< responsePacket.length - 2; i++)
-    {
-        responsePacket.data[i] = *(bytePointer++);
-    }
-    responsePacket.checksum = *(bytePointer++) << 8 | *(bytePointer++);
-}
-
-void UARTInterruptHandler()
+static void serviceSensorPort(SensorPort *sensor)
 {
+    uint8_t chunk[16];          // Bytes read in this call, for captureWrite(); the FIFO depth
+    uint8_t chunkLength = 0;
     // Get the interrupt status
-    uint32_t ui32Status = MAP_UARTIntStatus(UART_SENSOR_INTERFACE, true);
+    uint32_t ui32Status = MAP_UARTIntStatus(sensor->base, true);
+    uint32_t dmaDone = MAP_uDMAIntStatus() & (1 << (sensor->txDmaChannel & 0x1F));
 
     // Clear the asserted interrupts
-    MAP_UARTIntClear(UART_SENSOR_INTERFACE, ui32Status);
+    MAP_UARTIntClear(sensor->base, ui32Status);
+    // Completion of a transmit transfer is also signalled on the UART vector
+    MAP_uDMAIntClear(1 << (sensor->txDmaChannel & 0x1F));
+    if (dmaDone != 0 && transmitSignal != NULL)
+    {
+        transmitSignal();
+    }
     // Handle received interrupt
 
-    // Read raw bytes into an array
-    while (MAP_UARTCharsAvail(UART_SENSOR_INTERFACE))
+    // Feed raw bytes to the parser, the checksum is accumulated as they arrive
+    while (MAP_UARTCharsAvail(sensor->base))
     {
        // Read a character from the UART
-       recvPacket[transmissionBytesCounter++] = UARTCharGetNonBlocking(UART_SENSOR_INTERFACE);
-    }
-    if (transmissionBytesCounter >= 9)        //length of the packet has been received
-    {
-        receivePacketLength = (uint16_t)recvPacket[7] << 8 |
-                              (uint16_t)recvPacket[8] + PACKAGE_SIZE_WITHOUT_DATA - 2;
-    }
-    if (transmissionBytesCounter == receivePacketLength)
-    {
-        getStructuredPacket();
-        transmissionBytesCounter = 0;
-        isReceived = true;
+       uint8_t byte = UARTCharGetNonBlocking(sensor->base);
+
+       chunk[chunkLength++] = byte;
+       if (chunkLength == sizeof(chunk))
+       {
+           captureWrite((uint8_t)(sensor - ports), false, chunk, chunkLength);
+           chunkLength = 0;
+       }
+
+       ParserResult result = parsePacketByte(&sensor->receiveParser, byte);
+       switch (result)
+       {
+           case PARSER_OUTSIDE_PACKET:
+               // Outside of a packet the only byte the module sends on its own is the power-up handshake
+               if (byte == SENSOR_HANDSHAKE_BYTE && !sensor->isHandshakeReceived)
+               {
+                   sensor->handshakeTick = getTickCount();
+                   sensor->isHandshakeReceived = true;
+               }
+               break;
+           case PARSER_PACKET_OK:
+           case PARSER_PACKET_BADSUM:
+               // A frame behind an unread one is queued, not overwritten; a full queue counts it as dropped
+               frameQueuePush(&sensor->receiveQueue, &sensor->receiveParser.frame, result == PARSER_PACKET_OK);
+               if (frameSignal != NULL)
+               {
+                   frameSignal();
+               }
+               break;
+           default:
+               break;
+       }
     }
+    captureWrite((uint8_t)(sensor - ports), false, chunk, chunkLength);
+}
+
+void UARTInterruptHandler()
+{
+    serviceSensorPort(&ports[0]);
+}
+
+// Handlers of the extra sensor UARTs, unused vectors while SENSOR_COUNT is smaller
+void SensorPort1IntHandler()
+{
+#if SENSOR_COUNT > 1
+    serviceSensorPort(&ports[1]);
+#endif
+}
+
+void SensorPort2IntHandler()
+{
+#if SENSOR_COUNT > 2
+    serviceSensorPort(&ports[2]);
+#endif
+}
+
+void SensorPort3IntHandler()
+{
+#if SENSOR_COUNT > 3
+    serviceSensorPort(&ports[3]);
+#endif
 }
 
 // Function to initialize UART communication for a given UART number and baud rate
@@ -161,39 +240,246 @@ void UART_Send(uint32_t uartBase, uint8_t data)
     UARTCharPut(uartBase, data);
 }
 
+/**
+ * @brief Configure the clock, the tick timer and the UARTs. The sensor UARTs are brought up first so that the
+ *        modules' power-up handshakes are caught by the interrupt handlers while the rest of the board is initialized.
+ */
 void init()
 {
-    isReceived = false;
     initSystemClock();
+    initSysTick();
+    MAP_SysCtlPeripheralEnable(SYSCTL_PERIPH_UDMA);
+    MAP_uDMAEnable();
+    MAP_uDMAControlBaseSet(dmaControlTable);
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        uint32_t channel = sensorUartTxDma[i] & 0x1F;
+
+        ports[i].base = sensorUartBases[i];
+        ports[i].txDmaChannel = sensorUartTxDma[i];
+        frameQueueReset(&ports[i].receiveQueue);
+        ports[i].isHandshakeReceived = false;
+        resetPacketParser(&ports[i].receiveParser);
+        UART_Init(ports[i].base, UART_SENSOR_BAUD);
+
+        // Frames are moved into the transmit FIFO by the uDMA controller, see sendFrame()
+        MAP_uDMAChannelAssign(sensorUartTxDma[i]);
+        MAP_uDMAChannelAttributeDisable(channel, UDMA_ATTR_ALL);
+        MAP_uDMAChannelControlSet(channel | UDMA_PRI_SELECT, UDMA_SIZE_8 | UDMA_SRC_INC_8 | UDMA_DST_INC_NONE |
+                                  UDMA_ARB_4);
+        MAP_UARTDMAEnable(ports[i].base, UART_DMA_TX);
+
+        //Enable UART interrupt
+        MAP_IntEnable(sensorUartInts[i]);
+        MAP_UARTIntEnable(ports[i].base, UART_INT_RX | UART_INT_RT);
+    }
+    port = &ports[0];
+
+    // Runs while the sensor is still powering up
     configureUARTPrint();
-    UART_Init(UART_SENSOR_INTERFACE, UART_SENSOR_BAUD);
+}
 
-    //Enable UART interrupt
-    MAP_IntEnable(INT_UART_ASSIGNMENT);
-    MAP_UARTIntEnable(UART_SENSOR_INTERFACE, UART_INT_RX | UART_INT_RT);
+void SysTickIntHandler()
+{
+    tickCount++;
 }
 
+/**
+ * @brief  Milliseconds elapsed since init()
+ */
+uint32_t getTickCount(void)
+{
+#ifdef DY50_USE_FREERTOS
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+#else
+    return tickCount;
+#endif
+}
+
+/**
+ * @brief  Microseconds since init(), the tick count refined with the SysTick counter. Wraps after about 71 minutes.
+ *         Also correct in interrupt handlers that delay the SysTick handler.
+ */
+uint32_t getMicroseconds(void)
+{
+#ifdef DY50_USE_FREERTOS
+    uint32_t tickUs = portTICK_PERIOD_MS * 1000;
+#else
+    uint32_t tickUs = 1000;
+#endif
+    uint32_t period = MAP_SysTickPeriodGet();
+    uint32_t ms;
+    uint32_t counter;
+    bool isTickPending;
+
+    // Repeated if the tick was counted or the counter wrapped while reading, the counter counts down
+    do
+    {
+        ms = getTickCount();
+        counter = MAP_SysTickValueGet();
+        isTickPending = (HWREG(NVIC_INT_CTRL) & NVIC_INT_CTRL_PEND_STSET) != 0;
+    }
+    while (ms != getTickCount() || MAP_SysTickValueGet() > counter);
+    if (isTickPending)
+    {
+        ms += tickUs / 1000; // The counter wrapped before it was read, but the tick has not been counted yet
+    }
+    return ms * 1000 + (period - 1 - counter) / (period / tickUs);
+}
+
+/**
+ * @brief  Replace busy waiting for response packets, e.g. with an RTOS semaphore
+ * @param  wait                              - Blocks until signal() is called or the timeout in milliseconds expires,
+ *                                             returns false on timeout. NULL restores busy waiting.
+ * @param  signal                            - Called from the interrupt handler whenever a packet is complete
+ */
+void setFrameWaitHooks(bool (*wait)(uint32_t timeoutMs), void (*signal)(void))
+{
+    frameWait = wait;
+    frameSignal = signal;
+}
+
+/**
+ * @brief  Replace busy waiting for the end of a uDMA transmit transfer, e.g. with an RTOS semaphore
+ * @param  wait                              - Blocks until signal() is called or the timeout in milliseconds expires,
+ *                                             returns false on timeout. NULL restores busy waiting.
+ * @param  signal                            - Called from the interrupt handler when a transmit transfer is done
+ */
+void setTransmitWaitHooks(bool (*wait)(uint32_t timeoutMs), void (*signal)(void))
+{
+    transmitWait = wait;
+    transmitSignal = signal;
+}
+
+/**
+ * @brief  Check whether the module has sent its power-up handshake byte
+ * @param  readyTick                         - If not NULL and the handshake was received, set to the tick at which
+ *                                             it arrived
+ * @return true if the handshake byte was received since init()
+ */
+bool isSensorHandshakeReceived(uint32_t *readyTick)
+{
+    if (port->isHandshakeReceived && readyTick != NULL)
+    {
+        *readyTick = port->handshakeTick;
+    }
+    return port->isHandshakeReceived;
+}
+
+/**
+ * @brief  Direct sendPacket() and the receive functions to another sensor UART. With several tasks the driver lock
+ *         must be held while another port is selected.
+ * @param  index                             - Port number, 0 to SENSOR_COUNT - 1
+ */
+void selectSensorPort(uint8_t index)
+{
+    if (index < SENSOR_COUNT)
+    {
+        port = &ports[index];
+    }
+}
+
+uint8_t getSelectedSensorPort(void)
+{
+    return (uint8_t)(port - ports);
+}
+
+/**
+ * @brief  Start the transmission of a frame on a port. The frame is read by the uDMA controller and must stay
+ *         unchanged until waitForTransmit() returns.
+ */
+static void startTransmit(SensorPort *sensor, const WireFrame *frame, uint16_t size)
+{
+    uint32_t channel = sensor->txDmaChannel & 0x1F;
+
+    captureWrite((uint8_t)(sensor - ports), true, (const uint8_t *)frame, size);
+    MAP_uDMAChannelTransferSet(channel | UDMA_PRI_SELECT, UDMA_MODE_BASIC, (void *)frame,
+                               (void *)(sensor->base + UART_O_DR), size);
+    MAP_uDMAChannelEnable(channel);
+}
+
+/**
+ * @brief  Wait until the uDMA controller has moved the whole frame into the transmit FIFO. With transmit wait hooks
+ *         the caller blocks until the interrupt handler reports the end of a transfer.
+ */
+static void waitForTransmit(SensorPort *sensor)
+{
+    while (MAP_uDMAChannelIsEnabled(sensor->txDmaChannel & 0x1F))
+    {
+        if (transmitWait != NULL)
+        {
+            transmitWait(TRANSMIT_WAIT_TIMEOUT); // A signal of another port only causes another pass
+        }
+        else
+        {
+            dlogDrain();
+        }
+    }
+}
+
+/**
+ * @brief  Send a complete frame on the selected port with a single uDMA transfer
+ * @param  frame                             - Frame built with buildWireFrame()
+ * @param  size                              - Frame size in bytes, as returned by buildWireFrame()
+ */
+void sendFrame(const WireFrame *frame, uint16_t size)
+{
+    startTransmit(port, frame, size);
+    waitForTransmit(port);
+}
+
+/**
+ * @brief  Send the same frame on several sensor UARTs at once. Every port gets its own uDMA transfer from the same
+ *         buffer, so sending to all of them takes as long as sending the frame once.
+ * @param  portMask                          - Bit n selects port n
+ * @param  frame                             - Frame built with buildWireFrame()
+ * @param  size                              - Frame size in bytes
+ */
+void broadcastFrame(uint8_t portMask, const WireFrame *frame, uint16_t size)
+{
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        if (portMask & (1 << i))
+        {
+            startTransmit(&ports[i], frame, size);
+        }
+    }
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        if (portMask & (1 << i))
+        {
+            waitForTransmit(&ports[i]);
+        }
+    }
+}
+
+/**
+ * @brief  Send a packet on the selected port. The packet is converted to its wire layout first; new code builds a
+ *         WireFrame directly and calls sendFrame().
+ */
 void sendPacket(Packet *packet)
 {
-    unsigned char *address = (unsigned char*)&(packet->address);
-    unsigned char *data = packet->data;
+    WireFrame frame;
+    uint32_t address = (uint32_t)packet->address[0] << 24 | (uint32_t)packet->address[1] << 16 |
+                       (uint32_t)packet->address[2] << 8 | packet->address[3];
+    uint16_t size = buildWireFrame(&frame, address, packet->type, packet->data, packet->length - 2);
+
+    sendFrame(&frame, size);
+}
+
+/**
+ * @brief  Oldest queued frame of the selected port, if any; it stays queued until releaseResponseFrame()
+ */
+static const WireFrame *peekResponseFrame(void)
+{
+    bool isValid;
+    const WireFrame *frame = frameQueuePeek(&port->receiveQueue, &isValid);
 
-    MAP_UARTCharPutNonBlocking(UART_SENSOR_INTERFACE, packet->start_code >> 8);
-    MAP_UARTCharPutNonBlocking(UART_SENSOR_INTERFACE, (packet->start_code << 8) >> 8);
-    MAP_UARTCharPutNonBlocking(UART_SENSOR_INTERFACE, *address++);
-    MAP_UARTCharPutNonBlocking(UART_SENSOR_INTERFACE, *address++);
-    MAP_UARTCharPutNonBlocking(UART_SENSOR_INTERFACE, *address++);
-    MAP_UARTCharPutNonBlocking(UART_SENSOR_INTERFACE, *address++);
-    MAP_UARTCharPutNonBlocking(UART_SENSOR_INTERFACE, packet->type);
-    MAP_UARTCharPutNonBlocking(UART_SENSOR_INTERFACE, packet->length >> 8);
-    MAP_UARTCharPutNonBlocking(UART_SENSOR_INTERFACE, (packet->length << 8) >> 8);
-    int i;
-    for (i = 0; i < packet->length - 0x2; i++)
+    if (frame != NULL)
     {
-        MAP_UARTCharPutNonBlocking(UART_SENSOR_INTERFACE, *data++);
+        port->isResponseValid = isValid;
     }
-    MAP_UARTCharPutNonBlocking(UART_SENSOR_INTERFACE, (packet->checksum >> 8));
-    MAP_UARTCharPutNonBlocking(UART_SENSOR_INTERFACE, (packet->checksum << 8) >> 8);
+    return frame;
 }
 
 /**
@@ -201,11 +487,117 @@ void sendPacket(Packet *packet)
  */
 Packet awaitReponsePacket()
 {
-    while (!isReceived)
+    Packet response;
+    const WireFrame *frame;
+
+    while ((frame = peekResponseFrame()) == NULL)
+    {
+        dlogDrain();
+    }
+    wireFrameToPacket(frame, &response);
+    releaseResponseFrame();
+    return response;
+}
+
+/**
+ * @brief  Drop any partially received packet, a pending response and all bytes waiting in the receive FIFO
+ */
+void flushReceiver(void)
+{
+    MAP_UARTIntDisable(port->base, UART_INT_RX | UART_INT_RT);
+    while (MAP_UARTCharsAvail(port->base))
+    {
+        UARTCharGetNonBlocking(port->base);
+    }
+    resetPacketParser(&port->receiveParser);
+    frameQueueDiscard(&port->receiveQueue);
+    MAP_UARTIntEnable(port->base, UART_INT_RX | UART_INT_RT);
+}
+
+/**
+ * @brief  Check the checksum of the packet last returned by awaitReponsePacket(), awaitReponsePacketTimeout() or
+ *         awaitResponseFrame()
+ * @return true if the checksum computed while receiving matches the one sent by the module
+ */
+bool isResponseChecksumValid(void)
+{
+    return port->isResponseValid;
+}
+
+/**
+ * @brief  Receive queue statistics summed over all sensor ports
+ * @return Frames queued, frames dropped because a queue was full, and the deepest any queue has been
+ */
+FrameQueueStats getReceiveQueueStats(void)
+{
+    FrameQueueStats total = { 0, 0, 0 };
+
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        total.frames += ports[i].receiveQueue.stats.frames;
+        total.dropped += ports[i].receiveQueue.stats.dropped;
+        if (ports[i].receiveQueue.stats.maxDepth > total.maxDepth)
+        {
+            total.maxDepth = ports[i].receiveQueue.stats.maxDepth;
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief  Wait for a response frame and read it where the interrupt handler queued it, without a copy
+ * @param  timeoutMs                         - Maximum time to wait in milliseconds
+ * @return The frame, valid until releaseResponseFrame(); NULL if the timeout was reached
+ */
+const WireFrame *awaitResponseFrame(uint32_t timeoutMs)
+{
+    uint32_t start = getTickCount();
+    const WireFrame *frame;
+
+    while ((frame = peekResponseFrame()) == NULL)
+    {
+        uint32_t elapsed = getTickCount() - start;
+        if (elapsed >= timeoutMs)
+        {
+            return NULL;
+        }
+        if (frameWait != NULL)
+        {
+            frameWait(timeoutMs - elapsed); // A stale signal only causes another pass through the loop
+        }
+        else
+        {
+            dlogDrain(); // The sensor round trip is idle time for the console
+        }
+    }
+    return frame;
+}
+
+/**
+ * @brief  Hand the space of the frame returned by awaitResponseFrame() back to the interrupt handler
+ */
+void releaseResponseFrame(void)
+{
+    frameQueueRelease(&port->receiveQueue);
+}
+
+/**
+ * @brief  Wait for a response packet, giving up after the specified time
+ * @param  response                          - Populated with the received packet on success
+ * @param  timeoutMs                         - Maximum time to wait in milliseconds
+ * @return true if a packet was received, false if the timeout was reached
+ */
+bool awaitReponsePacketTimeout(Packet *response, uint32_t timeoutMs)
+{
+    const WireFrame *frame = awaitResponseFrame(timeoutMs);
+
+    if (frame == NULL)
     {
+        return false;
     }
-    isReceived = false;
-    return responsePacket;
+    wireFrameToPacket(frame, response);
+    releaseResponseFrame();
+    return true;
 }
 
 
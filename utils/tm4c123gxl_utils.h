@@ -1,7 +1,10 @@
 #pragma once
 
 #include "lib/types.h"
+#include "lib/packet_parser.h"
+#include "lib/frame_queue.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include "inc/tm4c123gh6pm.h"
 #include "inc/hw_memmap.h"
 #include "driverlib/uart.h"
@@ -10,7 +13,16 @@
 #include "driverlib/pin_map.h"
 #include "driverlib/rom_map.h"
 #include "driverlib/interrupt.h"
+#include "driverlib/systick.h"
+#include "driverlib/udma.h"
+#include "inc/hw_uart.h"
+#include "inc/hw_nvic.h"
+#include "inc/hw_types.h"
 #include "utils/uartstdio.h"
+#ifdef DY50_USE_FREERTOS
+#include "FreeRTOS.h"
+#include "task.h"
+#endif
 
 /* ***** Defines ***** */
 
@@ -22,5 +34,24 @@ void init();
 void UART_Init(uint32_t uartBase, uint32_t baudRate);
 void UART_Send(uint32_t uartBase, uint8_t data);
 void UARTInterruptHandler();
+void SensorPort1IntHandler();
+void SensorPort2IntHandler();
+void SensorPort3IntHandler();
+void SysTickIntHandler();
+uint32_t getTickCount(void);
+uint32_t getMicroseconds(void);
+void setFrameWaitHooks(bool (*wait)(uint32_t timeoutMs), void (*signal)(void));
+void setTransmitWaitHooks(bool (*wait)(uint32_t timeoutMs), void (*signal)(void));
+bool isSensorHandshakeReceived(uint32_t *readyTick);
+void selectSensorPort(uint8_t index);
+uint8_t getSelectedSensorPort(void);
+void sendFrame(const WireFrame *frame, uint16_t size);
+void broadcastFrame(uint8_t portMask, const WireFrame *frame, uint16_t size);
 void sendPacket(Packet *packet);
 Packet awaitReponsePacket();
+bool awaitReponsePacketTimeout(Packet *response, uint32_t timeoutMs);
+const WireFrame *awaitResponseFrame(uint32_t timeoutMs);
+void releaseResponseFrame(void);
+void flushReceiver(void);
+bool isResponseChecksumValid(void);
+FrameQueueStats getReceiveQueueStats(void);
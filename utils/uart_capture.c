@@ -0,0 +1,147 @@
+#include "uart_capture.h"
+#include "tm4c123gxl_utils.h"
+
+#define RING_MASK                               (CAPTURE_RING_SIZE - 1)
+
+static uint8_t ring[CAPTURE_RING_SIZE];
+static uint16_t ringHead;           // Next byte to be written
+static uint16_t ringTail;           // First byte of the oldest record
+static volatile bool isRunning;
+static CaptureStats stats;
+
+// The receive interrupt handlers write to the ring, so it is only changed with interrupts masked
+static bool lockRing(void)
+{
+    return MAP_IntMasterDisable();
+}
+
+static void unlockRing(bool wasMasked)
+{
+    if (!wasMasked)
+    {
+        MAP_IntMasterEnable();
+    }
+}
+
+static inline void putByte(uint8_t byte)
+{
+    ring[ringHead] = byte;
+    ringHead = (ringHead + 1) & RING_MASK;
+}
+
+static inline uint16_t recordSizeAt(uint16_t position)
+{
+    return CAPTURE_RECORD_HEADER_SIZE + ring[(position + 5) & RING_MASK];
+}
+
+/**
+ * @brief  Clear the ring and record the traffic from now on
+ */
+void captureStart(void)
+{
+    bool wasMasked = lockRing();
+
+    ringHead = 0;
+    ringTail = 0;
+    stats.records = 0;
+    stats.dropped = 0;
+    isRunning = true;
+    unlockRing(wasMasked);
+}
+
+/**
+ * @brief  Stop recording. The recorded traffic stays in the ring until it is read or captureStart() is called.
+ */
+void captureStop(void)
+{
+    isRunning = false;
+}
+
+/**
+ * @brief  Record bytes sent to or received from a sensor. Called by the transport, also from interrupt handlers.
+ *         Does nothing unless captureStart() was called.
+ * @param  portIndex                         - Sensor port the bytes were sent or received on
+ * @param  isToSensor                        - true for bytes sent by the board
+ * @param  data                              - Bytes in the order they were sent or received
+ * @param  length                            - Number of bytes, longer runs are split into several records
+ */
+void captureWrite(uint8_t portIndex, bool isToSensor, const uint8_t *data, uint16_t length)
+{
+    uint8_t flags = (uint8_t)((portIndex & CAPTURE_PORT_MASK) | (isToSensor ? CAPTURE_FLAG_TO_SENSOR : 0));
+    uint32_t time;
+    bool wasMasked;
+
+    if (!isRunning || length == 0)
+    {
+        return;
+    }
+    time = getMicroseconds();
+    wasMasked = lockRing();
+    while (length > 0)
+    {
+        uint8_t chunk = (uint8_t)(length < CAPTURE_MAX_CHUNK ? length : CAPTURE_MAX_CHUNK);
+        uint8_t gapFlag = 0;
+
+        // Make room by dropping the oldest records and mark the oldest one left, or this one if none is left
+        while (((ringTail - ringHead - 1) & RING_MASK) < CAPTURE_RECORD_HEADER_SIZE + chunk)
+        {
+            ringTail = (ringTail + recordSizeAt(ringTail)) & RING_MASK;
+            stats.dropped++;
+            if (ringTail != ringHead)
+            {
+                ring[(ringTail + 4) & RING_MASK] |= CAPTURE_FLAG_AFTER_GAP;
+            }
+            else
+            {
+                gapFlag = CAPTURE_FLAG_AFTER_GAP;
+            }
+        }
+        putByte((uint8_t)time);
+        putByte((uint8_t)(time >> 8));
+        putByte((uint8_t)(time >> 16));
+        putByte((uint8_t)(time >> 24));
+        putByte(flags | gapFlag);
+        putByte(chunk);
+        for (uint8_t i = 0; i < chunk; i++)
+        {
+            putByte(*data++);
+        }
+        length -= chunk;
+        stats.records++;
+    }
+    unlockRing(wasMasked);
+}
+
+/**
+ * @brief  Remove the oldest records from the ring
+ * @param  data                              - Receives whole records in the layout described in uart_capture.h
+ * @param  capacity                          - Size of data, at least CAPTURE_RECORD_HEADER_SIZE + CAPTURE_MAX_CHUNK
+ *                                             bytes to make progress with any record
+ * @return Number of bytes stored in data, 0 once the ring is empty
+ */
+uint16_t captureRead(uint8_t *data, uint16_t capacity)
+{
+    uint16_t length = 0;
+    bool wasMasked = lockRing();
+
+    while (ringTail != ringHead && length + recordSizeAt(ringTail) <= capacity)
+    {
+        uint16_t size = recordSizeAt(ringTail);
+
+        for (uint16_t i = 0; i < size; i++)
+        {
+            data[length++] = ring[ringTail];
+            ringTail = (ringTail + 1) & RING_MASK;
+        }
+    }
+    unlockRing(wasMasked);
+    return length;
+}
+
+CaptureStats getCaptureStats(void)
+{
+    CaptureStats current = stats;
+
+    current.isRunning = isRunning;
+    return current;
+}
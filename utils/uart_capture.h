@@ -0,0 +1,59 @@
+#ifndef UART_CAPTURE_H
+#define UART_CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Flight recorder of the sensor UART traffic. While capturing, the transport stores every frame sent to a sensor and
+ * every chunk of bytes read by the receive interrupt handler, each with a microsecond timestamp, in a RAM ring. When
+ * the ring is full the oldest records are dropped, so it always holds the most recent traffic. RPC_OP_CAPTURE reads
+ * the ring; host/uart_capture_tool.c saves it to a file that host/uart_replay.c plays back through the host build of
+ * the driver.
+ *
+ * Record layout, multi-byte fields little endian:
+ *   time in us (4) | flags (1) | length (1) | bytes
+ * Frames longer than CAPTURE_MAX_CHUNK are stored as several records with the same time. Received bytes are stamped
+ * when the interrupt handler read them, i.e. after the last byte of the chunk arrived. The oldest record left after
+ * a drop carries CAPTURE_FLAG_AFTER_GAP.
+ *
+ * File layout of a saved capture, see host/uart_capture_tool.c:
+ *   CAPTURE_FILE_MAGIC (8) | sensor baud rate (4) | records dropped since captureStart() (4) | records
+ */
+
+/* ***** Defines ***** */
+
+#ifndef CAPTURE_RING_SIZE
+#define CAPTURE_RING_SIZE                       4096 // Bytes, must be a power of two
+#endif
+#define CAPTURE_RECORD_HEADER_SIZE              6
+#define CAPTURE_MAX_CHUNK                       255  // Bytes of one record
+#define CAPTURE_FLAG_TO_SENSOR                  0x80 // Sent by the board; received from the sensor otherwise
+#define CAPTURE_FLAG_AFTER_GAP                  0x40 // Records before this one were dropped
+#define CAPTURE_PORT_MASK                       0x03 // Sensor port number, see selectSensorPort()
+#define CAPTURE_FILE_MAGIC                      "DY50CAP\x01"
+#define CAPTURE_FILE_HEADER_SIZE                16
+
+// RPC_OP_CAPTURE commands
+#define CAPTURE_COMMAND_START                   0    // Clear the ring and start recording
+#define CAPTURE_COMMAND_STOP                    1    // Stop recording, the ring keeps its contents
+#define CAPTURE_COMMAND_READ                    2    // Remove and return the recorded records, oldest first
+
+/* ***** Structures ***** */
+
+typedef struct
+{
+    uint32_t records;           // Records stored since captureStart()
+    uint32_t dropped;           // Oldest records overwritten because the ring was full
+    bool isRunning;
+} CaptureStats;
+
+/* ***** Functions ***** */
+
+void captureStart(void);
+void captureStop(void);
+void captureWrite(uint8_t portIndex, bool isToSensor, const uint8_t *data, uint16_t length);
+uint16_t captureRead(uint8_t *data, uint16_t capacity);
+CaptureStats getCaptureStats(void);
+
+#endif /* UART_CAPTURE_H */